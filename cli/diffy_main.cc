@@ -14,15 +14,26 @@
 #include "output/hex_column.hpp"
 #include "output/hex_common.hpp"
 #include "output/hex_unified.hpp"
+#include "output/output_sink.hpp"
+#include "output/pager.hpp"
+#include "output/structured.hpp"
 #include "output/unified.hpp"
 #include "processing/diff_hunk.hpp"
 #include "processing/diff_hunk_annotate.hpp"
 #include "processing/tokenizer.hpp"
+#include "render/diff_pipeline.hpp"
+#include "render/diff_record.hpp"
+#include "render/dir_diff.hpp"
 #include "util/binary_detect.hpp"
 #include "util/color.hpp"
+#include "util/deadline.hpp"
+#include "util/disk_cache.hpp"
 #include "util/hash.hpp"
 #include "util/mapped_file.hpp"
+#include "util/parallel.hpp"
+#include "util/trace.hpp"
 #include "util/readlines.hpp"
+#include "pager.hpp"
 #include "tty.hpp"
 
 #include <musl/getopt.h>
@@ -30,6 +41,8 @@
 
 #include <fmt/format.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -37,6 +50,8 @@
 #include <fstream>
 #include <gsl/span>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -61,6 +76,18 @@ stdout_is_tty() {
     return isatty(fileno(stdout)) != 0;
 #endif
 }
+
+// Descriptor-level sink for the rendered diff. Anything already queued in
+// stdio goes out first so the two streams don't interleave.
+std::unique_ptr<diffy::FdSink>
+stdout_sink() {
+    fflush(stdout);
+#if defined(DIFFY_PLATFORM_WINDOWS)
+    return std::make_unique<diffy::FdSink>(_fileno(stdout));
+#else
+    return std::make_unique<diffy::FdSink>(fileno(stdout));
+#endif
+}
 }  // namespace
 
 namespace diffy {
@@ -129,16 +156,27 @@ bool
 compute_diff(diffy::Algo algorithm,
              bool ignore_whitespace,
              diffy::DiffInput<diffy::Line> diff_input,
-             diffy::DiffResult* result) {
+             diffy::DiffResult* result,
+             const diffy::Deadline* deadline) {
+    DIFFY_TRACE_SCOPE("diff");
     switch (algorithm) {
         case diffy::Algo::kMyersGreedy: {
-            *result = diffy::MyersGreedy<diffy::Line>(diff_input).compute();
+            diffy::MyersGreedy<diffy::Line> algo(diff_input);
+            algo.deadline = deadline;
+            algo.trace_counters = true;
+            *result = algo.compute();
         } break;
         case diffy::Algo::kMyersLinear: {
-            *result = diffy::MyersLinear<diffy::Line>(diff_input).compute();
+            diffy::MyersLinear<diffy::Line> algo(diff_input);
+            algo.deadline = deadline;
+            algo.trace_counters = true;
+            *result = algo.compute();
         } break;
         case diffy::Algo::kPatience: {
-            *result = diffy::Patience<diffy::Line>(diff_input).compute();
+            diffy::Patience<diffy::Line> algo(diff_input);
+            algo.deadline = deadline;
+            algo.trace_counters = true;
+            *result = algo.compute();
         } break;
         case diffy::Algo::kInvalid:
             /* fall-through */
@@ -147,6 +185,9 @@ compute_diff(diffy::Algo algorithm,
             return false;
         } break;
     }
+    DIFFY_TRACE_COUNT(DiffEditDistance,
+                      std::count_if(result->edit_sequence.begin(), result->edit_sequence.end(),
+                                    [](const diffy::Edit& e) { return e.type != diffy::EditType::Common; }));
 
     // Ignore change if both sides are various forms of empty
     if (ignore_whitespace) {
@@ -155,8 +196,7 @@ compute_diff(diffy::Algo algorithm,
                 (int) seq.b_index >= (int) diff_input.B.size()) {
                 continue;
             }
-            if (diffy::is_empty(diff_input.A[seq.a_index].line) &&
-                diffy::is_empty(diff_input.B[seq.b_index].line)) {
+            if (diff_input.A[seq.a_index].info().blank && diff_input.B[seq.b_index].info().blank) {
                 seq.type = diffy::EditType::Common;
             }
         }
@@ -165,6 +205,165 @@ compute_diff(diffy::Algo algorithm,
     return true;
 }
 
+// -r: diff every file pair under two directories. Identical pairs are ruled out
+// without diffing, the rest are diffed on worker threads and written in path
+// order, so the output doesn't depend on scheduling. Blocks moved from one file
+// to another are listed once every file is done.
+int
+diff_directories(const diffy::ProgramOptions& opts, const diffy::ColumnViewState& cv_ui_opts) {
+    const bool color = opts.column_view || opts.color_mode == diffy::ColorMode::Always ||
+                       (opts.color_mode == diffy::ColorMode::Auto && stdout_is_tty());
+    int64_t width = opts.width;
+    if (width == 0) {
+        int term_height = 0, term_width = 0;
+        diffy::tty_get_term_size(&term_height, &term_width);
+        width = static_cast<int64_t>(term_width);
+    }
+    if (width == 0) {
+        width = 80;
+    }
+
+    diffy::DiffPipelineOptions pipeline;
+    pipeline.algorithm = opts.algorithm;
+    pipeline.context_lines = opts.context_lines;
+    pipeline.granularity = opts.line_granularity   ? diffy::EditGranularity::Line
+                           : opts.char_granularity ? diffy::EditGranularity::Char
+                                                   : diffy::EditGranularity::Token;
+    pipeline.ignore_whitespace = opts.ignore_whitespace;
+    pipeline.ignore_line_endings = opts.ignore_line_endings;
+    pipeline.move_options.ignore_whitespace = opts.moved_ignore_whitespace;
+    pipeline.move_options.max_edited_lines = static_cast<int>(opts.moved_edited_lines);
+    pipeline.syntax_highlight = color && opts.syntax_highlight;
+    pipeline.force_language = opts.force_language;
+    pipeline.lazy_annotation = true;
+
+    const std::vector<diffy::DirPair> pairs = diffy::pair_directory_files(opts.left_file, opts.right_file);
+
+    struct FileResult {
+        std::string output;
+        std::string error;
+        int status = 0;  // diff's convention: 0 identical, 1 differs, 2 trouble
+        diffy::Degradation degradations = diffy::DegradedNone;
+        std::unique_ptr<diffy::CrossFileRows> move_rows;
+    };
+
+    auto diff_pair = [&](size_t i) {
+        const diffy::DirPair& pair = pairs[i];
+        const std::string a_path = (fs::path(opts.left_file) / pair.path).string();
+        const std::string b_path = (fs::path(opts.right_file) / pair.path).string();
+        FileResult r;
+        if (pair.kind != diffy::DirPairKind::Both) {
+            const fs::path only(pair.kind == diffy::DirPairKind::OnlyA ? a_path : b_path);
+            r.output = fmt::format("Only in {}: {}\n", only.parent_path().string(), only.filename().string());
+            r.status = 1;
+            return r;
+        }
+        if (diffy::files_identical(a_path, b_path)) {
+            return r;
+        }
+
+        diffy::FileBytes a_file, b_file;
+        if (!a_file.load(a_path) || !b_file.load(b_path)) {
+            r.error = fmt::format("diffy: failed to read '{}' or '{}'\n", a_path, b_path);
+            r.status = 2;
+            return r;
+        }
+        const std::string_view a_bytes(reinterpret_cast<const char*>(a_file.data()), a_file.size());
+        const std::string_view b_bytes(reinterpret_cast<const char*>(b_file.data()), b_file.size());
+        // Sniffed like the two-file path: a NUL in the first 1 KiB of either side.
+        const bool binary = opts.binary_mode == diffy::BinaryMode::Always ||
+                            (opts.binary_mode == diffy::BinaryMode::Auto &&
+                             (diffy::looks_binary(a_bytes, 1024) || diffy::looks_binary(b_bytes, 1024)));
+        if (binary) {
+            r.output = fmt::format("Binary files {} and {} differ\n", a_path, b_path);
+            r.status = 1;
+            return r;
+        }
+
+        const std::string a_text(a_bytes);
+        const std::string b_text(b_bytes);
+        // --time-budget applies to each file on its own.
+        std::optional<diffy::Deadline> time_budget;
+        diffy::DiffPipelineOptions file_pipeline = pipeline;
+        if (opts.time_budget_ms > 0) {
+            time_budget.emplace(std::chrono::milliseconds(opts.time_budget_ms));
+            file_pipeline.deadline = &*time_budget;
+        }
+        diffy::DiffComputation c = diffy::compute_annotated_diff(a_text, b_text, a_path, b_path, file_pipeline);
+        r.degradations = c.degradations;
+        if (c.status != diffy::DiffResultStatus::OK && c.status != diffy::DiffResultStatus::NoChanges) {
+            r.error = fmt::format("diffy: diff failed for '{}'\n", pair.path);
+            r.status = 2;
+            return r;
+        }
+        if (!c.lazy_hunks || c.lazy_hunks->size() == 0) {
+            return r;  // differs only in what the options ignore
+        }
+
+        diffy::StringSink sink;
+        if (opts.column_view) {
+            // The column header shows the names and permissions from the options.
+            diffy::ProgramOptions file_opts = opts;
+            file_opts.left_file = file_opts.left_file_name = a_path;
+            file_opts.right_file = file_opts.right_file_name = b_path;
+            file_opts.left_file_permissions = diffy::read_file_permissions(a_path);
+            file_opts.right_file_permissions = diffy::read_file_permissions(b_path);
+            diffy::ColumnViewState cv = cv_ui_opts;
+            diffy::column_view_render(sink, c.input(), *c.lazy_hunks, cv, file_opts, width, &c.a_highlights,
+                                      &c.b_highlights);
+        } else {
+            const std::vector<std::string>& contexts = c.lazy_hunks->contexts();
+            const bool any_context =
+                std::any_of(contexts.begin(), contexts.end(), [](const std::string& s) { return !s.empty(); });
+            diffy::unified_diff_render(sink, c.input(), c.lazy_hunks->hunks(), any_context ? &contexts : nullptr,
+                                       color ? &cv_ui_opts.style : nullptr, color ? &c.a_highlights : nullptr,
+                                       color ? &c.b_highlights : nullptr, cv_ui_opts.settings.light_theme,
+                                       color ? width : 0);
+        }
+        r.output = sink.str();
+        r.move_rows = std::make_unique<diffy::CrossFileRows>(
+            diffy::cross_file_move_rows(c.input(), c.lazy_hunks->hunks(), c.lazy_hunks->moves()));
+        r.status = 1;
+        return r;
+    };
+
+    auto out = stdout_sink();
+    int exit_code = 0;
+    diffy::Degradation degradations = diffy::DegradedNone;
+    std::vector<std::unique_ptr<diffy::CrossFileRows>> move_rows;
+    std::vector<diffy::CrossFileDiff> changed_files;
+    diffy::parallel_for_ordered(pairs.size(), diff_pair, [&](size_t i, FileResult r) {
+        out->write(r.output);
+        if (!r.error.empty()) {
+            out->flush();
+            fputs(r.error.c_str(), stderr);
+        }
+        exit_code = std::max(exit_code, r.status);
+        degradations |= r.degradations;
+        if (r.move_rows) {
+            changed_files.push_back(r.move_rows->diff(pairs[i].path));
+            move_rows.push_back(std::move(r.move_rows));
+        }
+    });
+
+    diffy::detect_cross_file_moves(changed_files);
+    const std::vector<diffy::CrossFileMove> moves = diffy::collect_cross_file_moves(changed_files);
+    if (!moves.empty()) {
+        out->write("\nMoved between files:\n");
+        for (const auto& m : moves) {
+            out->write(fmt::format("    {}:{}-{} -> {}:{}-{}\n", m.from_path, m.from_line, m.from_line + m.lines - 1,
+                                   m.to_path, m.to_line, m.to_line + m.lines - 1));
+        }
+    }
+    out->flush();
+
+    if (degradations != diffy::DegradedNone) {
+        fmt::print(stderr, "diffy: note: time budget of {} ms exceeded; degraded: {}\n", opts.time_budget_ms,
+                   diffy::degradation_names(degradations));
+    }
+    return exit_code;
+}
+
 }  // namespace
 
 int
@@ -206,6 +405,7 @@ main(int argc, char* argv[], char * environ[]) {
 
         std::string help = fmt::format((R"(
 Usage: {0} [options] left_file right_file
+       {0} [options] -r left_dir right_dir
 
 Compare files line by line, side by side
 
@@ -218,6 +418,16 @@ Options:
                                     patience     (p)
     -u, -U, --unified [n]        show unified output, optional context line count
     -s, -S, --side-by-side [n]   show side-by-side column output, optional context line count
+    -r, --recursive              compare two directories file by file; files present on one
+                                 side only are listed, and blocks moved from one file to
+                                 another are summarised at the end
+    --format [fmt]               text (default); json: the hunks with their edit runs,
+                                 intra-line segments, moved lines and scope labels; binary:
+                                 the same as length-prefixed records. Written hunk by hunk
+    --pager                      page the side-by-side view in the terminal, laying out only
+                                 the rows on screen (j/k, space/b, n/N between hunks, g/G,
+                                 q to quit); written out as usual when stdout isn't a terminal.
+                                 Not available on Windows
 
     -o, --old-file               custom name to give the old-file (left)
     -n, --new-file               custom name to give the new-file (right)
@@ -236,8 +446,16 @@ Options:
                                  Bundled: {3}
                                  (plus any custom themes in the config directory)
     --color [when]               colour unified output: auto (default), always, or never
+    --cache, --no-cache          reuse diffs of previously seen file pairs from the
+                                 on-disk cache (general.diff_cache, off by default)
+
+    --time-budget [ms]           let the text diff take about this long; past it, use a
+                                 coarser diff, annotate whole lines and skip highlighting
+                                 rather than keep going (general.time_budget_ms)
 
     --list-colors                list all available colors available in the configuration
+    --stats                      print per-stage timings and algorithm counters to stderr
+                                 (DIFFY_TRACE=<file> writes a Chrome trace instead/as well)
 
 Binary (hex) diff:
     --binary                     force hex diff (default: auto-detect binary input)
@@ -252,6 +470,10 @@ Binary (hex) diff:
 
 Side by side options:
     -l, --line                   line based diff instead of word based diff
+    --char                       character based diff within changed lines; falls back
+                                 to words for lines that changed too much
+    --moved-tolerance [k]        also mark moved blocks that were reindented or had up
+                                 to k lines edited (default 1)
     -W, --width [width]          maximum width in each column
 )"),
                                        argv[0], diffy::config_get_directory(), lang_help, theme_help);
@@ -280,13 +502,26 @@ Side by side options:
     constexpr int kOptImageRender = 267;
     constexpr int kOptNoImageRender = 268;
     constexpr int kOptImageProtocol = 269;
+    constexpr int kOptChar = 270;
+    constexpr int kOptMovedTolerance = 271;
+    constexpr int kOptCache = 272;
+    constexpr int kOptNoCache = 273;
+    constexpr int kOptStats = 274;
+    constexpr int kOptTimeBudget = 275;
+    constexpr int kOptPager = 276;
+    constexpr int kOptFormat = 277;
 
     auto parse_args = [&](int in_argc, char* in_argv[]) {
         static struct option long_options[] = {
             {"help", no_argument, 0, 'h'},
             {"side-by-side", optional_argument, 0, 'S'},
             {"line", optional_argument, 0, 'l'},
+            {"char", no_argument, 0, kOptChar},
+            {"moved-tolerance", optional_argument, 0, kOptMovedTolerance},
             {"unified", optional_argument, 0, 'U'},
+            {"recursive", no_argument, 0, 'r'},
+            {"pager", no_argument, 0, kOptPager},
+            {"format", required_argument, 0, kOptFormat},
             {"version", no_argument, 0, 'v'},
             {"width", optional_argument, 0, 'W'},
             {"algorithm", optional_argument, 0, 'a'},
@@ -311,10 +546,14 @@ Side by side options:
             {"image-render", no_argument, 0, kOptImageRender},
             {"no-image-render", no_argument, 0, kOptNoImageRender},
             {"image-protocol", required_argument, 0, kOptImageProtocol},
+            {"cache", no_argument, 0, kOptCache},
+            {"no-cache", no_argument, 0, kOptNoCache},
+            {"stats", no_argument, 0, kOptStats},
+            {"time-budget", required_argument, 0, kOptTimeBudget},
             {"list-colors", no_argument, 0, '1'},
             {0, 0, 0, 0}};
         int c = 0, option_index = 0;
-        while ((c = getopt_long(in_argc, in_argv, "a:hlsvS:uU:W:o:n:L:iIw", long_options, &option_index)) >= 0) {
+        while ((c = getopt_long(in_argc, in_argv, "a:hlrsvS:uU:W:o:n:L:iIw", long_options, &option_index)) >= 0) {
             switch (c) {
                 case 'v':
                     fmt::print("version: {}\n", DIFFY_VERSION);
@@ -334,6 +573,26 @@ Side by side options:
                 case 'l':
                     opts.line_granularity = true;
                     break;
+                case 'r':
+                    opts.recursive = true;
+                    break;
+                case kOptPager:
+#if defined(DIFFY_PLATFORM_WINDOWS)
+                    // The pager drives a POSIX terminal (raw mode, SIGWINCH); there is
+                    // no Windows console backend.
+                    show_help("error: --pager isn't supported on Windows");
+                    return false;
+#else
+                    opts.pager = true;
+                    break;
+#endif
+                case kOptChar:
+                    opts.char_granularity = true;
+                    break;
+                case kOptMovedTolerance:
+                    opts.moved_ignore_whitespace = true;
+                    opts.moved_edited_lines = optarg ? std::max(0, atoi(optarg)) : 1;
+                    break;
                 case 'o':
                     opts.left_file_name = optarg ? optarg : "";
                     break;
@@ -369,6 +628,18 @@ Side by side options:
                 case kOptNoHighlight:
                     opts.syntax_highlight = false;
                     break;
+                case kOptCache:
+                    opts.diff_cache = true;
+                    break;
+                case kOptNoCache:
+                    opts.diff_cache = false;
+                    break;
+                case kOptStats:
+                    opts.stats = true;
+                    break;
+                case kOptTimeBudget:
+                    opts.time_budget_ms = optarg ? std::max<int64_t>(0, atoll(optarg)) : 0;
+                    break;
                 case kOptTheme:
                     if (optarg && *optarg) {
                         opts.theme = optarg;
@@ -406,6 +677,22 @@ Side by side options:
                 case kOptImageProtocol:
                     opts.image_protocol = optarg ? optarg : "";
                     break;
+                case kOptFormat: {
+                    const std::string format = optarg ? optarg : "";
+                    if (format == "text") {
+                        opts.output_format = diffy::OutputFormat::Text;
+                    } else if (format == "json") {
+                        opts.output_format = diffy::OutputFormat::Json;
+                    } else if (format == "binary") {
+                        opts.output_format = diffy::OutputFormat::Binary;
+                    } else {
+                        show_help(fmt::format("error: invalid value for --format ({}); "
+                                              "expected text, json, or binary\n",
+                                              format));
+                        return false;
+                    }
+                    break;
+                }
                 case kOptColor: {
                     const std::string when = optarg ? optarg : "";
                     if (when == "auto") {
@@ -459,6 +746,16 @@ Side by side options:
         } else if (!opts.unified && !opts.column_view) {
             opts.column_view = true;
         }
+        if (opts.pager && (opts.unified || opts.recursive)) {
+            show_help("error: --pager pages the side-by-side view of two files; it can't be combined "
+                      "with -u or -r");
+            return false;
+        }
+        if (opts.output_format != diffy::OutputFormat::Text && (opts.pager || opts.recursive)) {
+            show_help("error: --format=json and --format=binary write the diff of two files; they "
+                      "can't be combined with --pager or -r");
+            return false;
+        }
 
         int positional_count = argc - optind;
 
@@ -470,6 +767,17 @@ Side by side options:
         opts.left_file = argv[optind];
         opts.right_file = argv[optind + 1];
 
+        if (opts.recursive) {
+            std::error_code ec;
+            for (const std::string& dir : {opts.left_file, opts.right_file}) {
+                if (!fs::is_directory(dir, ec)) {
+                    show_help(fmt::format("error: -r expects two directories; '{}' is not one\n", dir));
+                    return false;
+                }
+            }
+            return true;
+        }
+
         auto a_status = diffy::check_file_status(opts.left_file);
         auto b_status = diffy::check_file_status(opts.right_file);
         
@@ -574,6 +882,32 @@ Side by side options:
         return 0;
     }
 
+    // --stats / DIFFY_TRACE=<file>: time the pipeline stages, reported on the way
+    // out whichever path (text, hex, image) ran.
+    struct TraceReport {
+        bool stats = false;
+        std::string path;
+        ~TraceReport() {
+            if (stats) {
+                fputs(diffy::trace_stats_table().c_str(), stderr);
+            }
+            if (!path.empty() && !diffy::trace_write_chrome(path)) {
+                fmt::print(stderr, "diffy: could not write trace to '{}'\n", path);
+            }
+        }
+    } trace_report;
+    if (const char* trace_path = std::getenv("DIFFY_TRACE"); trace_path && *trace_path) {
+        trace_report.path = trace_path;
+    }
+    trace_report.stats = opts.stats;
+    if (trace_report.stats || !trace_report.path.empty()) {
+        diffy::trace_enable();
+    }
+
+    if (opts.recursive) {
+        return diff_directories(opts, cv_ui_opts);
+    }
+
     // Binary / hex diff path. Decide before readlines so binary input never gets
     // line-split. Auto mode sniffs the first 1 KiB of each file for a NUL byte.
     {
@@ -596,6 +930,11 @@ Side by side options:
                       ? false
                       : (sniff_binary(opts.left_file) || sniff_binary(opts.right_file));
 
+        if (want_binary && opts.output_format != diffy::OutputFormat::Text) {
+            fmt::print(stderr, "diffy: --format=json and --format=binary need text input; '{}' or '{}' is "
+                       "binary\n", opts.left_file_name, opts.right_file_name);
+            return 2;
+        }
         if (want_binary) {
             diffy::FileBytes a_file, b_file;
             if (!a_file.load(opts.left_file) || !b_file.load(opts.right_file)) {
@@ -735,22 +1074,19 @@ Side by side options:
                 return w == 0 ? 80 : w;
             };
 
+            auto out = stdout_sink();
             if (opts.column_view) {
-                for (const auto& line : diffy::hex_column_render(
-                         a_bytes, b_bytes, alignment, color ? &cv_ui_opts.style : nullptr,
-                         static_cast<int>(opts.bytes_per_row), opts.context_lines, resolve_width())) {
-                    puts(line.c_str());
-                }
+                diffy::hex_column_render(*out, a_bytes, b_bytes, alignment, color ? &cv_ui_opts.style : nullptr,
+                                         static_cast<int>(opts.bytes_per_row), opts.context_lines,
+                                         resolve_width());
             } else {
                 const int64_t bpr = opts.bytes_per_row > 0 ? opts.bytes_per_row : 16;
                 const int64_t fill_width = color ? resolve_width() : 0;
-                for (const auto& line : diffy::hex_unified_render(
-                         a_bytes, b_bytes, opts.left_file_name, opts.right_file_name, alignment,
-                         color ? &cv_ui_opts.style : nullptr, static_cast<int>(bpr), opts.context_lines,
-                         fill_width)) {
-                    puts(line.c_str());
-                }
+                diffy::hex_unified_render(*out, a_bytes, b_bytes, opts.left_file_name, opts.right_file_name,
+                                          alignment, color ? &cv_ui_opts.style : nullptr, static_cast<int>(bpr),
+                                          opts.context_lines, fill_width);
             }
+            out->flush();
 
             if (truncated) {
                 fmt::print(stderr,
@@ -761,6 +1097,15 @@ Side by side options:
         }
     }
 
+    // --time-budget: from here on the stages poll this and degrade once it passes;
+    // what they gave up is reported on stderr after the output.
+    std::optional<diffy::Deadline> time_budget;
+    if (opts.time_budget_ms > 0) {
+        time_budget.emplace(std::chrono::milliseconds(opts.time_budget_ms));
+    }
+    const diffy::Deadline* deadline = time_budget ? &*time_budget : nullptr;
+    diffy::Degradation degradations = diffy::DegradedNone;
+
     // ignore_whitespace makes line matching whitespace-insensitive at read time, so
     // reindent-only lines share a checksum and the diff treats them as unchanged.
     auto left_line_data = diffy::readlines(opts.left_file, opts.ignore_line_endings, opts.ignore_whitespace);
@@ -772,10 +1117,84 @@ Side by side options:
     diffy::DiffInput<diffy::Line> diff_input{left_lines, right_lines, opts.left_file_name,
                                              opts.right_file_name};
 
+    // Concatenate each side once (readlines keeps the newlines); used for the cache
+    // key, syntax highlighting and hunk-scope analysis.
+    std::string a_text, b_text;
+    for (const auto& l : left_line_data) a_text += l.line;
+    for (const auto& l : right_line_data) b_text += l.line;
+
+    // Colourise unified output for terminal viewing only. --color forces the
+    // decision; otherwise (auto) colour a terminal but stay plain to a pipe or file
+    // (git difftool, `> foo.patch`, the test suite) so the output round-trips
+    // through `patch`. The side-by-side view is always coloured.
+    const bool color = opts.column_view || opts.color_mode == diffy::ColorMode::Always ||
+                       (opts.color_mode == diffy::ColorMode::Auto && stdout_is_tty());
+
+    // --cache: a record from an earlier run on the same pair (and options) replaces
+    // the diff, the scope analysis and, when present, tree-sitter highlighting.
+    std::optional<diffy::DiskCache> disk_cache;
+    std::optional<diffy::DiffRecord> record;
+    std::string cache_key;
+    if (opts.diff_cache) {
+        disk_cache.emplace(diffy::diff_cache_directory(),
+                           static_cast<uint64_t>(std::max<int64_t>(opts.diff_cache_mb, 0)) << 20);
+        diffy::DiffPipelineOptions key_options;
+        key_options.algorithm = opts.algorithm;
+        key_options.context_lines = opts.context_lines;
+        key_options.ignore_whitespace = opts.ignore_whitespace;
+        key_options.ignore_line_endings = opts.ignore_line_endings;
+        key_options.force_language = opts.force_language;
+        cache_key = diffy::diff_record_key(a_text, b_text, opts.left_file_name, opts.right_file_name, key_options,
+                                           DIFFY_VERSION "-" DIFFY_BUILD_HASH);
+        if (auto data = disk_cache->load(cache_key)) {
+            record = diffy::deserialize_diff_record(*data, left_line_data.size(), right_line_data.size());
+        }
+    }
+    const bool record_loaded = record.has_value();
+
+    // --language / -L forces both sides; otherwise detect from the file names.
+    const auto forced = diffy::language_from_name(opts.force_language);
+    const auto lang_a = forced.empty() ? diffy::language_for_path(opts.left_file_name) : forced;
+    const auto lang_b = forced.empty() ? diffy::language_for_path(opts.right_file_name) : forced;
+
+    // The tree-sitter passes need only the texts, so whichever of them the cache
+    // can't supply run on their own threads while this one diffs. Syntax
+    // highlighting (colour) is optional: no-op when disabled / unknown language /
+    // oversized. Scope outlines feed the git-style hunk context (the enclosing
+    // definition per hunk), which is always computed so headers carry it
+    // regardless of highlighting — like the GUI. Empty when the language is
+    // unknown or grammars are unavailable.
+    diffy::LineHighlights a_hl, b_hl;
+    std::vector<diffy::CodeScope> a_outline, b_outline;
+    const bool want_highlights =
+        color && opts.syntax_highlight && opts.output_format == diffy::OutputFormat::Text;
+    const bool highlights_cached = record && record->has_highlights;
+    const bool outlines_cached = record_loaded;
+    bool highlight_aborted[2] = {false, false};
+    bool outline_aborted[2] = {false, false};
+    diffy::TaskGroup tree_sitter;
+    if (want_highlights && highlights_cached) {
+        a_hl = std::move(record->a_highlights);
+        b_hl = std::move(record->b_highlights);
+    } else if (want_highlights) {
+        tree_sitter.run([&] { a_hl = diffy::highlight_source(a_text, lang_a, deadline, &highlight_aborted[0]); });
+        tree_sitter.run([&] { b_hl = diffy::highlight_source(b_text, lang_b, deadline, &highlight_aborted[1]); });
+    }
+    if (!outlines_cached) {
+        tree_sitter.run([&] { a_outline = diffy::scope_outline(a_text, lang_a, deadline, &outline_aborted[0]); });
+        tree_sitter.run([&] { b_outline = diffy::scope_outline(b_text, lang_b, deadline, &outline_aborted[1]); });
+    }
+
     diffy::DiffResult result;
-    if (!compute_diff(opts.algorithm, opts.ignore_whitespace, diff_input, &result)) {
+    if (record) {
+        result.status = record->status;
+        result.edit_sequence = std::move(record->edit_sequence);
+    } else if (!compute_diff(opts.algorithm, opts.ignore_whitespace, diff_input, &result, deadline)) {
         return 2;
     }
+    if (result.timed_out) {
+        degradations |= diffy::DegradedDiff;
+    }
 
     if (result.status != diffy::DiffResultStatus::OK && result.status != diffy::DiffResultStatus::NoChanges) {
         puts("Diff compute failed");
@@ -788,106 +1207,108 @@ Side by side options:
     // 2 = error (handled by the early returns above).
     const int exit_code = hunks.empty() ? 0 : 1;
 
-    if (opts.column_view) {
-        auto annotated_hunks = annotate_hunks(
-            diff_input, hunks,
-            opts.line_granularity ? diffy::EditGranularity::Line : diffy::EditGranularity::Token,
-            opts.ignore_whitespace);
-
-        // Terminal-width detection lives in the CLI now; the core renderer takes
-        // an explicit width so it stays free of any tty dependency.
-        int64_t width = opts.width;
-        if (width == 0) {
-            int term_height = 0, term_width = 0;
-            diffy::tty_get_term_size(&term_height, &term_width);
-            width = static_cast<int64_t>(term_width);
-        }
-        // Fall back to 80 columns when there's no tty (e.g. under a debugger).
-        if (width == 0) {
-            width = 80;
-        }
-
-        // Concatenate each side once (readlines keeps the newlines); used for both
-        // syntax highlighting and hunk-scope analysis. Language is inferred from
-        // the display name.
-        std::string a_text, b_text;
-        for (const auto& l : left_line_data) a_text += l.line;
-        for (const auto& l : right_line_data) b_text += l.line;
-        // --language / -L forces both sides; otherwise detect from the file names.
-        const auto forced = diffy::language_from_name(opts.force_language);
-        const auto lang_a = forced.empty() ? diffy::language_for_path(opts.left_file_name) : forced;
-        const auto lang_b = forced.empty() ? diffy::language_for_path(opts.right_file_name) : forced;
-
-        // Syntax highlighting (colour) is optional. No-op when disabled / unknown
-        // language / oversized.
-        diffy::LineHighlights a_hl, b_hl;
-        if (opts.syntax_highlight) {
-            a_hl = diffy::highlight_source(a_text, lang_a);
-            b_hl = diffy::highlight_source(b_text, lang_b);
-        }
-
-        // git-style hunk context (the enclosing definition per hunk) is always
-        // computed, so headers carry it regardless of syntax highlighting — like
-        // the GUI. Empty when the language is unknown or grammars are unavailable.
-        {
-            const auto a_outline = diffy::scope_outline(a_text, lang_a);
-            const auto b_outline = diffy::scope_outline(b_text, lang_b);
-            for (auto& h : annotated_hunks) {
-                int64_t a_change = -1, b_change = -1;
-                for (const auto& el : h.a_lines)
-                    if (el.type == diffy::EditType::Delete) { a_change = el.line_index; break; }
-                for (const auto& el : h.b_lines)
-                    if (el.type == diffy::EditType::Insert) { b_change = el.line_index; break; }
-                h.context = diffy::hunk_context(a_outline, b_outline, a_change, b_change, h.from_start,
-                                                h.to_start);
+    tree_sitter.wait();
+    std::vector<std::string> hunk_contexts;
+    if (record && record->hunk_contexts.size() == hunks.size()) {
+        hunk_contexts = std::move(record->hunk_contexts);
+    } else {
+        if (outlines_cached) {
+            a_outline = diffy::scope_outline(a_text, lang_a, deadline, &outline_aborted[0]);
+            b_outline = diffy::scope_outline(b_text, lang_b, deadline, &outline_aborted[1]);
+        }
+        hunk_contexts.reserve(hunks.size());
+        for (const auto& h : hunks) {
+            int64_t a_change = -1, b_change = -1;
+            for (const auto& e : h.edit_units) {
+                if (a_change < 0 && e.type == diffy::EditType::Delete) a_change = e.a_index;
+                if (b_change < 0 && e.type == diffy::EditType::Insert) b_change = e.b_index;
+                if (a_change >= 0 && b_change >= 0) break;
             }
+            hunk_contexts.push_back(
+                diffy::hunk_context(a_outline, b_outline, a_change, b_change, h.from_start, h.to_start));
         }
+    }
 
-        for (const auto& line : diffy::column_view_render_lines(diff_input, annotated_hunks, cv_ui_opts,
-                                                                opts, width, &a_hl, &b_hl)) {
-            puts(line.c_str());
+    if (highlight_aborted[0] || highlight_aborted[1]) {
+        degradations |= diffy::DegradedHighlight;
+    }
+    if (outline_aborted[0] || outline_aborted[1]) {
+        degradations |= diffy::DegradedScopes;
+    }
+
+    // Write the record on a miss, or to add highlight runs a plain run didn't need.
+    // A degraded run isn't stored: the next one may have the time to do it properly.
+    if (disk_cache && degradations == diffy::DegradedNone &&
+        (!record_loaded || (want_highlights && !highlights_cached))) {
+        diffy::DiffRecord out;
+        out.status = result.status;
+        out.edit_sequence = result.edit_sequence;
+        out.hunk_contexts = hunk_contexts;
+        out.has_highlights = want_highlights;
+        out.a_highlights = a_hl;
+        out.b_highlights = b_hl;
+        disk_cache->store(cache_key, diffy::serialize_diff_record(out));
+    }
+
+    if (opts.column_view || opts.output_format != diffy::OutputFormat::Text) {
+        auto granularity = diffy::EditGranularity::Token;
+        if (opts.line_granularity) {
+            granularity = diffy::EditGranularity::Line;
+        } else if (opts.char_granularity) {
+            granularity = diffy::EditGranularity::Char;
         }
-    } else if (opts.unified) {
-        // Concatenate each side once, for scope analysis and (optional) highlighting.
-        std::string a_text, b_text;
-        for (const auto& l : left_line_data) a_text += l.line;
-        for (const auto& l : right_line_data) b_text += l.line;
-        // --language / -L forces both sides; otherwise detect from the file names.
-        const auto forced = diffy::language_from_name(opts.force_language);
-        const auto lang_a = forced.empty() ? diffy::language_for_path(opts.left_file_name) : forced;
-        const auto lang_b = forced.empty() ? diffy::language_for_path(opts.right_file_name) : forced;
-
-        // git-style hunk context for the "@@ ... @@" headers — always computed so
-        // the enclosing definition shows regardless of syntax highlighting (colour).
-        std::vector<std::string> hunk_contexts;
-        {
-            const auto a_outline = diffy::scope_outline(a_text, lang_a);
-            const auto b_outline = diffy::scope_outline(b_text, lang_b);
-            hunk_contexts.reserve(hunks.size());
-            for (const auto& h : hunks) {
-                int64_t a_change = -1, b_change = -1;
-                for (const auto& e : h.edit_units) {
-                    if (a_change < 0 && e.type == diffy::EditType::Delete) a_change = e.a_index;
-                    if (b_change < 0 && e.type == diffy::EditType::Insert) b_change = e.b_index;
-                    if (a_change >= 0 && b_change >= 0) break;
-                }
-                hunk_contexts.push_back(diffy::hunk_context(a_outline, b_outline, a_change, b_change,
-                                                            h.from_start, h.to_start));
-            }
+        // Past the budget, skip tokenizing and intra-line diffs altogether.
+        if (granularity != diffy::EditGranularity::Line && diffy::deadline_expired(deadline)) {
+            granularity = diffy::EditGranularity::Line;
+            degradations |= diffy::DegradedAnnotation;
         }
-
-        // Colourise for terminal viewing only. --color forces the decision;
-        // otherwise (auto) colour a terminal but stay plain to a pipe or file
-        // (git difftool, `> foo.patch`, the test suite) so the output round-trips
-        // through `patch`.
-        const bool color = opts.color_mode == diffy::ColorMode::Always ||
-                           (opts.color_mode == diffy::ColorMode::Auto && stdout_is_tty());
-        diffy::LineHighlights a_hl, b_hl;
-        if (color && opts.syntax_highlight) {
-            a_hl = diffy::highlight_source(a_text, lang_a);
-            b_hl = diffy::highlight_source(b_text, lang_b);
+        // Hunks are annotated as the renderer reaches them and freed once their
+        // rows are written. Serially that is one hunk at a time; a large diff is
+        // rendered in batches on the workers, a few batches ahead of the output
+        // at most (see parallel_for_ordered), so memory stays bounded either way.
+        diffy::MoveOptions move_options;
+        move_options.ignore_whitespace = opts.moved_ignore_whitespace;
+        move_options.max_edited_lines = static_cast<int>(opts.moved_edited_lines);
+        diffy::LazyAnnotatedHunks annotated_hunks(diff_input, hunks, granularity, opts.ignore_whitespace,
+                                                  move_options);
+        for (size_t i = 0; i < annotated_hunks.size(); i++) {
+            annotated_hunks.set_context(i, hunk_contexts[i]);
         }
 
+        if (opts.output_format != diffy::OutputFormat::Text) {
+            auto out = stdout_sink();
+            const auto format = opts.output_format == diffy::OutputFormat::Json ? diffy::StructuredFormat::Json
+                                                                                : diffy::StructuredFormat::Binary;
+            diffy::structured_diff_render(*out, format, diff_input, annotated_hunks);
+            out->flush();
+        } else {
+            // Terminal-width detection lives in the CLI now; the core renderer takes
+            // an explicit width so it stays free of any tty dependency.
+            int64_t width = opts.width;
+            if (width == 0) {
+                int term_height = 0, term_width = 0;
+                diffy::tty_get_term_size(&term_height, &term_width);
+                width = static_cast<int64_t>(term_width);
+            }
+            // Fall back to 80 columns when there's no tty (e.g. under a debugger).
+            if (width == 0) {
+                width = 80;
+            }
+
+            // --pager: lay out only the rows on screen, the hunks as they scroll into view.
+            bool paged = false;
+            if (opts.pager && !hunks.empty() && stdout_is_tty()) {
+                diffy::LazyColumnView view(diff_input, annotated_hunks, cv_ui_opts, opts, &a_hl, &b_hl);
+                diffy::Pager pager(view, fmt::format("{} -> {}", opts.left_file_name, opts.right_file_name));
+                paged = diffy::tty_run_pager(pager);
+            }
+            if (!paged) {
+                auto out = stdout_sink();
+                diffy::column_view_render(*out, diff_input, annotated_hunks, cv_ui_opts, opts, width, &a_hl, &b_hl);
+                out->flush();
+            }
+        }
+    } else if (opts.unified) {
         // Terminal width, so coloured rows fill to the right edge as solid bars.
         // Honours an explicit -W, else the detected terminal size, else 80.
         int64_t fill_width = 0;
@@ -903,23 +1324,19 @@ Side by side options:
             }
         }
 
-        auto unified_lines = diffy::unified_diff_render(
-            diff_input, hunks, hunk_contexts.empty() ? nullptr : &hunk_contexts,
-            color ? &cv_ui_opts.style : nullptr, color ? &a_hl : nullptr, color ? &b_hl : nullptr,
-            cv_ui_opts.settings.light_theme, fill_width);
-        auto num_lines = unified_lines.size();
-        for (auto i = 0u; i < num_lines; i++) {
-            const auto& line = unified_lines[i];
-            if (line[line.size() - 1] == '\n')
-                printf("%s", line.c_str());
-            else {
-                printf("%s\n", line.c_str());
-            }
-        }
+        auto out = stdout_sink();
+        diffy::unified_diff_render(*out, diff_input, hunks, hunk_contexts.empty() ? nullptr : &hunk_contexts,
+                                   color ? &cv_ui_opts.style : nullptr, color ? &a_hl : nullptr,
+                                   color ? &b_hl : nullptr, cv_ui_opts.settings.light_theme, fill_width);
+        out->flush();
         // The "\ No newline at end of file" markers are emitted per side by
         // unified_diff_render (TXT-5), immediately after the affected line — not
         // once globally for the right file here.
     }
 
+    if (degradations != diffy::DegradedNone) {
+        fmt::print(stderr, "diffy: note: time budget of {} ms exceeded; degraded: {}\n", opts.time_budget_ms,
+                   diffy::degradation_names(degradations));
+    }
     return exit_code;
 }
@@ -0,0 +1,143 @@
+#include "pager.hpp"
+
+#include "tty.hpp"
+
+#include <string>
+#include <string_view>
+
+#ifdef DIFFY_PLATFORM_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+using namespace diffy;
+
+#ifdef DIFFY_PLATFORM_POSIX
+
+namespace {
+
+// SIGWINCH is turned into a byte on this pipe, so the input loop can wait on
+// keys and resizes together.
+int resize_pipe[2] = {-1, -1};
+
+void
+on_resize(int) {
+    const int saved_errno = errno;
+    const char byte = 0;
+    (void)!write(resize_pipe[1], &byte, 1);
+    errno = saved_errno;
+}
+
+void
+write_all(int fd, std::string_view bytes) {
+    while (!bytes.empty()) {
+        const ssize_t n = write(fd, bytes.data(), bytes.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        bytes.remove_prefix(static_cast<size_t>(n));
+    }
+}
+
+}  // namespace
+
+bool
+diffy::tty_run_pager(Pager& pager) {
+    const int out_fd = STDOUT_FILENO;
+    const bool own_input = !isatty(STDIN_FILENO);
+    const int in_fd = own_input ? open("/dev/tty", O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+    struct termios saved;
+    if (in_fd < 0 || tcgetattr(in_fd, &saved) != 0 || pipe(resize_pipe) != 0) {
+        if (own_input && in_fd >= 0) {
+            close(in_fd);
+        }
+        return false;
+    }
+    for (int fd : resize_pipe) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    // Keys arrive one at a time and unechoed; Ctrl-C is a key too, so quitting
+    // always goes through the restore below.
+    struct termios raw = saved;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(in_fd, TCSAFLUSH, &raw);
+
+    struct sigaction resize_action = {};
+    struct sigaction saved_action;
+    resize_action.sa_handler = on_resize;
+    sigemptyset(&resize_action.sa_mask);
+    sigaction(SIGWINCH, &resize_action, &saved_action);
+
+    // Alternate screen, hidden cursor, no autowrap (a row never spills over).
+    write_all(out_fd, "\033[?1049h\033[?25l\033[?7l");
+
+    auto fit = [&pager] {
+        int rows = 0, cols = 0;
+        tty_get_term_size(&rows, &cols);
+        pager.resize(rows > 0 ? rows : 24, cols > 0 ? cols : 80);
+    };
+    fit();
+
+    std::string frame;
+    for (bool running = true; running;) {
+        frame.clear();
+        pager.draw(frame);
+        write_all(out_fd, frame);
+
+        struct pollfd fds[2] = {{in_fd, POLLIN, 0}, {resize_pipe[0], POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(resize_pipe[0], drain, sizeof(drain)) > 0) {
+            }
+            fit();
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            char keys[64];
+            const ssize_t n = read(in_fd, keys, sizeof(keys));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            running = n > 0 && pager.input(std::string_view(keys, static_cast<size_t>(n)));
+        }
+    }
+
+    write_all(out_fd, "\033[?7h\033[?25h\033[?1049l");
+    sigaction(SIGWINCH, &saved_action, nullptr);
+    tcsetattr(in_fd, TCSAFLUSH, &saved);
+    for (int& fd : resize_pipe) {
+        close(fd);
+        fd = -1;
+    }
+    if (own_input) {
+        close(in_fd);
+    }
+    return true;
+}
+
+#else
+
+bool
+diffy::tty_run_pager(Pager&) {
+    // No console backend: the CLI rejects --pager on this platform.
+    return false;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "output/pager.hpp"
+
+namespace diffy {
+
+// Run `pager` full-screen on stdout until the user quits. Keys are read from
+// stdin when it's a terminal, else from the controlling terminal, in raw mode
+// for the duration; frames go to the alternate screen, and a SIGWINCH re-lays
+// it out at the new terminal size. Returns false when the terminal couldn't be
+// set up, in which case nothing was drawn. POSIX only: elsewhere it always
+// returns false, and the CLI refuses --pager at option parsing.
+bool
+tty_run_pager(Pager& pager);
+
+}  // namespace diffy
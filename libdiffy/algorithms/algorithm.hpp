@@ -1,9 +1,12 @@
 #pragma once
 
+#include "util/deadline.hpp"
+
 #include <cassert>
 #include <cinttypes>
 #include <climits>
 #include <cstddef>
+#include <functional>
 #include <gsl/span>
 #include <string>
 #include <vector>
@@ -13,6 +16,9 @@ namespace diffy {
 using std::int64_t;
 using std::size_t;
 
+// Search steps between Algorithm::on_progress reports.
+constexpr int64_t kProgressInterval = 64;
+
 // Which line-diff algorithm to run. Lives here (not in config) so the render
 // pipeline can name it without pulling in the terminal/theme config types.
 enum class Algo { kInvalid, kMyersGreedy, kMyersLinear, kPatience };
@@ -81,6 +87,9 @@ struct DiffInput {
 struct DiffResult {
     DiffResultStatus status;
     std::vector<Edit> edit_sequence;
+    // Algorithm::deadline expired mid-search: the differing middle is a plain
+    // delete + insert instead of a minimal script (still a valid one).
+    bool timed_out = false;
 };
 
 template <typename Unit>
@@ -88,6 +97,19 @@ class Algorithm {
    public:
     DiffInput<Unit>& diff_input_;
 
+    // Polled while searching. Once it expires diff() gives up (Failed) and
+    // compute() substitutes a coarse script, setting DiffResult::timed_out. Not
+    // owned; null means no limit.
+    const Deadline* deadline = nullptr;
+
+    // Called every kProgressInterval search steps with the edit distance reached
+    // so far, for a progress display. Runs on the diffing thread; empty = silent.
+    std::function<void(int64_t)> on_progress;
+
+    // Feed the diff.* trace counters. Set for the line-level diff only, so the
+    // intra-line passes (ByteUnit, TokenEdit) don't mix into its numbers.
+    bool trace_counters = false;
+
     Algorithm(DiffInput<Unit>& diff_input) : diff_input_(diff_input) {
     }
 
@@ -96,6 +118,19 @@ class Algorithm {
     virtual DiffResult
     diff() = 0;
 
+    // The cheapest valid script for A[a_begin, a_end) against B[b_begin, b_end):
+    // delete every line, then insert every line. Stands in for a diff the deadline
+    // cut short.
+    static void
+    append_coarse(std::vector<Edit>& out, int64_t a_begin, int64_t a_end, int64_t b_begin, int64_t b_end) {
+        for (int64_t i = a_begin; i < a_end; i++) {
+            out.push_back({EditType::Delete, EditIndex(i), EditIndexInvalid});
+        }
+        for (int64_t j = b_begin; j < b_end; j++) {
+            out.push_back({EditType::Insert, EditIndexInvalid, EditIndex(j)});
+        }
+    }
+
     DiffResult
     compute() {
         DiffResult result;
@@ -137,7 +172,15 @@ class Algorithm {
             ++suffix;
         }
         if (prefix == 0 && suffix == 0) {
-            return diff();  // nothing shared to peel; run the algorithm as-is
+            // Nothing shared to peel; run the algorithm as-is.
+            DiffResult whole = diff();
+            if (whole.status == DiffResultStatus::Failed && deadline_expired(deadline)) {
+                whole.edit_sequence.clear();
+                append_coarse(whole.edit_sequence, 0, N, 0, M);
+                whole.status = DiffResultStatus::OK;
+                whole.timed_out = true;
+            }
+            return whole;
         }
 
         for (int64_t i = 0; i < prefix; ++i) {
@@ -165,9 +208,14 @@ class Algorithm {
             DiffResult core = diff();
             A = saved_A;
             B = saved_B;
-            if (core.status == DiffResultStatus::Failed) {
+            if (core.status == DiffResultStatus::Failed && deadline_expired(deadline)) {
+                core.edit_sequence.clear();
+                append_coarse(core.edit_sequence, 0, core_n, 0, core_m);
+                core.timed_out = true;
+            } else if (core.status == DiffResultStatus::Failed) {
                 return core;
             }
+            result.timed_out = core.timed_out;
             for (Edit e : core.edit_sequence) {
                 if (e.a_index.valid) {
                     e.a_index.value += static_cast<int32_t>(prefix);
@@ -334,3 +334,70 @@ TEST_CASE("diff algorithms — fixture corpus reconstruct invariant") {
     CHECK(pairs > 0);
 }
 #endif
+
+TEST_CASE("Myers greedy — max_cost bounds the edit distance") {
+    auto A = make_lines({"a", "b", "c", "d", "e"});
+    auto B = make_lines({"v", "w", "x", "y", "z"});
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+
+    MyersGreedy<Line> bounded(in);
+    bounded.max_cost = 4;  // the real distance is 10
+    CHECK(bounded.compute().status == DiffResultStatus::Failed);
+
+    MyersGreedy<Line> roomy(in);
+    roomy.max_cost = 10;
+    auto r = roomy.compute();
+    CHECK(r.status == DiffResultStatus::OK);
+    CHECK(r.edit_sequence.size() == 10);
+}
+
+TEST_CASE("diff algorithms — an expired deadline yields a coarse but valid script") {
+    auto A = make_lines({"head", "a", "b", "c", "tail"});
+    auto B = make_lines({"head", "x", "b", "y", "tail"});
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    Deadline cancelled;
+    cancelled.cancel();
+    CHECK(cancelled.expired());
+    CHECK(cancelled.remaining_micros() == 0);
+
+    auto check_coarse = [&](DiffResult r) {
+        CHECK(r.timed_out);
+        CHECK(is_valid_transform(A, B, r));
+        // Only the shared ends survive; "b" in the middle is deleted and re-inserted.
+        std::vector<EditType> types;
+        for (const auto& e : r.edit_sequence) {
+            types.push_back(e.type);
+        }
+        CHECK(types == std::vector<EditType>{EditType::Common, EditType::Delete, EditType::Delete,
+                                             EditType::Delete, EditType::Insert, EditType::Insert,
+                                             EditType::Insert, EditType::Common});
+    };
+    MyersGreedy<Line> greedy(in);
+    greedy.deadline = &cancelled;
+    check_coarse(greedy.compute());
+    MyersLinear<Line> linear(in);
+    linear.deadline = &cancelled;
+    check_coarse(linear.compute());
+    Patience<Line> patience(in);
+    patience.deadline = &cancelled;
+    check_coarse(patience.compute());
+
+    // Nothing shared at either end: the whole input is the coarse middle.
+    auto C = make_lines({"p", "q"});
+    DiffInput<Line> disjoint{gsl::span<Line>{A}, gsl::span<Line>{C}, "a", "c"};
+    MyersLinear<Line> whole(disjoint);
+    whole.deadline = &cancelled;
+    auto r = whole.compute();
+    CHECK(r.timed_out);
+    CHECK(r.edit_sequence.size() == 7);
+    CHECK(is_valid_transform(A, C, r));
+
+    // A budget that hasn't run out changes nothing.
+    Deadline roomy(std::chrono::milliseconds(60000));
+    CHECK_FALSE(roomy.expired());
+    Patience<Line> unhurried(in);
+    unhurried.deadline = &roomy;
+    auto fine = unhurried.compute();
+    CHECK_FALSE(fine.timed_out);
+    CHECK(fine.edit_sequence.size() == Patience<Line>(in).compute().edit_sequence.size());
+}
@@ -5,6 +5,7 @@
 #include "algorithm.hpp"
 #include "myers_linear.hpp"
 #include "util/bipolar_array.hpp"
+#include "util/trace.hpp"
 
 #include <gsl/span>
 #include <limits>
@@ -21,6 +22,12 @@ struct MyersGreedy : public Algorithm<Unit> {
     const gsl::span<Unit>& A;
     const gsl::span<Unit>& B;
 
+    // Give up once the edit distance exceeds this many insert/delete steps; the
+    // result is then DiffResultStatus::Failed and the caller picks a cheaper
+    // representation. 0 means unbounded. Bounds both time (O((N+M) D)) and the
+    // O(D^2) trace, which is what makes byte-level intra-line diffs affordable.
+    int64_t max_cost = 0;
+
     MyersGreedy(DiffInput<Unit>& diff_input)
         : Algorithm<Unit>(diff_input)
         , N(static_cast<int64_t>(diff_input.A.size()))
@@ -71,6 +78,12 @@ struct MyersGreedy : public Algorithm<Unit> {
 
         v[1] = 0;
         for (int64_t d = 0; d <= max; d++) {
+            if ((max_cost > 0 && d > max_cost) || deadline_expired(this->deadline)) {
+                return -3;
+            }
+            if (this->on_progress && d % kProgressInterval == 0) {
+                this->on_progress(d);
+            }
             const auto [blo, bhi] = band(d);
             if (trace_bytes + static_cast<std::size_t>(bhi - blo + 1) * sizeof(IndexSizeType) >
                 kMaxTraceBytes) {
@@ -166,8 +179,16 @@ struct MyersGreedy : public Algorithm<Unit> {
 
         if (edit_distance == -2) {
             // Trace would exceed the memory budget; fall back to linear-space Myers.
-            return MyersLinear<Unit>{this->diff_input_}.compute();
+            if (this->trace_counters) {
+                DIFFY_TRACE_COUNT(GreedyToLinear, 1);
+            }
+            MyersLinear<Unit> linear{this->diff_input_};
+            linear.deadline = this->deadline;
+            linear.on_progress = this->on_progress;
+            linear.trace_counters = this->trace_counters;
+            return linear.compute();
         } else if (edit_distance < 0) {
+            // -1: invalid input, -3: max_cost exceeded or the deadline passed.
             result.status = DiffResultStatus::Failed;
             return result;
         } else if (edit_distance == 0) {
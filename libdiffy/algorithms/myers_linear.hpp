@@ -6,6 +6,7 @@
 
 #include "algorithm.hpp"
 #include "util/bipolar_array.hpp"
+#include "util/trace.hpp"
 
 #include <numeric>  // std::accumulate
 #include <optional>
@@ -44,6 +45,8 @@ struct MyersLinear : public Algorithm<Unit> {
     const gsl::span<Unit>& A;
     const gsl::span<Unit>& B;
 
+    bool timed_out = false;  // a midpoint search ran past the deadline
+
     MyersLinear(DiffInput<Unit>& diff_input)
         : Algorithm<Unit>(diff_input)
         , N(static_cast<int64_t>(diff_input.A.size()))
@@ -81,6 +84,9 @@ struct MyersLinear : public Algorithm<Unit> {
         auto snake = midpoint(box);
         if (!snake)
             return false;
+        if (this->trace_counters) {
+            DIFFY_TRACE_COUNT(DiffSnakes, 1);
+        }
 
         auto start = snake.value().from;
         auto finish = snake.value().to;
@@ -113,6 +119,15 @@ struct MyersLinear : public Algorithm<Unit> {
         vb[1] = box.bottom;
 
         for (auto d = 0; d <= max; d++) {
+            if (deadline_expired(this->deadline)) {
+                timed_out = true;
+                return std::nullopt;
+            }
+            // Only the outermost search bounds the whole diff: no midpoint within
+            // d steps from either end means D > 2d.
+            if (this->on_progress && d % kProgressInterval == 0 && box.size() == N + M) {
+                this->on_progress(2 * d);
+            }
             if (auto m = forwards(box, vf, vb, d)) {
                 return m;
             }
@@ -243,8 +258,10 @@ struct MyersLinear : public Algorithm<Unit> {
 
         std::vector<Coordinate> path;
         bool found = find_path(0, 0, N, M, path);
-        if (!found)
+        if (!found || timed_out) {
+            result.status = DiffResultStatus::Failed;
             return result;
+        }
 
         auto solution = walk_snakes(path);
 
@@ -2,6 +2,7 @@
 
 #include "algorithm.hpp"
 #include "myers_linear.hpp"
+#include "util/trace.hpp"
 
 #include <gsl/span>
 #include <algorithm>  // std::reverse, std::sort, std::max
@@ -40,6 +41,8 @@ struct Patience : public Algorithm<Unit> {
     const gsl::span<Unit>& A;
     const gsl::span<Unit>& B;
 
+    bool timed_out = false;  // the deadline passed part-way; the script is incomplete
+
     Patience(DiffInput<Unit>& diff_input)
         : Algorithm<Unit>(diff_input)
         , N(static_cast<int64_t>(diff_input.A.size()))
@@ -187,6 +190,10 @@ struct Patience : public Algorithm<Unit> {
     // Appends this slice's edits to `out`.
     void
     do_diff(const Slice& in_slice, std::vector<Edit>& out) {
+        if (timed_out || deadline_expired(this->deadline)) {
+            timed_out = true;
+            return;
+        }
         auto unique_lines = index_unique_lines(in_slice);
         auto* match = patience_sort(unique_lines);
         if (!match) {
@@ -208,7 +215,18 @@ struct Patience : public Algorithm<Unit> {
 
             DiffInput<Unit> algo_input{A.subspan(in_slice.a_low, a_count), B.subspan(in_slice.b_low, b_count),
                                        "A", "B"};
-            auto result = MyersLinear<Unit>{algo_input}.compute();
+            if (this->trace_counters) {
+                DIFFY_TRACE_COUNT(PatienceToMyers, 1);
+            }
+            MyersLinear<Unit> myers{algo_input};
+            myers.deadline = this->deadline;
+            myers.on_progress = this->on_progress;
+            myers.trace_counters = this->trace_counters;
+            auto result = myers.compute();
+            if (result.timed_out || result.status == DiffResultStatus::Failed) {
+                timed_out = true;
+                return;
+            }
 
             for (auto& e : result.edit_sequence) {
                 e.a_index.value += static_cast<int32_t>(in_slice.a_low);
@@ -290,6 +308,11 @@ struct Patience : public Algorithm<Unit> {
         auto s = Slice{0, N, 0, M};
         DiffResult result;
         do_diff(s, result.edit_sequence);
+        if (timed_out) {
+            result.status = DiffResultStatus::Failed;
+            result.edit_sequence.clear();
+            return result;
+        }
         int64_t common_count = std::accumulate(
             result.edit_sequence.begin(), result.edit_sequence.end(), (int64_t) 0,
             [](uint64_t acc, const auto& e) { return e.type == EditType::Common ? acc + 1 : acc; });
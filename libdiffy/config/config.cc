@@ -627,6 +627,14 @@ diffy::config_get_directory() {
     return fmt::format("{}/diffy", sago::getConfigHome());
 }
 
+std::string
+diffy::diff_cache_directory() {
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) {
+        return fmt::format("{}/diffy", xdg);
+    }
+    return fmt::format("{}/cache", config_get_directory());
+}
+
 std::vector<std::pair<std::string, std::string>>
 diffy::config_bundled_themes() {
     return {
@@ -868,6 +876,12 @@ diffy::config_apply_options(diffy::ProgramOptions& program_options) {
        { "general.context_lines",       ConfigVariableType::Int,    &program_options.context_lines},
        { "general.ignore_line_endings", ConfigVariableType::Bool,   &program_options.ignore_line_endings },
        { "general.ignore_whitespace",   ConfigVariableType::Bool,   &program_options.ignore_whitespace },
+       { "general.char_granularity",    ConfigVariableType::Bool,   &program_options.char_granularity },
+       { "general.moved_ignore_whitespace", ConfigVariableType::Bool, &program_options.moved_ignore_whitespace },
+       { "general.moved_edited_lines",  ConfigVariableType::Int,    &program_options.moved_edited_lines },
+       { "general.diff_cache",          ConfigVariableType::Bool,   &program_options.diff_cache },
+       { "general.diff_cache_mb",       ConfigVariableType::Int,    &program_options.diff_cache_mb },
+       { "general.time_budget_ms",      ConfigVariableType::Int,    &program_options.time_budget_ms },
     };
     // clang-format on
 
@@ -31,12 +31,29 @@ enum class ImageMode { Auto, Always, Never };
 // to a pipe (testing); Never keeps just the text summary.
 enum class ImageRenderMode { Auto, Always, Never };
 
+// --format: the styled text views, or the hunks as JSON / binary records for
+// other tools (output/structured.hpp).
+enum class OutputFormat { Text, Json, Binary };
+
 struct ProgramOptions {
     bool debug = false;
+    bool stats = false;  // --stats: per-stage timings on stderr (util/trace.hpp)
     bool help = false;
     bool column_view = false;
     bool line_granularity = false;
+    // --char: byte-level intra-line diff (EditGranularity::Char). --line wins.
+    bool char_granularity = false;
+    // --moved-tolerance[=k]: also pair moved blocks that were reindented and/or had
+    // up to k lines edited (MoveOptions). Off by default: moves are byte-identical.
+    bool moved_ignore_whitespace = false;
+    int64_t moved_edited_lines = 0;
     bool unified = false;
+    // -r: the two arguments are directories; diff every file pair under them.
+    bool recursive = false;
+    // --pager: page the side-by-side view in the terminal, rendering only the
+    // rows on screen. Ignored when stdout isn't a terminal.
+    bool pager = false;
+    OutputFormat output_format = OutputFormat::Text;
     Algo algorithm = Algo::kPatience;
     int64_t context_lines = 3;
     int64_t width = 0;
@@ -47,6 +64,15 @@ struct ProgramOptions {
     bool ignore_whitespace = false;
     bool syntax_highlight = true;  // tree-sitter syntax highlighting (--no-highlight)
 
+    // --cache/--no-cache: keep edit scripts, hunk labels and highlight runs in
+    // diff_cache_directory() so re-diffing the same pair skips that work.
+    bool diff_cache = false;
+    int64_t diff_cache_mb = 64;  // size cap of the cache directory
+
+    // --time-budget: milliseconds the text diff may take before its stages degrade
+    // (coarser diff, line-only annotation, no highlighting). 0 means unlimited.
+    int64_t time_budget_ms = 0;
+
     // --language / -L: force the syntax language for both sides instead of
     // detecting it from the file names. Empty means "detect" (the default).
     std::string force_language;
@@ -216,6 +242,11 @@ struct ColumnViewSettings {
 std::string
 config_get_directory();
 
+// Where the on-disk diff cache lives: $XDG_CACHE_HOME/diffy when that is set,
+// otherwise a cache/ directory under config_get_directory().
+std::string
+diff_cache_directory();
+
 // The bundled, self-contained example themes seeded on first-run setup, as
 // {file-stem, .conf-content} pairs (e.g. {"theme_paper", "..."}). Exposed so
 // tests can validate the shipped theme content.
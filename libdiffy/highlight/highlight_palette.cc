@@ -1,6 +1,9 @@
 #include "highlight/highlight_palette.hpp"
 
+#include <fmt/format.h>
+
 #include <array>
+#include <string>
 
 namespace diffy {
 
@@ -13,6 +16,32 @@ std::array<HlRgb, kGroupCount> g_override{};
 HlRgb
 default_syntax_color(HighlightGroup group, bool light);
 
+// Foreground escapes per palette (dark, light) and group, so renderers don't
+// format one per segment. Built on first use; an override rewrites its group.
+using EscapeTable = std::array<std::array<std::string, kGroupCount>, 2>;
+
+constexpr size_t kLastGroup = static_cast<size_t>(HighlightGroup::Attribute);
+
+void
+build_fg_escape(EscapeTable& table, size_t i) {
+    for (const bool light : {false, true}) {
+        const HlRgb c = syntax_color(static_cast<HighlightGroup>(i), light);
+        table[light][i] = fmt::format("\033[38;2;{};{};{}m", c.r, c.g, c.b);
+    }
+}
+
+EscapeTable&
+fg_escapes() {
+    static EscapeTable table = [] {
+        EscapeTable t;
+        for (size_t i = 1; i <= kLastGroup; i++) {  // None stays empty
+            build_fg_escape(t, i);
+        }
+        return t;
+    }();
+    return table;
+}
+
 }  // namespace
 
 void
@@ -23,11 +52,17 @@ set_syntax_color_override(HighlightGroup group, HlRgb rgb) {
     }
     g_has_override[i] = true;
     g_override[i] = rgb;
+    if (i <= kLastGroup) {
+        build_fg_escape(fg_escapes(), i);
+    }
 }
 
 void
 clear_syntax_overrides() {
     g_has_override.fill(false);
+    for (size_t i = 1; i <= kLastGroup; i++) {
+        build_fg_escape(fg_escapes(), i);
+    }
 }
 
 HlRgb
@@ -39,6 +74,16 @@ syntax_color(HighlightGroup group, bool light) {
     return default_syntax_color(group, light);
 }
 
+const std::string&
+syntax_fg_escape(HighlightGroup group, bool light) {
+    static const std::string kNone;
+    const auto i = static_cast<size_t>(group);
+    if (group == HighlightGroup::None || i > kLastGroup) {
+        return kNone;
+    }
+    return fg_escapes()[light][i];
+}
+
 namespace {
 
 HlRgb
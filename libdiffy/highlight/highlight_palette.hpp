@@ -11,6 +11,7 @@
 #include "highlight/highlight_group.hpp"
 
 #include <cstdint>
+#include <string>
 
 namespace diffy {
 
@@ -23,6 +24,13 @@ struct HlRgb {
 HlRgb
 syntax_color(HighlightGroup group, bool light_theme);
 
+// syntax_color() as a truecolor foreground escape ("\033[38;2;r;g;bm"), from a
+// table built once rather than formatted per call. Empty for None. The string
+// stays put for the life of the process (an override rewrites it in place), so
+// renderers may hold on to it.
+const std::string&
+syntax_fg_escape(HighlightGroup group, bool light_theme);
+
 // Override the colour for a group (applies to both variants), e.g. from the
 // user's theme/config. Frontends call this at startup. HighlightGroup::None is
 // ignored. Overrides persist for the process; clear_syntax_overrides() resets.
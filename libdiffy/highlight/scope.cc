@@ -2,6 +2,7 @@
 
 #include "highlight/language_ts.hpp"
 #include "highlight/syntax_highlighter.hpp"  // kHighlightSizeCap
+#include "util/trace.hpp"
 
 namespace diffy {
 
@@ -13,6 +14,7 @@ namespace diffy {
 
 #include <algorithm>
 #include <cstring>
+#include <limits>
 
 namespace diffy {
 
@@ -295,7 +297,8 @@ extend_start_over_prefix(std::string_view source, const std::vector<size_t>& lin
 }  // namespace
 
 std::vector<CodeScope>
-scope_outline(std::string_view source, Language lang) {
+scope_outline(std::string_view source, Language lang, const Deadline* deadline, bool* aborted) {
+    DIFFY_TRACE_SCOPE("scope_outline");
     std::vector<CodeScope> out;
     if (source.empty() || source.size() > kHighlightSizeCap) {
         return out;
@@ -315,8 +318,31 @@ scope_outline(std::string_view source, Language lang) {
         ts_parser_delete(parser);
         return out;
     }
+    if (deadline) {
+        // A zero timeout means "unlimited" to tree-sitter, so an expired deadline
+        // skips the parse instead.
+        const uint64_t left = deadline->remaining_micros();
+        if (left == 0) {
+            ts_parser_delete(parser);
+            if (aborted) {
+                *aborted = true;
+            }
+            return out;
+        }
+        if (left != std::numeric_limits<uint64_t>::max()) {
+            ts_parser_set_timeout_micros(parser, left);
+        }
+        ts_parser_set_cancellation_flag(parser, deadline->cancel_flag());
+    }
     TSTree* tree = ts_parser_parse_string(parser, nullptr, source.data(),
                                           static_cast<uint32_t>(source.size()));
+    if (!tree) {
+        ts_parser_delete(parser);
+        if (aborted) {
+            *aborted = true;
+        }
+        return out;
+    }
 
     // Byte offset of each line's first char, so a definition's start can be walked
     // upward over preceding doc-comment/decorator lines (extend_start_over_prefix).
@@ -456,7 +482,7 @@ enclosing_scope(const std::vector<CodeScope>& outline, int64_t line) {
 #else  // !DIFFY_ENABLE_HIGHLIGHT
 
 std::vector<CodeScope>
-scope_outline(std::string_view, Language) {
+scope_outline(std::string_view, Language, const Deadline*, bool*) {
     return {};
 }
 
@@ -12,6 +12,7 @@
 */
 
 #include "highlight/language.hpp"
+#include "util/deadline.hpp"
 
 #include <cstdint>
 #include <optional>
@@ -28,9 +29,13 @@ struct CodeScope {
     std::string name;    // the defined identifier (unqualified), or "" if none found
 };
 
-// All definition/scope spans in `source`, in document order.
+// All definition/scope spans in `source`, in document order. A `deadline` bounds
+// the parse; when it cuts the parse short the outline is empty and `*aborted` set.
 std::vector<CodeScope>
-scope_outline(std::string_view source, Language lang);
+scope_outline(std::string_view source,
+              Language lang,
+              const Deadline* deadline = nullptr,
+              bool* aborted = nullptr);
 
 // The definition named `name` (exact, unqualified match), preferring the one
 // nearest `near_line` (pass -1 for none). Nullopt when no scope matches. Purely
@@ -2,6 +2,7 @@
 
 #include "highlight/language_ts.hpp"
 #include "util/binary_detect.hpp"
+#include "util/trace.hpp"
 
 namespace diffy {
 
@@ -64,7 +65,8 @@ line_starts(std::string_view src) {
 }  // namespace
 
 LineHighlights
-highlight_source(std::string_view source, Language lang) {
+highlight_source(std::string_view source, Language lang, const Deadline* deadline, bool* aborted) {
+    DIFFY_TRACE_SCOPE("highlight_source");
     LineHighlights empty;
     if (source.empty() || source.size() > kHighlightSizeCap || looks_binary(source)) {
         return empty;
@@ -89,11 +91,28 @@ highlight_source(std::string_view source, Language lang) {
         ts_parser_delete(parser);
         return empty;
     }
-    ts_parser_set_timeout_micros(parser, kParseTimeoutMicros);
+    uint64_t timeout = kParseTimeoutMicros;
+    if (deadline) {
+        timeout = std::min(timeout, deadline->remaining_micros());
+        ts_parser_set_cancellation_flag(parser, deadline->cancel_flag());
+    }
+    if (timeout == 0) {
+        ts_parser_delete(parser);  // 0 would mean "no limit" to tree-sitter
+        if (aborted) {
+            *aborted = true;
+        }
+        return empty;
+    }
+    ts_parser_set_timeout_micros(parser, timeout);
     TSTree* tree = ts_parser_parse_string(parser, nullptr, source.data(),
                                           static_cast<uint32_t>(source.size()));
     if (!tree) {
         ts_parser_delete(parser);  // parse timed out — cached query is owned by the cache
+        // Only a tripped deadline degrades the diff; running into kParseTimeoutMicros
+        // with time to spare is the ordinary no-highlight fallback.
+        if (aborted && deadline_expired(deadline)) {
+            *aborted = true;
+        }
         return empty;
     }
 
@@ -201,7 +220,7 @@ highlight_source(std::string_view source, Language lang) {
 #else  // !DIFFY_ENABLE_HIGHLIGHT
 
 LineHighlights
-highlight_source(std::string_view, Language) {
+highlight_source(std::string_view, Language, const Deadline*, bool*) {
     return {};
 }
 
@@ -14,6 +14,7 @@
 
 #include "highlight/highlight_group.hpp"
 #include "highlight/language.hpp"
+#include "util/deadline.hpp"
 
 #include <cstdint>
 #include <string_view>
@@ -32,8 +33,14 @@ struct HighlightRun {
 // no highlighting have an empty vector; rows beyond the buffer are absent.
 using LineHighlights = std::vector<std::vector<HighlightRun>>;
 
+// With a `deadline`, the parse is also bounded by the time left and aborted on
+// cancel(); when the deadline cuts it short the result is empty and `*aborted` is
+// set. A parse that only hits the fixed per-buffer timeout is empty but not aborted.
 LineHighlights
-highlight_source(std::string_view source, Language lang);
+highlight_source(std::string_view source,
+                 Language lang,
+                 const Deadline* deadline = nullptr,
+                 bool* aborted = nullptr);
 
 // Largest buffer we will parse (bytes). Larger inputs are returned unhighlighted.
 constexpr size_t kHighlightSizeCap = 2u * 1024u * 1024u;
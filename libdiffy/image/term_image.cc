@@ -1,5 +1,7 @@
 #include "image/term_image.hpp"
 
+#include "util/base64.hpp"
+
 #include <algorithm>
 
 #include <fmt/format.h>
@@ -43,32 +45,6 @@ term_image_protocol_from_name(const std::string& name) {
 
 namespace {
 
-const char kB64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-std::string
-base64(const uint8_t* data, size_t n) {
-    std::string out;
-    out.reserve((n + 2) / 3 * 4);
-    size_t i = 0;
-    for (; i + 3 <= n; i += 3) {
-        const uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
-        out.push_back(kB64[(v >> 18) & 0x3f]);
-        out.push_back(kB64[(v >> 12) & 0x3f]);
-        out.push_back(kB64[(v >> 6) & 0x3f]);
-        out.push_back(kB64[v & 0x3f]);
-    }
-    if (i < n) {
-        const uint32_t b0 = data[i];
-        const uint32_t b1 = (i + 1 < n) ? data[i + 1] : 0;
-        const uint32_t v = (b0 << 16) | (b1 << 8);
-        out.push_back(kB64[(v >> 18) & 0x3f]);
-        out.push_back(kB64[(v >> 12) & 0x3f]);
-        out.push_back((i + 1 < n) ? kB64[(v >> 6) & 0x3f] : '=');
-        out.push_back('=');
-    }
-    return out;
-}
-
 // Box-average downscale of an RGBA8 image to tw x th. (Upscaling isn't needed —
 // callers only ever shrink to fit the terminal.)
 std::vector<uint8_t>
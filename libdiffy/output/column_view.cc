@@ -3,6 +3,10 @@
 #include "highlight/highlight_palette.hpp"
 #include "processing/diff_hunk.hpp"
 #include "processing/diff_hunk_annotate.hpp"
+#include "util/arena.hpp"
+#include "util/parallel.hpp"
+#include "util/sgr.hpp"
+#include "util/trace.hpp"
 #include "util/utf8decode.hpp"
 
 #include <fcntl.h>
@@ -12,8 +16,11 @@
 #include <cstdlib>
 #include <filesystem>
 #include <gsl/span>
-#include <numeric>
-#include <stack>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <tuple>
 
 namespace fs = std::filesystem;
@@ -22,54 +29,88 @@ using namespace diffy;
 
 namespace {
 
-struct DisplayCommand {
-    std::string style;
-    std::string text;
-
-    static DisplayCommand
-    with_style(std::string style, std::string text) {
-        return DisplayCommand{.style = std::move(style), .text = std::move(text)};
-    }
-};
-
-std::string
-format_line_number(int64_t line_number, int64_t width, bool right_align) {
-    if (line_number == -1) {
-        return fmt::format("{:>{}}", " ", width);
-    }
-    if (right_align) {
-        return fmt::format("{:>{}}", line_number, width);
-    }
-
-    return fmt::format("{:<{}}", line_number, width);
-}
-
 struct DisplayLineSegment {
-    std::string text;
+    std::string_view text;  // into a source Line, or into the hunk's TextArena
     int64_t text_len;
     TokenFlag flags;
     EditType type;
     HighlightGroup syntax = HighlightGroup::None;
+    bool escaped = false;  // text carries escapes of its own (the file-name header)
 };
 
-// Truecolor SGR foreground for a syntax group in the chosen palette (light vs
-// dark). Empty for None. Escapes carry no display width, so adding them never
-// disturbs alignment.
-std::string
-syntax_fg(HighlightGroup group, bool light) {
-    if (group == HighlightGroup::None) {
-        return "";
+using SegmentPool = std::vector<DisplayLineSegment>;
+
+struct DisplayLine {
+    // The line's segments: [first_segment, first_segment + segment_count) of the
+    // hunk's SegmentPool.
+    uint32_t first_segment = 0;
+    uint32_t segment_count = 0;
+    int64_t line_length = 0;
+    int64_t line_number = -1;
+    bool is_word_wrapped = false;
+    EditType type = EditType::Meta;
+    int move_id = 0;  // non-zero => a relocated (moved) line; tint its number (GAP-9)
+};
+
+using DisplayColumns = std::vector<std::vector<DisplayLine>>;
+
+// A hunk's lines split into styled segments with their display widths, before
+// any column width is applied: everything a resize leaves as it is. `sides`
+// holds one unwrapped DisplayLine per edit line, old side first; its segments
+// live in `segments`.
+struct PreparedHunk {
+    int64_t from_start = 0;
+    int64_t from_count = 0;
+    int64_t to_start = 0;
+    int64_t to_count = 0;
+    std::string context;
+    SegmentPool segments;
+    DisplayColumns sides{2};
+};
+
+// Everything the renderer builds for one hunk, reset (not freed) before the
+// next: segment text that isn't a view into a source Line lives in `text`, the
+// hunk's prepared lines in `prepared` (when it isn't kept elsewhere), the
+// wrapped lines' segments in `segments`, the laid-out panes in `columns`, and
+// each styled row is assembled in `row` before it's emitted. Once these have
+// grown to fit the largest hunk, rendering a row allocates nothing. `sgr` lives
+// for the whole render: it tracks the terminal style across the cells of a row.
+struct RenderScratch {
+    TextArena text;
+    PreparedHunk prepared;
+    SegmentPool segments;
+    DisplayColumns columns{2};
+    DisplayColumns aligned{2};  // insert_alignment_rows' output, swapped into `columns`
+    std::string row;
+    SgrWriter sgr;
+
+    // Drop the laid-out rows. `text` is reset separately, by whoever fills it.
+    void
+    reset() {
+        segments.clear();
+        for (auto& c : columns) {
+            c.clear();
+        }
+    }
+};
+
+void
+format_line_number(std::string& out, int64_t line_number, int64_t width, bool right_align) {
+    if (line_number == -1) {
+        fmt::format_to(std::back_inserter(out), "{:>{}}", " ", width);
+    } else if (right_align) {
+        fmt::format_to(std::back_inserter(out), "{:>{}}", line_number, width);
+    } else {
+        fmt::format_to(std::back_inserter(out), "{:<{}}", line_number, width);
     }
-    const HlRgb c = syntax_color(group, light);
-    return fmt::format("\033[38;2;{};{};{}m", c.r, c.g, c.b);
 }
 
 // Append `text` (whose first byte sits at line column `base_col`) to `out`,
 // split at the boundaries of the line's syntax-highlight runs so each piece
 // carries one HighlightGroup. With no runs it appends a single None segment.
 void
-push_text_segments(std::vector<DisplayLineSegment>& out,
-                   const std::string& text,
+push_text_segments(SegmentPool& out,
+                   std::string_view text,
                    uint32_t base_col,
                    TokenFlag flags,
                    EditType type,
@@ -78,7 +119,7 @@ push_text_segments(std::vector<DisplayLineSegment>& out,
         if (b <= a) {
             return;
         }
-        std::string piece = text.substr(a - base_col, b - a);
+        const std::string_view piece = text.substr(a - base_col, b - a);
         out.push_back({piece, utf8_len(piece), flags, type, g});
     };
     if (!runs) {
@@ -108,158 +149,158 @@ push_text_segments(std::vector<DisplayLineSegment>& out,
     }
 }
 
-struct DisplayLine {
-    std::vector<DisplayLineSegment> segments;
-    int64_t line_length = 0;
-    int64_t line_number = -1;
-    bool is_word_wrapped = false;
-    EditType type = EditType::Meta;
-    int move_id = 0;  // non-zero => a relocated (moved) line; tint its number (GAP-9)
-};
-
 // Fallback foreground SGR that flags a moved line's number (violet #a371f7),
 // used when a theme leaves `style.moved_line` unset. Layered after the number's
 // own style so it keeps the background but recolours the digits.
-constexpr const char* kMovedNumberFg = "\033[38;2;163;113;247m";
+constexpr std::string_view kMovedNumberFg = "\033[38;2;163;113;247m";
 
-using DisplayColumns = std::vector<std::vector<DisplayLine>>;
-
-std::vector<DisplayLine>
-make_display_line_chopped(const DisplayLine& input_line, int64_t limit) {
+// `input_line`'s segments are read from `source`; the new lines' segments are
+// appended to `pool`.
+void
+make_display_line_chopped(const SegmentPool& source,
+                          const DisplayLine& input_line,
+                          int64_t limit,
+                          SegmentPool& pool,
+                          std::vector<DisplayLine>& out) {
     DisplayLine line;
     line.line_number = input_line.line_number;
     line.type = input_line.type;
     line.move_id = input_line.move_id;
+    line.first_segment = static_cast<uint32_t>(pool.size());
 
     int64_t pos = 0;
-    for (const auto& input_segment : input_line.segments) {
-        DisplayLineSegment segment = input_segment;
+    for (uint32_t i = 0; i < input_line.segment_count; i++) {
+        const DisplayLineSegment& segment = source[input_line.first_segment + i];
         if (pos + segment.text_len >= limit) {
             auto offset = utf8_advance_by(segment.text, 0, limit - pos);
-            // @todo I think we could maybe use string_views instead of substr. Although I don't
-            // think we'd notice much of a speedup.
-            auto partial = segment.text.substr(0, offset);
-            line.segments.push_back({partial, utf8_len(partial), segment.flags, segment.type});
+            const std::string_view partial = segment.text.substr(0, offset);
+            pool.push_back({partial, utf8_len(partial), segment.flags, segment.type});
+            line.segment_count++;
+            line.line_length += utf8_len(partial);
             break;
-        } else {
-            line.segments.push_back(segment);
         }
+        pool.push_back(segment);
+        line.segment_count++;
+        line.line_length += segment.text_len;
         pos += segment.text_len;
     }
 
-    line.line_length = std::accumulate(
-        line.segments.begin(), line.segments.end(), 0U,
-        [](size_t acc, const DisplayLineSegment& segment) { return acc + (size_t) segment.text_len; });
-
-    return {line};
+    out.push_back(line);
 }
 
-std::vector<DisplayLine>
-make_display_line_wrapped(const DisplayLine& input_line, int64_t limit) {
-    std::vector<DisplayLine> lines;
+void
+make_display_line_wrapped(const SegmentPool& source,
+                          const DisplayLine& input_line,
+                          int64_t limit,
+                          SegmentPool& pool,
+                          std::vector<DisplayLine>& out) {
+    [[maybe_unused]] const size_t first_out = out.size();
 
     DisplayLine line;
     line.line_number = input_line.line_number;
     line.type = input_line.type;
     line.move_id = input_line.move_id;
+    line.first_segment = static_cast<uint32_t>(pool.size());
 
-    auto segments = input_line.segments;
-    auto segments_count = segments.size();
+    const size_t segments_count = input_line.segment_count;
+    DisplayLineSegment segment{};
+    bool resume = false;  // `segment` is the unplaced rest of the previous one
     for (size_t seg_idx = 0; seg_idx < segments_count; seg_idx++) {
-        auto& segment = segments[seg_idx];
+        if (!resume) {
+            segment = source[input_line.first_segment + seg_idx];
+        }
+        resume = false;
 
         if (line.line_length + segment.text_len <= limit) {
-            line.segments.push_back(segment);
+            pool.push_back(segment);
+            line.segment_count++;
             line.line_length += segment.text_len;
         } else {
-            DisplayLineSegment partial = {"", 0, segment.flags, segment.type};
+            DisplayLineSegment partial = {{}, 0, segment.flags, segment.type};
             auto fits = limit - line.line_length;
             auto offs = utf8_advance_by(segment.text, 0, fits);
             partial.text = segment.text.substr(0, offs);
             partial.text_len = utf8_len(partial.text);
             assert(partial.text_len > 0);
 
-            line.segments.push_back(partial);
+            pool.push_back(partial);
+            line.segment_count++;
             line.line_length += partial.text_len;
 
             segment.text = segment.text.substr(offs);
             segment.text_len -= partial.text_len;
 
+            resume = true;
             seg_idx--;
         }
 
         assert(line.line_length <= limit);
-        assert(line.segments.size() > 0);
+        assert(line.segment_count > 0);
         if (line.line_length == limit || seg_idx == segments_count - 1) {
-            lines.push_back(line);
+            out.push_back(line);
             line = {};
             line.type = input_line.type;
-        line.move_id = input_line.move_id;
+            line.move_id = input_line.move_id;
             line.is_word_wrapped = true;
+            line.first_segment = static_cast<uint32_t>(pool.size());
         }
     }
 
-    for (auto i = 0u; i < lines.size(); i++) {
-        if (i != 0) {
-            assert(lines[i].line_number == -1);
+    for (auto i = first_out; i < out.size(); i++) {
+        if (i != first_out) {
+            assert(out[i].line_number == -1);
         } else {
-            assert(lines[i].line_number > 0);
+            assert(out[i].line_number > 0);
         }
     }
-
-    return lines;
 }
 
+// Split an edit line into styled segments, appended to `segments`; whitespace
+// markers are built in `arena`.
 DisplayLine
 transform_edit_line(const gsl::span<diffy::Line>& content_strings,
                     const EditLine& edit_line,
                     const ColumnViewState& config,
-                    const std::vector<HighlightRun>* runs) {
+                    const std::vector<HighlightRun>* runs,
+                    TextArena& arena,
+                    SegmentPool& segments) {
     DisplayLine display_line;
     display_line.line_number = static_cast<int>(edit_line.line_index + 1);
     display_line.type = edit_line.type;
     display_line.move_id = edit_line.move_id;
+    display_line.first_segment = static_cast<uint32_t>(segments.size());
 
     for (const auto& segment : edit_line.segments) {
-        std::string text;
+        // Verbatim source text is viewed in place; whitespace markers are built
+        // in the arena.
+        std::string_view text;
         bool plain = false;  // verbatim source text (eligible for syntax splitting)
         if (segment.type != EditType::Common) {
             if (segment.flags & TokenFlagTab) {
-                for (size_t i = 0; i < segment.length; i++)
-                    text += config.chars.tab_replacement;
+                text = arena.repeat(config.chars.tab_replacement, segment.length);
             } else if (segment.flags & TokenFlagCR) {
-                for (size_t i = 0; i < segment.length; i++)
-                    text += config.chars.cr_replacement;
+                text = arena.repeat(config.chars.cr_replacement, segment.length);
             } else if (segment.flags & TokenFlagSpace) {
-                for (size_t i = 0; i < segment.length; i++)
-                    text += config.chars.space_replacement;
+                text = arena.repeat(config.chars.space_replacement, segment.length);
             } else if (segment.flags & TokenFlagLF) {
-                for (size_t i = 0; i < segment.length; i++)
-                    text += config.chars.lf_replacement;
+                text = arena.repeat(config.chars.lf_replacement, segment.length);
             } else if (segment.flags & TokenFlagCRLF) {
-                for (size_t i = 0; i < segment.length / 2; i++)
-                    text += config.chars.crlf_replacement;
+                text = arena.repeat(config.chars.crlf_replacement, segment.length / 2);
             } else {
                 auto idx = static_cast<long>(edit_line.line_index);
-                text = content_strings[idx].line.substr(segment.start, segment.length);
+                text = std::string_view(content_strings[idx].line).substr(segment.start, segment.length);
                 plain = true;
             }
         } else {
             if (segment.flags & TokenFlagTab) {
-                for (size_t i = 0; i < segment.length; i++)
-                    text += std::string(utf8_len(config.chars.tab_replacement), ' ');
+                text = arena.repeat(" ", segment.length * utf8_len(config.chars.tab_replacement));
             } else if (segment.flags & TokenFlagSpace) {
-                for (size_t i = 0; i < segment.length; i++)
-                    text += " ";
-            } else if (segment.flags & TokenFlagCR) {
-                text += "";
-            } else if (segment.flags & TokenFlagLF) {
-                text += "";
-            } else if (segment.flags & TokenFlagCRLF) {
-                text += "";
+                text = arena.repeat(" ", segment.length);
+            } else if (segment.flags & (TokenFlagCR | TokenFlagLF | TokenFlagCRLF)) {
+                text = {};
             } else {
                 auto idx = static_cast<long>(edit_line.line_index);
-                text = content_strings[idx].line.substr(segment.start, segment.length);
+                text = std::string_view(content_strings[idx].line).substr(segment.start, segment.length);
                 plain = true;
             }
         }
@@ -269,10 +310,9 @@ transform_edit_line(const gsl::span<diffy::Line>& content_strings,
         // ones too, so added/deleted code stays syntax-coloured (the token
         // background marks the change). Whitespace markers stay plain (None).
         if (plain && runs) {
-            push_text_segments(display_line.segments, text, segment.start, segment.flags, segment.type,
-                               runs);
+            push_text_segments(segments, text, segment.start, segment.flags, segment.type, runs);
         } else {
-            display_line.segments.push_back({
+            segments.push_back({
                 text,
                 utf8_len(text),
                 segment.flags,
@@ -282,31 +322,49 @@ transform_edit_line(const gsl::span<diffy::Line>& content_strings,
         }
     }
 
-    display_line.line_length = std::accumulate(
-        display_line.segments.begin(), display_line.segments.end(), 0U,
-        [](size_t acc, const DisplayLineSegment& segment) { return acc + (size_t) segment.text_len; });
+    display_line.segment_count = static_cast<uint32_t>(segments.size()) - display_line.first_segment;
+    for (uint32_t i = 0; i < display_line.segment_count; i++) {
+        display_line.line_length += segments[display_line.first_segment + i].text_len;
+    }
 
     return display_line;
 }
 
-std::vector<DisplayLine>
-make_display_lines(const gsl::span<diffy::Line>& content_strings,
-                   const EditLine& line,
-                   const ColumnViewState& config,
-                   const std::vector<HighlightRun>* runs) {
-
-    // TODO: So... this is the one that works on line level...
-    DisplayLine display_line = transform_edit_line(content_strings, line, config, runs);
-
-    if (!config.settings.word_wrap) {
-        return make_display_line_chopped(display_line, config.max_row_length);
-    }
-
-    return make_display_line_wrapped(display_line, config.max_row_length);
+// Split every line of `hunk` into segments (see PreparedHunk). Only the
+// characters and highlights in `config` are used, not its width.
+template <typename Hunk>
+void
+prepare_hunk(const DiffInput<diffy::Line>& diff_input,
+             const Hunk& hunk,
+             const ColumnViewState& config,
+             const LineHighlights* a_highlights,
+             const LineHighlights* b_highlights,
+             TextArena& arena,
+             PreparedHunk& out) {
+    out.from_start = hunk.from_start;
+    out.from_count = hunk.from_count;
+    out.to_start = hunk.to_start;
+    out.to_count = hunk.to_count;
+    out.context = hunk.context;
+    out.segments.clear();
+
+    auto prepare_side = [&](const auto& content_strings, const auto& lines, const LineHighlights* hl,
+                            std::vector<DisplayLine>& side) {
+        side.clear();
+        for (const auto& line : lines) {
+            const std::vector<HighlightRun>* runs = nullptr;
+            if (hl && line.line_index < hl->size() && !(*hl)[line.line_index].empty()) {
+                runs = &(*hl)[line.line_index];
+            }
+            side.push_back(transform_edit_line(content_strings, line, config, runs, arena, out.segments));
+        }
+    };
+    prepare_side(diff_input.A, hunk.a_lines, a_highlights, out.sides[0]);
+    prepare_side(diff_input.B, hunk.b_lines, b_highlights, out.sides[1]);
 }
 
 void
-insert_alignment_rows(DisplayColumns& columns) {
+insert_alignment_rows(DisplayColumns& columns, DisplayColumns& scratch) {
     auto& left = columns[0];
     auto& right = columns[1];
     const DisplayLine empty;
@@ -318,7 +376,10 @@ insert_alignment_rows(DisplayColumns& columns) {
     // inserted at the wrong index and used `ia -= 2` on unsigned counters, which
     // underflowed at the start of a hunk that began with >= 2 deletes and dropped
     // out of the loop with mismatched, misaligned columns.
-    std::vector<DisplayLine> out_left, out_right;
+    std::vector<DisplayLine>& out_left = scratch[0];
+    std::vector<DisplayLine>& out_right = scratch[1];
+    out_left.clear();
+    out_right.clear();
     out_left.reserve(left.size() + right.size());
     out_right.reserve(left.size() + right.size());
 
@@ -349,8 +410,9 @@ insert_alignment_rows(DisplayColumns& columns) {
         }
     }
 
-    left = std::move(out_left);
-    right = std::move(out_right);
+    // The old columns become next hunk's scratch, capacity and all.
+    std::swap(left, out_left);
+    std::swap(right, out_right);
 }
 
 std::string
@@ -407,14 +469,14 @@ color_code_file_permissions(const std::string& delete_style,
     return std::make_tuple(styled_left, styled_right);
 }
 
-std::vector<DisplayColumns>
+// Lay out the file-name header row into `scratch.columns`.
+void
 make_header_columns(const std::string& left_name,
                     const std::optional<std::filesystem::perms> a_permissions,
                     const std::string& right_name,
                     const std::optional<std::filesystem::perms> b_permissions,
-                    const ColumnViewState& config) {
-    std::vector<DisplayLine> col_left;
-    std::vector<DisplayLine> col_right;
+                    const ColumnViewState& config,
+                    RenderScratch& scratch) {
    
     auto shorten = [&](const std::string& s, int trail_reserved = 0) {
         int max_len = config.max_row_length - trail_reserved;
@@ -512,30 +574,31 @@ make_header_columns(const std::string& left_name,
         blen += right_perm_width + num_extra_perm_chars;
     }
 
-    col_left.push_back({DisplayLine{{{config.style.header + a + "\033[0m", alen, 0, EditType::Meta}}, alen}});
-    col_right.push_back({DisplayLine{{{config.style.header + b + "\033[0m", blen, 0, EditType::Meta}}, blen}});
-
-    return {{ col_left, col_right }};
+    auto push_header = [&scratch, &config](std::vector<DisplayLine>& column, const std::string& text,
+                                           int64_t len) {
+        DisplayLine line;
+        line.first_segment = static_cast<uint32_t>(scratch.segments.size());
+        line.segment_count = 1;
+        line.line_length = len;
+        scratch.segments.push_back({scratch.text.copy(config.style.header + text + "\033[0m"), len, 0,
+                                    EditType::Meta, HighlightGroup::None, true});
+        column.push_back(line);
+    };
+    push_header(scratch.columns[0], a, alen);
+    push_header(scratch.columns[1], b, blen);
 }
 
-// Build the display rows for a single hunk: both panes, aligned and padded.
-DisplayColumns
-make_hunk_columns(const DiffInput<diffy::Line>& diff_input,
-                  const AnnotatedHunk& hunk,
-                  const ColumnViewState& config,
-                  const LineHighlights* a_highlights,
-                  const LineHighlights* b_highlights) {
-    auto make_rows = [&config](const auto& content_strings, const auto& lines,
-                               const LineHighlights* hl) {
-        std::vector<DisplayLine> rows;
+// Lay out the display rows for a single prepared hunk into `scratch.columns`
+// (chopped or wrapped to the column width): both panes, aligned and padded.
+void
+make_hunk_columns(const PreparedHunk& hunk, const ColumnViewState& config, RenderScratch& scratch) {
+    auto make_rows = [&config, &scratch, &hunk](const std::vector<DisplayLine>& lines,
+                                                std::vector<DisplayLine>& rows) {
         for (const auto& line : lines) {
-            const std::vector<HighlightRun>* runs = nullptr;
-            if (hl && line.line_index < hl->size() && !(*hl)[line.line_index].empty()) {
-                runs = &(*hl)[line.line_index];
-            }
-            const auto& display_lines = make_display_lines(content_strings, line, config, runs);
-            for (const auto& display_line : display_lines) {
-                rows.push_back(display_line);
+            if (config.settings.word_wrap) {
+                make_display_line_wrapped(hunk.segments, line, config.max_row_length, scratch.segments, rows);
+            } else {
+                make_display_line_chopped(hunk.segments, line, config.max_row_length, scratch.segments, rows);
             }
         }
 
@@ -544,16 +607,13 @@ make_hunk_columns(const DiffInput<diffy::Line>& diff_input,
             // TODO(ja): doesn't work
             rows.push_back(DisplayLine{});
         }
-
-        return rows;
     };
 
-    DisplayColumns columns{
-        make_rows(diff_input.A, hunk.a_lines, a_highlights),
-        make_rows(diff_input.B, hunk.b_lines, b_highlights),
-    };
+    auto& columns = scratch.columns;
+    make_rows(hunk.sides[0], columns[0]);
+    make_rows(hunk.sides[1], columns[1]);
 
-    insert_alignment_rows(columns);
+    insert_alignment_rows(columns, scratch.aligned);
 
     // @cleanup
     auto diff = static_cast<int64_t>(columns[0].size()) - static_cast<int64_t>(columns[1].size());
@@ -569,8 +629,6 @@ make_hunk_columns(const DiffInput<diffy::Line>& diff_input,
     }
 
     assert(columns[0].size() == columns[1].size());
-
-    return columns;
 }
 
 // The base style (background tint) for a whole row of the given edit type.
@@ -592,61 +650,62 @@ line_style(const ColumnViewState& config, EditType type) {
     }
 }
 
-// Transform the segments into a list of display commands, i.e "set color", "write text".
-// Each segment is painted with the line's base style (its background) and, for changed
-// tokens, the token style layered on top — so token highlights sit over the line tint
-// rather than clearing it back to the terminal default.
+// Write a line's segments into `out`. Each segment is painted with the line's
+// base style (its background) and, for changed tokens, the token style layered
+// on top — so token highlights sit over the line tint rather than clearing it
+// back to the terminal default. Every cell's layers go through `sgr`, which
+// writes only what changed since the previous cell.
 void
 render_display_line(const ColumnViewState& config,
-                    std::vector<DisplayCommand>* output,
-                    const DisplayLine& line) {
-    // Compose the layered token styles once per line, not once per segment: the
-    // line's base tint with the token style on top, so highlights sit over the
-    // tint instead of clearing it.
+                    const SegmentPool& segments,
+                    const DisplayLine& line,
+                    SgrWriter& sgr,
+                    std::string& out) {
+    const std::string& background = config.style.background;
     const std::string& base = line_style(config, line.type);
-    const std::string insert_style = base + config.style.insert_token;
-    const std::string delete_style = base + config.style.delete_token;
-    for (const auto& segment : line.segments) {
+    for (uint32_t i = 0; i < line.segment_count; i++) {
+        const DisplayLineSegment& segment = segments[line.first_segment + i];
         // A changed token with a syntax group keeps its token background + bold but
         // takes the syntax foreground (SGR is cumulative, so the trailing fg wins),
         // so added/deleted code reads as syntax-coloured code sitting on the token
         // patch. No syntax group (plain files / highlighting off) => "" => the full
         // token style as before. (UXP-9)
-        const std::string syntax = syntax_fg(segment.syntax, config.settings.light_theme);
+        const std::string& syntax = syntax_fg_escape(segment.syntax, config.settings.light_theme);
         switch (segment.type) {
             case EditType::Insert:
-                output->push_back(DisplayCommand::with_style(insert_style + syntax, segment.text));
+                sgr.set(out, {background, base, config.style.insert_token, syntax});
                 break;
             case EditType::Delete:
-                output->push_back(DisplayCommand::with_style(delete_style + syntax, segment.text));
+                sgr.set(out, {background, base, config.style.delete_token, syntax});
                 break;
             // Common (unchanged) and Meta segments keep the line's own background,
             // with the syntax-highlight foreground layered on top when present.
             // TODO: "Meta" is a hack that doesn't scale; it needs its own DisplayType.
             default:
-                output->push_back(DisplayCommand::with_style(base + syntax, segment.text));
+                sgr.set(out, {background, base, syntax});
                 break;
         }
+        out += segment.text;
+        if (segment.escaped) {
+            sgr.invalidate();
+        }
     }
 }
 
-// Render one left/right row pair into a single styled string.
-std::string
-render_display_line_pair(const DisplayLine& left, const DisplayLine& right, const ColumnViewState& config) {
-    std::vector<DisplayCommand> display_commands;
-
-    // color stack? do we have the line meta data somewhere here to decide if we should
-    // push header_background or content_background?
-
-    // Left side
-    display_commands.push_back(
-        DisplayCommand::with_style(config.style.empty_cell, config.chars.edge_separator));
+// One pane of a row: line number gutter, text, and padding to the column width.
+void
+render_display_line_side(const ColumnViewState& config,
+                         const SegmentPool& segments,
+                         const DisplayLine& line,
+                         SgrWriter& sgr,
+                         std::string& out) {
+    const std::string& background = config.style.background;
     if (config.settings.show_line_numbers) {
         // Fall back to the row's base style (not "") so the number cell still
         // carries a background under an inverted theme when not context-colored.
-        std::string style = line_style(config, left.type);
+        std::string_view style = line_style(config, line.type);
         if (config.settings.context_colored_line_numbers) {
-            switch (left.type) {
+            switch (line.type) {
                 case EditType::Insert:
                     style = config.style.insert_line_number;
                     break;
@@ -663,129 +722,99 @@ render_display_line_pair(const DisplayLine& left, const DisplayLine& right, cons
                     break;
             }
         }
-        if (left.move_id != 0) {
-            // Theme-driven moved accent (style.moved_line); fall back to the
-            // built-in violet when the theme leaves it unset. (GAP-9)
-            style += config.style.moved_line.empty() ? kMovedNumberFg : config.style.moved_line;
+        // Theme-driven moved accent (style.moved_line); fall back to the
+        // built-in violet when the theme leaves it unset. (GAP-9)
+        std::string_view moved;
+        if (line.move_id != 0) {
+            moved = config.style.moved_line.empty() ? kMovedNumberFg : std::string_view(config.style.moved_line);
         }
-        display_commands.push_back(DisplayCommand::with_style(
-            style, format_line_number(left.line_number, config.line_number_digits_count,
-                                      config.settings.line_number_align_right)));
-        display_commands.push_back(DisplayCommand::with_style(config.style.empty_cell, " "));
+        sgr.set(out, {background, style, moved});
+        format_line_number(out, line.line_number, config.line_number_digits_count,
+                           config.settings.line_number_align_right);
+        sgr.set(out, {background, config.style.empty_cell});
+        out += ' ';
     }
 
-    render_display_line(config, &display_commands, left);
-    assert(config.max_row_length >= left.line_length);
+    render_display_line(config, segments, line, sgr, out);
+    assert(config.max_row_length >= line.line_length);
 
     // Pad with the row's own style so a delete/insert highlight spans the full
     // column width, not just the text.
-    display_commands.push_back(DisplayCommand::with_style(
-        line_style(config, left.type), std::string(config.max_row_length - left.line_length, ' ')));
+    sgr.set(out, {background, line_style(config, line.type)});
+    out.append(static_cast<size_t>(config.max_row_length - line.line_length), ' ');
+}
+
+// Render one left/right row pair into `out` (cleared first). The row ends
+// with the terminal back in its default style.
+//
+// A single base background (style.background), painted under every cell, lets
+// a fully inverted theme be expressed with one key; per-cell styles layer on
+// top. Empty when unset, so default (fg-only) themes emit no escapes at all.
+void
+render_display_line_pair(const DisplayLine& left,
+                         const DisplayLine& right,
+                         const ColumnViewState& config,
+                         const SegmentPool& segments,
+                         SgrWriter& sgr,
+                         std::string& out) {
+    const std::string& background = config.style.background;
+    out.clear();
+
+    sgr.set(out, {background, config.style.empty_cell});
+    out += config.chars.edge_separator;
+    render_display_line_side(config, segments, left, sgr, out);
 
     // Middle
     if (config.settings.context_colored_line_numbers) {
-        display_commands.push_back(
-            DisplayCommand::with_style(config.style.frame, config.chars.column_separator));
+        sgr.set(out, {background, config.style.frame});
     } else {
-        display_commands.push_back(
-            DisplayCommand::with_style(config.style.empty_cell, config.chars.column_separator));
-    }
-
-    // Right side
-
-    if (config.settings.show_line_numbers) {
-        // Fall back to the row's base style (not "") so the number cell still
-        // carries a background under an inverted theme when not context-colored.
-        std::string style = line_style(config, right.type);
-        if (config.settings.context_colored_line_numbers) {
-            switch (right.type) {
-                case EditType::Insert:
-                    style = config.style.insert_line_number;
-                    break;
-                case EditType::Delete:
-                    style = config.style.delete_line_number;
-                    break;
-                case EditType::Common:
-                    style = config.style.common_line_number;
-                    break;
-                case EditType::Meta:
-                    style = config.style.empty_cell;
-                    break;
-                default:
-                    break;
-            }
-        }
-        if (right.move_id != 0) {
-            // Theme-driven moved accent (style.moved_line); fall back to the
-            // built-in violet when the theme leaves it unset. (GAP-9)
-            style += config.style.moved_line.empty() ? kMovedNumberFg : config.style.moved_line;
-        }
-        display_commands.push_back(DisplayCommand::with_style(
-            style, format_line_number(right.line_number, config.line_number_digits_count,
-                                      config.settings.line_number_align_right)));
-        display_commands.push_back(DisplayCommand::with_style(config.style.empty_cell, " "));
+        sgr.set(out, {background, config.style.empty_cell});
     }
+    out += config.chars.column_separator;
 
-    render_display_line(config, &display_commands, right);
-    assert(config.max_row_length >= right.line_length);
-
-    // Pad with the row's own style so a delete/insert highlight spans the full
-    // column width, not just the text.
-    display_commands.push_back(DisplayCommand::with_style(
-        line_style(config, right.type), std::string(config.max_row_length - right.line_length, ' ')));
-
-    display_commands.push_back(
-        DisplayCommand::with_style(config.style.empty_cell, config.chars.edge_separator));
-
-    // A single base background, painted under every cell, lets a fully inverted
-    // theme be expressed with one key; per-cell styles layer on top. Empty when
-    // unset, so default (fg-only) themes stay byte-identical.
-    const std::string& background = config.style.background;
-
-    std::string full;
-    for (const auto& command : display_commands) {
-        if (command.style.empty() && background.empty()) {
-            full += command.text;
-        } else {
-            full += background;
-            full += command.style;
-            full += command.text;
-            full += "\033[0m";
-        }
-    }
-    return full;
+    render_display_line_side(config, segments, right, sgr, out);
+    sgr.set(out, {background, config.style.empty_cell});
+    out += config.chars.edge_separator;
+    sgr.reset(out);
 }
 
-// Render every visual row of one DisplayColumns, handing each to `emit`.
+// Render every visual row of the laid-out columns, handing each to `emit`.
 template <typename Emit>
 void
-emit_columns(const DisplayColumns& columns, const ColumnViewState& config, Emit& emit) {
-    const auto& left = columns[0];
-    const auto& right = columns[1];
+emit_columns(RenderScratch& scratch, const ColumnViewState& config, Emit& emit) {
+    const auto& left = scratch.columns[0];
+    const auto& right = scratch.columns[1];
     auto max_idx = std::max(left.size(), right.size());
     for (size_t idx = 0; idx < max_idx; idx++) {
-        emit(render_display_line_pair(left[idx], right[idx], config));
-    }
-    // Empty line between hunks.
-    // TODO(ja): doesn't work
-    if (columns.empty()) {
-        DisplayLine dl;
-        emit(render_display_line_pair(dl, dl, config));
+        render_display_line_pair(left[idx], right[idx], config, scratch.segments, scratch.sgr, scratch.row);
+        emit(scratch.row);
     }
 }
 
-// Render the column view one hunk at a time, handing each row to `emit`. Peak
-// memory stays bounded to a single hunk rather than the whole diff.
-template <typename Emit>
+// Hunk source over an already annotated diff; the streaming renderer's other
+// source is LazyAnnotatedHunks, which annotates on get() and frees on release().
+struct EagerHunks {
+    const std::vector<AnnotatedHunk>& hunks;
+
+    std::size_t size() const {
+        return hunks.size();
+    }
+    const AnnotatedHunk& hunk(std::size_t i) const {
+        return hunks[i];
+    }
+    const AnnotatedHunk& get(std::size_t i) const {
+        return hunks[i];
+    }
+    void release(std::size_t) const {
+    }
+};
+
+// Size the panes for `width`: the frame and line-number gutters come off the
+// top, the rest is split between the two sides. `last_hunk` (null when there
+// are no hunks) decides how many digits the line numbers need.
+template <typename Hunk>
 void
-column_view_render_streaming(const DiffInput<diffy::Line>& diff_input,
-                             const std::vector<AnnotatedHunk>& hunks,
-                             ColumnViewState& config,
-                             const ProgramOptions& options,
-                             int64_t width,
-                             const LineHighlights* a_highlights,
-                             const LineHighlights* b_highlights,
-                             Emit emit) {
+set_row_width(ColumnViewState& config, const Hunk* last_hunk, int64_t width) {
     int64_t frame_characters = 0;
     if (!config.chars.column_separator.empty()) {
         frame_characters += utf8_len(config.chars.column_separator);
@@ -796,10 +825,9 @@ column_view_render_streaming(const DiffInput<diffy::Line>& diff_input,
 
     int64_t line_number_digits = 4;
     int64_t line_number_digits_padding = 0;
-    if (config.settings.show_line_numbers && hunks.size() > 0) {
-        auto& last_hunk = *(hunks.end() - 1);
-        int64_t line_number_max =
-            std::max(last_hunk.from_start + last_hunk.from_count, last_hunk.to_start + last_hunk.to_count);
+    if (config.settings.show_line_numbers && last_hunk) {
+        int64_t line_number_max = std::max(last_hunk->from_start + last_hunk->from_count,
+                                           last_hunk->to_start + last_hunk->to_count);
         int64_t line_number_max_digits = fmt::format("{}", line_number_max + 1).size();
         line_number_digits = line_number_max_digits;
         line_number_digits_padding = 2;
@@ -815,50 +843,311 @@ column_view_render_streaming(const DiffInput<diffy::Line>& diff_input,
     config.max_row_length = (width - extra_layout_characters) / 2;
     if (config.max_row_length < 5)
         config.max_row_length = 5;
+}
+
+// git-style hunk header, shown as a full-width line above the hunk and
+// mirroring the unified output: the line range, plus —
+// when a caller ran tree-sitter scope analysis — the enclosing definition
+// (e.g. the function the hunk is inside). Painted full-width with the theme
+// background so a light theme doesn't leave a ragged black tail past it.
+template <typename Hunk>
+void
+render_hunk_header(const Hunk& hunk, const ColumnViewState& config, std::string& row) {
+    const int64_t gutter = config.settings.show_line_numbers ? (config.line_number_digits_count + 1) : 0;
+    const int64_t row_width = 2 * config.max_row_length + 2 * gutter + utf8_len(config.chars.column_separator) +
+                              2 * utf8_len(config.chars.edge_separator);
+    // Git-style range, matching the unified output's @@ header exactly (a
+    // single number when the count is 1, else "start,count").
+    auto fmt_change = [](int64_t start, int64_t count) {
+        return count == 1 ? fmt::format("{}", start) : fmt::format("{},{}", start, count);
+    };
+    std::string label = fmt::format("@@ -{} +{} @@", fmt_change(hunk.from_start, hunk.from_count),
+                                    fmt_change(hunk.to_start, hunk.to_count));
+    if (!hunk.context.empty()) {
+        label += " " + hunk.context;
+    }
+    const int64_t avail = row_width > 0 ? row_width : 0;
+    if (static_cast<int64_t>(utf8_len(label)) > avail) {
+        label = label.substr(0, utf8_advance_by(label, 0, static_cast<size_t>(avail)));
+    }
+    const int64_t pad = row_width - static_cast<int64_t>(utf8_len(label));
+    row.clear();
+    row += config.style.background;
+    row += config.style.frame;
+    row += label;
+    if (pad > 0) {
+        row.append(static_cast<size_t>(pad), ' ');
+    }
+    row += "\033[0m";
+}
+
+// Lay out and emit a prepared hunk: its @@ header, then its rows at the current
+// column width.
+template <typename Emit>
+void
+emit_hunk(const PreparedHunk& hunk, const ColumnViewState& config, RenderScratch& scratch, Emit& emit) {
+    render_hunk_header(hunk, config, scratch.row);
+    emit(scratch.row);
+    scratch.reset();
+    make_hunk_columns(hunk, config, scratch);
+    emit_columns(scratch, config, emit);
+}
+
+// Lines (old plus new) of hunks laid out together on one worker when a diff is
+// big enough to render in parallel.
+constexpr std::size_t kParallelBatchLines = 2048;
+
+// Render the column view one hunk at a time, handing each row to `emit`. Peak
+// memory stays bounded to a single hunk rather than the whole diff; with a lazy
+// source the hunk is also annotated just before and released right after.
+//
+// A diff of more than one batch of hunks is annotated and laid out on worker
+// threads instead, each batch into rows of its own, which are emitted strictly
+// in order; then it's the batches ahead of the slowest one that are held. Not
+// when this already runs on a worker (one file of a directory diff).
+template <typename Source, typename Emit>
+void
+column_view_render_streaming(const DiffInput<diffy::Line>& diff_input,
+                             Source& hunks,
+                             ColumnViewState& config,
+                             const ProgramOptions& options,
+                             int64_t width,
+                             const LineHighlights* a_highlights,
+                             const LineHighlights* b_highlights,
+                             Emit emit) {
+    DIFFY_TRACE_SCOPE("render.column");
+    set_row_width(config, hunks.size() > 0 ? &hunks.hunk(hunks.size() - 1) : nullptr, width);
 
     // Header first, then each hunk built, emitted, and freed before the next.
-    for (const auto& column :
-         make_header_columns(diff_input.A_name, options.left_file_permissions, diff_input.B_name,
-                             options.right_file_permissions, config)) {
-        emit_columns(column, config, emit);
-    }
-
-    for (const auto& hunk : hunks) {
-        // git-style hunk header, shown as a full-width line above the hunk and
-        // mirroring the unified output: the line range, plus —
-        // when a caller ran tree-sitter scope analysis — the enclosing definition
-        // (e.g. the function the hunk is inside). Painted full-width with the theme
-        // background so a light theme doesn't leave a ragged black tail past it.
-        {
-            const int64_t gutter =
-                config.settings.show_line_numbers ? (config.line_number_digits_count + 1) : 0;
-            const int64_t row_width = 2 * config.max_row_length + 2 * gutter +
-                                      utf8_len(config.chars.column_separator) +
-                                      2 * utf8_len(config.chars.edge_separator);
-            // Git-style range, matching the unified output's @@ header exactly (a
-            // single number when the count is 1, else "start,count").
-            auto fmt_change = [](int64_t start, int64_t count) {
-                return count == 1 ? fmt::format("{}", start) : fmt::format("{},{}", start, count);
-            };
-            std::string label = fmt::format("@@ -{} +{} @@", fmt_change(hunk.from_start, hunk.from_count),
-                                            fmt_change(hunk.to_start, hunk.to_count));
-            if (!hunk.context.empty()) {
-                label += " " + hunk.context;
+    // Every row is laid out in and rendered from the same scratch, so after the
+    // first few hunks the renderer stops allocating.
+    RenderScratch scratch;
+    make_header_columns(diff_input.A_name, options.left_file_permissions, diff_input.B_name,
+                        options.right_file_permissions, config, scratch);
+    emit_columns(scratch, config, emit);
+
+    auto render_hunk = [&](std::size_t hunk_index, RenderScratch& into, auto& out) {
+        into.text.reset();
+        prepare_hunk(diff_input, hunks.get(hunk_index), config, a_highlights, b_highlights, into.text,
+                     into.prepared);
+        hunks.release(hunk_index);
+        emit_hunk(into.prepared, config, into, out);
+    };
+
+    const std::vector<std::size_t> batches = parallel_batches(
+        hunks.size(),
+        [&](std::size_t i) {
+            const auto& hunk = hunks.hunk(i);
+            return static_cast<std::size_t>(hunk.from_count + hunk.to_count);
+        },
+        kParallelBatchLines);
+    if (batches.size() <= 2 || on_parallel_worker) {
+        for (std::size_t hunk_index = 0; hunk_index < hunks.size(); hunk_index++) {
+            render_hunk(hunk_index, scratch, emit);
+        }
+        return;
+    }
+
+    parallel_for_ordered(
+        batches.size() - 1,
+        [&](std::size_t b) {
+            std::vector<std::string> rows;
+            RenderScratch batch_scratch;
+            auto collect = [&rows](const std::string& row) { rows.push_back(row); };
+            for (std::size_t i = batches[b]; i < batches[b + 1]; i++) {
+                render_hunk(i, batch_scratch, collect);
             }
-            const int64_t avail = row_width > 0 ? row_width : 0;
-            if (static_cast<int64_t>(utf8_len(label)) > avail) {
-                label = label.substr(0, utf8_advance_by(label, 0, static_cast<size_t>(avail)));
+            return rows;
+        },
+        [&](std::size_t, std::vector<std::string> rows) {
+            for (const auto& row : rows) {
+                emit(row);
             }
-            const int64_t pad = row_width - static_cast<int64_t>(utf8_len(label));
-            emit(config.style.background + config.style.frame + label +
-                 (pad > 0 ? std::string(static_cast<size_t>(pad), ' ') : std::string()) + "\033[0m");
-        }
-        emit_columns(make_hunk_columns(diff_input, hunk, config, a_highlights, b_highlights), config,
-                     emit);
+        });
+}
+
+template <typename Source>
+void
+prepare_all(const DiffInput<diffy::Line>& diff_input,
+            Source& hunks,
+            const ColumnViewState& config,
+            const LineHighlights* a_highlights,
+            const LineHighlights* b_highlights,
+            TextArena& arena,
+            std::vector<PreparedHunk>& out) {
+    DIFFY_TRACE_SCOPE("render.column.prepare");
+    out.resize(hunks.size());
+    for (std::size_t i = 0; i < hunks.size(); i++) {
+        prepare_hunk(diff_input, hunks.get(i), config, a_highlights, b_highlights, arena, out[i]);
+        hunks.release(i);
     }
 }
 }  // namespace
 
+struct diffy::ColumnViewLayout::Prepared {
+    ColumnViewState config;
+    std::string a_name;
+    std::string b_name;
+    std::optional<std::filesystem::perms> a_permissions;
+    std::optional<std::filesystem::perms> b_permissions;
+    TextArena text;  // whitespace markers of every hunk
+    std::vector<PreparedHunk> hunks;
+    RenderScratch scratch;
+
+    Prepared(const DiffInput<diffy::Line>& diff_input,
+             const ColumnViewState& config_,
+             const diffy::ProgramOptions& options)
+        : config(config_)
+        , a_name(diff_input.A_name)
+        , b_name(diff_input.B_name)
+        , a_permissions(options.left_file_permissions)
+        , b_permissions(options.right_file_permissions) {
+    }
+};
+
+diffy::ColumnViewLayout::ColumnViewLayout(const DiffInput<diffy::Line>& diff_input,
+                                          const std::vector<AnnotatedHunk>& hunks,
+                                          const ColumnViewState& config,
+                                          const diffy::ProgramOptions& options,
+                                          const LineHighlights* a_highlights,
+                                          const LineHighlights* b_highlights)
+    : prepared_(std::make_unique<Prepared>(diff_input, config, options)) {
+    EagerHunks source{hunks};
+    prepare_all(diff_input, source, prepared_->config, a_highlights, b_highlights, prepared_->text,
+                prepared_->hunks);
+}
+
+diffy::ColumnViewLayout::ColumnViewLayout(const DiffInput<diffy::Line>& diff_input,
+                                          LazyAnnotatedHunks& hunks,
+                                          const ColumnViewState& config,
+                                          const diffy::ProgramOptions& options,
+                                          const LineHighlights* a_highlights,
+                                          const LineHighlights* b_highlights)
+    : prepared_(std::make_unique<Prepared>(diff_input, config, options)) {
+    prepare_all(diff_input, hunks, prepared_->config, a_highlights, b_highlights, prepared_->text,
+                prepared_->hunks);
+}
+
+diffy::ColumnViewLayout::~ColumnViewLayout() = default;
+diffy::ColumnViewLayout::ColumnViewLayout(ColumnViewLayout&&) noexcept = default;
+diffy::ColumnViewLayout&
+diffy::ColumnViewLayout::operator=(ColumnViewLayout&&) noexcept = default;
+
+void
+diffy::ColumnViewLayout::render(int64_t width, const std::function<void(const std::string&)>& emit) {
+    DIFFY_TRACE_SCOPE("render.column.layout");
+    Prepared& p = *prepared_;
+    ColumnViewState& config = p.config;
+    RenderScratch& scratch = p.scratch;
+    set_row_width(config, p.hunks.empty() ? nullptr : &p.hunks.back(), width);
+
+    scratch.text.reset();
+    scratch.reset();
+    make_header_columns(p.a_name, p.a_permissions, p.b_name, p.b_permissions, config, scratch);
+    emit_columns(scratch, config, emit);
+    for (const auto& hunk : p.hunks) {
+        emit_hunk(hunk, config, scratch, emit);
+    }
+}
+
+std::vector<std::string>
+diffy::ColumnViewLayout::render_lines(int64_t width) {
+    std::vector<std::string> out;
+    render(width, [&out](const std::string& line) { out.push_back(line); });
+    return out;
+}
+
+struct diffy::LazyColumnView::State {
+    const DiffInput<diffy::Line>& diff_input;
+    LazyAnnotatedHunks& hunks;
+    const LineHighlights* a_highlights;
+    const LineHighlights* b_highlights;
+    ColumnViewState config;
+    std::optional<std::filesystem::perms> a_permissions;
+    std::optional<std::filesystem::perms> b_permissions;
+    TextArena text;  // whitespace markers of the split hunks
+    std::vector<std::unique_ptr<PreparedHunk>> prepared;
+    std::vector<std::optional<std::vector<std::string>>> rows;  // per block, at the current width
+    RenderScratch scratch;
+
+    State(const DiffInput<diffy::Line>& diff_input_,
+          LazyAnnotatedHunks& hunks_,
+          const ColumnViewState& config_,
+          const diffy::ProgramOptions& options,
+          const LineHighlights* a_highlights_,
+          const LineHighlights* b_highlights_)
+        : diff_input(diff_input_)
+        , hunks(hunks_)
+        , a_highlights(a_highlights_)
+        , b_highlights(b_highlights_)
+        , config(config_)
+        , a_permissions(options.left_file_permissions)
+        , b_permissions(options.right_file_permissions)
+        , prepared(hunks_.size())
+        , rows(hunks_.size() + 1) {
+    }
+};
+
+diffy::LazyColumnView::LazyColumnView(const DiffInput<diffy::Line>& diff_input,
+                                      LazyAnnotatedHunks& hunks,
+                                      const ColumnViewState& config,
+                                      const diffy::ProgramOptions& options,
+                                      const LineHighlights* a_highlights,
+                                      const LineHighlights* b_highlights)
+    : state_(std::make_unique<State>(diff_input, hunks, config, options, a_highlights, b_highlights)) {
+    set_width(80);
+}
+
+diffy::LazyColumnView::~LazyColumnView() = default;
+diffy::LazyColumnView::LazyColumnView(LazyColumnView&&) noexcept = default;
+diffy::LazyColumnView&
+diffy::LazyColumnView::operator=(LazyColumnView&&) noexcept = default;
+
+void
+diffy::LazyColumnView::set_width(int64_t width) {
+    State& s = *state_;
+    set_row_width(s.config, s.hunks.size() > 0 ? &s.hunks.hunk(s.hunks.size() - 1) : nullptr, width);
+    for (auto& rows : s.rows) {
+        rows.reset();
+    }
+}
+
+std::size_t
+diffy::LazyColumnView::block_count() const {
+    return state_->rows.size();
+}
+
+const std::vector<std::string>&
+diffy::LazyColumnView::block(std::size_t i) {
+    State& s = *state_;
+    auto& rows = s.rows[i];
+    if (rows) {
+        return *rows;
+    }
+    rows.emplace();
+    auto emit = [&rows](const std::string& line) { rows->push_back(line); };
+    RenderScratch& scratch = s.scratch;
+    scratch.reset();
+    if (i == 0) {
+        scratch.text.reset();
+        make_header_columns(s.diff_input.A_name, s.a_permissions, s.diff_input.B_name, s.b_permissions, s.config,
+                            scratch);
+        emit_columns(scratch, s.config, emit);
+        return *rows;
+    }
+
+    auto& prepared = s.prepared[i - 1];
+    if (!prepared) {
+        DIFFY_TRACE_SCOPE("render.column.prepare");
+        prepared = std::make_unique<PreparedHunk>();
+        prepare_hunk(s.diff_input, s.hunks.get(i - 1), s.config, s.a_highlights, s.b_highlights, s.text,
+                     *prepared);
+        s.hunks.release(i - 1);
+    }
+    emit_hunk(*prepared, s.config, scratch, emit);
+    return *rows;
+}
+
 std::vector<std::string>
 diffy::column_view_render_lines(const DiffInput<diffy::Line>& diff_input,
                                 const std::vector<AnnotatedHunk>& hunks,
@@ -868,7 +1157,48 @@ diffy::column_view_render_lines(const DiffInput<diffy::Line>& diff_input,
                                 const LineHighlights* a_highlights,
                                 const LineHighlights* b_highlights) {
     std::vector<std::string> out;
+    EagerHunks source{hunks};
+    column_view_render_streaming(diff_input, source, config, options, width, a_highlights, b_highlights,
+                                 [&out](const std::string& line) { out.push_back(line); });
+    return out;
+}
+
+std::vector<std::string>
+diffy::column_view_render_lines(const DiffInput<diffy::Line>& diff_input,
+                                LazyAnnotatedHunks& hunks,
+                                ColumnViewState& config,
+                                const diffy::ProgramOptions& options,
+                                int64_t width,
+                                const LineHighlights* a_highlights,
+                                const LineHighlights* b_highlights) {
+    std::vector<std::string> out;
     column_view_render_streaming(diff_input, hunks, config, options, width, a_highlights, b_highlights,
-                                 [&out](std::string line) { out.push_back(std::move(line)); });
+                                 [&out](const std::string& line) { out.push_back(line); });
     return out;
 }
+
+void
+diffy::column_view_render_each(const DiffInput<diffy::Line>& diff_input,
+                               LazyAnnotatedHunks& hunks,
+                               ColumnViewState& config,
+                               const diffy::ProgramOptions& options,
+                               int64_t width,
+                               const LineHighlights* a_highlights,
+                               const LineHighlights* b_highlights,
+                               const std::function<void(std::string)>& emit) {
+    column_view_render_streaming(diff_input, hunks, config, options, width, a_highlights, b_highlights,
+                                 [&emit](const std::string& line) { emit(line); });
+}
+
+void
+diffy::column_view_render(OutputSink& out,
+                          const DiffInput<diffy::Line>& diff_input,
+                          LazyAnnotatedHunks& hunks,
+                          ColumnViewState& config,
+                          const diffy::ProgramOptions& options,
+                          int64_t width,
+                          const LineHighlights* a_highlights,
+                          const LineHighlights* b_highlights) {
+    column_view_render_streaming(diff_input, hunks, config, options, width, a_highlights, b_highlights,
+                                 [&out](const std::string& line) { out.row(line); });
+}
@@ -2,11 +2,14 @@
 
 #include "algorithms/algorithm.hpp"
 #include "config/config.hpp"
+#include "output/output_sink.hpp"
 #include "highlight/syntax_highlighter.hpp"
 #include "processing/diff_hunk.hpp"
 #include "processing/diff_hunk_annotate.hpp"
 #include "util/readlines.hpp"
 
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -37,4 +40,119 @@ column_view_render_lines(const DiffInput<diffy::Line>& diff_input,
                          const LineHighlights* a_highlights = nullptr,
                          const LineHighlights* b_highlights = nullptr);
 
+// As above, annotating each hunk only when it is rendered and releasing it after.
+std::vector<std::string>
+column_view_render_lines(const DiffInput<diffy::Line>& diff_input,
+                         LazyAnnotatedHunks& hunks,
+                         ColumnViewState& config,
+                         const diffy::ProgramOptions& options,
+                         int64_t width,
+                         const LineHighlights* a_highlights = nullptr,
+                         const LineHighlights* b_highlights = nullptr);
+
+// Streaming variant: hand each row to `emit` as soon as it is rendered, so at most
+// one annotated hunk is alive at a time.
+void
+column_view_render_each(const DiffInput<diffy::Line>& diff_input,
+                        LazyAnnotatedHunks& hunks,
+                        ColumnViewState& config,
+                        const diffy::ProgramOptions& options,
+                        int64_t width,
+                        const LineHighlights* a_highlights,
+                        const LineHighlights* b_highlights,
+                        const std::function<void(std::string)>& emit);
+
+// Streaming into a sink: each row is written newline-terminated as it's rendered.
+void
+column_view_render(OutputSink& out,
+                   const DiffInput<diffy::Line>& diff_input,
+                   LazyAnnotatedHunks& hunks,
+                   ColumnViewState& config,
+                   const diffy::ProgramOptions& options,
+                   int64_t width,
+                   const LineHighlights* a_highlights = nullptr,
+                   const LineHighlights* b_highlights = nullptr);
+
+// The column view split once into styled segments and rendered at any width.
+// Construction does the width-independent work: splitting every line at its
+// token and syntax-highlight boundaries and measuring each piece. render() only
+// wraps or chops those pieces to the columns, aligns the panes and writes the
+// rows — the same rows column_view_render_lines gives at that width — so a
+// frontend can re-render on every resize without re-running the rest.
+//
+// The segments view the lines of `diff_input`, which must outlive the layout.
+// The highlights are only read during construction.
+class ColumnViewLayout {
+   public:
+    ColumnViewLayout(const DiffInput<diffy::Line>& diff_input,
+                     const std::vector<AnnotatedHunk>& hunks,
+                     const ColumnViewState& config,
+                     const diffy::ProgramOptions& options,
+                     const LineHighlights* a_highlights = nullptr,
+                     const LineHighlights* b_highlights = nullptr);
+
+    // Each hunk is annotated, split, and released in turn.
+    ColumnViewLayout(const DiffInput<diffy::Line>& diff_input,
+                     LazyAnnotatedHunks& hunks,
+                     const ColumnViewState& config,
+                     const diffy::ProgramOptions& options,
+                     const LineHighlights* a_highlights = nullptr,
+                     const LineHighlights* b_highlights = nullptr);
+
+    ~ColumnViewLayout();
+    ColumnViewLayout(ColumnViewLayout&&) noexcept;
+    ColumnViewLayout&
+    operator=(ColumnViewLayout&&) noexcept;
+
+    void
+    render(int64_t width, const std::function<void(const std::string&)>& emit);
+
+    std::vector<std::string>
+    render_lines(int64_t width);
+
+   private:
+    struct Prepared;
+    std::unique_ptr<Prepared> prepared_;
+};
+
+// The column view rendered one block at a time, for a frontend that shows only
+// part of it (the CLI pager). Block 0 is the file-name header and block i + 1
+// is hunk i: its @@ row followed by its rows. A hunk is annotated, split and
+// released the first time a row of it is asked for, and its rows at the
+// current width are kept until the width changes, so the cost of showing a
+// screen depends on the hunks on it rather than on the size of the diff.
+//
+// `diff_input`, `hunks` and the highlights are used while rendering and must
+// outlive the view.
+class LazyColumnView {
+   public:
+    LazyColumnView(const DiffInput<diffy::Line>& diff_input,
+                   LazyAnnotatedHunks& hunks,
+                   const ColumnViewState& config,
+                   const diffy::ProgramOptions& options,
+                   const LineHighlights* a_highlights = nullptr,
+                   const LineHighlights* b_highlights = nullptr);
+
+    ~LazyColumnView();
+    LazyColumnView(LazyColumnView&&) noexcept;
+    LazyColumnView&
+    operator=(LazyColumnView&&) noexcept;
+
+    // Lay out at `width` columns from now on. Rows rendered at another width
+    // are dropped; the split hunks are kept.
+    void
+    set_width(int64_t width);
+
+    std::size_t
+    block_count() const;
+
+    // The rows of block `i` at the current width.
+    const std::vector<std::string>&
+    block(std::size_t i);
+
+   private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
 }  // namespace diffy
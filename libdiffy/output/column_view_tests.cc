@@ -137,3 +137,110 @@ TEST_CASE("column_view_render_lines — narrow width is clamped and does not cra
         if (l.rfind("@@ ", 0) != 0)
             CHECK(l.find("│") != std::string::npos);
 }
+
+TEST_CASE("ColumnViewLayout — re-renders at any width the same as a fresh render") {
+    std::vector<std::string> a, b;
+    for (int i = 0; i < 30; i++) {
+        const std::string n = std::to_string(i);
+        a.push_back("\tline " + n + " with some words to wrap across the narrow panes");
+        b.push_back(i % 7 == 3 ? "\tline " + n + " with OTHER words  to wrap, öäå, and then some"
+                               : a.back());
+    }
+    auto A = mk(a);
+    auto B = mk(b);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "LEFTNAME", "RIGHTNAME"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+    auto annotated = annotate_hunks(in, hunks, EditGranularity::Token, false);
+    ProgramOptions options;
+
+    for (bool wrap : {true, false}) {
+        CAPTURE(wrap);
+        ColumnViewState config;
+        config.settings.word_wrap = wrap;
+        config.settings.show_line_numbers = true;
+        ColumnViewLayout layout(in, annotated, config, options);
+        LazyAnnotatedHunks lazy(in, hunks, EditGranularity::Token, false);
+        ColumnViewLayout lazy_layout(in, lazy, config, options);
+        for (int64_t width : {80, 41, 133, 20, 80}) {
+            CAPTURE(width);
+            ColumnViewState fresh = config;
+            const auto want = column_view_render_lines(in, annotated, fresh, options, width);
+            CHECK(layout.render_lines(width) == want);
+            CHECK(lazy_layout.render_lines(width) == want);
+        }
+    }
+}
+
+TEST_CASE("LazyColumnView — blocks join up to the full render, annotating only what was asked for") {
+    std::vector<std::string> a, b;
+    for (int i = 0; i < 200; i++) {
+        a.push_back("line " + std::to_string(i) + " of the old file, long enough to wrap at forty");
+        b.push_back(i % 20 == 5 ? "line " + std::to_string(i) + " CHANGED" : a.back());
+    }
+    auto A = mk(a);
+    auto B = mk(b);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "LEFTNAME", "RIGHTNAME"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+    REQUIRE(hunks.size() == 10);
+    auto annotated = annotate_hunks(in, hunks, EditGranularity::Token, false);
+    ProgramOptions options;
+    ColumnViewState config;
+    config.settings.word_wrap = true;
+
+    LazyAnnotatedHunks lazy(in, hunks, EditGranularity::Token, false);
+    LazyColumnView view(in, lazy, config, options);
+    REQUIRE(view.block_count() == hunks.size() + 1);
+    view.set_width(60);
+    CHECK(view.block(4).size() > 1);
+    CHECK(lazy.annotated_count() == 1);
+
+    for (int64_t width : {60, 40, 120}) {
+        CAPTURE(width);
+        view.set_width(width);
+        std::vector<std::string> joined;
+        for (std::size_t i = 0; i < view.block_count(); i++) {
+            const auto& rows = view.block(i);
+            joined.insert(joined.end(), rows.begin(), rows.end());
+        }
+        ColumnViewState fresh = config;
+        CHECK(joined == column_view_render_lines(in, annotated, fresh, options, width));
+    }
+    // Each hunk was split once; later widths only re-wrapped it.
+    CHECK(lazy.annotated_count() == hunks.size());
+}
+
+TEST_CASE("column_view_render_lines — a diff rendered in parallel batches matches the serial render") {
+    // Enough changed hunks to make several batches of work.
+    std::vector<std::string> a, b;
+    for (int i = 0; i < 4000; i++) {
+        a.push_back("line " + std::to_string(i) + " of the old file, long enough to wrap at forty");
+        b.push_back(i % 10 == 5 ? "line " + std::to_string(i) + " CHANGED" : a.back());
+    }
+    auto A = mk(a);
+    auto B = mk(b);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "LEFTNAME", "RIGHTNAME"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+    REQUIRE(hunks.size() == 400);
+    ProgramOptions options;
+    ColumnViewState config;
+    config.settings.word_wrap = true;
+    config.settings.show_line_numbers = true;
+
+    // LazyColumnView lays out one hunk per block, on the calling thread.
+    LazyAnnotatedHunks blocks_source(in, hunks, EditGranularity::Token, false);
+    LazyColumnView view(in, blocks_source, config, options);
+    view.set_width(60);
+    std::vector<std::string> serial;
+    for (std::size_t i = 0; i < view.block_count(); i++) {
+        const auto& rows = view.block(i);
+        serial.insert(serial.end(), rows.begin(), rows.end());
+    }
+
+    LazyAnnotatedHunks lazy(in, hunks, EditGranularity::Token, false);
+    ColumnViewState fresh = config;
+    CHECK(column_view_render_lines(in, lazy, fresh, options, 60) == serial);
+    CHECK(lazy.annotated_count() == hunks.size());
+}
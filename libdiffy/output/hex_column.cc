@@ -1,6 +1,7 @@
 #include "output/hex_column.hpp"
 
 #include "output/hex_common.hpp"
+#include "output/hex_rows.hpp"
 
 #include <algorithm>
 
@@ -10,16 +11,6 @@ using namespace diffy;
 
 namespace {
 
-struct Cell {
-    bool has_a = false;
-    bool has_b = false;
-    uint8_t a = 0;
-    uint8_t b = 0;
-    uint64_t a_off = 0;
-    uint64_t b_off = 0;
-    HexSegKind kind = HexSegKind::Equal;
-};
-
 struct Styles {
     bool color = false;
     std::string reset;
@@ -31,10 +22,10 @@ struct Styles {
 
 // Build one pane (left = A side, right = B side) for a row of cells.
 std::string
-build_pane(const std::vector<Cell>& row, bool left, int bpr, int width, const Styles& s) {
+build_pane(gsl::span<const HexCell> row, bool left, int bpr, int width, const Styles& s) {
     std::string offstr(static_cast<size_t>(width), ' ');
     bool have_off = false;
-    for (const Cell& c : row) {
+    for (const HexCell& c : row) {
         const bool present = left ? c.has_a : c.has_b;
         if (present) {
             offstr = hex_offset(left ? c.a_off : c.b_off, width);
@@ -53,7 +44,7 @@ build_pane(const std::vector<Cell>& row, bool left, int bpr, int width, const St
             ascii += ' ';
             continue;
         }
-        const Cell& c = row[static_cast<size_t>(k)];
+        const HexCell& c = row[static_cast<size_t>(k)];
         const bool present = left ? c.has_a : c.has_b;
         if (!present) {
             hex += "   ";
@@ -82,7 +73,17 @@ std::vector<std::string>
 diffy::hex_column_render(gsl::span<const uint8_t> a, gsl::span<const uint8_t> b,
                         const HexAlignment& alignment, const ColumnViewTextStyleEscapeCodes* style,
                         int bytes_per_row, int64_t context_rows, int64_t width) {
-    std::vector<std::string> out;
+    std::vector<std::string> rows;
+    RowSink sink(rows, false);
+    hex_column_render(sink, a, b, alignment, style, bytes_per_row, context_rows, width);
+    sink.flush();
+    return rows;
+}
+
+void
+diffy::hex_column_render(OutputSink& out, gsl::span<const uint8_t> a, gsl::span<const uint8_t> b,
+                        const HexAlignment& alignment, const ColumnViewTextStyleEscapeCodes* style,
+                        int bytes_per_row, int64_t context_rows, int64_t width) {
     const int off_w = hex_offset_width(std::max<uint64_t>(a.size(), b.size()));
 
     // Each pane is off_w + 2 (gap) + 3*bpr (hex) + 2 (|ascii|) + bpr (ascii).
@@ -119,88 +120,18 @@ diffy::hex_column_render(gsl::span<const uint8_t> a, gsl::span<const uint8_t> b,
     }
     const std::string sep = " │ ";  // " │ "
 
-    std::vector<Cell> row;
-    auto flush_row = [&]() {
-        if (row.empty()) {
-            return;
-        }
-        out.push_back(build_pane(row, true, bpr, off_w, s) + sep + build_pane(row, false, bpr, off_w, s));
-        row.clear();
-    };
-    auto add_cell = [&](const Cell& c) {
-        row.push_back(c);
-        // Flush on the left (A) side's bytes-per-row grid boundary so equal
-        // regions realign to clean offsets after a length change (like xxd),
-        // instead of carrying the change's phase forever. Cells with no A byte
-        // (pure insertions) can't align to A, so cap their width at bpr.
-        const bool at_grid = c.has_a && (c.a_off % static_cast<uint64_t>(bpr) == static_cast<uint64_t>(bpr) - 1);
-        if (at_grid || static_cast<int>(row.size()) == bpr) {
-            flush_row();
-        }
-    };
-    auto marker = [&](uint64_t a_off, uint64_t b_off) {
-        const std::string text =
-            fmt::format("@@ -{} +{} @@", hex_offset(a_off, off_w), hex_offset(b_off, off_w));
-        out.push_back(s.color && !s.header.empty() ? s.header + text + s.reset : text);
-    };
-
     const uint64_t ctx = static_cast<uint64_t>(context_rows < 0 ? 0 : context_rows);
-
-    for (size_t si = 0; si < alignment.size(); ++si) {
-        const HexSegment& seg = alignment[si];
-        switch (seg.kind) {
-            case HexSegKind::Replace:
-                for (uint64_t i = 0; i < seg.a_len; ++i) {
-                    add_cell({true, true, a[seg.a_offset + i], b[seg.b_offset + i], seg.a_offset + i,
-                              seg.b_offset + i, HexSegKind::Replace});
-                }
-                break;
-            case HexSegKind::OnlyA:
-                // Insertions/deletions can't share the A grid, so give them their
-                // own rows rather than desyncing the surrounding offset columns.
-                flush_row();
-                for (uint64_t i = 0; i < seg.a_len; ++i) {
-                    add_cell({true, false, a[seg.a_offset + i], 0, seg.a_offset + i, 0, HexSegKind::OnlyA});
-                }
-                flush_row();
-                break;
-            case HexSegKind::OnlyB:
-                flush_row();
-                for (uint64_t i = 0; i < seg.b_len; ++i) {
-                    add_cell({false, true, 0, b[seg.b_offset + i], 0, seg.b_offset + i, HexSegKind::OnlyB});
-                }
-                flush_row();
-                break;
-            case HexSegKind::Equal: {
-                const std::vector<HexRow> rows = hex_grid_rows(seg.a_offset, seg.a_len, bpr);
-                const HexWindow w =
-                    hex_equal_window(rows.size(), si == 0, si + 1 == alignment.size(), ctx);
-                if (w.head == 0 && w.omitted == 0 && w.tail == 0) {
-                    break;
-                }
-                const uint64_t len = seg.a_len;
-                const uint64_t head = w.head < rows.size() ? rows[w.head].offset - seg.a_offset : len;
-                const uint64_t tail_start =
-                    w.head + w.omitted < rows.size() ? rows[w.head + w.omitted].offset - seg.a_offset : len;
-                for (uint64_t i = 0; i < head; ++i) {
-                    add_cell({true, true, a[seg.a_offset + i], b[seg.b_offset + i], seg.a_offset + i,
-                              seg.b_offset + i, HexSegKind::Equal});
-                }
-                // Skip the resume marker on the last segment (tail == 0): it would
-                // point past EOF with no context following it.
-                if (w.omitted > 0 && w.tail > 0) {
-                    flush_row();
-                    marker(seg.a_offset + tail_start, seg.b_offset + tail_start);
-                }
-                for (uint64_t i = tail_start; i < len; ++i) {
-                    add_cell({true, true, a[seg.a_offset + i], b[seg.b_offset + i], seg.a_offset + i,
-                              seg.b_offset + i, HexSegKind::Equal});
-                }
-                break;
-            }
+    HexRowIterator rows(a, b, alignment, HexLayout::SideBySide, bpr, ctx);
+    HexLine line;
+    while (rows.next(line)) {
+        if (line.kind == HexRowKind::Marker) {
+            const std::string text =
+                fmt::format("@@ -{} +{} @@", hex_offset(line.a_offset, off_w), hex_offset(line.b_offset, off_w));
+            out.row(s.color && !s.header.empty() ? s.header + text + s.reset : text);
+            continue;
         }
+        out.write(build_pane(line.cells, true, bpr, off_w, s));
+        out.write(sep);
+        out.row(build_pane(line.cells, false, bpr, off_w, s));
     }
-    flush_row();
-
-    return out;
 }
@@ -2,6 +2,7 @@
 
 #include "binary/hex_align.hpp"
 #include "config/config.hpp"  // ColumnViewTextStyleEscapeCodes
+#include "output/output_sink.hpp"
 
 #include <cstdint>
 #include <string>
@@ -28,4 +29,15 @@ hex_column_render(gsl::span<const uint8_t> a,
                   int64_t context_rows = 3,
                   int64_t width = 0);
 
+// As above, streamed into `out` one newline-terminated row at a time.
+void
+hex_column_render(OutputSink& out,
+                  gsl::span<const uint8_t> a,
+                  gsl::span<const uint8_t> b,
+                  const HexAlignment& alignment,
+                  const ColumnViewTextStyleEscapeCodes* style = nullptr,
+                  int bytes_per_row = 16,
+                  int64_t context_rows = 3,
+                  int64_t width = 0);
+
 }  // namespace diffy
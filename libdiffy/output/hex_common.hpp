@@ -2,7 +2,6 @@
 
 #include <cstdint>
 #include <string>
-#include <vector>
 
 namespace diffy {
 
@@ -123,12 +122,6 @@ ascii_char(uint8_t b) {
     return (b >= 0x20 && b <= 0x7e) ? static_cast<char>(b) : '.';
 }
 
-// One emitted hex row: `count` bytes starting at absolute file offset `offset`.
-struct HexRow {
-    uint64_t offset;
-    uint64_t count;
-};
-
 // Split a run of `len` bytes starting at file offset `base_offset` into display
 // rows aligned to the bytes-per-row grid, like xxd: the first row runs only up to
 // the next multiple of `bytes_per_row`, and every row after it starts on a grid
@@ -137,20 +130,26 @@ struct HexRow {
 // ...0c, ...1c, ... instead of the clean ...10, ...20 xxd shows. The one short
 // catch-up row is the price of realigning; equal regions on either side of a
 // change then line up column-for-column.
-inline std::vector<HexRow>
-hex_grid_rows(uint64_t base_offset, uint64_t len, int bytes_per_row) {
+//
+// This is the number of rows; hex_grid_row_offset() says where each starts. Both
+// are arithmetic, so splitting a multi-MB run costs nothing.
+inline uint64_t
+hex_grid_row_count(uint64_t base_offset, uint64_t len, int bytes_per_row) {
     const uint64_t bpr = bytes_per_row > 0 ? static_cast<uint64_t>(bytes_per_row) : 16;
-    std::vector<HexRow> rows;
-    uint64_t off = base_offset;
-    uint64_t remaining = len;
-    while (remaining > 0) {
-        const uint64_t to_boundary = bpr - (off % bpr);  // room left in this grid row
-        const uint64_t n = to_boundary < remaining ? to_boundary : remaining;
-        rows.push_back({off, n});
-        off += n;
-        remaining -= n;
+    if (len == 0) {
+        return 0;
     }
-    return rows;
+    const uint64_t first_end = (base_offset / bpr + 1) * bpr;  // end of the catch-up row
+    const uint64_t end = base_offset + len;
+    return end <= first_end ? 1 : 1 + (end - first_end + bpr - 1) / bpr;
+}
+
+// The offset row `k` starts at. For k == the row count it is where the run ends
+// (or the next grid boundary past it).
+inline uint64_t
+hex_grid_row_offset(uint64_t base_offset, int bytes_per_row, uint64_t k) {
+    const uint64_t bpr = bytes_per_row > 0 ? static_cast<uint64_t>(bytes_per_row) : 16;
+    return k == 0 ? base_offset : (base_offset / bpr + k) * bpr;
 }
 
 // How much of an Equal run to show as context around the surrounding changes.
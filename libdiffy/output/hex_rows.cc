@@ -0,0 +1,220 @@
+#include "output/hex_rows.hpp"
+
+#include "output/hex_common.hpp"
+
+#include <algorithm>
+
+using namespace diffy;
+
+namespace {
+
+// Insertions and deletions can't share A's bytes-per-row grid, so side by side
+// they get rows of their own rather than desyncing the offset columns around them.
+bool
+own_rows(const HexSegment& seg) {
+    return seg.kind == HexSegKind::OnlyA || seg.kind == HexSegKind::OnlyB;
+}
+
+}  // namespace
+
+diffy::HexRowIterator::HexRowIterator(gsl::span<const uint8_t> a,
+                                      gsl::span<const uint8_t> b,
+                                      const HexAlignment& alignment,
+                                      HexLayout layout,
+                                      int bytes_per_row,
+                                      uint64_t context_rows)
+    : a_(a),
+      b_(b),
+      alignment_(alignment),
+      layout_(layout),
+      bpr_(bytes_per_row > 0 ? static_cast<uint64_t>(bytes_per_row) : 16),
+      ctx_(context_rows) {
+    if (layout_ == HexLayout::SideBySide) {
+        cells_.reserve(bpr_);
+    }
+}
+
+void
+diffy::HexRowIterator::plan_segment() {
+    const HexSegment& seg = alignment_[si_];
+    const int bpr = static_cast<int>(bpr_);
+    const bool unified = layout_ == HexLayout::Unified;
+    first_begin_ = first_end_ = second_begin_ = second_end_ = 0;
+    marker_ = false;
+
+    if (seg.kind != HexSegKind::Equal) {
+        if (!unified) {
+            first_end_ = seg.kind == HexSegKind::OnlyB ? seg.b_len : seg.a_len;
+            return;
+        }
+        // Unified: A's rows, then B's (either may be empty).
+        first_kind_ = HexRowKind::Delete;
+        first_end_ = hex_grid_row_count(seg.a_offset, seg.a_len, bpr);
+        second_kind_ = HexRowKind::Insert;
+        second_end_ = hex_grid_row_count(seg.b_offset, seg.b_len, bpr);
+        return;
+    }
+
+    const uint64_t total = hex_grid_row_count(seg.a_offset, seg.a_len, bpr);
+    const HexWindow w = hex_equal_window(total, si_ == 0, si_ + 1 == alignment_.size(), ctx_);
+    if (w.head == 0 && w.omitted == 0 && w.tail == 0) {
+        return;  // whole file equal: nothing to show
+    }
+    const uint64_t tail_row = w.head + w.omitted;
+    // No resume marker on the last segment (tail == 0): it would point past EOF
+    // with no context following it.
+    marker_ = w.omitted > 0 && w.tail > 0;
+    if (marker_) {
+        marker_a_ = hex_grid_row_offset(seg.a_offset, bpr, tail_row);
+        marker_b_ = seg.b_offset + (marker_a_ - seg.a_offset);
+    }
+    if (unified) {
+        first_kind_ = second_kind_ = HexRowKind::Equal;
+        first_end_ = w.head;
+        second_begin_ = tail_row;
+        second_end_ = total;
+        return;
+    }
+    // Side by side the window is cut at the same grid rows, as byte positions.
+    auto row_start = [&](uint64_t row) {
+        return row < total ? hex_grid_row_offset(seg.a_offset, bpr, row) - seg.a_offset : seg.a_len;
+    };
+    first_end_ = row_start(w.head);
+    second_begin_ = row_start(tail_row);
+    second_end_ = seg.a_len;
+}
+
+bool
+diffy::HexRowIterator::next(HexLine& out) {
+    return layout_ == HexLayout::Unified ? next_unified(out) : next_pair(out);
+}
+
+bool
+diffy::HexRowIterator::next_unified(HexLine& out) {
+    while (true) {
+        switch (stage_) {
+            case Stage::Start:
+                if (si_ == alignment_.size()) {
+                    return false;
+                }
+                plan_segment();
+                stage_ = Stage::First;
+                pos_ = first_begin_;
+                end_ = first_end_;
+                break;
+            case Stage::First:
+            case Stage::Second: {
+                if (pos_ == end_) {
+                    stage_ = stage_ == Stage::First ? Stage::Marker : Stage::End;
+                    break;
+                }
+                const HexSegment& seg = alignment_[si_];
+                const HexRowKind kind = stage_ == Stage::First ? first_kind_ : second_kind_;
+                const bool from_b = kind == HexRowKind::Insert;
+                const uint64_t base = from_b ? seg.b_offset : seg.a_offset;
+                const uint64_t limit = base + (from_b ? seg.b_len : seg.a_len);
+                const int bpr = static_cast<int>(bpr_);
+                const uint64_t offset = hex_grid_row_offset(base, bpr, pos_);
+                pos_++;
+                out.kind = kind;
+                out.a_offset = from_b ? 0 : offset;
+                out.b_offset = from_b ? offset : kind == HexRowKind::Equal ? seg.b_offset + (offset - base) : 0;
+                out.count = std::min(hex_grid_row_offset(base, bpr, pos_), limit) - offset;
+                out.cells = {};
+                return true;
+            }
+            case Stage::Marker:
+                stage_ = Stage::Second;
+                pos_ = second_begin_;
+                end_ = second_end_;
+                if (marker_) {
+                    out = HexLine{HexRowKind::Marker, marker_a_, marker_b_, 0, {}};
+                    return true;
+                }
+                break;
+            case Stage::End:
+                si_++;
+                stage_ = Stage::Start;
+                break;
+        }
+    }
+}
+
+bool
+diffy::HexRowIterator::emit_pair(HexLine& out) {
+    if (cells_.empty()) {
+        return false;
+    }
+    out = HexLine{HexRowKind::Pair, 0, 0, 0, cells_};
+    return true;
+}
+
+bool
+diffy::HexRowIterator::next_pair(HexLine& out) {
+    cells_.clear();
+    while (true) {
+        switch (stage_) {
+            case Stage::Start:
+                if (si_ == alignment_.size()) {
+                    return emit_pair(out);
+                }
+                if (own_rows(alignment_[si_]) && !cells_.empty()) {
+                    return emit_pair(out);
+                }
+                plan_segment();
+                stage_ = Stage::First;
+                pos_ = first_begin_;
+                end_ = first_end_;
+                break;
+            case Stage::First:
+            case Stage::Second: {
+                if (pos_ == end_) {
+                    stage_ = stage_ == Stage::First ? Stage::Marker : Stage::End;
+                    break;
+                }
+                const HexSegment& seg = alignment_[si_];
+                const uint64_t i = pos_++;
+                HexCell c;
+                c.kind = seg.kind;
+                c.has_a = seg.kind != HexSegKind::OnlyB;
+                c.has_b = seg.kind != HexSegKind::OnlyA;
+                if (c.has_a) {
+                    c.a_off = seg.a_offset + i;
+                    c.a = a_[c.a_off];
+                }
+                if (c.has_b) {
+                    c.b_off = seg.b_offset + i;
+                    c.b = b_[c.b_off];
+                }
+                cells_.push_back(c);
+                // Break on A's grid so equal regions realign to clean offsets after
+                // a length change (like xxd) instead of carrying its phase. Cells
+                // without an A byte can't align to it, so they break every bpr.
+                const bool at_grid = c.has_a && c.a_off % bpr_ == bpr_ - 1;
+                if (at_grid || cells_.size() == bpr_) {
+                    return emit_pair(out);
+                }
+                break;
+            }
+            case Stage::Marker:
+                if (marker_ && !cells_.empty()) {
+                    return emit_pair(out);
+                }
+                stage_ = Stage::Second;
+                pos_ = second_begin_;
+                end_ = second_end_;
+                if (marker_) {
+                    out = HexLine{HexRowKind::Marker, marker_a_, marker_b_, 0, {}};
+                    return true;
+                }
+                break;
+            case Stage::End:
+                if (own_rows(alignment_[si_]) && !cells_.empty()) {
+                    return emit_pair(out);
+                }
+                si_++;
+                stage_ = Stage::Start;
+                break;
+        }
+    }
+}
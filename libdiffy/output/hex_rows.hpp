@@ -0,0 +1,110 @@
+#pragma once
+
+/*
+    The one walk over a HexAlignment that all three hex renderers share
+    (hex_unified, hex_column, render/hex_view_model): segments are cut into rows
+    on the bytes-per-row grid, equal runs are trimmed to their context window
+    (hex_equal_window) with a marker where rows were omitted, and the renderers
+    only turn each row into text or spans.
+
+    Rows are produced one at a time, so a renderer can write each to its sink as
+    it comes instead of collecting the whole diff; nothing here is proportional
+    to the size of a segment.
+*/
+
+#include "binary/hex_align.hpp"
+
+#include <cstdint>
+#include <vector>
+
+#include <gsl/span>
+
+namespace diffy {
+
+enum class HexLayout : uint8_t {
+    Unified,     // a row is bytes of one file: context, removed or added
+    SideBySide,  // a row pairs bytes of both files, cell by cell
+};
+
+enum class HexRowKind : uint8_t {
+    Marker,  // "@@ -a +b @@": equal rows were omitted; the diff resumes at a_offset/b_offset
+    Equal,   // unified: context bytes, shown from A
+    Delete,  // unified: bytes only in A, or A's side of a replaced run
+    Insert,  // unified: bytes only in B, or B's side of a replaced run
+    Pair,    // side-by-side: `cells`
+};
+
+// One byte position of a side-by-side row. A side without a byte (an insertion
+// seen from A, a deletion from B) is left blank.
+struct HexCell {
+    bool has_a = false;
+    bool has_b = false;
+    uint8_t a = 0;
+    uint8_t b = 0;
+    uint64_t a_off = 0;
+    uint64_t b_off = 0;
+    HexSegKind kind = HexSegKind::Equal;
+};
+
+struct HexLine {
+    HexRowKind kind = HexRowKind::Marker;
+    // Marker: where both files resume. Unified rows: the offset of the row's first
+    // byte in A (Equal, Delete) or B (Equal, Insert).
+    uint64_t a_offset = 0;
+    uint64_t b_offset = 0;
+    uint64_t count = 0;  // unified rows: bytes in the row
+    // Pair: the row's cells, valid until the next call to next().
+    gsl::span<const HexCell> cells;
+};
+
+class HexRowIterator {
+   public:
+    // `a`, `b` and `alignment` must outlive the iterator.
+    HexRowIterator(gsl::span<const uint8_t> a,
+                   gsl::span<const uint8_t> b,
+                   const HexAlignment& alignment,
+                   HexLayout layout,
+                   int bytes_per_row,
+                   uint64_t context_rows);
+
+    // The next row; false after the last.
+    bool
+    next(HexLine& out);
+
+   private:
+    enum class Stage : uint8_t { Start, First, Marker, Second, End };
+
+    void
+    plan_segment();
+    bool
+    next_unified(HexLine& out);
+    bool
+    next_pair(HexLine& out);
+    bool
+    emit_pair(HexLine& out);
+
+    gsl::span<const uint8_t> a_;
+    gsl::span<const uint8_t> b_;
+    const HexAlignment& alignment_;
+    HexLayout layout_;
+    uint64_t bpr_;
+    uint64_t ctx_;
+
+    // Where the walk is: segment `si_`, in `stage_`. A segment is shown as a
+    // first range, an optional marker, and a second range: grid rows of one file
+    // for the unified layout, byte positions for side-by-side.
+    size_t si_ = 0;
+    Stage stage_ = Stage::Start;
+    uint64_t pos_ = 0;
+    uint64_t end_ = 0;
+    uint64_t first_begin_ = 0, first_end_ = 0;
+    uint64_t second_begin_ = 0, second_end_ = 0;
+    HexRowKind first_kind_ = HexRowKind::Equal;  // unified: what each range's rows are
+    HexRowKind second_kind_ = HexRowKind::Equal;
+    bool marker_ = false;
+    uint64_t marker_a_ = 0, marker_b_ = 0;
+
+    std::vector<HexCell> cells_;
+};
+
+}  // namespace diffy
@@ -0,0 +1,136 @@
+#include <doctest.h>
+
+#include "output/hex_common.hpp"
+#include "output/hex_rows.hpp"
+
+#include <cstdint>
+#include <vector>
+
+using namespace diffy;
+
+namespace {
+
+std::vector<uint8_t>
+ramp(size_t n) {
+    std::vector<uint8_t> v(n);
+    for (size_t i = 0; i < n; ++i) {
+        v[i] = static_cast<uint8_t>(i);
+    }
+    return v;
+}
+
+std::vector<HexLine>
+walk(HexRowIterator it) {
+    std::vector<HexLine> lines;
+    HexLine line;
+    while (it.next(line)) {
+        lines.push_back(line);
+        lines.back().cells = {};  // only valid until the next call
+    }
+    return lines;
+}
+
+}  // namespace
+
+TEST_CASE("hex_grid_row_count/offset match the row-by-row split") {
+    for (uint64_t base : {0ull, 1ull, 15ull, 16ull, 17ull, 100ull}) {
+        for (uint64_t len : {0ull, 1ull, 15ull, 16ull, 17ull, 33ull, 1000ull}) {
+            for (int bpr : {1, 7, 16}) {
+                // The split spelled out: up to the next grid boundary, then whole rows.
+                std::vector<uint64_t> starts;
+                for (uint64_t off = base; off < base + len;) {
+                    starts.push_back(off);
+                    off = (off / bpr + 1) * bpr;
+                }
+                REQUIRE(hex_grid_row_count(base, len, bpr) == starts.size());
+                for (uint64_t k = 0; k < starts.size(); ++k) {
+                    CHECK(hex_grid_row_offset(base, bpr, k) == starts[k]);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("HexRowIterator unified: -/+ rows on each file's grid, context trimmed with a marker") {
+    const auto a = ramp(100);
+    const auto b = ramp(103);
+    // 0..39 equal, 40..43 replaced, then 3 bytes inserted in B, then equal to the end.
+    const HexAlignment al = {
+        {HexSegKind::Equal, 0, 40, 0, 40},
+        {HexSegKind::Replace, 40, 4, 40, 4},
+        {HexSegKind::OnlyB, 44, 0, 44, 3},
+        {HexSegKind::Equal, 44, 56, 47, 56},
+    };
+    const auto lines = walk(HexRowIterator(a, b, al, HexLayout::Unified, 16, 1));
+
+    // Equal head (is_first: none), the marker, one row of context before the change.
+    REQUIRE(lines.size() == 6);
+    CHECK(lines[0].kind == HexRowKind::Marker);
+    CHECK(lines[0].a_offset == 32);
+    CHECK(lines[0].b_offset == 32);
+    CHECK(lines[1].kind == HexRowKind::Equal);
+    CHECK(lines[1].a_offset == 32);
+    CHECK(lines[1].count == 8);
+    CHECK(lines[2].kind == HexRowKind::Delete);
+    CHECK(lines[2].a_offset == 40);
+    CHECK(lines[2].count == 4);
+    CHECK(lines[3].kind == HexRowKind::Insert);
+    CHECK(lines[3].b_offset == 40);
+    CHECK(lines[4].kind == HexRowKind::Insert);
+    CHECK(lines[4].b_offset == 44);
+    CHECK(lines[4].count == 3);
+    // One row of context after, up to A's next grid boundary; nothing marks the
+    // omitted rest at the end of the file.
+    CHECK(lines[5].kind == HexRowKind::Equal);
+    CHECK(lines[5].a_offset == 44);
+    CHECK(lines[5].b_offset == 47);
+    CHECK(lines[5].count == 4);
+}
+
+TEST_CASE("HexRowIterator side-by-side: paired cells break on A's grid, insertions get their own rows") {
+    const auto a = ramp(40);
+    const auto b = ramp(42);
+    const HexAlignment al = {
+        {HexSegKind::Equal, 0, 20, 0, 20},
+        {HexSegKind::OnlyB, 20, 0, 20, 2},
+        {HexSegKind::Equal, 20, 20, 22, 20},
+    };
+    HexRowIterator it(a, b, al, HexLayout::SideBySide, 8, 100);
+    HexLine line;
+    std::vector<size_t> sizes;
+    while (it.next(line)) {
+        REQUIRE(line.kind == HexRowKind::Pair);
+        sizes.push_back(line.cells.size());
+        for (const HexCell& c : line.cells) {
+            if (c.kind == HexSegKind::OnlyB) {
+                CHECK_FALSE(c.has_a);
+                CHECK(c.b == b[c.b_off]);
+            } else {
+                CHECK(c.a == a[c.a_off]);
+                CHECK(c.b == b[c.b_off]);
+            }
+        }
+    }
+    // 0-7, 8-15, 16-19 | the 2 inserted | 20-23 (back on the grid), 24-31, 32-39.
+    CHECK(sizes == std::vector<size_t>{8, 8, 4, 2, 4, 8, 8});
+}
+
+TEST_CASE("HexRowIterator: identical files yield nothing; a huge one-sided run is walked lazily") {
+    const auto a = ramp(64);
+    const HexAlignment same = {{HexSegKind::Equal, 0, 64, 0, 64}};
+    CHECK(walk(HexRowIterator(a, a, same, HexLayout::Unified, 16, 3)).empty());
+    CHECK(walk(HexRowIterator(a, a, same, HexLayout::SideBySide, 16, 3)).empty());
+
+    const std::vector<uint8_t> big(4 << 20, 0xab);
+    const std::vector<uint8_t> none;
+    const HexAlignment removed = {{HexSegKind::OnlyA, 0, big.size(), 0, 0}};
+    HexRowIterator it(big, none, removed, HexLayout::Unified, 16, 3);
+    HexLine line;
+    uint64_t rows = 0, bytes = 0;
+    while (it.next(line)) {
+        rows++;
+        bytes += line.count;
+    }
+    CHECK(rows == big.size() / 16);
+    CHECK(bytes == big.size());
+}
@@ -1,6 +1,7 @@
 #include "output/hex_unified.hpp"
 
 #include "output/hex_common.hpp"
+#include "output/hex_rows.hpp"
 
 #include <algorithm>
 
@@ -10,8 +11,6 @@ using namespace diffy;
 
 namespace {
 
-enum class RowKind { Context, Del, Add };
-
 struct Styles {
     bool color = false;
     std::string reset;
@@ -21,48 +20,27 @@ struct Styles {
     std::string add_base, add_fg;
 };
 
-// Plain, uncoloured content of one hex row: "{prefix}{offset}  {hex} |{ascii}|".
-std::string
-row_text(char prefix, const uint8_t* buf, uint64_t offset, size_t count, int bpr, int width) {
-    std::string hex;
-    std::string ascii;
+// Plain, uncoloured content of one hex row, "{prefix}{offset}  {hex}|{ascii}|",
+// into `text` (reused across rows).
+void
+row_text(std::string& text, char prefix, const uint8_t* buf, uint64_t offset, size_t count, int bpr, int width) {
+    text.clear();
+    text += prefix;
+    append_hex_offset(text, offset, width);
+    text += "  ";
     for (int k = 0; k < bpr; ++k) {
         if (k < static_cast<int>(count)) {
-            const uint8_t b = buf[offset + k];
-            hex += hex_byte(b);
-            hex += ' ';
-            ascii += ascii_char(b);
+            append_hex_byte(text, buf[offset + k]);
+            text += ' ';
         } else {
-            hex += "   ";
+            text += "   ";
         }
     }
-    return fmt::format("{}{}  {}|{}|", prefix, hex_offset(offset, width), hex, ascii);
-}
-
-void
-emit_rows(std::vector<std::string>& out, RowKind kind, const uint8_t* buf,
-          const std::vector<HexRow>& rows, size_t first_row, size_t num_rows, int bpr, int width,
-          const Styles& s, int64_t fill_width) {
-    const char prefix = kind == RowKind::Del ? '-' : kind == RowKind::Add ? '+' : ' ';
-    for (size_t r = first_row; r < first_row + num_rows && r < rows.size(); ++r) {
-        const HexRow& row = rows[r];
-        std::string text = row_text(prefix, buf, row.offset, static_cast<size_t>(row.count), bpr, width);
-        if (!s.color) {
-            out.push_back(text);
-            continue;
-        }
-        const std::string& base = kind == RowKind::Del ? s.del_base
-                                  : kind == RowKind::Add ? s.add_base
-                                                         : s.ctx_base;
-        const std::string& fg = kind == RowKind::Del ? s.del_fg
-                                : kind == RowKind::Add ? s.add_fg
-                                                       : s.ctx_fg;
-        std::string fill;
-        if (fill_width > 0 && text.size() < static_cast<size_t>(fill_width)) {
-            fill.assign(static_cast<size_t>(fill_width) - text.size(), ' ');
-        }
-        out.push_back(base + fg + text + fill + s.reset);
+    text += '|';
+    for (size_t k = 0; k < count; ++k) {
+        text += ascii_char(buf[offset + k]);
     }
+    text += '|';
 }
 
 }  // namespace
@@ -72,7 +50,18 @@ diffy::hex_unified_render(gsl::span<const uint8_t> a, gsl::span<const uint8_t> b
                          const std::string& a_name, const std::string& b_name,
                          const HexAlignment& alignment, const ColumnViewTextStyleEscapeCodes* style,
                          int bytes_per_row, int64_t context_rows, int64_t fill_width) {
-    std::vector<std::string> out;
+    std::vector<std::string> rows;
+    RowSink sink(rows, false);
+    hex_unified_render(sink, a, b, a_name, b_name, alignment, style, bytes_per_row, context_rows, fill_width);
+    sink.flush();
+    return rows;
+}
+
+void
+diffy::hex_unified_render(OutputSink& out, gsl::span<const uint8_t> a, gsl::span<const uint8_t> b,
+                         const std::string& a_name, const std::string& b_name,
+                         const HexAlignment& alignment, const ColumnViewTextStyleEscapeCodes* style,
+                         int bytes_per_row, int64_t context_rows, int64_t fill_width) {
     const int bpr = bytes_per_row > 0 ? bytes_per_row : 16;
     const int width = hex_offset_width(std::max<uint64_t>(a.size(), b.size()));
 
@@ -93,9 +82,11 @@ diffy::hex_unified_render(gsl::span<const uint8_t> a, gsl::span<const uint8_t> b
 
     auto push_header = [&](const std::string& text) {
         if (s.color && !s.header.empty()) {
-            out.push_back(s.header + text + s.reset);
+            out.write(s.header);
+            out.write(text);
+            out.row(s.reset);
         } else {
-            out.push_back(text);
+            out.row(text);
         }
     };
 
@@ -103,50 +94,31 @@ diffy::hex_unified_render(gsl::span<const uint8_t> a, gsl::span<const uint8_t> b
     push_header(fmt::format("+++ {}", b_name));
 
     const uint64_t ctx = static_cast<uint64_t>(context_rows < 0 ? 0 : context_rows);
-
-    for (size_t si = 0; si < alignment.size(); ++si) {
-        const HexSegment& seg = alignment[si];
-        switch (seg.kind) {
-            case HexSegKind::Replace:
-                emit_rows(out, RowKind::Del, a.data(), hex_grid_rows(seg.a_offset, seg.a_len, bpr), 0,
-                          seg.a_len, bpr, width, s, fill_width);
-                emit_rows(out, RowKind::Add, b.data(), hex_grid_rows(seg.b_offset, seg.b_len, bpr), 0,
-                          seg.b_len, bpr, width, s, fill_width);
-                break;
-            case HexSegKind::OnlyA:
-                emit_rows(out, RowKind::Del, a.data(), hex_grid_rows(seg.a_offset, seg.a_len, bpr), 0,
-                          seg.a_len, bpr, width, s, fill_width);
-                break;
-            case HexSegKind::OnlyB:
-                emit_rows(out, RowKind::Add, b.data(), hex_grid_rows(seg.b_offset, seg.b_len, bpr), 0,
-                          seg.b_len, bpr, width, s, fill_width);
-                break;
-            case HexSegKind::Equal: {
-                const std::vector<HexRow> rows = hex_grid_rows(seg.a_offset, seg.a_len, bpr);
-                const HexWindow w =
-                    hex_equal_window(rows.size(), si == 0, si + 1 == alignment.size(), ctx);
-                if (w.head == 0 && w.omitted == 0 && w.tail == 0) {
-                    break;  // whole file equal: nothing to show
-                }
-                if (w.head > 0) {
-                    emit_rows(out, RowKind::Context, a.data(), rows, 0, w.head, bpr, width, s, fill_width);
-                }
-                // Only mark the resume point when context actually follows: on the
-                // last segment tail == 0, so head + omitted == rows.size() and the
-                // marker would both index rows[] out of bounds and point past EOF.
-                if (w.omitted > 0 && w.tail > 0) {
-                    const uint64_t resume = rows[w.head + w.omitted].offset;
-                    push_header(fmt::format("@@ -{} +{} @@", hex_offset(resume, width),
-                                            hex_offset(seg.b_offset + (resume - seg.a_offset), width)));
-                }
-                if (w.tail > 0) {
-                    emit_rows(out, RowKind::Context, a.data(), rows, w.head + w.omitted, w.tail, bpr,
-                              width, s, fill_width);
-                }
-                break;
-            }
+    HexRowIterator rows(a, b, alignment, HexLayout::Unified, bpr, ctx);
+    HexLine line;
+    std::string text;
+    while (rows.next(line)) {
+        if (line.kind == HexRowKind::Marker) {
+            push_header(fmt::format("@@ -{} +{} @@", hex_offset(line.a_offset, width),
+                                    hex_offset(line.b_offset, width)));
+            continue;
         }
+        const bool add = line.kind == HexRowKind::Insert;
+        const char prefix = add ? '+' : line.kind == HexRowKind::Delete ? '-' : ' ';
+        row_text(text, prefix, add ? b.data() : a.data(), add ? line.b_offset : line.a_offset,
+                 static_cast<size_t>(line.count), bpr, width);
+        if (!s.color) {
+            out.row(text);
+            continue;
+        }
+        const std::string& base = add ? s.add_base : line.kind == HexRowKind::Delete ? s.del_base : s.ctx_base;
+        const std::string& fg = add ? s.add_fg : line.kind == HexRowKind::Delete ? s.del_fg : s.ctx_fg;
+        out.write(base);
+        out.write(fg);
+        out.write(text);
+        if (fill_width > 0 && text.size() < static_cast<size_t>(fill_width)) {
+            out.write(std::string(static_cast<size_t>(fill_width) - text.size(), ' '));
+        }
+        out.row(s.reset);
     }
-
-    return out;
 }
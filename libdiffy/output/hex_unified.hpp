@@ -2,6 +2,7 @@
 
 #include "binary/hex_align.hpp"
 #include "config/config.hpp"  // ColumnViewTextStyleEscapeCodes
+#include "output/output_sink.hpp"
 
 #include <cstdint>
 #include <string>
@@ -30,4 +31,17 @@ hex_unified_render(gsl::span<const uint8_t> a,
                    int64_t context_rows = 3,
                    int64_t fill_width = 0);
 
+// As above, streamed into `out` one newline-terminated row at a time.
+void
+hex_unified_render(OutputSink& out,
+                   gsl::span<const uint8_t> a,
+                   gsl::span<const uint8_t> b,
+                   const std::string& a_name,
+                   const std::string& b_name,
+                   const HexAlignment& alignment,
+                   const ColumnViewTextStyleEscapeCodes* style = nullptr,
+                   int bytes_per_row = 16,
+                   int64_t context_rows = 3,
+                   int64_t fill_width = 0);
+
 }  // namespace diffy
@@ -0,0 +1,114 @@
+#include "output/output_sink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+#if defined(DIFFY_PLATFORM_WINDOWS)
+#include <io.h>
+#else
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace diffy {
+
+void
+RowSink::write(std::string_view bytes) {
+    size_t pos = 0;
+    while (pos < bytes.size()) {
+        const size_t nl = bytes.find('\n', pos);
+        if (nl == std::string_view::npos) {
+            partial_.append(bytes.substr(pos));
+            return;
+        }
+        partial_.append(bytes.substr(pos, nl - pos));
+        if (keep_newlines_) {
+            partial_ += '\n';
+        }
+        rows_.push_back(std::move(partial_));
+        partial_.clear();
+        pos = nl + 1;
+    }
+}
+
+void
+RowSink::flush() {
+    if (!partial_.empty()) {
+        rows_.push_back(std::move(partial_));
+        partial_.clear();
+    }
+}
+
+FdSink::FdSink(int fd, std::size_t buffer_bytes) : fd_(fd), capacity_(buffer_bytes > 0 ? buffer_bytes : 1) {
+    buffer_.reserve(capacity_);
+}
+
+FdSink::~FdSink() {
+    flush();
+}
+
+void
+FdSink::write(std::string_view bytes) {
+    if (buffer_.size() + bytes.size() <= capacity_) {
+        buffer_.append(bytes);
+        return;
+    }
+    if (bytes.size() < capacity_) {
+        // Top the buffer up, ship it, and start the next one with the rest.
+        const size_t room = capacity_ - buffer_.size();
+        buffer_.append(bytes.substr(0, room));
+        write_all(buffer_, {});
+        buffer_.assign(bytes.substr(room));
+        return;
+    }
+    // Larger than the buffer: no point copying it.
+    write_all(buffer_, bytes);
+    buffer_.clear();
+}
+
+void
+FdSink::flush() {
+    if (!buffer_.empty()) {
+        write_all(buffer_, {});
+        buffer_.clear();
+    }
+}
+
+void
+FdSink::write_all(std::string_view first, std::string_view second) {
+    while (ok_ && (!first.empty() || !second.empty())) {
+#if defined(DIFFY_PLATFORM_WINDOWS)
+        std::string_view& part = first.empty() ? second : first;
+        const int n = _write(fd_, part.data(), static_cast<unsigned>(part.size()));
+        if (n < 0) {
+            ok_ = false;
+            return;
+        }
+        part.remove_prefix(static_cast<size_t>(n));
+#else
+        iovec iov[2];
+        int count = 0;
+        for (std::string_view* part : {&first, &second}) {
+            if (!part->empty()) {
+                iov[count].iov_base = const_cast<char*>(part->data());
+                iov[count].iov_len = part->size();
+                ++count;
+            }
+        }
+        const ssize_t n = ::writev(fd_, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok_ = false;
+            return;
+        }
+        const size_t done = static_cast<size_t>(n);
+        const size_t from_first = std::min(done, first.size());
+        first.remove_prefix(from_first);
+        second.remove_prefix(done - from_first);
+#endif
+    }
+}
+
+}  // namespace diffy
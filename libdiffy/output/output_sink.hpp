@@ -0,0 +1,115 @@
+#pragma once
+
+/*
+    Where the renderers write their output. A renderer appends bytes and ends
+    each row with '\n' itself, so a sink sees one continuous stream and never
+    holds more than its buffer; the renderer never holds more than the row (or
+    hunk) it is working on.
+
+    FdSink is the terminal/pipe sink: it copies small writes into one reusable
+    buffer and hands it to write(2) when full, passing a large write straight
+    through together with whatever is buffered (writev). StringSink and RowSink
+    collect in memory, for tests and for the vector-returning render APIs.
+*/
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace diffy {
+
+class OutputSink {
+   public:
+    virtual ~OutputSink() = default;
+
+    virtual void
+    write(std::string_view bytes) = 0;
+
+    // Push anything buffered on to the destination.
+    virtual void
+    flush() {
+    }
+
+    // `text` followed by a newline.
+    void
+    row(std::string_view text) {
+        write(text);
+        write("\n");
+    }
+};
+
+class StringSink : public OutputSink {
+   public:
+    void
+    write(std::string_view bytes) override {
+        out_ += bytes;
+    }
+
+    const std::string&
+    str() const {
+        return out_;
+    }
+
+   private:
+    std::string out_;
+};
+
+// Splits the stream into rows, appended to `rows`. With `keep_newlines` each row
+// keeps its '\n' (the unified renderer's historical vector format); a trailing
+// unterminated row is kept too.
+class RowSink : public OutputSink {
+   public:
+    RowSink(std::vector<std::string>& rows, bool keep_newlines) : rows_(rows), keep_newlines_(keep_newlines) {
+    }
+
+    ~RowSink() override {
+        flush();
+    }
+
+    void
+    write(std::string_view bytes) override;
+
+    void
+    flush() override;
+
+   private:
+    std::vector<std::string>& rows_;
+    bool keep_newlines_;
+    std::string partial_;
+};
+
+constexpr std::size_t kDefaultSinkBufferBytes = 64u * 1024u;
+
+class FdSink : public OutputSink {
+   public:
+    explicit FdSink(int fd, std::size_t buffer_bytes = kDefaultSinkBufferBytes);
+    ~FdSink() override;
+    FdSink(const FdSink&) = delete;
+    FdSink& operator=(const FdSink&) = delete;
+
+    void
+    write(std::string_view bytes) override;
+
+    void
+    flush() override;
+
+    // False once a write failed (a closed pipe, a full disk); later output is
+    // dropped rather than retried.
+    bool
+    ok() const {
+        return ok_;
+    }
+
+   private:
+    // Write `first` then `second` completely (either may be empty).
+    void
+    write_all(std::string_view first, std::string_view second);
+
+    int fd_;
+    std::size_t capacity_;
+    std::string buffer_;
+    bool ok_ = true;
+};
+
+}  // namespace diffy
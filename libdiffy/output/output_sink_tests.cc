@@ -0,0 +1,78 @@
+#include <doctest.h>
+
+#include "output/output_sink.hpp"
+
+#include <string>
+#include <vector>
+
+#if !defined(DIFFY_PLATFORM_WINDOWS)
+#include <unistd.h>
+#endif
+
+using namespace diffy;
+
+TEST_CASE("output sink: RowSink splits the stream into rows") {
+    std::vector<std::string> kept;
+    {
+        RowSink sink(kept, true);
+        sink.write("ab");
+        sink.write("c\nde");
+        sink.row("f");
+        sink.write("tail");
+    }
+    CHECK(kept == std::vector<std::string>{"abc\n", "def\n", "tail"});
+
+    std::vector<std::string> plain;
+    RowSink sink(plain, false);
+    sink.row("one");
+    sink.write("\n");
+    sink.write("two\nthree");
+    sink.flush();
+    CHECK(plain == std::vector<std::string>{"one", "", "two", "three"});
+}
+
+TEST_CASE("output sink: StringSink collects everything written") {
+    StringSink sink;
+    sink.write("x");
+    sink.row("y");
+    sink.flush();
+    CHECK(sink.str() == "xy\n");
+}
+
+#if !defined(DIFFY_PLATFORM_WINDOWS)
+TEST_CASE("output sink: FdSink buffers small writes and passes large ones through in order") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    auto drain = [&]() {
+        std::string got;
+        char buf[256];
+        for (;;) {
+            const ssize_t n = read(fds[0], buf, sizeof buf);
+            if (n <= 0) {
+                break;
+            }
+            got.append(buf, static_cast<size_t>(n));
+        }
+        return got;
+    };
+
+    std::string expected;
+    {
+        FdSink sink(fds[1], 16);
+        sink.write("0123456789");  // fits: held back
+        expected += "0123456789";
+        sink.write("abcdefghij");  // overflows: tops up, ships 16, keeps 4
+        expected += "abcdefghij";
+        const std::string big(40, 'z');  // larger than the buffer: written directly
+        sink.write(big);
+        expected += big;
+        sink.row("end");
+        expected += "end\n";
+        CHECK(sink.ok());
+    }  // destructor flushes
+    close(fds[1]);
+    CHECK(drain() == expected);
+    close(fds[0]);
+}
+#endif
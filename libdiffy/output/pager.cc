@@ -0,0 +1,322 @@
+#include "pager.hpp"
+
+#include "util/utf8decode.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <utility>
+
+using namespace diffy;
+
+namespace {
+
+// Longest escape sequence kept back for the next read.
+constexpr std::size_t kMaxKeySequence = 16;
+
+}  // namespace
+
+PagerCommand
+diffy::pager_parse_key(std::string_view bytes, std::size_t* length) {
+    *length = bytes.empty() ? 0 : 1;
+    if (bytes.empty()) {
+        return PagerCommand::None;
+    }
+    switch (bytes[0]) {
+        case 'q':
+        case 'Q':
+        case '\x03':  // Ctrl-C: raw mode delivers it as a key
+            return PagerCommand::Quit;
+        case 'j':
+        case 'e':
+        case '\r':
+        case '\n':
+        case '\x0e':  // Ctrl-N
+            return PagerCommand::Down;
+        case 'k':
+        case 'y':
+        case '\x10':  // Ctrl-P
+            return PagerCommand::Up;
+        case ' ':
+        case 'f':
+        case '\x06':  // Ctrl-F
+            return PagerCommand::PageDown;
+        case 'b':
+        case '\x02':  // Ctrl-B
+            return PagerCommand::PageUp;
+        case 'd':
+        case '\x04':  // Ctrl-D
+            return PagerCommand::HalfDown;
+        case 'u':
+        case '\x15':  // Ctrl-U
+            return PagerCommand::HalfUp;
+        case 'g':
+        case '<':
+            return PagerCommand::Top;
+        case 'G':
+        case '>':
+            return PagerCommand::Bottom;
+        case 'n':
+            return PagerCommand::NextHunk;
+        case 'N':
+        case 'p':
+            return PagerCommand::PrevHunk;
+        case '\033':
+            break;
+        default:
+            return PagerCommand::None;
+    }
+
+    // ESC [ <params> <final> (CSI) or ESC O <final> (SS3, application cursor keys).
+    // A sequence that runs off the end of `bytes` was split across reads: take none
+    // of it, so the caller can retry once the rest arrives.
+    if (bytes.size() == 1 || (bytes.size() == 2 && (bytes[1] == '[' || bytes[1] == 'O'))) {
+        *length = 0;
+        return PagerCommand::None;
+    }
+    if (bytes[1] != '[' && bytes[1] != 'O') {
+        return PagerCommand::None;  // a lone Escape
+    }
+    std::size_t i = 2;
+    int param = 0;
+    while (i < bytes.size() && ((bytes[i] >= '0' && bytes[i] <= '9') || bytes[i] == ';')) {
+        param = bytes[i] == ';' ? 0 : std::min(param * 10 + (bytes[i] - '0'), 1000);
+        i++;
+    }
+    if (i == bytes.size()) {
+        // No key sends this many parameter bytes; drop it rather than wait forever.
+        *length = i < kMaxKeySequence ? 0 : i;
+        return PagerCommand::None;
+    }
+    *length = i + 1;
+    switch (bytes[i]) {
+        case 'A':
+            return PagerCommand::Up;
+        case 'B':
+            return PagerCommand::Down;
+        case 'H':
+            return PagerCommand::Top;
+        case 'F':
+            return PagerCommand::Bottom;
+        case '~':
+            switch (param) {
+                case 1:
+                case 7:
+                    return PagerCommand::Top;
+                case 4:
+                case 8:
+                    return PagerCommand::Bottom;
+                case 5:
+                    return PagerCommand::PageUp;
+                case 6:
+                    return PagerCommand::PageDown;
+            }
+            break;
+    }
+    return PagerCommand::None;
+}
+
+diffy::Pager::Pager(LazyColumnView& view, std::string title) : view_(view), title_(std::move(title)) {
+    view_.set_width(cols_);
+}
+
+void
+diffy::Pager::resize(int rows, int cols) {
+    rows = std::max(rows, 1);
+    cols = std::max(cols, 1);
+    if (cols != cols_) {
+        // The blocks re-wrap to a different number of rows; stay on the same one.
+        view_.set_width(cols);
+        top_.row = std::min<int64_t>(top_.row, std::max<int64_t>(block_size(top_.block) - 1, 0));
+    }
+    rows_ = rows;
+    cols_ = cols;
+    end_known_ = false;
+    clamp();
+}
+
+int64_t
+diffy::Pager::block_size(std::size_t block) {
+    return static_cast<int64_t>(view_.block(block).size());
+}
+
+void
+diffy::Pager::scroll_down(int64_t n) {
+    while (n > 0) {
+        const int64_t left = block_size(top_.block) - top_.row;
+        if (n < left) {
+            top_.row += n;
+            break;
+        }
+        if (top_.block + 1 == view_.block_count()) {
+            top_.row = std::max<int64_t>(block_size(top_.block) - 1, 0);
+            break;
+        }
+        n -= left;
+        top_.block++;
+        top_.row = 0;
+    }
+    clamp();
+}
+
+void
+diffy::Pager::scroll_up(int64_t n) {
+    while (n > 0) {
+        if (n <= top_.row) {
+            top_.row -= n;
+            break;
+        }
+        if (top_.block == 0) {
+            top_.row = 0;
+            break;
+        }
+        n -= top_.row;
+        top_.block--;
+        top_.row = block_size(top_.block);
+    }
+}
+
+const Pager::Position&
+diffy::Pager::end_top() {
+    if (end_known_) {
+        return end_;
+    }
+    // Walk a screenful back from one past the last row.
+    Position p{view_.block_count() - 1, 0};
+    p.row = block_size(p.block);
+    int64_t need = page();
+    while (need > 0) {
+        if (p.row >= need) {
+            p.row -= need;
+            break;
+        }
+        need -= p.row;
+        if (p.block == 0) {
+            p.row = 0;
+            break;
+        }
+        p.block--;
+        p.row = block_size(p.block);
+    }
+    end_ = p;
+    end_known_ = true;
+    return end_;
+}
+
+void
+diffy::Pager::clamp() {
+    const Position& end = end_top();
+    if (top_.block > end.block || (top_.block == end.block && top_.row > end.row)) {
+        top_ = end;
+    }
+}
+
+bool
+diffy::Pager::at_end() {
+    return top_ == end_top();
+}
+
+void
+diffy::Pager::apply(PagerCommand command) {
+    switch (command) {
+        case PagerCommand::None:
+        case PagerCommand::Quit:
+            break;
+        case PagerCommand::Down:
+            scroll_down(1);
+            break;
+        case PagerCommand::Up:
+            scroll_up(1);
+            break;
+        case PagerCommand::PageDown:
+            scroll_down(page());
+            break;
+        case PagerCommand::PageUp:
+            scroll_up(page());
+            break;
+        case PagerCommand::HalfDown:
+            scroll_down(std::max<int64_t>(page() / 2, 1));
+            break;
+        case PagerCommand::HalfUp:
+            scroll_up(std::max<int64_t>(page() / 2, 1));
+            break;
+        case PagerCommand::Top:
+            top_ = Position{};
+            break;
+        case PagerCommand::Bottom:
+            top_ = end_top();
+            break;
+        case PagerCommand::NextHunk:
+            if (top_.block + 1 < view_.block_count()) {
+                top_ = Position{top_.block + 1, 0};
+                clamp();
+            }
+            break;
+        case PagerCommand::PrevHunk:
+            if (top_.row > 0) {
+                top_.row = 0;
+            } else if (top_.block > 0) {
+                top_ = Position{top_.block - 1, 0};
+            }
+            break;
+    }
+}
+
+bool
+diffy::Pager::input(std::string_view bytes) {
+    std::string joined;
+    if (!pending_.empty()) {
+        joined = std::move(pending_);
+        pending_.clear();
+        joined.append(bytes);
+        bytes = joined;
+    }
+    while (!bytes.empty()) {
+        std::size_t length = 0;
+        const PagerCommand command = pager_parse_key(bytes, &length);
+        if (length == 0) {
+            pending_.assign(bytes);  // the start of an escape sequence; the rest follows
+            break;
+        }
+        if (command == PagerCommand::Quit) {
+            return false;
+        }
+        apply(command);
+        bytes.remove_prefix(length);
+    }
+    return true;
+}
+
+void
+diffy::Pager::draw(std::string& out) {
+    out += "\033[H";
+    Position p = top_;
+    for (int64_t i = 0; i < page(); i++) {
+        while (p.block < view_.block_count() && p.row >= block_size(p.block)) {
+            p.block++;
+            p.row = 0;
+        }
+        // Clear first: erasing after a full-width row would take its last cell.
+        out += "\033[K";
+        if (p.block < view_.block_count()) {
+            out += view_.block(p.block)[static_cast<std::size_t>(p.row)];
+            p.row++;
+        }
+        out += "\033[0m\r\n";
+    }
+
+    // Where we are first: on a narrow terminal the title is what gets cut.
+    const std::size_t hunks = view_.block_count() - 1;
+    std::string status = fmt::format(" hunk {}/{}", std::max<std::size_t>(top_.block, 1), hunks);
+    status += at_end() ? " (END)  " : "  ";
+    status += title_;
+    status += "  q:quit n/N:hunk ";
+    // Short of the last column, so the terminal never scrolls.
+    const std::size_t fit = static_cast<std::size_t>(cols_ - 1);
+    if (static_cast<std::size_t>(utf8_len(status)) > fit) {
+        status.resize(utf8_advance_by(status, 0, fit));
+    }
+    out += "\033[K\033[7m";
+    out += status;
+    out += "\033[0m";
+}
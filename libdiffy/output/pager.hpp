@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+    The screen model of the built-in pager: which rows of a LazyColumnView are
+    on screen, how keys move them, and the frame that draws them.
+
+    Positions are kept as (block, row within the block), so nothing needs the
+    total row count: scrolling renders the blocks it passes, jumping to the end
+    renders the last screenful, and the first screen costs the hunks on it.
+    Terminal setup (raw mode, the alternate screen, SIGWINCH) is the caller's;
+    the model only turns input bytes into moves and writes frames.
+*/
+
+#include "output/column_view.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace diffy {
+
+enum class PagerCommand {
+    None,
+    Quit,
+    Down,      // j, Enter, Down
+    Up,        // k, Up
+    PageDown,  // Space, f, PgDn
+    PageUp,    // b, PgUp
+    HalfDown,  // d
+    HalfUp,    // u
+    Top,       // g, <, Home
+    Bottom,    // G, >, End
+    NextHunk,  // n
+    PrevHunk,  // N, p
+};
+
+// The command for the key at the start of `bytes` (a plain key or an escape
+// sequence), and how many bytes it took; 0 when `bytes` is empty or holds only
+// the start of an escape sequence, whose rest is still to be read.
+PagerCommand
+pager_parse_key(std::string_view bytes, std::size_t* length);
+
+class Pager {
+   public:
+    struct Position {
+        std::size_t block = 0;
+        int64_t row = 0;
+
+        bool
+        operator==(const Position& other) const {
+            return block == other.block && row == other.row;
+        }
+    };
+
+    // `title` is shown in the status line.
+    Pager(LazyColumnView& view, std::string title);
+
+    // The terminal is `rows` x `cols`. A new width re-renders the blocks on
+    // screen and keeps the top row's block in view.
+    void
+    resize(int rows, int cols);
+
+    void
+    apply(PagerCommand command);
+
+    // Apply every key in `bytes`. False once a key asked to quit. An escape
+    // sequence cut off at the end is kept and completed by the next call.
+    bool
+    input(std::string_view bytes);
+
+    // The whole screen: every content row, then the status line. Rows are
+    // cleared before they're written, so a frame never depends on the last.
+    void
+    draw(std::string& out);
+
+    const Position&
+    top() const {
+        return top_;
+    }
+
+    bool
+    at_end();
+
+   private:
+    int64_t
+    page() const {
+        return rows_ > 1 ? rows_ - 1 : 1;
+    }
+
+    int64_t
+    block_size(std::size_t block);
+
+    void
+    scroll_down(int64_t n);
+
+    void
+    scroll_up(int64_t n);
+
+    // The top of the last full screen; positions past it are pulled back to it.
+    const Position&
+    end_top();
+
+    void
+    clamp();
+
+    LazyColumnView& view_;
+    std::string title_;
+    int rows_ = 24;
+    int cols_ = 80;
+    Position top_;
+    Position end_;
+    bool end_known_ = false;
+    std::string pending_;  // an escape sequence split across input() calls
+};
+
+}  // namespace diffy
@@ -0,0 +1,196 @@
+#include <doctest.h>
+
+#include "algorithms/patience.hpp"
+#include "config/config.hpp"
+#include "output/pager.hpp"
+#include "output/render_test_util.hpp"
+#include "processing/diff_hunk.hpp"
+#include "processing/diff_hunk_annotate.hpp"
+#include "util/hash.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace diffy;
+
+namespace {
+
+// `hunks` hunks of one changed line each, 40 lines apart.
+struct PagedDiff {
+    std::vector<Line> a;
+    std::vector<Line> b;
+    DiffInput<Line> input;
+    LazyAnnotatedHunks lazy;
+    ColumnViewState config;
+    ProgramOptions options;
+    LazyColumnView view;
+
+    explicit PagedDiff(int hunks)
+        : a(lines(hunks, false))
+        , b(lines(hunks, true))
+        , input{gsl::span<Line>{a}, gsl::span<Line>{b}, "old.txt", "new.txt"}
+        , lazy(input, compose_hunks(Patience<Line>(input).compute().edit_sequence, 3), EditGranularity::Token,
+               false)
+        , view(input, lazy, config, options) {
+    }
+
+    static std::vector<Line>
+    lines(int hunks, bool changed) {
+        std::vector<Line> out;
+        for (uint32_t i = 0; i < static_cast<uint32_t>(hunks) * 40; i++) {
+            std::string s = "line " + std::to_string(i);
+            if (changed && i % 40 == 20) {
+                s += " changed";
+            }
+            out.push_back(Line{i + 1, hash::hash(s.c_str(), s.size()), s});
+        }
+        return out;
+    }
+};
+
+// The visible text of each screen row of a frame.
+std::vector<std::string>
+screen(Pager& pager) {
+    std::string frame;
+    pager.draw(frame);
+    std::vector<std::string> rows;
+    for (std::size_t start = 0;;) {
+        const std::size_t end = frame.find("\r\n", start);
+        rows.push_back(test::strip_ansi(frame.substr(start, end - start)));
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 2;
+    }
+    return rows;
+}
+
+}  // namespace
+
+TEST_CASE("pager_parse_key: plain keys and escape sequences") {
+    std::size_t n = 0;
+    CHECK(pager_parse_key("q", &n) == PagerCommand::Quit);
+    CHECK(pager_parse_key("\x03", &n) == PagerCommand::Quit);
+    CHECK(pager_parse_key(" ", &n) == PagerCommand::PageDown);
+    CHECK(pager_parse_key("G", &n) == PagerCommand::Bottom);
+    CHECK(pager_parse_key("\033[B", &n) == PagerCommand::Down);
+    CHECK(n == 3);
+    CHECK(pager_parse_key("\033OA", &n) == PagerCommand::Up);
+    CHECK(pager_parse_key("\033[6~j", &n) == PagerCommand::PageDown);
+    CHECK(n == 4);
+    CHECK(pager_parse_key("\033[1;5H", &n) == PagerCommand::Top);
+    CHECK(n == 6);
+
+    // A lone Escape is one key; the one after it still counts.
+    CHECK(pager_parse_key("\033q", &n) == PagerCommand::None);
+    CHECK(n == 1);
+    CHECK(pager_parse_key("", &n) == PagerCommand::None);
+    CHECK(n == 0);
+
+    // The start of a sequence whose rest hasn't been read yet takes nothing.
+    for (const char* partial : {"\033", "\033[", "\033O", "\033[6", "\033[1;5"}) {
+        CAPTURE(partial);
+        CHECK(pager_parse_key(partial, &n) == PagerCommand::None);
+        CHECK(n == 0);
+    }
+    // ... unless it is longer than any key sends.
+    const std::string junk = "\033[" + std::string(40, '1');
+    CHECK(pager_parse_key(junk, &n) == PagerCommand::None);
+    CHECK(n == junk.size());
+}
+
+TEST_CASE("Pager: an escape sequence split across reads is still one key") {
+    PagedDiff diff(20);
+    Pager pager(diff.view, "t");
+    pager.resize(10, 80);
+
+    // PgDn (ESC [ 6 ~) delivered in three reads.
+    CHECK(pager.input("\033"));
+    CHECK(pager.input("[6"));
+    CHECK(pager.top() == Pager::Position{});
+    CHECK(pager.input("~"));
+    Pager whole(diff.view, "t");
+    whole.resize(10, 80);
+    CHECK(whole.input("\033[6~"));
+    CHECK(pager.top() == whole.top());
+    CHECK_FALSE(pager.top() == Pager::Position{});
+
+    // A lone Escape followed by a key later still lets the key through.
+    CHECK(pager.input("\033"));
+    CHECK_FALSE(pager.input("q"));
+}
+
+TEST_CASE("Pager: the first screen and the last only annotate the hunks on them") {
+    PagedDiff diff(500);
+    REQUIRE(diff.view.block_count() == 501);
+    Pager pager(diff.view, "old.txt -> new.txt");
+    pager.resize(12, 100);
+
+    const auto first = screen(pager);
+    REQUIRE(first.size() == 12);
+    CHECK(first[0].find("old.txt") != std::string::npos);
+    CHECK(first[1].find("@@ -18,7 +18,7 @@") != std::string::npos);
+    CHECK(first.back().find("hunk 1/500") != std::string::npos);
+    // The two hunks on screen, and the two on the last screen (where scrolling
+    // stops), out of 500.
+    CHECK(diff.lazy.annotated_count() == 4);
+
+    CHECK(pager.input("G"));
+    CHECK(pager.at_end());
+    const auto last = screen(pager);
+    CHECK(last[10].find("line 19983") != std::string::npos);
+    CHECK(last.back().find("(END)") != std::string::npos);
+    CHECK(diff.lazy.annotated_count() == 4);
+
+    // Past the end is pulled back to the last full screen.
+    CHECK(pager.input("jjj\033[6~n"));
+    CHECK(pager.at_end());
+    CHECK(screen(pager) == last);
+}
+
+TEST_CASE("Pager: scrolling and hunk jumps") {
+    PagedDiff diff(20);
+    Pager pager(diff.view, "t");
+    pager.resize(10, 80);
+
+    CHECK(pager.input("nnn"));
+    CHECK(pager.top() == Pager::Position{3, 0});
+    CHECK(screen(pager)[0].find("@@ -98,7 +98,7 @@") != std::string::npos);
+
+    // Scrolling runs across block boundaries and back.
+    const Pager::Position hunk3 = pager.top();
+    CHECK(pager.input("jjjjjjjjjjjj"));
+    CHECK(pager.top().block == 4);
+    CHECK(pager.input("kkkkkkkkkkkk"));
+    CHECK(pager.top() == hunk3);
+    CHECK(pager.input(" b"));
+    CHECK(pager.top() == hunk3);
+
+    // N goes to the start of the hunk on top first, then to the one before.
+    CHECK(pager.input("jN"));
+    CHECK(pager.top() == hunk3);
+    CHECK(pager.input("N"));
+    CHECK(pager.top() == Pager::Position{2, 0});
+    CHECK(pager.input("g"));
+    CHECK(pager.top() == Pager::Position{0, 0});
+    CHECK_FALSE(pager.input("jq"));
+}
+
+TEST_CASE("Pager: a resize re-wraps and keeps the top hunk in view") {
+    PagedDiff diff(20);
+    diff.config.settings.word_wrap = true;
+    Pager pager(diff.view, "t");
+    pager.resize(10, 120);
+    CHECK(pager.input("nnnnn"));
+    const auto wide = screen(pager);
+
+    pager.resize(6, 30);
+    CHECK(pager.top() == Pager::Position{5, 0});
+    const auto narrow = screen(pager);
+    REQUIRE(narrow.size() == 6);
+    CHECK(narrow[0].find("@@") != std::string::npos);
+    CHECK(narrow[0].size() < wide[0].size());
+
+    pager.resize(10, 120);
+    CHECK(screen(pager) == wide);
+}
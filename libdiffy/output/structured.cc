@@ -0,0 +1,336 @@
+#include "structured.hpp"
+
+#include "util/base64.hpp"
+#include "util/trace.hpp"
+#include "util/utf8decode.hpp"
+#include "util/varint.hpp"
+
+#include <nlohmann/json.hpp>
+
+#include <utility>
+
+using namespace diffy;
+
+namespace {
+
+constexpr std::string_view kBinaryMagic = "DIFFYBIN";
+constexpr uint8_t kFormatVersion = 1;
+
+constexpr char kFileRecord = 'F';
+constexpr char kHunkRecord = 'H';
+constexpr char kEndRecord = 'E';
+
+const char*
+type_name(EditType type) {
+    switch (type) {
+        case EditType::Delete:
+            return "delete";
+        case EditType::Insert:
+            return "insert";
+        case EditType::Common:
+            return "common";
+        case EditType::Meta:
+            break;
+    }
+    return "meta";
+}
+
+// A line number as written: 1-based, 0 for none.
+int64_t
+line_number(const EditIndex& index) {
+    return index.valid ? static_cast<int64_t>(index.value) + 1 : 0;
+}
+
+std::string_view
+line_text(const gsl::span<Line>& lines, const EditLine& line) {
+    if (!line.line_index.valid || line.line_index.value < 0 ||
+        static_cast<size_t>(line.line_index.value) >= lines.size()) {
+        return {};
+    }
+    return lines[static_cast<size_t>(line.line_index.value)].line;
+}
+
+// Set `key` to `text`, and when `text` isn't valid UTF-8 (the dump replaces those
+// bytes with U+FFFD) also `key`_base64 to its raw bytes, so nothing is lost.
+void
+put_text(nlohmann::json& j, const std::string& key, std::string_view text) {
+    j[key] = text;
+    if (!utf8_valid(text)) {
+        j[key + "_base64"] = base64(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    }
+}
+
+nlohmann::json
+json_lines(const gsl::span<Line>& lines, const std::vector<EditLine>& edit_lines) {
+    nlohmann::json out = nlohmann::json::array();
+    for (const auto& line : edit_lines) {
+        nlohmann::json segments = nlohmann::json::array();
+        for (const auto& s : line.segments) {
+            segments.push_back(
+                {{"start", s.start}, {"length", s.length}, {"type", type_name(s.type)}, {"flags", s.flags}});
+        }
+        nlohmann::json j = {{"line", line_number(line.line_index)}, {"type", type_name(line.type)}};
+        put_text(j, "text", line_text(lines, line));
+        j["segments"] = std::move(segments);
+        if (line.move_id != 0) {
+            j["move_id"] = line.move_id;
+            j["move_line"] = line.move_line;
+        }
+        out.push_back(std::move(j));
+    }
+    return out;
+}
+
+std::string
+json_dump(const nlohmann::json& j) {
+    return j.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+}
+
+void
+json_render(OutputSink& out, const DiffInput<Line>& diff_input, LazyAnnotatedHunks& hunks) {
+    nlohmann::json old_file = {{"lines", diff_input.A.size()}};
+    nlohmann::json new_file = {{"lines", diff_input.B.size()}};
+    put_text(old_file, "name", diff_input.A_name);
+    put_text(new_file, "name", diff_input.B_name);
+    const nlohmann::json header = {
+        {"format", "diffy"},
+        {"version", kFormatVersion},
+        {"old", std::move(old_file)},
+        {"new", std::move(new_file)},
+    };
+    // The header object without its closing brace, so the hunks can follow.
+    std::string text = json_dump(header);
+    text.pop_back();
+    out.write(text);
+    out.write(",\"hunks\":[");
+
+    for (size_t i = 0; i < hunks.size(); i++) {
+        const AnnotatedHunk& hunk = hunks.get(i);
+        nlohmann::json runs = nlohmann::json::array();
+        for (const auto& run : edit_runs(hunks.hunk(i))) {
+            runs.push_back({{"type", type_name(run.type)},
+                            {"old", run.old_start},
+                            {"new", run.new_start},
+                            {"count", run.count}});
+        }
+        const nlohmann::json j = {
+            {"old_start", hunk.from_start},
+            {"old_count", hunk.from_count},
+            {"new_start", hunk.to_start},
+            {"new_count", hunk.to_count},
+            {"context", hunk.context},
+            {"runs", std::move(runs)},
+            {"old_lines", json_lines(diff_input.A, hunk.a_lines)},
+            {"new_lines", json_lines(diff_input.B, hunk.b_lines)},
+        };
+        hunks.release(i);
+        out.write(i == 0 ? "\n" : ",\n");
+        out.write(json_dump(j));
+    }
+    out.write("\n]}\n");
+}
+
+void
+put_record(OutputSink& out, char tag, const std::string& payload, std::string& scratch) {
+    scratch.clear();
+    scratch += tag;
+    put_varint(scratch, payload.size());
+    out.write(scratch);
+    out.write(payload);
+}
+
+void
+put_lines(std::string& out, const gsl::span<Line>& lines, const std::vector<EditLine>& edit_lines) {
+    put_varint(out, edit_lines.size());
+    for (const auto& line : edit_lines) {
+        put_varint(out, static_cast<uint64_t>(line_number(line.line_index)));
+        out += static_cast<char>(line.type);
+        put_varint(out, static_cast<uint64_t>(line.move_id));
+        put_varint(out, static_cast<uint64_t>(line.move_line));
+        put_string(out, line_text(lines, line));
+        put_varint(out, line.segments.size());
+        for (const auto& s : line.segments) {
+            put_varint(out, s.start);
+            put_varint(out, s.length);
+            out += static_cast<char>(s.type);
+            out += static_cast<char>(s.flags);
+        }
+    }
+}
+
+void
+binary_render(OutputSink& out, const DiffInput<Line>& diff_input, LazyAnnotatedHunks& hunks) {
+    std::string prefix(kBinaryMagic);
+    prefix += static_cast<char>(kFormatVersion);
+    out.write(prefix);
+
+    std::string payload;
+    put_string(payload, diff_input.A_name);
+    put_string(payload, diff_input.B_name);
+    put_varint(payload, diff_input.A.size());
+    put_varint(payload, diff_input.B.size());
+    put_record(out, kFileRecord, payload, prefix);
+
+    for (size_t i = 0; i < hunks.size(); i++) {
+        const AnnotatedHunk& hunk = hunks.get(i);
+        payload.clear();
+        put_varint(payload, static_cast<uint64_t>(hunk.from_start));
+        put_varint(payload, static_cast<uint64_t>(hunk.from_count));
+        put_varint(payload, static_cast<uint64_t>(hunk.to_start));
+        put_varint(payload, static_cast<uint64_t>(hunk.to_count));
+        put_string(payload, hunk.context);
+        const std::vector<EditRun> runs = edit_runs(hunks.hunk(i));
+        put_varint(payload, runs.size());
+        for (const auto& run : runs) {
+            payload += static_cast<char>(run.type);
+            put_varint(payload, static_cast<uint64_t>(run.old_start));
+            put_varint(payload, static_cast<uint64_t>(run.new_start));
+            put_varint(payload, static_cast<uint64_t>(run.count));
+        }
+        put_lines(payload, diff_input.A, hunk.a_lines);
+        put_lines(payload, diff_input.B, hunk.b_lines);
+        hunks.release(i);
+        put_record(out, kHunkRecord, payload, prefix);
+    }
+    put_record(out, kEndRecord, {}, prefix);
+}
+
+bool
+read_type(VarintReader& in, EditType& type) {
+    const uint8_t code = in.byte();
+    type = static_cast<EditType>(code);
+    if (code > static_cast<uint8_t>(EditType::Meta)) {
+        in.ok = false;
+    }
+    return in.ok;
+}
+
+bool
+read_lines(VarintReader& in, std::vector<EditLine>& lines, std::vector<std::string>& text) {
+    lines.resize(in.count());
+    text.resize(lines.size());
+    for (size_t i = 0; i < lines.size() && in.ok; i++) {
+        EditLine& line = lines[i];
+        const uint64_t number = in.varint();
+        line.line_index = number == 0 ? EditIndex() : EditIndex(static_cast<int64_t>(number - 1));
+        if (!read_type(in, line.type)) {
+            return false;
+        }
+        line.move_id = static_cast<int>(in.varint());
+        line.move_line = static_cast<int64_t>(in.varint());
+        text[i] = in.string();
+        line.segments.resize(in.count());
+        for (auto& s : line.segments) {
+            s.start = in.varint();
+            s.length = in.varint();
+            if (!read_type(in, s.type)) {
+                return false;
+            }
+            s.flags = in.byte();
+        }
+    }
+    return in.ok;
+}
+
+}  // namespace
+
+std::vector<EditRun>
+diffy::edit_runs(const Hunk& hunk) {
+    std::vector<EditRun> runs;
+    for (const auto& e : hunk.edit_units) {
+        const int64_t old_line = line_number(e.a_index);
+        const int64_t new_line = line_number(e.b_index);
+        if (!runs.empty()) {
+            EditRun& last = runs.back();
+            const bool old_follows = old_line == 0 ? last.old_start == 0 : old_line == last.old_start + last.count;
+            const bool new_follows = new_line == 0 ? last.new_start == 0 : new_line == last.new_start + last.count;
+            if (last.type == e.type && old_follows && new_follows) {
+                last.count++;
+                continue;
+            }
+        }
+        runs.push_back({e.type, old_line, new_line, 1});
+    }
+    return runs;
+}
+
+void
+diffy::structured_diff_render(OutputSink& out,
+                              StructuredFormat format,
+                              const DiffInput<Line>& diff_input,
+                              LazyAnnotatedHunks& hunks) {
+    DIFFY_TRACE_SCOPE("render.structured");
+    switch (format) {
+        case StructuredFormat::Json:
+            json_render(out, diff_input, hunks);
+            break;
+        case StructuredFormat::Binary:
+            binary_render(out, diff_input, hunks);
+            break;
+    }
+}
+
+diffy::BinaryDiffReader::BinaryDiffReader(std::string_view data) : data_(data) {
+    if (data_.substr(0, kBinaryMagic.size()) != kBinaryMagic || data_.size() <= kBinaryMagic.size() ||
+        static_cast<uint8_t>(data_[kBinaryMagic.size()]) != kFormatVersion) {
+        ok_ = false;
+        return;
+    }
+    pos_ = kBinaryMagic.size() + 1;
+
+    VarintReader in{data_, pos_};
+    const char tag = static_cast<char>(in.byte());
+    const uint64_t length = in.count();
+    if (!in.ok || tag != kFileRecord) {
+        ok_ = false;
+        return;
+    }
+    VarintReader file{data_.substr(in.pos, length)};
+    old_name_ = file.string();
+    new_name_ = file.string();
+    old_lines_ = static_cast<int64_t>(file.varint());
+    new_lines_ = static_cast<int64_t>(file.varint());
+    ok_ = file.ok;
+    pos_ = in.pos + length;
+}
+
+bool
+diffy::BinaryDiffReader::next(StructuredHunk& out) {
+    while (ok_ && !done_) {
+        VarintReader in{data_, pos_};
+        const char tag = static_cast<char>(in.byte());
+        const uint64_t length = in.count();
+        if (!in.ok) {
+            ok_ = false;
+            break;
+        }
+        pos_ = in.pos + length;
+        if (tag == kEndRecord) {
+            done_ = true;
+            break;
+        }
+        if (tag != kHunkRecord) {
+            continue;
+        }
+
+        VarintReader h{data_.substr(in.pos, length)};
+        AnnotatedHunk& hunk = out.hunk;
+        hunk.from_start = static_cast<int64_t>(h.varint());
+        hunk.from_count = static_cast<int64_t>(h.varint());
+        hunk.to_start = static_cast<int64_t>(h.varint());
+        hunk.to_count = static_cast<int64_t>(h.varint());
+        hunk.context = h.string();
+        out.runs.resize(h.count());
+        for (auto& run : out.runs) {
+            if (!read_type(h, run.type)) {
+                break;
+            }
+            run.old_start = static_cast<int64_t>(h.varint());
+            run.new_start = static_cast<int64_t>(h.varint());
+            run.count = static_cast<int64_t>(h.varint());
+        }
+        ok_ = h.ok && read_lines(h, hunk.a_lines, out.a_text) && read_lines(h, hunk.b_lines, out.b_text);
+        return ok_;
+    }
+    return false;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+/*
+    Machine-readable diff output, for tools that would otherwise re-parse the
+    unified text: each hunk's range and scope label, its edit runs, and its
+    annotated lines with their intra-line segments and moved-block tags.
+
+    Two encodings of the same model, both written a hunk at a time as the lazy
+    source annotates it, so neither holds more than one hunk:
+
+      - JSON: one document, {"format": "diffy", "version": 1, "old": {...},
+        "new": {...}, "hunks": [...]}, with each hunk on a line of its own.
+        Segment offsets are bytes into the line's raw text; bytes that aren't
+        valid UTF-8 are written as U+FFFD, and a line (or file name) holding
+        any also carries its raw bytes as "text_base64" ("name_base64").
+      - Binary: the magic "DIFFYBIN", a version byte, then records of a tag
+        byte, a varint payload length and the payload (LEB128 varints and
+        length-prefixed strings, see util/varint.hpp): one 'F' (file) record,
+        one 'H' per hunk, and an 'E' at the end. Readers skip tags they don't
+        know. BinaryDiffReader decodes it.
+*/
+
+#include "algorithms/algorithm.hpp"
+#include "output/output_sink.hpp"
+#include "processing/diff_hunk.hpp"
+#include "processing/diff_hunk_annotate.hpp"
+#include "util/readlines.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace diffy {
+
+// Consecutive edits of one type. Line numbers are 1-based; 0 where the run has
+// no lines on that side (an insert on the old side, a delete on the new).
+struct EditRun {
+    EditType type = EditType::Common;
+    int64_t old_start = 0;
+    int64_t new_start = 0;
+    int64_t count = 0;
+
+    bool
+    operator==(const EditRun& other) const {
+        return type == other.type && old_start == other.old_start && new_start == other.new_start &&
+               count == other.count;
+    }
+};
+
+std::vector<EditRun>
+edit_runs(const Hunk& hunk);
+
+enum class StructuredFormat {
+    Json,
+    Binary,
+};
+
+// Write the whole diff in `format`. Each hunk is annotated, written and
+// released in turn.
+void
+structured_diff_render(OutputSink& out,
+                       StructuredFormat format,
+                       const DiffInput<Line>& diff_input,
+                       LazyAnnotatedHunks& hunks);
+
+// A hunk read back from the binary encoding. The line indices in `hunk` are
+// 0-based, as the annotator makes them.
+struct StructuredHunk {
+    AnnotatedHunk hunk;
+    std::vector<EditRun> runs;
+    std::vector<std::string> a_text;  // the text of each of hunk.a_lines
+    std::vector<std::string> b_text;
+};
+
+// Decodes the binary encoding a hunk at a time. `data` must outlive the reader.
+class BinaryDiffReader {
+   public:
+    explicit BinaryDiffReader(std::string_view data);
+
+    // The next hunk; false at the end record, or when the data is damaged
+    // (then ok() is false too).
+    bool
+    next(StructuredHunk& out);
+
+    bool
+    ok() const {
+        return ok_;
+    }
+
+    const std::string&
+    old_name() const {
+        return old_name_;
+    }
+    const std::string&
+    new_name() const {
+        return new_name_;
+    }
+    int64_t
+    old_lines() const {
+        return old_lines_;
+    }
+    int64_t
+    new_lines() const {
+        return new_lines_;
+    }
+
+   private:
+    std::string_view data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+    bool done_ = false;
+    std::string old_name_;
+    std::string new_name_;
+    int64_t old_lines_ = 0;
+    int64_t new_lines_ = 0;
+};
+
+}  // namespace diffy
@@ -0,0 +1,236 @@
+// Tests for the structured (JSON and binary) diff output. The JSON is parsed back
+// with nlohmann::json and the binary with BinaryDiffReader, and both are checked
+// against the annotated hunks they were written from.
+
+#include "algorithms/patience.hpp"
+#include "output/structured.hpp"
+#include "processing/diff_hunk.hpp"
+#include "processing/diff_hunk_annotate.hpp"
+#include "util/hash.hpp"
+#include "util/readlines.hpp"
+#include "util/varint.hpp"
+
+#include <doctest.h>
+#include <nlohmann/json.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace diffy;
+
+namespace {
+
+std::vector<Line>
+mk(const std::vector<std::string>& v) {
+    std::vector<Line> out;
+    uint32_t i = 1;
+    for (const auto& s : v) {
+        out.push_back(Line{i, hash::hash(s.c_str(), s.size()), s});
+        i++;
+    }
+    return out;
+}
+
+struct Fixture {
+    std::vector<Line> A;
+    std::vector<Line> B;
+    DiffInput<Line> in;
+    std::vector<Hunk> hunks;
+
+    Fixture(const std::vector<std::string>& a, const std::vector<std::string>& b)
+        : A(mk(a)), B(mk(b)), in{gsl::span<Line>{A}, gsl::span<Line>{B}, "old.c", "new.c"} {
+        auto r = Patience<Line>(in).compute();
+        hunks = compose_hunks(r.edit_sequence, 1);
+    }
+
+    std::string
+    render(StructuredFormat format, const std::vector<std::string>& contexts = {}) {
+        LazyAnnotatedHunks lazy(in, hunks, EditGranularity::Token, false);
+        for (size_t i = 0; i < contexts.size() && i < lazy.size(); i++) {
+            lazy.set_context(i, contexts[i]);
+        }
+        StringSink sink;
+        structured_diff_render(sink, format, in, lazy);
+        return sink.str();
+    }
+};
+
+}  // namespace
+
+TEST_CASE("edit_runs — merges consecutive edits of one type") {
+    Fixture f({"a", "b", "c", "d"}, {"a", "B", "C", "d", "e"});
+    REQUIRE(f.hunks.size() == 1);
+    const std::vector<EditRun> runs = edit_runs(f.hunks[0]);
+    const std::vector<EditRun> expected = {
+        {EditType::Common, 1, 1, 1},
+        {EditType::Delete, 2, 0, 2},
+        {EditType::Insert, 0, 2, 2},
+        {EditType::Common, 4, 4, 1},
+        {EditType::Insert, 0, 5, 1},
+    };
+    CHECK(runs == expected);
+}
+
+TEST_CASE("structured_diff_render — JSON carries hunks, runs, segments and moves") {
+    Fixture f({"x1", "x2", "x3", "x4", "y1", "y2", "y3", "int value = 1;"},
+              {"y1", "y2", "y3", "x1", "x2", "x3", "x4", "int value = 2;"});
+    const std::string text = f.render(StructuredFormat::Json, {"int main()"});
+
+    // A hunk per line (the separating comma ends the line), so line-oriented
+    // tools can split the stream too.
+    const size_t first = text.find('\n') + 1;
+    size_t end = text.find('\n', first);
+    if (text[end - 1] == ',') {
+        end--;
+    }
+    CHECK(nlohmann::json::parse(text.substr(first, end - first)).contains("old_start"));
+
+    const nlohmann::json doc = nlohmann::json::parse(text);
+    CHECK(doc["format"] == "diffy");
+    CHECK(doc["version"] == 1);
+    CHECK(doc["old"]["name"] == "old.c");
+    CHECK(doc["new"]["lines"] == 8);
+    REQUIRE(doc["hunks"].size() == f.hunks.size());
+
+    const auto& h = doc["hunks"][0];
+    CHECK(h["context"] == "int main()");
+    CHECK(h["runs"].size() == edit_runs(f.hunks[0]).size());
+
+    int moved = 0;
+    bool token_segment = false;
+    for (const auto& side : {"old_lines", "new_lines"}) {
+        for (const auto& hunk : doc["hunks"]) {
+            for (const auto& line : hunk[side]) {
+                if (line.contains("move_id")) {
+                    moved++;
+                    CHECK(line["move_line"] > 0);
+                }
+                if (line["text"] == "int value = 2;") {
+                    CHECK(line["type"] == "insert");
+                    CHECK(line["line"] == 8);
+                    // Only the changed token is marked, not the whole line.
+                    token_segment = line["segments"].size() > 1;
+                }
+            }
+        }
+    }
+    CHECK(moved == 6);  // y1..y3 on both sides
+    CHECK(token_segment);
+}
+
+TEST_CASE("structured_diff_render — JSON replaces invalid UTF-8") {
+    Fixture f({"ok", "bad \xff byte"}, {"ok", "bad byte"});
+    const nlohmann::json doc = nlohmann::json::parse(f.render(StructuredFormat::Json));
+    const auto& old_lines = doc["hunks"][0]["old_lines"];
+    bool found = false;
+    for (const auto& line : old_lines) {
+        if (line["line"] == 2) {
+            CHECK(line["text"] == "bad \xef\xbf\xbd byte");
+            found = true;
+        }
+    }
+    CHECK(found);
+}
+
+TEST_CASE("structured_diff_render — JSON keeps the raw bytes of Latin-1 lines") {
+    // The same word saved as Latin-1 on the old side and as UTF-8 on the new.
+    Fixture f({"ok", "caf\xe9 au lait"}, {"ok", "caf\xc3\xa9 au lait"});
+    const nlohmann::json doc = nlohmann::json::parse(f.render(StructuredFormat::Json));
+    const auto& hunk = doc["hunks"][0];
+    REQUIRE(hunk["old_lines"].size() == 2);
+    REQUIRE(hunk["new_lines"].size() == 2);
+    CHECK_FALSE(hunk["old_lines"][0].contains("text_base64"));  // the common "ok"
+    const auto& latin1 = hunk["old_lines"][1];
+    CHECK(latin1["text"] == "caf\xef\xbf\xbd au lait");
+    CHECK(latin1["text_base64"] == "Y2Fm6SBhdSBsYWl0");
+    const auto& utf8 = hunk["new_lines"][1];
+    CHECK(utf8["text"] == "caf\xc3\xa9 au lait");
+    CHECK_FALSE(utf8.contains("text_base64"));
+    CHECK_FALSE(doc["old"].contains("name_base64"));
+}
+
+TEST_CASE("structured_diff_render — JSON with no differences") {
+    Fixture f({"same"}, {"same"});
+    const nlohmann::json doc = nlohmann::json::parse(f.render(StructuredFormat::Json));
+    CHECK(doc["hunks"].empty());
+}
+
+TEST_CASE("BinaryDiffReader — round-trips the binary encoding") {
+    Fixture f({"a", "b", "c", "d", "e", "f", "g", "h"}, {"a", "B", "c", "d", "e", "f", "g", "h", "i"});
+    REQUIRE(f.hunks.size() == 2);
+    const std::string data = f.render(StructuredFormat::Binary, {"first", "second"});
+    CHECK(data.rfind("DIFFYBIN", 0) == 0);
+
+    BinaryDiffReader reader(data);
+    REQUIRE(reader.ok());
+    CHECK(reader.old_name() == "old.c");
+    CHECK(reader.new_name() == "new.c");
+    CHECK(reader.old_lines() == 8);
+    CHECK(reader.new_lines() == 9);
+
+    const std::vector<AnnotatedHunk> expected = annotate_hunks(f.in, f.hunks, EditGranularity::Token, false);
+    StructuredHunk got;
+    for (size_t i = 0; i < expected.size(); i++) {
+        REQUIRE(reader.next(got));
+        const AnnotatedHunk& want = expected[i];
+        CHECK(got.hunk.from_start == want.from_start);
+        CHECK(got.hunk.from_count == want.from_count);
+        CHECK(got.hunk.to_start == want.to_start);
+        CHECK(got.hunk.to_count == want.to_count);
+        CHECK(got.hunk.context == (i == 0 ? "first" : "second"));
+        CHECK(got.runs == edit_runs(f.hunks[i]));
+        REQUIRE(got.hunk.a_lines.size() == want.a_lines.size());
+        REQUIRE(got.hunk.b_lines.size() == want.b_lines.size());
+        for (size_t j = 0; j < want.b_lines.size(); j++) {
+            const EditLine& line = got.hunk.b_lines[j];
+            CHECK(line.type == want.b_lines[j].type);
+            CHECK(line.line_index.value == want.b_lines[j].line_index.value);
+            CHECK(got.b_text[j] == f.B[static_cast<size_t>(line.line_index.value)].line);
+            REQUIRE(line.segments.size() == want.b_lines[j].segments.size());
+            for (size_t k = 0; k < line.segments.size(); k++) {
+                CHECK(line.segments[k].start == want.b_lines[j].segments[k].start);
+                CHECK(line.segments[k].length == want.b_lines[j].segments[k].length);
+                CHECK(line.segments[k].type == want.b_lines[j].segments[k].type);
+            }
+        }
+    }
+    CHECK_FALSE(reader.next(got));
+    CHECK(reader.ok());
+}
+
+TEST_CASE("BinaryDiffReader — rejects damaged input") {
+    Fixture f({"a", "b", "c"}, {"a", "B", "c"});
+    const std::string data = f.render(StructuredFormat::Binary);
+    StructuredHunk hunk;
+
+    CHECK_FALSE(BinaryDiffReader("NOTDIFFY\x01").ok());
+
+    std::string wrong_version = data;
+    wrong_version[8] = 2;
+    CHECK_FALSE(BinaryDiffReader(wrong_version).ok());
+
+    // Cut inside the hunk record: its length runs past the end.
+    BinaryDiffReader truncated(std::string_view(data).substr(0, data.size() - 4));
+    REQUIRE(truncated.ok());
+    CHECK_FALSE(truncated.next(hunk));
+    CHECK_FALSE(truncated.ok());
+}
+
+TEST_CASE("varint — round-trips values and strings") {
+    std::string buf;
+    const std::vector<uint64_t> values = {0, 1, 127, 128, 300, 1ull << 35, ~0ull};
+    for (uint64_t v : values) {
+        put_varint(buf, v);
+    }
+    put_string(buf, "hello");
+    CHECK(buf.size() == 1 + 1 + 1 + 2 + 2 + 6 + 10 + 6);
+
+    VarintReader in{buf};
+    for (uint64_t v : values) {
+        CHECK(in.varint() == v);
+    }
+    CHECK(in.string() == "hello");
+    CHECK(in.ok);
+    in.varint();
+    CHECK_FALSE(in.ok);  // reading past the end
+}
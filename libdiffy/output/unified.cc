@@ -1,7 +1,10 @@
 #include "unified.hpp"
 
-#include "highlight/highlight_palette.hpp"  // syntax_color
+#include "highlight/highlight_palette.hpp"  // syntax_fg_escape
 #include "util/display_text.hpp"            // display_width
+#include "util/parallel.hpp"
+#include "util/sgr.hpp"
+#include "util/trace.hpp"
 
 #include <sys/stat.h>
 
@@ -63,19 +66,21 @@ get_file_timestamp(const std::string& path, char timestamp[256]) {
     return std::strftime(timestamp, MAX_LENGTH, time_format.c_str(), ltime) > 0;
 }
 
-// Colourise `body` (no trailing newline) using tree-sitter runs over `base`.
-// Runs are ordered, non-overlapping byte ranges; gaps and None runs keep the
-// base style, coloured runs get a truecolor foreground and then re-assert `base`
-// so its background persists to the end of the line.
-std::string
-colour_runs(const std::string& body,
+// Append `body` (no trailing newline) to `out`, colourised using tree-sitter
+// runs over `base`. Runs are ordered, non-overlapping byte ranges; gaps and None
+// runs keep the base style, coloured runs get a truecolor foreground on top of
+// it. `sgr` only writes the escapes that change between pieces.
+void
+colour_runs(std::string& out,
+            SgrWriter& sgr,
+            std::string_view body,
             const std::vector<HighlightRun>* runs,
             const std::string& base,
             bool light) {
     if (!runs || runs->empty()) {
-        return body;
+        out += body;
+        return;
     }
-    std::string out;
     size_t pos = 0;
     for (const auto& run : *runs) {
         if (run.start >= body.size()) {
@@ -83,24 +88,23 @@ colour_runs(const std::string& body,
         }
         const size_t end = std::min<size_t>(run.end, body.size());
         if (run.start > pos) {
+            sgr.set(out, {base});
             out += body.substr(pos, run.start - pos);
         }
-        if (run.group != HighlightGroup::None) {
-            const HlRgb c = syntax_color(run.group, light);
-            out += fmt::format("\033[38;2;{};{};{}m", c.r, c.g, c.b);
-            out += body.substr(run.start, end - run.start);
-            out += base;
-        } else {
-            out += body.substr(run.start, end - run.start);
-        }
+        sgr.set(out, {base, syntax_fg_escape(run.group, light)});
+        out += body.substr(run.start, end - run.start);
         pos = end;
     }
+    sgr.set(out, {base});
     if (pos < body.size()) {
         out += body.substr(pos);
     }
-    return out;
 }
 
+// Hunk lines rendered together on one worker when a diff is big enough to
+// render in parallel.
+constexpr std::size_t kParallelBatchLines = 8192;
+
 // Terminal columns occupied by `s` (which carries no ANSI escapes): UTF-8
 // codepoints count as one column each, tabs advance to the next multiple of 8
 // (the standard terminal tab stop), matching how the row is actually rendered so
@@ -108,7 +112,7 @@ colour_runs(const std::string& body,
 // display_width (tab_width = 8, the terminal tab stop) so this width logic lives
 // in one place alongside expand_for_display's column accounting.
 std::size_t
-display_cols(const std::string& s) {
+display_cols(std::string_view s) {
     return static_cast<std::size_t>(diffy::display_width(s, 8));
 }
 
@@ -124,16 +128,32 @@ diffy::unified_diff_render(const DiffInput<Line>& diff_input,
                            bool light_theme,
                            int64_t fill_width) {
     std::vector<std::string> udiff;
+    RowSink sink(udiff, true);
+    unified_diff_render(sink, diff_input, hunks, hunk_contexts, style, a_hl, b_hl, light_theme, fill_width);
+    sink.flush();
+    return udiff;
+}
 
+void
+diffy::unified_diff_render(OutputSink& out,
+                           const DiffInput<Line>& diff_input,
+                           const std::vector<Hunk>& hunks,
+                           const std::vector<std::string>* hunk_contexts,
+                           const ColumnViewTextStyleEscapeCodes* style,
+                           const LineHighlights* a_hl,
+                           const LineHighlights* b_hl,
+                           bool light_theme,
+                           int64_t fill_width) {
+    DIFFY_TRACE_SCOPE("render.unified");
     char timestamp[2][256];
     if (!get_file_timestamp(diff_input.A_name, timestamp[0])) {
         // TODO: Should return error code if this fails
-        return udiff;
+        return;
     }
 
     if (!get_file_timestamp(diff_input.B_name, timestamp[1])) {
         // TODO: Should return error code if this fails
-        return udiff;
+        return;
     }
 
     // Colour only when a theme is supplied; the plain path stays byte-identical
@@ -154,11 +174,17 @@ diffy::unified_diff_render(const DiffInput<Line>& diff_input,
         std::string a = fmt::format("--- {}\t{}", diff_input.A_name, timestamp[0]);
         std::string b = fmt::format("+++ {}\t{}", diff_input.B_name, timestamp[1]);
         if (color && !style->frame.empty()) {
-            udiff.push_back(style->frame + a + fill(display_cols(a)) + reset + "\n");
-            udiff.push_back(style->frame + b + fill(display_cols(b)) + reset + "\n");
+            out.write(style->frame);
+            out.write(a);
+            out.write(fill(display_cols(a)));
+            out.row(reset);
+            out.write(style->frame);
+            out.write(b);
+            out.write(fill(display_cols(b)));
+            out.row(reset);
         } else {
-            udiff.push_back(a + "\n");
-            udiff.push_back(b + "\n");
+            out.row(a);
+            out.row(b);
         }
     }
 
@@ -168,7 +194,9 @@ diffy::unified_diff_render(const DiffInput<Line>& diff_input,
         return fmt::format("{},{}", start, count);
     };
 
-    for (size_t hi = 0; hi < hunks.size(); ++hi) {
+    // Hunk `hi` into `dst`; a coloured content line is assembled in `line` before
+    // it's written.
+    auto render_hunk = [&](OutputSink& dst, size_t hi, std::string& line, SgrWriter& sgr) {
         const auto& hunk = hunks[hi];
         std::string ctx;
         if (hunk_contexts && hi < hunk_contexts->size() && !(*hunk_contexts)[hi].empty()) {
@@ -177,9 +205,12 @@ diffy::unified_diff_render(const DiffInput<Line>& diff_input,
         std::string header = fmt::format("@@ -{} +{} @@{}", format_change(hunk.from_start, hunk.from_count),
                                          format_change(hunk.to_start, hunk.to_count), ctx);
         if (color && !style->header.empty()) {
-            udiff.push_back(style->header + header + fill(display_cols(header)) + reset + "\n");
+            dst.write(style->header);
+            dst.write(header);
+            dst.write(fill(display_cols(header)));
+            dst.row(reset);
         } else {
-            udiff.push_back(header + "\n");
+            dst.row(header);
         }
 
         for (const auto& e : hunk.edit_units) {
@@ -198,7 +229,8 @@ diffy::unified_diff_render(const DiffInput<Line>& diff_input,
             const bool no_eol = text.empty() || text.back() != '\n';
 
             if (!color) {
-                udiff.push_back(fmt::format("{:1}{}", op, text));
+                dst.write(op);
+                dst.write(text);
             } else {
                 // Theme background for the line kind + tree-sitter syntax foreground.
                 const std::string& base = e.type == EditType::Insert  ? style->insert_line
@@ -214,27 +246,55 @@ diffy::unified_diff_render(const DiffInput<Line>& diff_input,
 
                 // Keep the trailing newline outside the coloured span so the reset
                 // lands before it (no background bleed past the line end).
-                std::string body = text;
-                std::string nl;
-                if (!body.empty() && body.back() == '\n') {
-                    nl = "\n";
-                    body.pop_back();
+                const std::string_view body =
+                    no_eol ? std::string_view(text) : std::string_view(text).substr(0, text.size() - 1);
+                line.clear();
+                sgr.set(line, {base});
+                line += op;
+                colour_runs(line, sgr, body, runs, base, light_theme);
+                line += fill(1 + display_cols(body));
+                sgr.reset(line);
+                if (!no_eol) {
+                    line += '\n';
                 }
-                udiff.push_back(base + op + colour_runs(body, runs, base, light_theme) +
-                                fill(1 + display_cols(body)) + reset + nl);
+                dst.write(line);
             }
 
             // Emit the marker per side, immediately after the affected +/-/context
             // line, the way diff/patch expect it. Terminate the content line first
             // so the marker stands on its own row (the source lacks the newline).
             if (no_eol) {
-                if (udiff.back().empty() || udiff.back().back() != '\n') {
-                    udiff.back() += "\n";
-                }
-                udiff.push_back("\\ No newline at end of file\n");
+                dst.write("\n");
+                dst.row("\\ No newline at end of file");
             }
         }
+    };
+
+    const std::vector<std::size_t> batches = parallel_batches(
+        hunks.size(), [&](std::size_t i) { return hunks[i].edit_units.size(); }, kParallelBatchLines);
+    if (batches.size() <= 2 || on_parallel_worker) {
+        std::string line;
+        SgrWriter sgr;
+        for (size_t hi = 0; hi < hunks.size(); ++hi) {
+            render_hunk(out, hi, line, sgr);
+        }
+        return;
     }
 
-    return udiff;
+    // A large diff is rendered a batch of hunks per worker (unless this is one
+    // already, under a directory diff), each into a buffer of its own, and
+    // written out in order. Every line ends with a reset, so a batch
+    // starting from a fresh SgrWriter writes what the serial pass would.
+    parallel_for_ordered(
+        batches.size() - 1,
+        [&](std::size_t b) {
+            StringSink batch;
+            std::string line;
+            SgrWriter sgr;
+            for (size_t hi = batches[b]; hi < batches[b + 1]; ++hi) {
+                render_hunk(batch, hi, line, sgr);
+            }
+            return batch.str();
+        },
+        [&](std::size_t, const std::string& text) { out.write(text); });
 }
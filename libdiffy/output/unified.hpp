@@ -3,6 +3,7 @@
 #include "algorithms/algorithm.hpp"
 #include "config/config.hpp"                 // ColumnViewTextStyleEscapeCodes
 #include "highlight/syntax_highlighter.hpp"  // LineHighlights
+#include "output/output_sink.hpp"
 #include "processing/diff_hunk.hpp"
 #include "util/readlines.hpp"
 
@@ -33,4 +34,17 @@ unified_diff_render(const DiffInput<Line>& diff_input,
                     bool light_theme = false,
                     int64_t fill_width = 0);
 
+// As above, streamed into `out`: each row is written, newline-terminated, as
+// it's produced rather than collected first.
+void
+unified_diff_render(OutputSink& out,
+                    const DiffInput<Line>& diff_input,
+                    const std::vector<Hunk>& hunks,
+                    const std::vector<std::string>* hunk_contexts = nullptr,
+                    const ColumnViewTextStyleEscapeCodes* style = nullptr,
+                    const LineHighlights* a_hl = nullptr,
+                    const LineHighlights* b_hl = nullptr,
+                    bool light_theme = false,
+                    int64_t fill_width = 0);
+
 }  // namespace diffy
@@ -104,3 +104,31 @@ TEST_CASE("unified_diff_render — missing file name yields empty output") {
     auto out = unified_diff_render(in, {});
     CHECK(out.empty());
 }
+
+TEST_CASE("unified_diff_render — a diff rendered in parallel batches matches hunk-by-hunk output") {
+    std::string a, b;
+    for (int i = 0; i < 20000; i++) {
+        const std::string line = "line " + std::to_string(i) + "\n";
+        a += line;
+        b += i % 10 == 5 ? "changed " + line : line;
+    }
+    auto pa = write_temp("diffy_parallel_a.txt", a);
+    auto pb = write_temp("diffy_parallel_b.txt", b);
+    auto A = readlines(pa, false);
+    auto B = readlines(pb, false);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, pa, pb};
+    auto hunks = compose_hunks(Patience<Line>(in).compute().edit_sequence, 3);
+    REQUIRE(hunks.size() == 2000);
+
+    // Each hunk on its own is too small to split; its rows follow the two file headers.
+    std::vector<std::string> want;
+    for (const auto& hunk : hunks) {
+        auto one = unified_diff_render(in, {hunk});
+        REQUIRE(one.size() > 2);
+        if (want.empty()) {
+            want.insert(want.end(), one.begin(), one.begin() + 2);
+        }
+        want.insert(want.end(), one.begin() + 2, one.end());
+    }
+    CHECK(unified_diff_render(in, hunks) == want);
+}
@@ -1,5 +1,7 @@
 #include "diff_hunk.hpp"
 
+#include "util/trace.hpp"
+
 using namespace diffy;
 
 namespace {
@@ -87,6 +89,7 @@ extend_hunk_ranges(const std::vector<Edit>& edit_sequence,
 // Compose a list of Hunks from a sequence of edits.
 std::vector<Hunk>
 diffy::compose_hunks(const std::vector<Edit>& edit_sequence, const int64_t context_size) {
+    DIFFY_TRACE_SCOPE("compose_hunks");
     // DEBUG("compose_hunks: context lines = {}", context_size);
 
     // Start by finding all hunks without taking context size into consideration.
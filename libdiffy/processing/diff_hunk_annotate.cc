@@ -1,8 +1,10 @@
 #include "diff_hunk_annotate.hpp"
 
+#include "algorithms/myers_greedy.hpp"
 #include "algorithms/myers_linear.hpp"
 #include "algorithms/patience.hpp"
 #include "processing/tokenizer.hpp"
+#include "util/trace.hpp"
 
 #include <fmt/format.h>
 
@@ -41,6 +43,17 @@ struct TokenEdit {
     }
 };
 
+// One byte of a line, for the character-granularity diff. Only equality is
+// needed: MyersGreedy never hashes its units.
+struct ByteUnit {
+    char c;
+
+    bool
+    operator==(const ByteUnit& other) const {
+        return c == other.c;
+    }
+};
+
 EditType
 resolve_edit_type_from_indices(EditIndex idx_a, EditIndex idx_b) {
     if (idx_a.valid && !idx_b.valid) {
@@ -82,6 +95,27 @@ line_similarity(const std::vector<Token>& ta, const std::vector<Token>& tb) {
     return (2.0 * common) / static_cast<double>(tot_a + tot_b);
 }
 
+// Shared prefix + suffix bytes as a fraction of both lines (Dice-style, 0..1).
+// Token similarity undervalues a one-byte edit inside one long token (a base64
+// blob, a minified line), which is exactly what character granularity is for, so
+// Char pairing also accepts lines that mostly agree at both ends.
+double
+affix_similarity(const std::string& a, const std::string& b) {
+    if (a.empty() && b.empty()) {
+        return 1.0;
+    }
+    const std::size_t n = std::min(a.size(), b.size());
+    std::size_t prefix = 0;
+    while (prefix < n && a[prefix] == b[prefix]) {
+        prefix++;
+    }
+    std::size_t suffix = 0;
+    while (suffix < n - prefix && a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) {
+        suffix++;
+    }
+    return (2.0 * static_cast<double>(prefix + suffix)) / static_cast<double>(a.size() + b.size());
+}
+
 // Every token of `line` marked `type`; for context/common lines and for changed
 // lines with no similar counterpart (a pure add or delete).
 void
@@ -142,165 +176,299 @@ diff_line_pair(const std::string& la,
     }
 }
 
+// Per-line cost budget for the character-granularity diff: the maximum number of
+// inserted + deleted bytes (after the shared prefix/suffix is peeled) before a
+// pair is considered too different to show byte by byte. Keeps the bounded Myers
+// run at O((N+M) * budget) per line; over budget the pair falls back to tokens.
+constexpr int64_t kCharCostBudget = 256;
+
+// Turn one side's per-byte edit types into segments. Whitespace/line-ending
+// tokens stay atomic (the renderers substitute glyphs per token length, so a
+// half-changed CRLF would lose its marker); inside other tokens runs are snapped
+// to UTF-8 code point boundaries so a changed multi-byte character is never
+// split across two styled segments.
+void
+char_segments(const std::string& line,
+              const std::vector<EditType>& byte_types,
+              EditType changed,
+              EditLine& out,
+              bool ignore_whitespace) {
+    for (const auto& tk : tokenize(line)) {
+        const std::size_t tk_end = tk.start + tk.length;
+        if (tk.flags != TokenFlagNone) {
+            auto et = EditType::Common;
+            for (std::size_t i = tk.start; i < tk_end; i++) {
+                if (byte_types[i] != EditType::Common) {
+                    et = changed;
+                    break;
+                }
+            }
+            if (ignore_whitespace && (tk.flags & (TokenFlagSpace | TokenFlagTab))) {
+                et = EditType::Common;
+            }
+            out.segments.push_back({tk.start, tk.length, tk.flags, et});
+            continue;
+        }
+        std::size_t run_start = tk.start;
+        auto run_type = EditType::Meta;
+        std::size_t cp = tk.start;
+        while (cp < tk_end) {
+            std::size_t cp_end = cp + 1;
+            while (cp_end < tk_end && (static_cast<unsigned char>(line[cp_end]) & 0xC0) == 0x80) {
+                cp_end++;
+            }
+            auto cp_type = EditType::Common;
+            for (std::size_t i = cp; i < cp_end; i++) {
+                if (byte_types[i] != EditType::Common) {
+                    cp_type = changed;
+                    break;
+                }
+            }
+            if (cp_type != run_type) {
+                if (cp > run_start) {
+                    out.segments.push_back({run_start, cp - run_start, tk.flags, run_type});
+                }
+                run_start = cp;
+                run_type = cp_type;
+            }
+            cp = cp_end;
+        }
+        out.segments.push_back({run_start, tk_end - run_start, tk.flags, run_type});
+    }
+}
+
+// Byte-diff two single lines under kCharCostBudget. Returns false (leaving both
+// EditLines untouched) when the pair is over budget, so the caller can fall back
+// to the token diff.
+bool
+diff_line_pair_chars(const std::string& la,
+                     const std::string& lb,
+                     EditLine& aline,
+                     EditLine& bline,
+                     bool ignore_whitespace) {
+    std::vector<ByteUnit> a, b;
+    a.reserve(la.size());
+    b.reserve(lb.size());
+    for (char c : la) {
+        a.push_back({c});
+    }
+    for (char c : lb) {
+        b.push_back({c});
+    }
+    DiffInput<ByteUnit> in{a, b, "l", "r"};
+    MyersGreedy<ByteUnit> differ(in);
+    differ.max_cost = kCharCostBudget;
+    auto res = differ.compute();
+    if (res.status == DiffResultStatus::Failed) {
+        return false;
+    }
+
+    std::vector<EditType> a_types(la.size(), EditType::Delete);
+    std::vector<EditType> b_types(lb.size(), EditType::Insert);
+    for (const auto& e : res.edit_sequence) {
+        if (e.type == EditType::Common) {
+            a_types[static_cast<std::size_t>(e.a_index.value)] = EditType::Common;
+            b_types[static_cast<std::size_t>(e.b_index.value)] = EditType::Common;
+        }
+    }
+    if (res.status == DiffResultStatus::NoChanges) {
+        // MyersGreedy reports an identical core without an edit sequence.
+        std::fill(a_types.begin(), a_types.end(), EditType::Common);
+        std::fill(b_types.begin(), b_types.end(), EditType::Common);
+    }
+    char_segments(la, a_types, EditType::Delete, aline, ignore_whitespace);
+    char_segments(lb, b_types, EditType::Insert, bline, ignore_whitespace);
+    return true;
+}
+
 // ALG-3: intra-line highlighting by pairing changed lines. Instead of diffing all
 // of a hunk's changed tokens as one concatenated stream per side (which let a
 // unique token anchor line 1 of A to line 7 of B), pair each deleted line with
 // its most similar inserted line and token-diff within the pair; unpaired lines
-// are whole-line adds/deletes.
-std::vector<AnnotatedHunk>
+// are whole-line adds/deletes. With `char_level` each pair is diffed byte by byte
+// instead (EditGranularity::Char), falling back to tokens when over budget.
+AnnotatedHunk
 annotate_tokens(const DiffInput<diffy::Line>& diff_input,
-                const std::vector<Hunk>& hunks,
-                bool ignore_whitespace) {
+                const Hunk& hunk,
+                bool ignore_whitespace,
+                bool char_level) {
     // Cap the O(deletes × inserts) similarity search so a pathological hunk can't
     // blow up; above it, changed lines fall back to whole-line add/delete.
     constexpr size_t kPairBudget = 4096;
     constexpr double kPairThreshold = 0.30;  // below this, treat as unrelated add + delete
 
-    std::vector<AnnotatedHunk> output;
-    for (const auto& hunk : hunks) {
-        AnnotatedHunk ahunk;
-        ahunk.from_start = hunk.from_start;
-        ahunk.from_count = hunk.from_count;
-        ahunk.to_start = hunk.to_start;
-        ahunk.to_count = hunk.to_count;
-        ahunk.a_lines.resize(static_cast<size_t>(hunk.from_count));
-        ahunk.b_lines.resize(static_cast<size_t>(hunk.to_count));
-
-        // Deleted lines (A-side) and inserted lines (B-side) are candidates for
-        // pairing; context/common lines get whole-line Common segments immediately.
-        struct ChangedLine {
-            size_t line_idx;  // index into ahunk.a_lines / b_lines
-            std::string text;
-            std::vector<Token> tokens;
-        };
-        std::vector<ChangedLine> dels, inss;
-
-        size_t a_i = 0, b_i = 0;
-        for (const auto& edit : hunk.edit_units) {
-            if (edit.a_index.valid) {
-                const std::string& line = diff_input.A[static_cast<long>(edit.a_index)].line;
-                ahunk.a_lines[a_i].type = edit.type;
-                ahunk.a_lines[a_i].line_index = edit.a_index;
-                if (edit.type == EditType::Delete) {
-                    dels.push_back({a_i, line, tokenize(line)});
-                } else {
-                    whole_line_segments(line, edit.type, ahunk.a_lines[a_i], ignore_whitespace);
-                }
-                a_i++;
+    AnnotatedHunk ahunk;
+    ahunk.from_start = hunk.from_start;
+    ahunk.from_count = hunk.from_count;
+    ahunk.to_start = hunk.to_start;
+    ahunk.to_count = hunk.to_count;
+    ahunk.a_lines.resize(static_cast<size_t>(hunk.from_count));
+    ahunk.b_lines.resize(static_cast<size_t>(hunk.to_count));
+
+    // Deleted lines (A-side) and inserted lines (B-side) are candidates for
+    // pairing; context/common lines get whole-line Common segments immediately.
+    struct ChangedLine {
+        size_t line_idx;  // index into ahunk.a_lines / b_lines
+        std::string text;
+        std::vector<Token> tokens;
+    };
+    std::vector<ChangedLine> dels, inss;
+
+    size_t a_i = 0, b_i = 0;
+    for (const auto& edit : hunk.edit_units) {
+        if (edit.a_index.valid) {
+            const std::string& line = diff_input.A[static_cast<long>(edit.a_index)].line;
+            ahunk.a_lines[a_i].type = edit.type;
+            ahunk.a_lines[a_i].line_index = edit.a_index;
+            if (edit.type == EditType::Delete) {
+                dels.push_back({a_i, line, tokenize(line)});
+            } else {
+                whole_line_segments(line, edit.type, ahunk.a_lines[a_i], ignore_whitespace);
             }
-            if (edit.b_index.valid) {
-                const std::string& line = diff_input.B[static_cast<long>(edit.b_index)].line;
-                ahunk.b_lines[b_i].type = edit.type;
-                ahunk.b_lines[b_i].line_index = edit.b_index;
-                if (edit.type == EditType::Insert) {
-                    inss.push_back({b_i, line, tokenize(line)});
-                } else {
-                    whole_line_segments(line, edit.type, ahunk.b_lines[b_i], ignore_whitespace);
-                }
-                b_i++;
+            a_i++;
+        }
+        if (edit.b_index.valid) {
+            const std::string& line = diff_input.B[static_cast<long>(edit.b_index)].line;
+            ahunk.b_lines[b_i].type = edit.type;
+            ahunk.b_lines[b_i].line_index = edit.b_index;
+            if (edit.type == EditType::Insert) {
+                inss.push_back({b_i, line, tokenize(line)});
+            } else {
+                whole_line_segments(line, edit.type, ahunk.b_lines[b_i], ignore_whitespace);
             }
+            b_i++;
         }
+    }
 
-        // Greedy best-match pairing: score every delete×insert pair, then assign the
-        // highest-scoring pairs first, each line used at most once.
-        std::vector<bool> del_used(dels.size(), false), ins_used(inss.size(), false);
-        if (!dels.empty() && !inss.empty() && dels.size() * inss.size() <= kPairBudget) {
-            struct Cand {
-                double sim;
-                size_t di;
-                size_t ii;
-            };
-            std::vector<Cand> cands;
-            for (size_t di = 0; di < dels.size(); di++) {
-                for (size_t ii = 0; ii < inss.size(); ii++) {
-                    const double s = line_similarity(dels[di].tokens, inss[ii].tokens);
-                    if (s >= kPairThreshold) {
-                        cands.push_back({s, di, ii});
-                    }
+    // Greedy best-match pairing: score every delete×insert pair, then assign the
+    // highest-scoring pairs first, each line used at most once.
+    std::vector<bool> del_used(dels.size(), false), ins_used(inss.size(), false);
+    if (!dels.empty() && !inss.empty() && dels.size() * inss.size() <= kPairBudget) {
+        struct Cand {
+            double sim;
+            size_t di;
+            size_t ii;
+        };
+        std::vector<Cand> cands;
+        for (size_t di = 0; di < dels.size(); di++) {
+            for (size_t ii = 0; ii < inss.size(); ii++) {
+                double s = line_similarity(dels[di].tokens, inss[ii].tokens);
+                if (char_level && s < kPairThreshold) {
+                    s = affix_similarity(dels[di].text, inss[ii].text);
                 }
-            }
-            std::stable_sort(cands.begin(), cands.end(),
-                             [](const Cand& x, const Cand& y) { return x.sim > y.sim; });
-            for (const auto& c : cands) {
-                if (del_used[c.di] || ins_used[c.ii]) {
-                    continue;
+                if (s >= kPairThreshold) {
+                    cands.push_back({s, di, ii});
                 }
-                del_used[c.di] = ins_used[c.ii] = true;
-                diff_line_pair(dels[c.di].text, inss[c.ii].text, ahunk.a_lines[dels[c.di].line_idx],
-                               ahunk.b_lines[inss[c.ii].line_idx], ignore_whitespace);
             }
         }
-        // Unpaired changed lines are pure delete / insert.
-        for (size_t di = 0; di < dels.size(); di++) {
-            if (!del_used[di]) {
-                whole_line_segments(dels[di].text, EditType::Delete,
-                                    ahunk.a_lines[dels[di].line_idx], ignore_whitespace);
+        std::stable_sort(cands.begin(), cands.end(),
+                         [](const Cand& x, const Cand& y) { return x.sim > y.sim; });
+        for (const auto& c : cands) {
+            if (del_used[c.di] || ins_used[c.ii]) {
+                continue;
             }
-        }
-        for (size_t ii = 0; ii < inss.size(); ii++) {
-            if (!ins_used[ii]) {
-                whole_line_segments(inss[ii].text, EditType::Insert,
-                                    ahunk.b_lines[inss[ii].line_idx], ignore_whitespace);
+            del_used[c.di] = ins_used[c.ii] = true;
+            EditLine& aline = ahunk.a_lines[dels[c.di].line_idx];
+            EditLine& bline = ahunk.b_lines[inss[c.ii].line_idx];
+            if (char_level &&
+                diff_line_pair_chars(dels[c.di].text, inss[c.ii].text, aline, bline, ignore_whitespace)) {
+                continue;
             }
+            diff_line_pair(dels[c.di].text, inss[c.ii].text, aline, bline, ignore_whitespace);
+        }
+    }
+    // Unpaired changed lines are pure delete / insert.
+    for (size_t di = 0; di < dels.size(); di++) {
+        if (!del_used[di]) {
+            whole_line_segments(dels[di].text, EditType::Delete,
+                                ahunk.a_lines[dels[di].line_idx], ignore_whitespace);
+        }
+    }
+    for (size_t ii = 0; ii < inss.size(); ii++) {
+        if (!ins_used[ii]) {
+            whole_line_segments(inss[ii].text, EditType::Insert,
+                                ahunk.b_lines[inss[ii].line_idx], ignore_whitespace);
         }
-
-        output.push_back(std::move(ahunk));
     }
-    return output;
+
+    return ahunk;
 }
 
-std::vector<AnnotatedHunk>
-annotate_lines(const DiffInput<diffy::Line>& diff_input,
-               const std::vector<Hunk>& hunks,
-               bool ignore_whitespace) {
-    std::vector<AnnotatedHunk> output;
-
-    for (auto& hunk : hunks) {
-        AnnotatedHunk ahunk;
-        ahunk.from_start = hunk.from_start;
-        ahunk.from_count = hunk.from_count;
-        ahunk.to_start = hunk.to_start;
-        ahunk.to_count = hunk.to_count;
-
-        for (auto& edit : hunk.edit_units) {
-            if (edit.a_index.valid) {
-                const auto& a_line = diff_input.A[static_cast<long>(edit.a_index)].line;
-                ahunk.a_lines.push_back({edit.type, edit.a_index, {}});
-                for (const auto& token : tokenize(a_line)) {
-                    auto edit_type = edit.type;
-                    if (ignore_whitespace && (token.flags & (TokenFlagSpace | TokenFlagTab))) {
-                        edit_type = EditType::Common;
-                    }
-                    ahunk.a_lines.back().segments.push_back(
-                        {token.start, token.length, token.flags, edit_type});
+AnnotatedHunk
+annotate_lines(const DiffInput<diffy::Line>& diff_input, const Hunk& hunk, bool ignore_whitespace) {
+    AnnotatedHunk ahunk;
+    ahunk.from_start = hunk.from_start;
+    ahunk.from_count = hunk.from_count;
+    ahunk.to_start = hunk.to_start;
+    ahunk.to_count = hunk.to_count;
+
+    for (auto& edit : hunk.edit_units) {
+        if (edit.a_index.valid) {
+            const auto& a_line = diff_input.A[static_cast<long>(edit.a_index)].line;
+            ahunk.a_lines.push_back({edit.type, edit.a_index, {}});
+            for (const auto& token : tokenize(a_line)) {
+                auto edit_type = edit.type;
+                if (ignore_whitespace && (token.flags & (TokenFlagSpace | TokenFlagTab))) {
+                    edit_type = EditType::Common;
                 }
+                ahunk.a_lines.back().segments.push_back(
+                    {token.start, token.length, token.flags, edit_type});
             }
+        }
 
-            if (edit.b_index.valid) {
-                const auto& b_line = diff_input.B[static_cast<long>(edit.b_index)].line;
-                ahunk.b_lines.push_back({edit.type, edit.b_index, {}});
-                for (const auto& token : tokenize(b_line)) {
-                    auto edit_type = edit.type;
-                    if (ignore_whitespace && (token.flags & (TokenFlagSpace | TokenFlagTab))) {
-                        edit_type = EditType::Common;
-                    }
-                    ahunk.b_lines.back().segments.push_back(
-                        {token.start, token.length, token.flags, edit_type});
+        if (edit.b_index.valid) {
+            const auto& b_line = diff_input.B[static_cast<long>(edit.b_index)].line;
+            ahunk.b_lines.push_back({edit.type, edit.b_index, {}});
+            for (const auto& token : tokenize(b_line)) {
+                auto edit_type = edit.type;
+                if (ignore_whitespace && (token.flags & (TokenFlagSpace | TokenFlagTab))) {
+                    edit_type = EditType::Common;
                 }
+                ahunk.b_lines.back().segments.push_back(
+                    {token.start, token.length, token.flags, edit_type});
             }
         }
-        output.push_back(ahunk);
     }
-    return output;
+    return ahunk;
 }
 
+// Stamp the move tags of a MoveIndex onto one annotated hunk's pure delete/insert lines.
+void
+apply_moves(const MoveIndex& moves, AnnotatedHunk& ahunk) {
+    if (moves.a_lines.empty() && moves.b_lines.empty()) {
+        return;
+    }
+    for (auto& el : ahunk.a_lines) {
+        if (el.type == EditType::Delete && el.line_index.valid) {
+            if (auto it = moves.a_lines.find(static_cast<int64_t>(el.line_index)); it != moves.a_lines.end()) {
+                el.move_id = it->second.move_id;
+                el.move_line = it->second.move_line;
+            }
+        }
+    }
+    for (auto& el : ahunk.b_lines) {
+        if (el.type == EditType::Insert && el.line_index.valid) {
+            if (auto it = moves.b_lines.find(static_cast<int64_t>(el.line_index)); it != moves.b_lines.end()) {
+                el.move_id = it->second.move_id;
+                el.move_line = it->second.move_line;
+            }
+        }
+    }
+}
+
+}  // namespace
+
 // Tag deleted/inserted lines that form a block reappearing verbatim elsewhere in
 // the diff as a move (GAP-9): a run of >= kMinMoveLines deleted lines whose
 // content matches a run of inserted lines gets a shared move_id, and each line
 // records the counterpart block's start line so the UI can draw an arrow (within
-// the file) or a reference. Runs as a cross-hunk pass over the whole file diff.
-void
-detect_moves(const DiffInput<diffy::Line>& in, std::vector<AnnotatedHunk>& hunks) {
+// the file) or a reference. Runs as a cross-hunk pass over the raw hunks, so it
+// needs no annotation and can run before (or instead of) annotating them all.
+MoveIndex
+diffy::detect_moves(const DiffInput<diffy::Line>& in,
+                    const std::vector<Hunk>& hunks,
+                    const MoveOptions& options) {
+    DIFFY_TRACE_SCOPE("detect_moves");
     // A line-hash match alone does NOT make a move: a run of bare "}" / "});" / blank
     // lines matches all over a file yet relocates nothing. So every candidate run must
     // (a) be long enough and (b) carry real content — measured as the number of lines
@@ -316,123 +484,370 @@ detect_moves(const DiffInput<diffy::Line>& in, std::vector<AnnotatedHunk>& hunks
     constexpr int kMinShortMoveLines = 2;
     constexpr size_t kMinShortMoveChars = 16;
     constexpr size_t kMinSubstantiveMoveLines = 2;  // lines that must carry real content
-    constexpr size_t kMoveBudget = 1u << 22;  // skip pathological dels*inss searches
+    // Candidates come from a Rabin-Karp index of every kMinShortMoveLines-line window
+    // of inserted lines, so each deleted window is one hash probe instead of a scan.
+    // A window made only of bracket/blank lines is never indexed (it can't start a run
+    // that passes the content gate on its own); such lines still join a block that a
+    // content window anchored, above it or below. A probe tries at most
+    // kMaxWindowCandidates occurrences of its window, the first ones not yet claimed
+    // by a block. Together these keep the pass near-linear with no whole-file cut-off,
+    // so large refactors still get their moves marked.
+    constexpr size_t kWindow = static_cast<size_t>(kMinShortMoveLines);
+    constexpr size_t kMaxWindowCandidates = 64;
+    constexpr uint64_t kWindowBase = 0x100000001b3ull;
+    const size_t max_edits = static_cast<size_t>(std::max(0, options.max_edited_lines));
 
     struct Ref {
-        EditLine* el;
+        int64_t index;            // 0-based line index on its side
         uint32_t hash;
-        int64_t lineno;           // 1-based
         const std::string* text;  // for content-verify (guards hash collisions)
+        bool has_content;         // >= 1 identifier/literal char (see the gate below)
+        uint32_t nonws;           // non-whitespace byte count
     };
-    std::vector<Ref> dels, inss;
-    for (auto& h : hunks) {
-        for (auto& el : h.a_lines) {
-            if (el.type == EditType::Delete && el.line_index.valid) {
-                const auto& L = in.A[static_cast<long>(el.line_index)];
-                dels.push_back({&el, L.checksum, static_cast<int64_t>(el.line_index) + 1, &L.line});
+    // A "content" line has >= 1 identifier/literal char (alphanumeric, '_', or a
+    // non-ASCII byte, which in UTF-8 is part of a word/string); pure bracket/blank
+    // lines have none. Both facts come from the line's readlines metadata.
+    //
+    // Matching modulo whitespace reuses the line's own checksum when it was read with
+    // whitespace ignored (its cmp_key is already the stripped text). Otherwise the hash
+    // is taken over the visible bytes (above ' ', as LineInfo::nonws counts them) in
+    // place, and same_line verifies by walking both lines past the rest, so no
+    // per-line copy is made.
+    auto visible = [](char c) { return static_cast<unsigned char>(c) > ' '; };
+    auto make_ref = [&options, &visible](int64_t index, const Line& L) {
+        const LineInfo info = L.info();
+        Ref r{index, L.checksum, &L.line, info.content, info.nonws};
+        if (options.ignore_whitespace) {
+            if (L.has_cmp_key) {
+                r.text = &L.cmp_key;
+            } else {
+                uint32_t h = 2166136261u;
+                for (char c : L.line) {
+                    if (visible(c)) {
+                        h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+                    }
+                }
+                r.hash = h;
             }
         }
-        for (auto& el : h.b_lines) {
-            if (el.type == EditType::Insert && el.line_index.valid) {
-                const auto& L = in.B[static_cast<long>(el.line_index)];
-                inss.push_back({&el, L.checksum, static_cast<int64_t>(el.line_index) + 1, &L.line});
+        return r;
+    };
+    auto same_squeezed = [&visible](const std::string& a, const std::string& b) {
+        size_t i = 0, j = 0;
+        for (;;) {
+            while (i < a.size() && !visible(a[i])) {
+                i++;
+            }
+            while (j < b.size() && !visible(b[j])) {
+                j++;
+            }
+            if (i == a.size() || j == b.size()) {
+                return i == a.size() && j == b.size();
+            }
+            if (a[i++] != b[j++]) {
+                return false;
+            }
+        }
+    };
+    auto same_line = [&options, &same_squeezed](const Ref& d, const Ref& i) {
+        if (d.hash != i.hash) {
+            return false;
+        }
+        return options.ignore_whitespace ? same_squeezed(*d.text, *i.text) : *d.text == *i.text;
+    };
+    MoveIndex moves;
+    std::vector<Ref> dels, inss;
+    for (const auto& h : hunks) {
+        for (const auto& e : h.edit_units) {
+            if (e.type == EditType::Delete && e.a_index.valid) {
+                dels.push_back(make_ref(e.a_index, in.A[static_cast<long>(e.a_index)]));
+            } else if (e.type == EditType::Insert && e.b_index.valid) {
+                inss.push_back(make_ref(e.b_index, in.B[static_cast<long>(e.b_index)]));
             }
         }
     }
-    if (dels.empty() || inss.empty() || dels.size() * inss.size() > kMoveBudget) {
-        return;
+    if (dels.size() < kWindow || inss.size() < kWindow) {
+        return moves;
+    }
+
+    // Rolling hash of each kWindow-line window; window_hashes[i] covers refs[i, i+kWindow).
+    auto window_hashes = [](const std::vector<Ref>& refs) {
+        uint64_t top = 1;  // kWindowBase^(kWindow-1), to drop the outgoing line
+        for (size_t k = 1; k < kWindow; ++k) {
+            top *= kWindowBase;
+        }
+        std::vector<uint64_t> out(refs.size() - kWindow + 1);
+        uint64_t h = 0;
+        for (size_t k = 0; k < kWindow; ++k) {
+            h = h * kWindowBase + refs[k].hash;
+        }
+        out[0] = h;
+        for (size_t i = 1; i < out.size(); ++i) {
+            h = (h - refs[i - 1].hash * top) * kWindowBase + refs[i + kWindow - 1].hash;
+            out[i] = h;
+        }
+        return out;
+    };
+    auto window_has_content = [](const std::vector<Ref>& refs, size_t start) {
+        for (size_t k = 0; k < kWindow; ++k) {
+            if (refs[start + k].has_content) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Every occurrence of an inserted window, in order; at[0, head) are claimed.
+    struct Occurrences {
+        std::vector<uint32_t> at;
+        size_t head = 0;
+    };
+    const auto del_windows = window_hashes(dels);
+    const auto ins_windows = window_hashes(inss);
+    std::unordered_map<uint64_t, Occurrences> ins_by_window;
+    for (size_t k = 0; k < ins_windows.size(); ++k) {
+        if (window_has_content(inss, k)) {
+            ins_by_window[ins_windows[k]].at.push_back(static_cast<uint32_t>(k));
+        }
     }
 
-    std::unordered_multimap<uint32_t, size_t> ins_by_hash;
-    for (size_t k = 0; k < inss.size(); ++k) {
-        ins_by_hash.emplace(inss[k].hash, k);
+    // Prefix sums over the deleted side so the gate is O(1) per candidate run.
+    std::vector<size_t> substantive_prefix(dels.size() + 1, 0), nonws_prefix(dels.size() + 1, 0);
+    for (size_t k = 0; k < dels.size(); ++k) {
+        substantive_prefix[k + 1] = substantive_prefix[k] + (dels[k].has_content ? 1 : 0);
+        nonws_prefix[k + 1] = nonws_prefix[k] + dels[k].nonws;
     }
 
     std::vector<bool> ins_used(inss.size(), false);
+    // The first kMaxWindowCandidates unclaimed occurrences in `o`. Claimed ones met on
+    // the way are dropped for good (the kept ones slide up to the new head), so each
+    // occurrence is skipped at most once over the whole pass.
+    auto unclaimed = [&ins_used](Occurrences& o) {
+        uint32_t keep[kMaxWindowCandidates];
+        size_t kept = 0, r = o.head;
+        for (; r < o.at.size() && kept < kMaxWindowCandidates; ++r) {
+            if (!ins_used[o.at[r]]) {
+                keep[kept++] = o.at[r];
+            }
+        }
+        o.head = r - kept;
+        std::copy(keep, keep + kept, o.at.begin() + static_cast<long>(o.head));
+        return gsl::span<const uint32_t>(o.at.data() + o.head, kept);
+    };
+    size_t claimed_end = 0;  // dels before this belong to an accepted block
     int next_move_id = 0;
     for (size_t di = 0; di < dels.size();) {
-        // Longest still-free insert run matching the delete run starting at di.
-        size_t best_len = 0, best_ii = 0;
-        auto range = ins_by_hash.equal_range(dels[di].hash);
-        for (auto it = range.first; it != range.second; ++it) {
-            size_t ii = it->second;
-            size_t len = 0;
-            while (di + len < dels.size() && ii + len < inss.size() && !ins_used[ii + len] &&
-                   dels[di + len].hash == inss[ii + len].hash &&
-                   *dels[di + len].text == *inss[ii + len].text) {
-                ++len;
+        // Longest still-free insert run matching the delete run starting at di. With
+        // max_edited_lines, up to that many lines inside the run may differ (a moved
+        // block that was also touched up); an edited line is only bridged when the
+        // block resumes right after it, so a run never ends on a mismatch.
+        size_t best_len = 0, best_ii = 0, best_edits = 0;
+        auto found = di < del_windows.size() ? ins_by_window.find(del_windows[di]) : ins_by_window.end();
+        if (found != ins_by_window.end()) {
+            for (size_t ii : unclaimed(found->second)) {
+                size_t len = 0, edits = 0;
+                while (di + len < dels.size() && ii + len < inss.size() && !ins_used[ii + len]) {
+                    if (same_line(dels[di + len], inss[ii + len])) {
+                        ++len;
+                    } else if (edits < max_edits && di + len + 1 < dels.size() &&
+                               ii + len + 1 < inss.size() && !ins_used[ii + len + 1] &&
+                               same_line(dels[di + len + 1], inss[ii + len + 1])) {
+                        ++edits;
+                        ++len;
+                    } else {
+                        break;
+                    }
+                }
+                if (len > best_len || (len == best_len && edits < best_edits)) {
+                    best_len = len;
+                    best_ii = ii;
+                    best_edits = edits;
+                }
             }
-            if (len > best_len) {
-                best_len = len;
-                best_ii = ii;
+        }
+        // A seed window can't start on an edited line, so an edit near the top of the
+        // block would cut its head off; walk back over it (and the matching lines above)
+        // while the edit allowance lasts, never into an already claimed block.
+        size_t back = 0;
+        while (best_len > 0 && best_edits < max_edits && di - back >= claimed_end + 2 &&
+               best_ii - back >= 2 && !ins_used[best_ii - back - 1] && !ins_used[best_ii - back - 2] &&
+               same_line(dels[di - back - 2], inss[best_ii - back - 2])) {
+            back += 2;
+            ++best_edits;
+            while (di - back > claimed_end && best_ii - back > 0 && !ins_used[best_ii - back - 1] &&
+                   same_line(dels[di - back - 1], inss[best_ii - back - 1])) {
+                ++back;
             }
         }
+        size_t run_di = di - back;
+        size_t run_ii = best_ii - back;
+        size_t run_len = best_len + back;
+        // Bracket/blank windows aren't indexed, so a block opening with such lines
+        // (a "}" closing what precedes it, blank separators) was seeded below them;
+        // take them in while they match.
+        while (run_len > 0 && run_di > claimed_end && run_ii > 0 && !ins_used[run_ii - 1] &&
+               same_line(dels[run_di - 1], inss[run_ii - 1])) {
+            --run_di;
+            --run_ii;
+            ++run_len;
+        }
+
         // Quality gate (GAP-9): a hash match is not enough. Count, across the matched
         // block, the lines that carry real content and the total non-whitespace chars.
-        // A "content" line has >= 1 identifier/literal char (alphanumeric, '_', or a
-        // non-ASCII byte, which in UTF-8 is part of a word/string); pure bracket/blank
-        // lines have none.
-        auto is_content = [](unsigned char c) {
-            return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
-                   (c >= 'a' && c <= 'z') || c == '_' || c > 0x7F;
-        };
-        size_t substantive = 0, nonws = 0;
-        for (size_t k = 0; k < best_len; ++k) {
-            bool has_content = false;
-            for (unsigned char c : *dels[di + k].text) {
-                if (c > ' ') {
-                    ++nonws;
-                }
-                has_content = has_content || is_content(c);
-            }
-            if (has_content) {
-                ++substantive;
-            }
-        }
+        const size_t substantive = substantive_prefix[run_di + run_len] - substantive_prefix[run_di];
+        const size_t nonws = nonws_prefix[run_di + run_len] - nonws_prefix[run_di];
         // Accept only a run that is long enough, has enough content lines (so a bracket-
         // only run of ANY length is dropped), and — for the coincidence-prone 2-line
-        // case — enough non-whitespace overall.
-        bool accept = best_len >= static_cast<size_t>(kMinShortMoveLines) &&
+        // case — enough non-whitespace overall. A run with edited lines must still hold
+        // kMinMoveLines lines that match outright.
+        bool accept = run_len >= static_cast<size_t>(kMinShortMoveLines) &&
                       substantive >= kMinSubstantiveMoveLines &&
-                      (best_len >= static_cast<size_t>(kMinMoveLines) ||
-                       nonws >= kMinShortMoveChars);
+                      (run_len >= static_cast<size_t>(kMinMoveLines) || nonws >= kMinShortMoveChars) &&
+                      (best_edits == 0 || run_len - best_edits >= static_cast<size_t>(kMinMoveLines));
         if (accept) {
             ++next_move_id;
-            const int64_t ins_start = inss[best_ii].lineno;
-            const int64_t del_start = dels[di].lineno;
-            for (size_t k = 0; k < best_len; ++k) {
-                dels[di + k].el->move_id = next_move_id;
-                dels[di + k].el->move_line = ins_start;  // deleted block moved *to* here
-                inss[best_ii + k].el->move_id = next_move_id;
-                inss[best_ii + k].el->move_line = del_start;  // inserted block came *from* here
-                ins_used[best_ii + k] = true;
+            const int64_t ins_start = inss[run_ii].index + 1;
+            const int64_t del_start = dels[run_di].index + 1;
+            for (size_t k = 0; k < run_len; ++k) {
+                // The deleted block moved *to* ins_start; the inserted one came *from* del_start.
+                moves.a_lines[dels[run_di + k].index] = {next_move_id, ins_start};
+                moves.b_lines[inss[run_ii + k].index] = {next_move_id, del_start};
+                ins_used[run_ii + k] = true;
             }
-            di += best_len;
+            di = run_di + run_len;
+            claimed_end = di;
         } else {
             ++di;
         }
     }
+    return moves;
 }
 
-}  // namespace
-
-// TODO: Report failure?
-std::vector<AnnotatedHunk>
-diffy::annotate_hunks(const DiffInput<diffy::Line>& diff_input,
-                      const std::vector<Hunk>& hunks,
-                      EditGranularity granularity,
-                      bool ignore_whitespace) {
-    std::vector<AnnotatedHunk> hunks_annotated;
+AnnotatedHunk
+diffy::annotate_hunk(const DiffInput<diffy::Line>& diff_input,
+                     const Hunk& hunk,
+                     EditGranularity granularity,
+                     bool ignore_whitespace,
+                     const MoveIndex* moves) {
+    DIFFY_TRACE_SCOPE("annotate_hunk");
+    DIFFY_TRACE_COUNT(AnnotatedHunks, 1);
+    AnnotatedHunk ahunk;
     switch (granularity) {
         case EditGranularity::Line:
-            hunks_annotated = annotate_lines(diff_input, hunks, ignore_whitespace);
+            ahunk = annotate_lines(diff_input, hunk, ignore_whitespace);
             break;
         case EditGranularity::Token:
-            hunks_annotated = annotate_tokens(diff_input, hunks, ignore_whitespace);
+            ahunk = annotate_tokens(diff_input, hunk, ignore_whitespace, false);
+            break;
+        case EditGranularity::Char:
+            ahunk = annotate_tokens(diff_input, hunk, ignore_whitespace, true);
             break;
         default:
             break;
     }
-    detect_moves(diff_input, hunks_annotated);
+    if (moves) {
+        apply_moves(*moves, ahunk);
+    }
+    return ahunk;
+}
+
+void
+diffy::retag_moves(const MoveIndex& moves, AnnotatedHunk& hunk) {
+    for (auto* lines : {&hunk.a_lines, &hunk.b_lines}) {
+        for (auto& el : *lines) {
+            el.move_id = 0;
+            el.move_line = 0;
+        }
+    }
+    apply_moves(moves, hunk);
+}
+
+// TODO: Report failure?
+std::vector<AnnotatedHunk>
+diffy::annotate_hunks(const DiffInput<diffy::Line>& diff_input,
+                      const std::vector<Hunk>& hunks,
+                      EditGranularity granularity,
+                      bool ignore_whitespace,
+                      const MoveOptions& move_options) {
+    DIFFY_TRACE_SCOPE("annotate_hunks");
+    const MoveIndex moves = detect_moves(diff_input, hunks, move_options);
+    std::vector<AnnotatedHunk> hunks_annotated;
+    hunks_annotated.reserve(hunks.size());
+    for (const auto& hunk : hunks) {
+        hunks_annotated.push_back(annotate_hunk(diff_input, hunk, granularity, ignore_whitespace, &moves));
+    }
     return hunks_annotated;
 }
+
+diffy::LazyAnnotatedHunks::LazyAnnotatedHunks(const DiffInput<diffy::Line>& diff_input,
+                                       std::vector<Hunk> hunks,
+                                       EditGranularity granularity,
+                                       bool ignore_whitespace,
+                                       MoveOptions move_options)
+    : input_(diff_input)
+    , hunks_(std::move(hunks))
+    , granularity_(granularity)
+    , ignore_whitespace_(ignore_whitespace)
+    , move_options_(move_options)
+    , contexts_(hunks_.size())
+    , cache_(hunks_.size()) {
+}
+
+void
+diffy::LazyAnnotatedHunks::set_context(std::size_t i, std::string context) {
+    contexts_[i] = std::move(context);
+    if (cache_[i]) {
+        cache_[i]->context = contexts_[i];
+    }
+}
+
+const AnnotatedHunk&
+diffy::LazyAnnotatedHunks::get(std::size_t i) {
+    if (!retained_locks_) {
+        return annotate(i);
+    }
+    std::lock_guard<std::mutex> lock(retained_locks_[i]);
+    return annotate(i);
+}
+
+const AnnotatedHunk&
+diffy::LazyAnnotatedHunks::annotate(std::size_t i) {
+    if (!cache_[i]) {
+        cache_[i] = annotate_hunk(input_, hunks_[i], granularity_, ignore_whitespace_, &moves());
+        cache_[i]->context = contexts_[i];
+        ++annotated_count_;
+    }
+    return *cache_[i];
+}
+
+const diffy::MoveIndex&
+diffy::LazyAnnotatedHunks::moves() {
+    // The move pass needs every hunk's delete/insert lines, but not their
+    // annotation, so it runs once on the raw hunks the first time any is pulled.
+    std::call_once(moves_once_, [this] { moves_ = detect_moves(input_, hunks_, move_options_); });
+    return *moves_;
+}
+
+void
+diffy::LazyAnnotatedHunks::release(std::size_t i) {
+    if (!retained_locks_) {
+        cache_[i].reset();
+    }
+}
+
+void
+diffy::LazyAnnotatedHunks::retain() {
+    if (!retained_locks_) {
+        retained_locks_ = std::make_unique<std::mutex[]>(hunks_.size());
+    }
+}
+
+std::vector<AnnotatedHunk>
+diffy::LazyAnnotatedHunks::materialize() {
+    std::vector<AnnotatedHunk> out;
+    out.reserve(hunks_.size());
+    for (std::size_t i = 0; i < hunks_.size(); i++) {
+        out.push_back(get(i));
+    }
+    return out;
+}
@@ -13,7 +13,14 @@
 #include "processing/tokenizer.hpp"
 #include "util/readlines.hpp"
 
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace diffy {
@@ -55,12 +62,191 @@ struct AnnotatedHunk {
 enum class EditGranularity {
     Line,   // Whole line insert/delete
     Token,  // Words and operators separated by whitespace
+    Char,   // Bytes within paired lines (UTF-8 safe); Token when a line changed too much
 };
 
+// Moved-block tags (GAP-9) keyed by 0-based line index on each side. Computed
+// from the raw hunks, so a caller can know every move without annotating every hunk.
+struct MoveTag {
+    int move_id = 0;
+    int64_t move_line = 0;
+};
+
+struct MoveIndex {
+    std::unordered_map<int64_t, MoveTag> a_lines;  // deleted lines
+    std::unordered_map<int64_t, MoveTag> b_lines;  // inserted lines
+};
+
+// Move-detection tolerance (GAP-9). The default only pairs byte-identical blocks.
+struct MoveOptions {
+    bool ignore_whitespace = false;  // match lines modulo whitespace (reindented blocks)
+    int max_edited_lines = 0;        // lines per block that may differ (moved and edited)
+};
+
+MoveIndex
+detect_moves(const DiffInput<Line>& diff_input,
+             const std::vector<Hunk>& hunks,
+             const MoveOptions& options = {});
+
+// Annotate a single hunk. `moves`, when given, stamps move_id/move_line on its lines.
+AnnotatedHunk
+annotate_hunk(const DiffInput<Line>& diff_input,
+              const Hunk& hunk,
+              const EditGranularity granularity,
+              bool ignore_whitespace,
+              const MoveIndex* moves = nullptr);
+
+// Clear an annotated hunk's move tags and stamp them afresh from `moves`, for a
+// hunk kept from an earlier annotation while the move pass was re-run.
+void
+retag_moves(const MoveIndex& moves, AnnotatedHunk& hunk);
+
 std::vector<AnnotatedHunk>
 annotate_hunks(const DiffInput<Line>& diff_input,
                const std::vector<Hunk>& hunks,
                const EditGranularity granularity,
-               bool ignore_whitespace);
+               bool ignore_whitespace,
+               const MoveOptions& move_options = {});
+
+// Per-hunk, on-demand annotation. Only the hunks that are actually pulled get
+// tokenized and intra-line diffed, so a viewer showing one screen of a large diff
+// (or a streaming renderer that drops each hunk once written) never holds the
+// whole annotated diff. Move detection is deferred until the first hunk is pulled
+// and then runs once over the raw hunks; the result equals annotate_hunks().
+//
+// get() and release() may run concurrently for different hunks (the renderers
+// annotate batches of hunks on worker threads); set_context() may not. After
+// retain(), get() is safe for the same hunk from any number of threads too.
+//
+// The line spans in `diff_input` must outlive this object.
+class LazyAnnotatedHunks {
+   public:
+    LazyAnnotatedHunks(const DiffInput<Line>& diff_input,
+                       std::vector<Hunk> hunks,
+                       EditGranularity granularity,
+                       bool ignore_whitespace,
+                       MoveOptions move_options = {});
+
+    std::size_t
+    size() const {
+        return hunks_.size();
+    }
+
+    const Hunk&
+    hunk(std::size_t i) const {
+        return hunks_[i];
+    }
+
+    const std::vector<Hunk>&
+    hunks() const {
+        return hunks_;
+    }
+
+    // Annotate hunk `i` (cached until released).
+    const AnnotatedHunk&
+    get(std::size_t i);
+
+    // Drop the cached annotation of hunk `i`; a later get() recomputes it.
+    void
+    release(std::size_t i);
+
+    // Keep every annotation once made, for an instance shared between consumers
+    // (DiffCache): release() becomes a no-op, so a revisit never re-annotates, and
+    // get() serializes per hunk so two threads pulling the same one annotate it once.
+    void
+    retain();
+
+    // Scope label copied into the hunk's `context` whenever it is annotated.
+    void
+    set_context(std::size_t i, std::string context);
+
+    // The labels set so far, one per hunk (empty where none was set).
+    const std::vector<std::string>&
+    contexts() const {
+        return contexts_;
+    }
+
+    // Number of annotate_hunk() calls so far (for tests and stats).
+    std::size_t
+    annotated_count() const {
+        return annotated_count_;
+    }
+
+    // The within-file move pass over every hunk, run on first use (by this or by
+    // annotating any hunk) and kept for the rest.
+    const MoveIndex&
+    moves();
+
+    // Annotate everything (the eager result, for callers that need a vector).
+    std::vector<AnnotatedHunk>
+    materialize();
+
+    class iterator {
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = AnnotatedHunk;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const AnnotatedHunk*;
+        using reference = const AnnotatedHunk&;
+
+        iterator(LazyAnnotatedHunks* owner, std::size_t i) : owner_(owner), i_(i) {
+        }
+
+        reference
+        operator*() const {
+            return owner_->get(i_);
+        }
+        pointer
+        operator->() const {
+            return &owner_->get(i_);
+        }
+        iterator&
+        operator++() {
+            ++i_;
+            return *this;
+        }
+        bool
+        operator==(const iterator& o) const {
+            return i_ == o.i_;
+        }
+        bool
+        operator!=(const iterator& o) const {
+            return i_ != o.i_;
+        }
+        std::size_t
+        index() const {
+            return i_;
+        }
+
+       private:
+        LazyAnnotatedHunks* owner_;
+        std::size_t i_;
+    };
+
+    iterator
+    begin() {
+        return iterator(this, 0);
+    }
+    iterator
+    end() {
+        return iterator(this, hunks_.size());
+    }
+
+   private:
+    const AnnotatedHunk&
+    annotate(std::size_t i);
+
+    DiffInput<Line> input_;
+    std::vector<Hunk> hunks_;
+    EditGranularity granularity_;
+    bool ignore_whitespace_;
+    MoveOptions move_options_;
+    std::vector<std::string> contexts_;
+    std::vector<std::optional<AnnotatedHunk>> cache_;
+    std::unique_ptr<std::mutex[]> retained_locks_;  // set by retain(), one per hunk
+    std::optional<MoveIndex> moves_;
+    std::once_flag moves_once_;
+    std::atomic<std::size_t> annotated_count_{0};
+};
 
 }  // namespace diffy
\ No newline at end of file
@@ -210,6 +210,174 @@ TEST_CASE("annotate_hunks — a bracket-only block is not flagged as a move (GAP
     }
 }
 
+TEST_CASE("detect_moves — finds a move inside a large rewrite (GAP-9)") {
+    // ~2100 deleted x ~2100 inserted lines: past the old dels*inss cut-off, which
+    // silently dropped every move marker for a refactor this size.
+    std::vector<std::string> a, b;
+    const std::vector<std::string> moved = {"int moved_fn() {", "    return compute(42);", "}  // moved_fn"};
+    a.insert(a.end(), moved.begin(), moved.end());
+    for (int i = 0; i < 10; i++) {
+        a.push_back("anchor " + std::to_string(i));
+        b.push_back("anchor " + std::to_string(i));
+    }
+    b.insert(b.end(), moved.begin(), moved.end());
+    for (int i = 0; i < 2100; i++) {
+        a.push_back("old body line " + std::to_string(i));
+        b.push_back("new body line " + std::to_string(i));
+        if (i % 50 == 0) {
+            // Repeated bracket/blank runs on both sides must not become moves.
+            a.push_back("}");
+            a.push_back("");
+            b.push_back("}");
+            b.push_back("");
+        }
+    }
+    auto A = mk(a);
+    auto B = mk(b);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+    auto moves = detect_moves(in, hunks);
+
+    REQUIRE(moves.a_lines.count(0) == 1);
+    const auto tag = moves.a_lines.at(0);
+    CHECK(tag.move_id != 0);
+    CHECK(tag.move_line == 11);  // moved to new line 11 (after the 10 anchors)
+    for (int64_t k = 0; k < 3; k++) {
+        REQUIRE(moves.b_lines.count(10 + k) == 1);
+        CHECK(moves.b_lines.at(10 + k).move_id == tag.move_id);
+        CHECK(moves.b_lines.at(10 + k).move_line == 1);
+    }
+    for (const auto& [index, t] : moves.a_lines) {
+        CHECK(A[index].line != "}");
+        CHECK(!A[index].line.empty());
+    }
+}
+
+TEST_CASE("detect_moves — a moved block keeps its leading bracket and blank lines (GAP-9)") {
+    // The block opens with a "}" and a blank line: no window of those two is indexed,
+    // but they still belong to the block the content lines below them anchor.
+    std::vector<std::string> a = {"}", "", "void alpha() {", "    run_alpha();"};
+    std::vector<std::string> b;
+    for (int i = 0; i < 6; i++) {
+        a.push_back("anchor " + std::to_string(i));
+        b.push_back("anchor " + std::to_string(i));
+    }
+    b.insert(b.end(), a.begin(), a.begin() + 4);
+    auto A = mk(a);
+    auto B = mk(b);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto hunks = compose_hunks(Patience<Line>(in).compute().edit_sequence, 3);
+    auto moves = detect_moves(in, hunks);
+
+    REQUIRE(moves.a_lines.count(0) == 1);
+    for (int64_t k = 0; k < 4; k++) {
+        REQUIRE(moves.a_lines.count(k) == 1);
+        CHECK(moves.a_lines.at(k).move_id == moves.a_lines.at(0).move_id);
+        CHECK(moves.a_lines.at(k).move_line == 7);
+        REQUIRE(moves.b_lines.count(6 + k) == 1);
+        CHECK(moves.b_lines.at(6 + k).move_line == 1);
+    }
+}
+
+TEST_CASE("detect_moves — a block repeated past the candidate limit is still paired (GAP-9)") {
+    // 70 copies of one block move down, each followed by a line of its own, so they
+    // pair copy by copy; the claimed occurrences make room for the later ones.
+    std::vector<std::string> a, b;
+    const std::vector<std::string> block = {"call_shared(1);", "call_shared(2);", "call_shared(3);"};
+    for (int i = 0; i < 70; i++) {
+        a.insert(a.end(), block.begin(), block.end());
+        a.push_back("old separator " + std::to_string(i));
+    }
+    for (int i = 0; i < 6; i++) {
+        a.push_back("anchor " + std::to_string(i));
+        b.push_back("anchor " + std::to_string(i));
+    }
+    for (int i = 0; i < 70; i++) {
+        b.insert(b.end(), block.begin(), block.end());
+        b.push_back("new separator " + std::to_string(i));
+    }
+    auto A = mk(a);
+    auto B = mk(b);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto hunks = compose_hunks(Patience<Line>(in).compute().edit_sequence, 3);
+    auto moves = detect_moves(in, hunks);
+    for (int64_t i = 0; i < 70; i++) {
+        CAPTURE(i);
+        CHECK(moves.a_lines.count(i * 4) == 1);
+    }
+}
+
+TEST_CASE("detect_moves — tolerant mode pairs a reindented, lightly edited block (GAP-9)") {
+    // The block moves below the anchors, gains one indent level, and has its middle
+    // line tweaked: exact matching sees an unrelated delete + insert.
+    std::vector<std::string> a = {"int helper(int x) {", "    int y = x * 2;", "    log(y);",
+                                  "    return y + 1;", "}"};
+    std::vector<std::string> b;
+    for (int i = 0; i < 6; i++) {
+        a.push_back("anchor " + std::to_string(i));
+        b.push_back("anchor " + std::to_string(i));
+    }
+    for (const auto& s : {"    int helper(int x) {", "        int y = x * 3;", "        log(y);",
+                          "        return y + 1;", "    }"}) {
+        b.push_back(s);
+    }
+    auto A = mk(a);
+    auto B = mk(b);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+
+    CHECK(detect_moves(in, hunks).a_lines.empty());
+
+    // Ignoring whitespace alone pairs the untouched tail of the block, but the edited
+    // line splits it, so the head stays an unrelated delete.
+    MoveOptions ws_only;
+    ws_only.ignore_whitespace = true;
+    auto partial = detect_moves(in, hunks, ws_only);
+    CHECK(partial.a_lines.count(0) == 0);
+    CHECK(partial.a_lines.count(4) == 1);
+
+    MoveOptions tolerant;
+    tolerant.ignore_whitespace = true;
+    tolerant.max_edited_lines = 1;
+    auto moves = detect_moves(in, hunks, tolerant);
+    for (int64_t k = 0; k < 5; k++) {
+        REQUIRE(moves.a_lines.count(k) == 1);
+        CHECK(moves.a_lines.at(k).move_line == 7);
+        REQUIRE(moves.b_lines.count(6 + k) == 1);
+        CHECK(moves.b_lines.at(6 + k).move_line == 1);
+    }
+}
+
+TEST_CASE("detect_moves — tolerant mode reuses the whitespace-stripped checksums of -w lines") {
+    // Same reindented, edited block, but read with whitespace ignored: the lines
+    // carry a stripped cmp_key and checksum, which the move pass matches on directly.
+    std::string a = "int helper(int x) {\n    int y = x * 2;\n    log(y);\n    return y + 1;\n}\n";
+    std::string b;
+    for (int i = 0; i < 6; i++) {
+        a += "anchor " + std::to_string(i) + "\n";
+        b += "anchor " + std::to_string(i) + "\n";
+    }
+    b += "    int helper(int x) {\n        int y = x * 3;\n        log(y);\n"
+         "        return y + 1;\n    }\n";
+    auto A = readlines_from_string(a, false, true);
+    auto B = readlines_from_string(b, false, true);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto hunks = compose_hunks(Patience<Line>(in).compute().edit_sequence, 3);
+
+    MoveOptions tolerant;
+    tolerant.ignore_whitespace = true;
+    tolerant.max_edited_lines = 1;
+    auto moves = detect_moves(in, hunks, tolerant);
+    for (int64_t k = 0; k < 5; k++) {
+        REQUIRE(moves.a_lines.count(k) == 1);
+        CHECK(moves.a_lines.at(k).move_line == 7);
+        REQUIRE(moves.b_lines.count(6 + k) == 1);
+        CHECK(moves.b_lines.at(6 + k).move_line == 1);
+    }
+}
+
 TEST_CASE("annotate_hunks — a plain edit is not a move") {
     auto A = mk({"ctx", "old value here", "ctx2"});
     auto B = mk({"ctx", "new value here", "ctx2"});
@@ -227,6 +395,84 @@ TEST_CASE("annotate_hunks — a plain edit is not a move") {
     }
 }
 
+TEST_CASE("LazyAnnotatedHunks — annotates on demand and matches the eager result") {
+    // Two hunks: a moved 3-line block (so the deferred move pass must still tag the
+    // hunk that's pulled first) and a plain edit far below it.
+    std::vector<std::string> a, b;
+    for (const auto& s : {"y1 moved line", "y2 moved line", "y3 moved line"}) {
+        b.push_back(s);
+    }
+    for (int i = 0; i < 12; i++) {
+        a.push_back("anchor " + std::to_string(i));
+        b.push_back("anchor " + std::to_string(i));
+    }
+    for (const auto& s : {"y1 moved line", "y2 moved line", "y3 moved line"}) {
+        a.push_back(s);
+    }
+    for (int i = 0; i < 12; i++) {
+        a.push_back("tail " + std::to_string(i));
+        b.push_back("tail " + std::to_string(i));
+    }
+    a.push_back("old value here");
+    b.push_back("new value here");
+    auto A = mk(a);
+    auto B = mk(b);
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+    REQUIRE(hunks.size() >= 2);
+
+    auto eager = annotate_hunks(in, hunks, EditGranularity::Token, false);
+    LazyAnnotatedHunks lazy(in, hunks, EditGranularity::Token, false);
+    CHECK(lazy.annotated_count() == 0);
+    // The move pass on its own annotates nothing, and is the one the hunks use.
+    const MoveIndex& moves = lazy.moves();
+    CHECK(lazy.annotated_count() == 0);
+    CHECK(moves.a_lines.size() == 3);
+    CHECK(&lazy.moves() == &moves);
+
+    auto same_lines = [](const std::vector<EditLine>& x, const std::vector<EditLine>& y) {
+        REQUIRE(x.size() == y.size());
+        for (size_t i = 0; i < x.size(); i++) {
+            CHECK(x[i].type == y[i].type);
+            CHECK(x[i].line_index.value == y[i].line_index.value);
+            CHECK(x[i].move_id == y[i].move_id);
+            CHECK(x[i].move_line == y[i].move_line);
+            REQUIRE(x[i].segments.size() == y[i].segments.size());
+            for (size_t k = 0; k < x[i].segments.size(); k++) {
+                CHECK(x[i].segments[k].start == y[i].segments[k].start);
+                CHECK(x[i].segments[k].length == y[i].segments[k].length);
+                CHECK(x[i].segments[k].type == y[i].segments[k].type);
+            }
+        }
+    };
+
+    // Pull the last hunk alone first: only it gets annotated.
+    const size_t last = lazy.size() - 1;
+    same_lines(lazy.get(last).a_lines, eager[last].a_lines);
+    same_lines(lazy.get(last).b_lines, eager[last].b_lines);
+    CHECK(lazy.annotated_count() == 1);
+
+    size_t i = 0;
+    bool saw_move = false;
+    for (auto it = lazy.begin(); it != lazy.end(); ++it, ++i) {
+        same_lines(it->a_lines, eager[i].a_lines);
+        same_lines(it->b_lines, eager[i].b_lines);
+        for (const auto& el : it->a_lines) {
+            saw_move = saw_move || el.move_id != 0;
+        }
+    }
+    CHECK(i == eager.size());
+    CHECK(saw_move);
+    CHECK(lazy.annotated_count() == eager.size());  // the cached last hunk wasn't redone
+
+    lazy.set_context(0, "fn scope");
+    CHECK(lazy.get(0).context == "fn scope");
+    lazy.release(0);
+    CHECK(lazy.get(0).context == "fn scope");  // re-annotated, label kept
+    CHECK(lazy.annotated_count() == eager.size() + 1);
+}
+
 TEST_CASE("annotate_hunks — ignore_whitespace marks whitespace segments common") {
     auto A = mk({"ctx", "value", "ctx2"});
     auto B = mk({"ctx", "value   ", "ctx2"});  // trailing whitespace added
@@ -249,3 +495,101 @@ TEST_CASE("annotate_hunks — ignore_whitespace marks whitespace segments common
     }
     CHECK(saw_whitespace_segment);
 }
+
+TEST_CASE("annotate_hunks — char granularity highlights only the changed bytes") {
+    // One long "word" (a base64-ish blob) with a single changed character: token
+    // granularity marks the whole blob, char granularity just that byte.
+    auto A = mk({"ctx", "key = QUJDREVGR0hJSktMTU5PUFFSU1RVVldY", "ctx2"});
+    auto B = mk({"ctx", "key = QUJDREVGR0hJSktMTU5PUFFSU1RVVldZ", "ctx2"});
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+    REQUIRE(hunks.size() == 1);
+
+    auto annotated = annotate_hunks(in, hunks, EditGranularity::Char, false);
+    REQUIRE(annotated.size() == 1);
+    check_tiling(A, annotated[0].a_lines);
+    check_tiling(B, annotated[0].b_lines);
+
+    auto changed = [](const std::string& src, const EditLine& el, EditType want) {
+        std::string out;
+        for (const auto& seg : el.segments) {
+            if (seg.type == want) {
+                out += src.substr(seg.start, seg.length);
+            }
+        }
+        return out;
+    };
+    for (const auto& el : annotated[0].a_lines) {
+        if (el.type == EditType::Delete) {
+            CHECK(changed(A[el.line_index.value].line, el, EditType::Delete) == "Y");
+        }
+    }
+    for (const auto& el : annotated[0].b_lines) {
+        if (el.type == EditType::Insert) {
+            CHECK(changed(B[el.line_index.value].line, el, EditType::Insert) == "Z");
+        }
+    }
+}
+
+TEST_CASE("annotate_hunks — char granularity never splits a UTF-8 character") {
+    // "é" (C3 A9) -> "è" (C3 A8) share their lead byte; the changed segment must
+    // still cover the whole two-byte character on both sides.
+    auto A = mk({"ctx", "caf\xC3\xA9 au lait", "ctx2"});
+    auto B = mk({"ctx", "caf\xC3\xA8 au lait", "ctx2"});
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+    auto annotated = annotate_hunks(in, hunks, EditGranularity::Char, false);
+    REQUIRE(annotated.size() == 1);
+    check_tiling(A, annotated[0].a_lines);
+    check_tiling(B, annotated[0].b_lines);
+
+    for (const auto& el : annotated[0].b_lines) {
+        if (el.type != EditType::Insert) {
+            continue;
+        }
+        const std::string& src = B[el.line_index.value].line;
+        for (const auto& seg : el.segments) {
+            // Every segment starts on a code point boundary.
+            CHECK((static_cast<unsigned char>(src[seg.start]) & 0xC0) != 0x80);
+            if (seg.type == EditType::Insert) {
+                CHECK(src.substr(seg.start, seg.length) == "\xC3\xA8");
+            }
+        }
+    }
+}
+
+TEST_CASE("annotate_hunks — char granularity falls back to tokens over budget") {
+    // Two similar lines whose differences far exceed the per-line byte budget:
+    // the pair is still diffed, but token by token.
+    std::string la = "call(", lb = "call(";
+    for (int i = 0; i < 200; i++) {
+        la += "aa, ";
+        lb += "bb, ";
+    }
+    la += ");";
+    lb += ");";
+    auto A = mk({"ctx", la, "ctx2"});
+    auto B = mk({"ctx", lb, "ctx2"});
+    DiffInput<Line> in{gsl::span<Line>{A}, gsl::span<Line>{B}, "a", "b"};
+    auto r = Patience<Line>(in).compute();
+    auto hunks = compose_hunks(r.edit_sequence, 3);
+
+    auto as_char = annotate_hunks(in, hunks, EditGranularity::Char, false);
+    auto as_token = annotate_hunks(in, hunks, EditGranularity::Token, false);
+    REQUIRE(as_char.size() == as_token.size());
+    for (size_t h = 0; h < as_char.size(); h++) {
+        REQUIRE(as_char[h].b_lines.size() == as_token[h].b_lines.size());
+        for (size_t i = 0; i < as_char[h].b_lines.size(); i++) {
+            const auto& sc = as_char[h].b_lines[i].segments;
+            const auto& st = as_token[h].b_lines[i].segments;
+            REQUIRE(sc.size() == st.size());
+            for (size_t k = 0; k < sc.size(); k++) {
+                CHECK(sc[k].start == st[k].start);
+                CHECK(sc[k].length == st[k].length);
+                CHECK(sc[k].type == st[k].type);
+            }
+        }
+    }
+}
@@ -1,5 +1,7 @@
 #include "indent_heuristic.hpp"
 
+#include "util/trace.hpp"
+
 #include <cstddef>
 #include <gsl/span>
 #include <string>
@@ -26,26 +28,14 @@ constexpr int RELATIVE_DEDENT_WITH_BLANK_PENALTY = 17;
 constexpr long INDENT_HEURISTIC_MAX_SLIDING = 100;
 
 // Visual indent width of a line (spaces=1, tab to next multiple of 8), capped at
-// MAX_INDENT. Returns -1 for a blank (all-whitespace) line. The trailing newline
-// is whitespace and never reached before a non-space, so it doesn't matter.
+// MAX_INDENT, or -1 for a blank (all-whitespace) line. As in git, a blank line
+// whose whitespace reaches MAX_INDENT gives MAX_INDENT. Read from the line's
+// metadata (computed once by readlines) rather than rescanned per split tried.
 int
-get_indent(const std::string& s) {
-    int ret = 0;
-    for (char c : s) {
-        if (c == ' ') {
-            ret += 1;
-        } else if (c == '\t') {
-            ret += 8 - ret % 8;
-        } else if (c == '\n' || c == '\r' || c == '\f' || c == '\v') {
-            ret += 1;  // other whitespace: count as one (git ignores; blank check below)
-        } else {
-            return ret;  // first non-space: this is the indent
-        }
-        if (ret >= MAX_INDENT) {
-            return MAX_INDENT;
-        }
-    }
-    return -1;  // only whitespace
+get_indent(const Line& line) {
+    static_assert(MAX_INDENT == LineInfo::kMaxIndent, "LineInfo clamps at git's MAX_INDENT");
+    const LineInfo info = line.info();
+    return info.blank && info.indent < MAX_INDENT ? -1 : info.indent;
 }
 
 struct SplitMeasurement {
@@ -70,12 +60,12 @@ measure_split(const gsl::span<Line>& lines, long split, SplitMeasurement& m) {
         m.indent = -1;
     } else {
         m.end_of_file = false;
-        m.indent = get_indent(lines[split].line);
+        m.indent = get_indent(lines[split]);
     }
     m.pre_blank = 0;
     m.pre_indent = -1;
     for (long i = split - 1; i >= 0; i--) {
-        m.pre_indent = get_indent(lines[i].line);
+        m.pre_indent = get_indent(lines[i]);
         if (m.pre_indent != -1) {
             break;
         }
@@ -88,7 +78,7 @@ measure_split(const gsl::span<Line>& lines, long split, SplitMeasurement& m) {
     m.post_blank = 0;
     m.post_indent = -1;
     for (long i = split + 1; i < n; i++) {
-        m.post_indent = get_indent(lines[i].line);
+        m.post_indent = get_indent(lines[i]);
         if (m.post_indent != -1) {
             break;
         }
@@ -220,6 +210,7 @@ slide_side(const gsl::span<Line>& lines, std::vector<char>& changed) {
 
 void
 apply_indent_heuristic(const DiffInput<Line>& input, std::vector<Edit>& edit_sequence) {
+    DIFFY_TRACE_SCOPE("indent_heuristic");
     const long N = static_cast<long>(input.A.size());
     const long M = static_cast<long>(input.B.size());
     if (N == 0 || M == 0) {
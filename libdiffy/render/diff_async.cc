@@ -0,0 +1,97 @@
+#include "diff_async.hpp"
+
+#include "util/parallel.hpp"
+
+#include <memory>
+#include <utility>
+
+namespace diffy {
+
+namespace {
+
+// Diffs in flight at once. Each one also runs its tree-sitter passes on threads
+// of its own, so this stays well below the core count.
+constexpr std::size_t kAsyncDiffWorkers = 4;
+
+WorkerPool&
+diff_workers() {
+    static WorkerPool pool(parallel_worker_count(kAsyncDiffWorkers));
+    return pool;
+}
+
+// Queue `job` and hand back a future for its result (or its exception).
+template <typename T, typename Job>
+std::future<T>
+submit(Job job) {
+    auto promise = std::make_shared<std::promise<T>>();
+    std::future<T> future = promise->get_future();
+    diff_workers().submit([promise, job = std::move(job)]() mutable {
+        try {
+            promise->set_value(job());
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    return future;
+}
+
+}  // namespace
+
+std::future<DiffComputation>
+compute_annotated_diff_async(std::string a_text,
+                             std::string b_text,
+                             std::string a_name,
+                             std::string b_name,
+                             DiffPipelineOptions options) {
+    return submit<DiffComputation>([a_text = std::move(a_text), b_text = std::move(b_text),
+                                    a_name = std::move(a_name), b_name = std::move(b_name),
+                                    options = std::move(options)] {
+        return compute_annotated_diff(a_text, b_text, a_name, b_name, options);
+    });
+}
+
+std::future<DiffViewModel>
+build_diff_view_async(std::string a_text,
+                      std::string b_text,
+                      std::string a_name,
+                      std::string b_name,
+                      DiffPipelineOptions pipeline_options,
+                      DiffLayoutOptions layout_options,
+                      std::map<int, GapExpansion> expansions) {
+    return submit<DiffViewModel>([a_text = std::move(a_text), b_text = std::move(b_text),
+                                  a_name = std::move(a_name), b_name = std::move(b_name),
+                                  pipeline_options = std::move(pipeline_options), layout_options,
+                                  expansions = std::move(expansions)] {
+        return build_diff_view_from_text(a_text, b_text, a_name, b_name, pipeline_options, layout_options, nullptr,
+                                         expansions.empty() ? nullptr : &expansions);
+    });
+}
+
+void
+build_diff_view_async(std::string a_text,
+                      std::string b_text,
+                      std::string a_name,
+                      std::string b_name,
+                      DiffPipelineOptions pipeline_options,
+                      DiffLayoutOptions layout_options,
+                      std::function<void(DiffViewModel)> on_done,
+                      std::function<void(std::exception_ptr)> on_error) {
+    diff_workers().submit([a_text = std::move(a_text), b_text = std::move(b_text), a_name = std::move(a_name),
+                           b_name = std::move(b_name), pipeline_options = std::move(pipeline_options),
+                           layout_options, on_done = std::move(on_done), on_error = std::move(on_error)] {
+        DiffViewModel model;
+        try {
+            model = build_diff_view_from_text(a_text, b_text, a_name, b_name, pipeline_options, layout_options);
+        } catch (...) {
+            if (on_error) {
+                on_error(std::current_exception());
+            }
+            return;
+        }
+        if (on_done) {
+            on_done(std::move(model));
+        }
+    });
+}
+
+}  // namespace diffy
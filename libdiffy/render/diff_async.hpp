@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+    Asynchronous front to the diff pipeline, for frontends that must keep drawing
+    while a large pair is diffed. Each call queues the work on a small pool shared
+    by the process and returns at once; the result arrives through a future or a
+    completion callback, and DiffPipelineOptions::progress reports the stages as
+    they advance (both on the worker thread, so marshal to the UI thread as needed).
+
+    The texts and options are copied into the job. A DiffPipelineOptions::deadline
+    is not: it must outlive the job, and cancel() on it stops the work early.
+*/
+
+#include "render/diff_pipeline.hpp"
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <string>
+
+namespace diffy {
+
+std::future<DiffComputation>
+compute_annotated_diff_async(std::string a_text,
+                             std::string b_text,
+                             std::string a_name,
+                             std::string b_name,
+                             DiffPipelineOptions options);
+
+std::future<DiffViewModel>
+build_diff_view_async(std::string a_text,
+                      std::string b_text,
+                      std::string a_name,
+                      std::string b_name,
+                      DiffPipelineOptions pipeline_options,
+                      DiffLayoutOptions layout_options,
+                      std::map<int, GapExpansion> expansions = {});
+
+// Callback flavour: `on_done` gets the model, or `on_error` the exception the
+// pipeline threw (dropped when on_error is empty).
+void
+build_diff_view_async(std::string a_text,
+                      std::string b_text,
+                      std::string a_name,
+                      std::string b_name,
+                      DiffPipelineOptions pipeline_options,
+                      DiffLayoutOptions layout_options,
+                      std::function<void(DiffViewModel)> on_done,
+                      std::function<void(std::exception_ptr)> on_error = {});
+
+}  // namespace diffy
@@ -0,0 +1,84 @@
+#include <doctest.h>
+
+#include "render/diff_async.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace diffy;
+
+namespace {
+
+std::string
+numbered(int n, int changed_every) {
+    std::string s;
+    for (int i = 0; i < n; i++) {
+        s += (changed_every && i % changed_every == 0) ? "changed " : "line ";
+        s += std::to_string(i) + "\n";
+    }
+    return s;
+}
+
+}  // namespace
+
+TEST_CASE("async diff: the future holds what the synchronous call returns") {
+    const std::string a = numbered(2000, 0);
+    const std::string b = numbered(2000, 97);
+    DiffPipelineOptions p;
+    DiffLayoutOptions layout;
+    layout.mode = ViewMode::Unified;
+
+    std::vector<DiffProgress> events;
+    DiffPipelineOptions observed = p;
+    observed.progress = [&events](const DiffProgress& e) { events.push_back(e); };  // one worker thread
+
+    auto view = build_diff_view_async(a, b, "a", "b", observed, layout);
+    auto computation = compute_annotated_diff_async(a, b, "a", "b", p);
+    const auto want = build_diff_view_from_text(a, b, "a", "b", p, layout);
+    const auto got = view.get();
+    CHECK(got.rows.size() == want.rows.size());
+    CHECK(computation.get().hunks.size() == compute_annotated_diff(a, b, "a", "b", p).hunks.size());
+
+    REQUIRE(!events.empty());
+    CHECK(events.front().stage == DiffStage::Reading);
+    CHECK(events.back().stage == DiffStage::Done);
+    CHECK(events.back().lines_read == 4000);
+    CHECK(events.back().edit_distance == 2 * 21);  // 21 lines replaced
+    CHECK(events.back().hunks_total > 0);
+    CHECK(events.back().hunks_annotated == events.back().hunks_total);
+    for (size_t i = 1; i < events.size(); i++) {
+        CHECK(events[i].stage >= events[i - 1].stage);
+        CHECK(events[i].lines_read >= events[i - 1].lines_read);
+        CHECK(events[i].edit_distance >= events[i - 1].edit_distance);
+        CHECK(events[i].hunks_annotated >= events[i - 1].hunks_annotated);
+    }
+}
+
+TEST_CASE("async diff: the callback form delivers the model off the calling thread") {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool delivered = false;
+    size_t rows = 0;
+    build_diff_view_async(numbered(10, 0), numbered(10, 3), "a", "b", {}, {}, [&](DiffViewModel model) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rows = model.rows.size();
+        delivered = true;
+        cv.notify_one();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    REQUIRE(cv.wait_for(lock, std::chrono::seconds(30), [&] { return delivered; }));
+    CHECK(rows > 0);
+}
+
+TEST_CASE("async diff: a cancelled deadline still completes, degraded") {
+    Deadline deadline;
+    deadline.cancel();
+    DiffPipelineOptions p;
+    p.deadline = &deadline;
+    auto c = compute_annotated_diff_async(numbered(100, 0), numbered(100, 7), "a", "b", p).get();
+    CHECK(c.status == DiffResultStatus::OK);
+    CHECK((c.degradations & DegradedDiff) != 0);
+}
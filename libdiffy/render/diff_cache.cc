@@ -0,0 +1,236 @@
+#include "diff_cache.hpp"
+
+#include "util/hash.hpp"
+
+#include <utility>
+
+namespace diffy {
+
+namespace {
+
+template <typename T>
+void
+append_raw(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void
+append_sized(std::string& out, const std::string& s) {
+    append_raw(out, s.size());
+    out += s;
+}
+
+// Every field of DiffPipelineOptions that changes the computation is part of the
+// key (deadline and progress only bound or observe it). Extend this when the
+// options grow.
+std::string
+cache_key(const std::string& a_text,
+          const std::string& b_text,
+          const std::string& a_name,
+          const std::string& b_name,
+          const DiffPipelineOptions& o) {
+    std::string key;
+    append_raw(key, a_text.size());
+    append_raw(key, hash::hash(a_text.data(), a_text.size()));
+    append_raw(key, b_text.size());
+    append_raw(key, hash::hash(b_text.data(), b_text.size()));
+    append_sized(key, a_name);
+    append_sized(key, b_name);
+    append_raw(key, o.algorithm);
+    append_raw(key, o.context_lines);
+    append_raw(key, o.granularity);
+    append_raw(key, o.ignore_whitespace);
+    append_raw(key, o.ignore_line_endings);
+    append_raw(key, o.move_options.ignore_whitespace);
+    append_raw(key, o.move_options.max_edited_lines);
+    append_raw(key, o.syntax_highlight);
+    append_raw(key, o.lazy_annotation);
+    append_sized(key, o.force_language);
+    return key;
+}
+
+template <typename T>
+std::size_t
+vector_bytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+std::size_t
+lines_bytes(const std::vector<Line>& lines) {
+    std::size_t n = vector_bytes(lines);
+    for (const auto& l : lines) {
+        n += l.line.capacity() + l.cmp_key.capacity();
+    }
+    return n;
+}
+
+std::size_t
+highlights_bytes(const LineHighlights& h) {
+    std::size_t n = vector_bytes(h);
+    for (const auto& runs : h) {
+        n += vector_bytes(runs);
+    }
+    return n;
+}
+
+std::size_t
+annotated_bytes(const AnnotatedHunk& h) {
+    std::size_t n = sizeof(AnnotatedHunk) + h.context.capacity();
+    for (const auto* side : {&h.a_lines, &h.b_lines}) {
+        n += vector_bytes(*side);
+        for (const auto& el : *side) {
+            n += vector_bytes(el.segments);
+        }
+    }
+    return n;
+}
+
+// A cached lazy computation keeps every hunk it annotates, so its entry is charged
+// up front for the annotations it can grow to: one EditLine per edit unit, with a
+// couple of segments each.
+std::size_t
+retained_annotation_bytes(const DiffComputation& c) {
+    std::size_t n = 0;
+    for (std::size_t i = 0; c.lazy_hunks && i < c.lazy_hunks->size(); i++) {
+        n += sizeof(AnnotatedHunk) +
+             c.lazy_hunks->hunk(i).edit_units.size() * (sizeof(EditLine) + 2 * sizeof(LineSegment));
+    }
+    return n;
+}
+
+}  // namespace
+
+std::size_t
+approximate_bytes(const DiffComputation& c) {
+    std::size_t n = sizeof(DiffComputation) + lines_bytes(c.a_lines) + lines_bytes(c.b_lines);
+    for (const auto& h : c.hunks) {
+        n += annotated_bytes(h);
+    }
+    for (std::size_t i = 0; c.lazy_hunks && i < c.lazy_hunks->size(); i++) {
+        n += sizeof(Hunk) + vector_bytes(c.lazy_hunks->hunk(i).edit_units);
+    }
+    n += highlights_bytes(c.a_highlights) + highlights_bytes(c.b_highlights);
+    n += c.a_text.capacity() + c.b_text.capacity() + vector_bytes(c.edit_sequence);
+    return n;
+}
+
+DiffCache::DiffCache(std::size_t max_bytes) : max_bytes_(max_bytes) {
+}
+
+std::shared_ptr<const DiffComputation>
+DiffCache::get_or_compute(const std::string& a_text,
+                          const std::string& b_text,
+                          const std::string& a_name,
+                          const std::string& b_name,
+                          const DiffPipelineOptions& options) {
+    if (options.incremental) {
+        return std::make_shared<DiffComputation>(
+            compute_annotated_diff(a_text, b_text, a_name, b_name, options));
+    }
+
+    std::string key = cache_key(a_text, b_text, a_name, b_name, options);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end() && it->second->a_text == a_text && it->second->b_text == b_text) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            ++hits_;
+            return it->second->computation;
+        }
+        ++misses_;
+    }
+
+    // Compute without the lock so other pairs can be served meanwhile. Two threads
+    // missing on the same pair both compute; the second insert replaces the first.
+    auto computation = std::make_shared<DiffComputation>(
+        compute_annotated_diff(a_text, b_text, a_name, b_name, options));
+    const std::size_t bytes = approximate_bytes(*computation) + retained_annotation_bytes(*computation) +
+                              a_text.capacity() + b_text.capacity() + key.size();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (bytes > max_bytes_ || computation->degradations != DegradedNone) {
+        return computation;
+    }
+    if (auto it = index_.find(key); it != index_.end()) {
+        bytes_ -= it->second->bytes;
+        lru_.erase(it->second);
+        index_.erase(it);
+    }
+    // Every caller that hits this entry shares its lazy hunks, so they must be safe
+    // to pull concurrently and must not be dropped under another reader.
+    if (computation->lazy_hunks) {
+        computation->lazy_hunks->retain();
+    }
+    evict_to(max_bytes_ - bytes);
+    lru_.push_front(Entry{key, a_text, b_text, computation, bytes});
+    index_.emplace(std::move(key), lru_.begin());
+    bytes_ += bytes;
+    return computation;
+}
+
+void
+DiffCache::evict_to(std::size_t budget) {
+    while (bytes_ > budget && !lru_.empty()) {
+        bytes_ -= lru_.back().bytes;
+        index_.erase(lru_.back().key);
+        lru_.pop_back();
+    }
+}
+
+void
+DiffCache::set_max_bytes(std::size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    evict_to(max_bytes_);
+}
+
+void
+DiffCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    evict_to(0);
+}
+
+std::size_t
+DiffCache::max_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_bytes_;
+}
+
+std::size_t
+DiffCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+std::size_t
+DiffCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lru_.size();
+}
+
+uint64_t
+DiffCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t
+DiffCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+DiffViewModel
+build_diff_view_from_text(DiffCache& cache,
+                          const std::string& a_text,
+                          const std::string& b_text,
+                          const std::string& a_name,
+                          const std::string& b_name,
+                          const DiffPipelineOptions& pipeline_options,
+                          const DiffLayoutOptions& layout_options,
+                          const std::map<int, GapExpansion>* expansions) {
+    auto c = cache.get_or_compute(a_text, b_text, a_name, b_name, pipeline_options);
+    return build_diff_view(*c, layout_options, expansions);
+}
+
+}  // namespace diffy
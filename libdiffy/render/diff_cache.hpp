@@ -0,0 +1,104 @@
+#pragma once
+
+/*
+    In-process memo of compute_annotated_diff results.
+
+    A frontend re-runs the pipeline whenever the user flips a layout option or
+    goes back to a file pair it already showed. DiffCache keeps recent
+    DiffComputations keyed by both buffers' contents, their names (which pick the
+    highlight grammar) and the DiffPipelineOptions, so those repeats only pay for
+    build_diff_view. Entries are evicted least-recently-used once the estimated
+    footprint passes a byte cap.
+*/
+
+#include "render/diff_pipeline.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace diffy {
+
+constexpr std::size_t kDefaultDiffCacheBytes = 256u * 1024u * 1024u;
+
+// Rough heap footprint of a computation (lines, edits, annotations, highlights),
+// the figure DiffCache charges against its cap.
+std::size_t
+approximate_bytes(const DiffComputation& c);
+
+class DiffCache {
+   public:
+    explicit DiffCache(std::size_t max_bytes = kDefaultDiffCacheBytes);
+
+    // The cached computation for these inputs, computing and inserting it on a
+    // miss. The same object is handed to every caller that hits it, hence const.
+    // Its lazy hunks, if any, are retained: any thread may pull them, and each is
+    // annotated once however many views lay it out.
+    // Incremental computations are edited in place by their owner and are never
+    // cached; a computation larger than the whole cap, or one degraded by
+    // DiffPipelineOptions::deadline, is returned uncached too.
+    std::shared_ptr<const DiffComputation>
+    get_or_compute(const std::string& a_text,
+                   const std::string& b_text,
+                   const std::string& a_name,
+                   const std::string& b_name,
+                   const DiffPipelineOptions& options);
+
+    void
+    set_max_bytes(std::size_t max_bytes);
+    void
+    clear();
+
+    std::size_t
+    max_bytes() const;
+    // Estimated footprint of the cached entries.
+    std::size_t
+    bytes() const;
+    std::size_t
+    size() const;
+    uint64_t
+    hits() const;
+    uint64_t
+    misses() const;
+
+   private:
+    struct Entry {
+        std::string key;
+        // The inputs themselves: a content hash alone could collide, and a diff
+        // tool must never show one pair's diff for another.
+        std::string a_text;
+        std::string b_text;
+        std::shared_ptr<const DiffComputation> computation;
+        std::size_t bytes = 0;
+    };
+
+    void
+    evict_to(std::size_t budget);
+
+    mutable std::mutex mutex_;
+    std::list<Entry> lru_;  // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::size_t max_bytes_;
+    std::size_t bytes_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+// build_diff_view_from_text through a cache: a layout-only change, or a pair seen
+// before, skips the pipeline and only lays the model out again.
+DiffViewModel
+build_diff_view_from_text(DiffCache& cache,
+                          const std::string& a_text,
+                          const std::string& b_text,
+                          const std::string& a_name,
+                          const std::string& b_name,
+                          const DiffPipelineOptions& pipeline_options,
+                          const DiffLayoutOptions& layout_options,
+                          const std::map<int, GapExpansion>* expansions = nullptr);
+
+}  // namespace diffy
@@ -9,29 +9,57 @@
 #include "processing/diff_hunk.hpp"
 #include "processing/indent_heuristic.hpp"
 #include "processing/tokenizer.hpp"
+#include "util/parallel.hpp"
+#include "util/trace.hpp"
 
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <optional>
 #include <utility>
 
 namespace diffy {
 
 namespace {
 
+// Run `algorithm` under `deadline`; a script it had to coarsen (see
+// DiffResult::timed_out) is recorded as DegradedDiff in `*degradations`.
 bool
-compute_edit_sequence(Algo algorithm, bool ignore_whitespace, DiffInput<Line>& input, DiffResult* result) {
+compute_edit_sequence(Algo algorithm,
+                      bool ignore_whitespace,
+                      DiffInput<Line>& input,
+                      DiffResult* result,
+                      const Deadline* deadline = nullptr,
+                      Degradation* degradations = nullptr,
+                      std::function<void(int64_t)> on_progress = {}) {
+    DIFFY_TRACE_SCOPE("diff");
+    auto run = [&](auto&& algo) {
+        algo.deadline = deadline;
+        algo.on_progress = std::move(on_progress);
+        algo.trace_counters = true;
+        *result = algo.compute();
+    };
     switch (algorithm) {
         case Algo::kMyersGreedy:
-            *result = MyersGreedy<Line>(input).compute();
+            run(MyersGreedy<Line>(input));
             break;
         case Algo::kMyersLinear:
-            *result = MyersLinear<Line>(input).compute();
+            run(MyersLinear<Line>(input));
             break;
         case Algo::kPatience:
-            *result = Patience<Line>(input).compute();
+            run(Patience<Line>(input));
             break;
         case Algo::kInvalid:
         default:
             return false;
     }
+    if (result->timed_out && degradations) {
+        *degradations |= DegradedDiff;
+    }
+    // D of the line script, whichever algorithm produced it (patience isn't
+    // minimal, so this is the length it actually settled on).
+    DIFFY_TRACE_COUNT(DiffEditDistance, std::count_if(result->edit_sequence.begin(), result->edit_sequence.end(),
+                                                      [](const Edit& e) { return e.type != EditType::Common; }));
 
     // Treat a two-sided edit whose both lines are empty-ish as unchanged (mirrors the
     // CLI). Only genuine two-sided edits qualify: a pure Insert has no A line and a
@@ -47,7 +75,7 @@ compute_edit_sequence(Algo algorithm, bool ignore_whitespace, DiffInput<Line>& i
             if (!seq.a_index.valid || !seq.b_index.valid) {
                 continue;  // one-sided (pure insert/delete): no counterpart to compare
             }
-            if (is_empty(input.A[seq.a_index].line) && is_empty(input.B[seq.b_index].line)) {
+            if (input.A[seq.a_index].info().blank && input.B[seq.b_index].info().blank) {
                 seq.type = EditType::Common;
             }
         }
@@ -55,8 +83,110 @@ compute_edit_sequence(Algo algorithm, bool ignore_whitespace, DiffInput<Line>& i
     return true;
 }
 
+// Enclosing-definition label per hunk (git-style "@@ ... @@ funcname"). Prefer
+// the new side; fall back to the old side for pure deletions.
+void
+label_hunks(DiffComputation& c, const std::vector<CodeScope>& a_outline, const std::vector<CodeScope>& b_outline) {
+    for (auto& h : c.hunks) {
+        int64_t a_change = -1, b_change = -1;
+        for (const auto& el : h.a_lines) {
+            if (el.type == EditType::Delete) { a_change = el.line_index; break; }
+        }
+        for (const auto& el : h.b_lines) {
+            if (el.type == EditType::Insert) { b_change = el.line_index; break; }
+        }
+        h.context =
+            hunk_context(a_outline, b_outline, a_change, b_change, h.from_start, h.to_start);
+    }
+    // Lazy: the same first-change lookup, read off the raw edit units.
+    for (size_t i = 0; c.lazy_hunks && i < c.lazy_hunks->size(); i++) {
+        const auto& h = c.lazy_hunks->hunk(i);
+        int64_t a_change = -1, b_change = -1;
+        for (const auto& e : h.edit_units) {
+            if (a_change < 0 && e.type == EditType::Delete) a_change = e.a_index;
+            if (b_change < 0 && e.type == EditType::Insert) b_change = e.b_index;
+        }
+        c.lazy_hunks->set_context(
+            i, hunk_context(a_outline, b_outline, a_change, b_change, h.from_start, h.to_start));
+    }
+}
+
+// Accumulates DiffProgress for DiffPipelineOptions::progress; inert without one.
+struct ProgressReporter {
+    const std::function<void(const DiffProgress&)>& callback;
+    DiffProgress state;
+
+    void
+    emit(DiffStage stage) {
+        if (callback) {
+            state.stage = stage;
+            callback(state);
+        }
+    }
+};
+
+// annotate_hunks, watching the deadline and reporting progress: moves are skipped if it has passed by
+// the time they'd be detected, and the hunks annotated after it get whole-line
+// granularity — no tokenizing or intra-line diff.
+std::vector<AnnotatedHunk>
+annotate_hunks_until(const DiffInput<Line>& input,
+                     const std::vector<Hunk>& hunks,
+                     const DiffPipelineOptions& options,
+                     Degradation* degradations,
+                     ProgressReporter& progress) {
+    if (!options.deadline && !options.progress) {
+        return annotate_hunks(input, hunks, options.granularity, options.ignore_whitespace, options.move_options);
+    }
+    DIFFY_TRACE_SCOPE("annotate_hunks");
+    MoveIndex moves;
+    if (deadline_expired(options.deadline)) {
+        *degradations |= DegradedMoves;
+    } else {
+        moves = detect_moves(input, hunks, options.move_options);
+    }
+    std::vector<AnnotatedHunk> annotated;
+    annotated.reserve(hunks.size());
+    for (const auto& hunk : hunks) {
+        EditGranularity granularity = options.granularity;
+        if (granularity != EditGranularity::Line && deadline_expired(options.deadline)) {
+            granularity = EditGranularity::Line;
+            *degradations |= DegradedAnnotation;
+        }
+        annotated.push_back(annotate_hunk(input, hunk, granularity, options.ignore_whitespace, &moves));
+        progress.state.hunks_annotated++;
+        progress.emit(DiffStage::Annotating);
+    }
+    return annotated;
+}
+
+// Highlight grammar for one side: the forced language, else the one its name implies.
+Language
+side_language(const DiffPipelineOptions& options, const std::string& name) {
+    const Language forced = language_from_name(options.force_language);
+    return forced.empty() ? language_for_path(name) : forced;
+}
+
 }  // namespace
 
+std::string
+degradation_names(Degradation degradations) {
+    static const std::pair<Degradation, const char*> kNames[] = {
+        {DegradedDiff, "diff"},
+        {DegradedMoves, "moves"},
+        {DegradedAnnotation, "annotation"},
+        {DegradedHighlight, "highlight"},
+        {DegradedScopes, "scopes"},
+    };
+    std::string out;
+    for (const auto& [flag, name] : kNames) {
+        if (degradations & flag) {
+            out += out.empty() ? "" : ", ";
+            out += name;
+        }
+    }
+    return out;
+}
+
 DiffComputation
 compute_annotated_diff(const std::string& a_text,
                        const std::string& b_text,
@@ -66,15 +196,63 @@ compute_annotated_diff(const std::string& a_text,
     DiffComputation c;
     c.a_name = a_name;
     c.b_name = b_name;
+    if (options.incremental) {
+        c.incremental = true;
+        c.options = options;
+        c.options.deadline = nullptr;  // later edits aren't bound by this call's budget or
+        c.options.progress = nullptr;  // reported to its observer
+        c.a_text = a_text;
+        c.b_text = b_text;
+    }
     // ignore_whitespace makes line matching whitespace-insensitive at read time, so
     // reindent-only lines share a checksum and the diff treats them as unchanged.
+    ProgressReporter progress{options.progress, {}};
+    progress.emit(DiffStage::Reading);
     c.a_lines = readlines_from_string(a_text, options.ignore_line_endings, options.ignore_whitespace);
+    progress.state.lines_read = static_cast<int64_t>(c.a_lines.size());
+    progress.emit(DiffStage::Reading);
     c.b_lines = readlines_from_string(b_text, options.ignore_line_endings, options.ignore_whitespace);
+    progress.state.lines_read += static_cast<int64_t>(c.b_lines.size());
+    progress.emit(DiffStage::Reading);
+
+    // Syntax highlighting: parse each full buffer once; the language is inferred
+    // from the file name unless force_language overrides it. Returns empty
+    // (no-op) for unknown/oversized/binary. The four tree-sitter passes only read
+    // the texts, so they run on their own threads while this one diffs and
+    // annotates; the results are joined for the hunk labels at the end.
+    LineHighlights a_highlights, b_highlights;
+    std::vector<CodeScope> a_outline, b_outline;
+    bool highlight_aborted[2] = {false, false};
+    bool outline_aborted[2] = {false, false};
+    TaskGroup tree_sitter;  // joins before the results above go out of scope
+    if (options.syntax_highlight) {
+        const Language lang_a = side_language(options, a_name);
+        const Language lang_b = side_language(options, b_name);
+        const Deadline* deadline = options.deadline;
+        tree_sitter.run(
+            [&, lang_a] { a_highlights = highlight_source(a_text, lang_a, deadline, &highlight_aborted[0]); });
+        tree_sitter.run(
+            [&, lang_b] { b_highlights = highlight_source(b_text, lang_b, deadline, &highlight_aborted[1]); });
+        tree_sitter.run([&, lang_a] { a_outline = scope_outline(a_text, lang_a, deadline, &outline_aborted[0]); });
+        tree_sitter.run([&, lang_b] { b_outline = scope_outline(b_text, lang_b, deadline, &outline_aborted[1]); });
+    }
 
     auto input = c.input();
 
     DiffResult result;
-    if (!compute_edit_sequence(options.algorithm, options.ignore_whitespace, input, &result)) {
+    std::function<void(int64_t)> on_distance;
+    if (options.progress) {
+        progress.emit(DiffStage::Diffing);
+        on_distance = [&progress](int64_t d) {
+            // Patience reports per slice, so keep the largest seen.
+            if (d > progress.state.edit_distance) {
+                progress.state.edit_distance = d;
+                progress.emit(DiffStage::Diffing);
+            }
+        };
+    }
+    if (!compute_edit_sequence(options.algorithm, options.ignore_whitespace, input, &result, options.deadline,
+                               &c.degradations, std::move(on_distance))) {
         c.status = DiffResultStatus::Failed;
         return c;
     }
@@ -83,41 +261,270 @@ compute_annotated_diff(const std::string& a_text,
     if (result.status != DiffResultStatus::OK && result.status != DiffResultStatus::NoChanges) {
         return c;
     }
+    if (options.progress) {
+        const auto changed = std::count_if(result.edit_sequence.begin(), result.edit_sequence.end(),
+                                           [](const Edit& e) { return e.type != EditType::Common; });
+        progress.state.edit_distance = std::max<int64_t>(progress.state.edit_distance, changed);
+        progress.emit(DiffStage::Diffing);
+    }
 
     // Slide equivalent add/delete groups to more readable positions (ALG-2) before
     // grouping into hunks. Purely a placement improvement; the diff stays correct.
     apply_indent_heuristic(input, result.edit_sequence);
 
     auto hunks = compose_hunks(result.edit_sequence, options.context_lines);
-    c.hunks = annotate_hunks(input, hunks, options.granularity, options.ignore_whitespace);
+    if (options.incremental) {
+        c.edit_sequence = result.edit_sequence;
+        c.raw_hunks = hunks;
+    }
+    progress.state.hunks_total = static_cast<int64_t>(hunks.size());
+    progress.emit(DiffStage::Annotating);
+    if (options.lazy_annotation) {
+        c.lazy_hunks = std::make_unique<LazyAnnotatedHunks>(input, std::move(hunks), options.granularity,
+                                                            options.ignore_whitespace, options.move_options);
+    } else {
+        c.hunks = annotate_hunks_until(input, hunks, options, &c.degradations, progress);
+    }
 
-    // Syntax highlighting: parse each full buffer once; the language is inferred
-    // from the file name unless force_language overrides it. Returns empty
-    // (no-op) for unknown/oversized/binary.
+    tree_sitter.wait();
+    if (highlight_aborted[0] || highlight_aborted[1]) {
+        c.degradations |= DegradedHighlight;
+    }
+    if (outline_aborted[0] || outline_aborted[1]) {
+        c.degradations |= DegradedScopes;
+    }
     if (options.syntax_highlight) {
-        const Language forced = language_from_name(options.force_language);
-        const Language lang_a = forced.empty() ? language_for_path(a_name) : forced;
-        const Language lang_b = forced.empty() ? language_for_path(b_name) : forced;
-        c.a_highlights = highlight_source(a_text, lang_a);
-        c.b_highlights = highlight_source(b_text, lang_b);
-
-        // Enclosing-definition label per hunk (git-style "@@ ... @@ funcname").
-        // Prefer the new side; fall back to the old side for pure deletions.
-        const auto a_outline = scope_outline(a_text, lang_a);
-        const auto b_outline = scope_outline(b_text, lang_b);
-        for (auto& h : c.hunks) {
-            int64_t a_change = -1, b_change = -1;
-            for (const auto& el : h.a_lines) {
-                if (el.type == EditType::Delete) { a_change = el.line_index; break; }
+        c.a_highlights = std::move(a_highlights);
+        c.b_highlights = std::move(b_highlights);
+        label_hunks(c, a_outline, b_outline);
+        if (options.incremental) {
+            c.a_outline = std::move(a_outline);
+            c.b_outline = std::move(b_outline);
+        }
+    }
+    progress.emit(DiffStage::Done);
+    return c;
+}
+
+namespace {
+
+void
+recompute_all(DiffComputation& c) {
+    const std::string a_text = std::move(c.a_text);
+    const std::string b_text = std::move(c.b_text);
+    c = compute_annotated_diff(a_text, b_text, c.a_name, c.b_name, c.options);
+}
+
+// True when hunk `now` (new coordinates) has the same edit units as `before` (old
+// coordinates, `shift` lines behind on the edited side) and touches none of the
+// re-read lines [touched_begin, touched_end) on that side: its annotation still holds.
+bool
+same_hunk(const Hunk& now, const Hunk& before, bool edited_a, int64_t shift,
+          int64_t touched_begin, int64_t touched_end) {
+    if (now.edit_units.size() != before.edit_units.size()) {
+        return false;
+    }
+    for (size_t k = 0; k < now.edit_units.size(); k++) {
+        const Edit& x = now.edit_units[k];
+        const Edit& y = before.edit_units[k];
+        if (x.type != y.type || x.a_index.valid != y.a_index.valid || x.b_index.valid != y.b_index.valid) {
+            return false;
+        }
+        const EditIndex& xs = edited_a ? x.a_index : x.b_index;
+        const EditIndex& ys = edited_a ? y.a_index : y.b_index;
+        const EditIndex& xo = edited_a ? x.b_index : x.a_index;
+        const EditIndex& yo = edited_a ? y.b_index : y.a_index;
+        if (xs.valid && (xs.value != ys.value + shift || (xs.value >= touched_begin && xs.value < touched_end))) {
+            return false;
+        }
+        if (xo.valid && xo.value != yo.value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool
+apply_text_edit(DiffComputation& c, DiffSide side, size_t offset, size_t length, std::string_view replacement) {
+    if (!c.incremental) {
+        return false;
+    }
+    const bool edited_a = side == DiffSide::Old;
+    std::string& text = edited_a ? c.a_text : c.b_text;
+    std::vector<Line>& lines = edited_a ? c.a_lines : c.b_lines;
+    offset = std::min(offset, text.size());
+    length = std::min(length, text.size() - offset);
+
+    // Lines whose bytes no longer match the text (ignore_line_endings trims them)
+    // can't be mapped back to byte offsets, and a failed diff has no edits to patch.
+    // A computation its deadline degraded is redone rather than patched; the redo
+    // runs unbounded (see compute_annotated_diff), which clears the degradations.
+    const bool patchable = !c.options.ignore_line_endings && !lines.empty() &&
+                           c.degradations == DegradedNone &&
+                           (c.status == DiffResultStatus::OK || c.status == DiffResultStatus::NoChanges);
+    if (!patchable) {
+        text.replace(offset, length, replacement);
+        recompute_all(c);
+        return true;
+    }
+
+    // 1. The lines the edit touches: from the one holding `offset` through the one
+    //    holding its last replaced byte, plus the next line, which absorbs a removed
+    //    newline. Only these are re-split and re-hashed.
+    size_t first = lines.size() - 1, first_byte = 0;
+    {
+        size_t pos = 0;
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (pos + lines[i].line.size() > offset) {
+                first = i;
+                first_byte = pos;
+                break;
+            }
+            pos += lines[i].line.size();
+            first_byte = pos - lines[i].line.size();
+        }
+    }
+    size_t last = first, end_byte = first_byte + lines[first].line.size();
+    while (last + 1 < lines.size() && end_byte < offset + length) {
+        ++last;
+        end_byte += lines[last].line.size();
+    }
+    if (last + 1 < lines.size()) {
+        ++last;
+        end_byte += lines[last].line.size();
+    }
+
+    text.replace(offset, length, replacement);
+    const size_t new_end_byte = end_byte + replacement.size() - length;
+    std::vector<Line> fresh = readlines_from_string(text.substr(first_byte, new_end_byte - first_byte), false,
+                                                    c.options.ignore_whitespace);
+    const int64_t old_count = static_cast<int64_t>(last - first + 1);
+    const int64_t new_count = static_cast<int64_t>(fresh.size());
+    const int64_t delta = new_count - old_count;
+    lines.erase(lines.begin() + static_cast<long>(first), lines.begin() + static_cast<long>(last) + 1);
+    lines.insert(lines.begin() + static_cast<long>(first), std::make_move_iterator(fresh.begin()),
+                 std::make_move_iterator(fresh.end()));
+    for (size_t i = first; i < lines.size() && (i < first + fresh.size() || delta != 0); i++) {
+        lines[i].line_number = static_cast<uint32_t>(i + 1);
+    }
+    const int64_t touched_begin = static_cast<int64_t>(first);
+    const int64_t touched_end = touched_begin + new_count;
+
+    // 2. Re-diff the lines. A region diffed on its own can't be relied on to match
+    //    the whole-file diff: patience anchors on lines unique in the whole file,
+    //    and which of several equal-cost scripts Myers settles on depends on where
+    //    its search starts. So the line diff is run whole, as
+    //    compute_annotated_diff runs it; what stays incremental is the re-read
+    //    above, the annotation and the highlighting below.
+    DiffInput<Line> whole = c.input();
+    DiffResult result;
+    if (!compute_edit_sequence(c.options.algorithm, c.options.ignore_whitespace, whole, &result) ||
+        (result.status != DiffResultStatus::OK && result.status != DiffResultStatus::NoChanges)) {
+        recompute_all(c);
+        return true;
+    }
+    apply_indent_heuristic(whole, result.edit_sequence);
+    c.edit_sequence = std::move(result.edit_sequence);
+    c.status = result.status;
+
+    // 3. Re-compose hunks. A hunk whose edits are unchanged (only shifted) and that
+    //    touches none of the re-read lines keeps its annotation; the rest are redone.
+    //    (Lazy hunks run their own move pass when first pulled.)
+    std::vector<Hunk> hunks = compose_hunks(c.edit_sequence, c.options.context_lines);
+    if (c.lazy_hunks) {
+        c.lazy_hunks = std::make_unique<LazyAnnotatedHunks>(whole, hunks, c.options.granularity,
+                                                            c.options.ignore_whitespace, c.options.move_options);
+    } else {
+        const MoveIndex moves = detect_moves(whole, hunks, c.options.move_options);
+        std::vector<AnnotatedHunk> annotated;
+        annotated.reserve(hunks.size());
+        size_t scan = 0;  // old hunks are in file order, as are the new ones
+        for (const auto& h : hunks) {
+            std::optional<size_t> keep;
+            for (; scan < c.raw_hunks.size(); scan++) {
+                const Hunk& old = c.raw_hunks[scan];
+                const int64_t old_start = edited_a ? old.from_start : old.to_start;
+                const int64_t shift = old_start > touched_begin ? delta : 0;
+                const int64_t new_start = (edited_a ? h.from_start : h.to_start);
+                if (old_start + shift > new_start) {
+                    break;  // later old hunks can't match this one either
+                }
+                if (old_start + shift == new_start &&
+                    same_hunk(h, old, edited_a, shift, touched_begin, touched_end)) {
+                    keep = scan++;
+                    break;
+                }
             }
-            for (const auto& el : h.b_lines) {
-                if (el.type == EditType::Insert) { b_change = el.line_index; break; }
+            if (keep) {
+                AnnotatedHunk ah = std::move(c.hunks[*keep]);
+                const int64_t shift = h.from_start != ah.from_start || h.to_start != ah.to_start ? delta : 0;
+                ah.from_start = h.from_start;
+                ah.to_start = h.to_start;
+                for (auto& el : edited_a ? ah.a_lines : ah.b_lines) {
+                    el.line_index.value += static_cast<int32_t>(shift);
+                }
+                retag_moves(moves, ah);
+                annotated.push_back(std::move(ah));
+            } else {
+                annotated.push_back(annotate_hunk(whole, h, c.options.granularity, c.options.ignore_whitespace,
+                                                  &moves));
             }
-            h.context =
-                hunk_context(a_outline, b_outline, a_change, b_change, h.from_start, h.to_start);
         }
+        c.hunks = std::move(annotated);
     }
-    return c;
+    c.raw_hunks = std::move(hunks);
+
+    // 4. Highlighting: only the edited side is re-parsed; the other side's runs and
+    //    outline stay as they were.
+    if (c.options.syntax_highlight) {
+        const Language lang = side_language(c.options, edited_a ? c.a_name : c.b_name);
+        (edited_a ? c.a_highlights : c.b_highlights) = highlight_source(text, lang);
+        (edited_a ? c.a_outline : c.b_outline) = scope_outline(text, lang);
+        label_hunks(c, c.a_outline, c.b_outline);
+    }
+    return true;
+}
+
+DiffViewModel
+build_diff_view(const DiffComputation& c,
+                const DiffLayoutOptions& layout_options,
+                const std::map<int, GapExpansion>* expansions) {
+    auto input = c.input();
+    return c.lazy_hunks ? build_diff_view(input, *c.lazy_hunks, layout_options, &c.a_highlights,
+                                          &c.b_highlights, expansions)
+                        : build_diff_view(input, c.hunks, layout_options, &c.a_highlights,
+                                          &c.b_highlights, expansions);
+}
+
+DiffViewRefModel
+build_diff_view_refs(const DiffComputation& c,
+                     const DiffLayoutOptions& layout_options,
+                     const std::map<int, GapExpansion>* expansions) {
+    auto input = c.input();
+    return c.lazy_hunks ? build_diff_view_refs(input, *c.lazy_hunks, layout_options, &c.a_highlights,
+                                               &c.b_highlights, expansions)
+                        : build_diff_view_refs(input, c.hunks, layout_options, &c.a_highlights,
+                                               &c.b_highlights, expansions);
+}
+
+DiffViewIndex
+build_diff_view_index(const DiffComputation& c,
+                      const DiffLayoutOptions& layout_options,
+                      const std::map<int, GapExpansion>* expansions) {
+    auto input = c.input();
+    return c.lazy_hunks ? build_diff_view_index(input, *c.lazy_hunks, layout_options, expansions)
+                        : build_diff_view_index(input, c.hunks, layout_options, expansions);
+}
+
+DiffViewModel
+build_diff_view_range(const DiffComputation& c, const DiffViewIndex& index, int64_t first_row, int64_t count) {
+    auto input = c.input();
+    return c.lazy_hunks ? build_diff_view_range(input, *c.lazy_hunks, index, first_row, count,
+                                                &c.a_highlights, &c.b_highlights)
+                        : build_diff_view_range(input, c.hunks, index, first_row, count, &c.a_highlights,
+                                                &c.b_highlights);
 }
 
 DiffViewModel
@@ -131,9 +538,7 @@ build_diff_view_from_text(const std::string& a_text,
                           const std::map<int, GapExpansion>* expansions) {
     DiffComputation c =
         compute_annotated_diff(a_text, b_text, a_name, b_name, pipeline_options);
-    auto input = c.input();
-    DiffViewModel model = build_diff_view(input, c.hunks, layout_options, &c.a_highlights,
-                                          &c.b_highlights, expansions);
+    DiffViewModel model = build_diff_view(c, layout_options, expansions);
     if (out_computation) {
         *out_computation = std::move(c);
     }
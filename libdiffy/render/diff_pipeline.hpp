@@ -7,31 +7,69 @@
 */
 
 #include "algorithms/algorithm.hpp"
+#include "highlight/scope.hpp"
 #include "processing/diff_hunk_annotate.hpp"
 #include "render/diff_view_model.hpp"
 #include "util/readlines.hpp"
 
 #include <gsl/span>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace diffy {
 
+// What a DiffPipelineOptions::deadline cut short, as a set of flags.
+using Degradation = std::uint8_t;
+const Degradation DegradedNone = 0;
+const Degradation DegradedDiff = 1 << 0;        // the unmatched middle is a plain delete + insert
+const Degradation DegradedMoves = 1 << 1;       // moved-block detection skipped
+const Degradation DegradedAnnotation = 1 << 2;  // some hunks annotated by whole lines only
+const Degradation DegradedHighlight = 1 << 3;   // syntax highlighting skipped or aborted
+const Degradation DegradedScopes = 1 << 4;      // hunk scope labels skipped or aborted
+
+// "diff, highlight", ...; empty for DegradedNone.
+std::string
+degradation_names(Degradation degradations);
+
 // Owns the per-side line storage so the DiffInput spans it hands out stay valid.
 struct DiffComputation {
     std::vector<Line> a_lines;
     std::vector<Line> b_lines;
     std::string a_name;
     std::string b_name;
-    std::vector<AnnotatedHunk> hunks;
+    std::vector<AnnotatedHunk> hunks;  // empty when lazy_hunks is set
+    // Set instead of `hunks` under DiffPipelineOptions::lazy_annotation. Points into
+    // a_lines/b_lines, whose buffers survive a move of the computation.
+    std::unique_ptr<LazyAnnotatedHunks> lazy_hunks;
     DiffResultStatus status = DiffResultStatus::Failed;
     LineHighlights a_highlights;  // per-line syntax runs for the old side (may be empty)
     LineHighlights b_highlights;  // per-line syntax runs for the new side (may be empty)
+    Degradation degradations = DegradedNone;
+
+    // State kept for apply_text_edit (DiffPipelineOptions::incremental); empty otherwise.
+    bool incremental = false;
+    DiffPipelineOptions options;
+    std::string a_text;
+    std::string b_text;
+    std::vector<Edit> edit_sequence;  // after the indent heuristic
+    std::vector<Hunk> raw_hunks;      // compose_hunks output the annotations came from
+    std::vector<CodeScope> a_outline;
+    std::vector<CodeScope> b_outline;
 
     DiffInput<Line>
     input() {
         return DiffInput<Line>{gsl::span<Line>(a_lines), gsl::span<Line>(b_lines), a_name, b_name};
     }
+
+    // For the layout and render passes, which only read the lines. DiffInput's spans
+    // are mutable only because the diff algorithms share the type.
+    DiffInput<Line>
+    input() const {
+        return const_cast<DiffComputation*>(this)->input();
+    }
 };
 
 // Run the whole pipeline on two in-memory buffers.
@@ -42,6 +80,42 @@ compute_annotated_diff(const std::string& a_text,
                        const std::string& b_name,
                        const DiffPipelineOptions& options);
 
+// Replace `length` bytes at `offset` of one side's text with `replacement` and
+// bring the computation up to date: only the touched lines are re-read, unaffected
+// hunks keep their annotation and only the edited side is re-highlighted. The line
+// diff itself is re-run over the whole file, so the result is what a fresh
+// compute_annotated_diff would give. Finding the edited line, splicing the lines and
+// re-composing the hunks walk the whole file too, and the edited side is re-parsed
+// whole for highlighting. Returns false (and changes nothing) unless the
+// computation was made with DiffPipelineOptions::incremental.
+bool
+apply_text_edit(DiffComputation& c, DiffSide side, size_t offset, size_t length, std::string_view replacement);
+
+// Lay out an already computed diff (lazy or eager hunks alike).
+DiffViewModel
+build_diff_view(const DiffComputation& c,
+                const DiffLayoutOptions& layout_options,
+                const std::map<int, GapExpansion>* expansions = nullptr);
+
+// Lay out an already computed diff without copying its text. The model's spans
+// point into `c`'s lines, so keep `c` alive (and unedited) while it's in use.
+DiffViewRefModel
+build_diff_view_refs(const DiffComputation& c,
+                     const DiffLayoutOptions& layout_options,
+                     const std::map<int, GapExpansion>* expansions = nullptr);
+
+// The row index of build_diff_view's layout of `c`, and the rows of that layout
+// in [first_row, first_row + count), for a frontend that draws only what's on
+// screen. The gap expansions are resolved into the index, so the range doesn't
+// take them again.
+DiffViewIndex
+build_diff_view_index(const DiffComputation& c,
+                      const DiffLayoutOptions& layout_options,
+                      const std::map<int, GapExpansion>* expansions = nullptr);
+
+DiffViewModel
+build_diff_view_range(const DiffComputation& c, const DiffViewIndex& index, int64_t first_row, int64_t count);
+
 // Convenience: pipeline + build_diff_view in one call. The returned model owns
 // its own text, so it outlives the (optionally returned) DiffComputation.
 // `expansions` is forwarded to build_diff_view to reveal hidden context around
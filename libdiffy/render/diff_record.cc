@@ -0,0 +1,191 @@
+#include "diff_record.hpp"
+
+#include "util/hash.hpp"
+#include "util/varint.hpp"
+
+#include <fmt/format.h>
+
+namespace diffy {
+
+namespace {
+
+// Bump when the layout below changes; older records then fail to parse (a miss).
+constexpr uint8_t kRecordVersion = 1;
+
+// FNV-1a, paired with crc32c so a cache file name carries 96 bits of the key.
+uint64_t
+fnv1a(std::string_view s, uint64_t h = 0xcbf29ce484222325ull) {
+    for (unsigned char c : s) {
+        h = (h ^ c) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+// An index is stored +1 so 0 can mean "not valid".
+uint64_t
+index_code(const EditIndex& i) {
+    return i.valid ? static_cast<uint64_t>(i.value) + 1 : 0;
+}
+
+EditIndex
+index_from_code(uint64_t code) {
+    return code == 0 ? EditIndex() : EditIndex(static_cast<int64_t>(code - 1));
+}
+
+bool
+continues_run(const Edit& prev, const Edit& next) {
+    return next.type == prev.type && next.a_index.valid == prev.a_index.valid &&
+           next.b_index.valid == prev.b_index.valid &&
+           (!next.a_index.valid || next.a_index.value == prev.a_index.value + 1) &&
+           (!next.b_index.valid || next.b_index.value == prev.b_index.value + 1);
+}
+
+void
+put_highlights(std::string& out, const LineHighlights& h) {
+    put_varint(out, h.size());
+    for (const auto& runs : h) {
+        put_varint(out, runs.size());
+        for (const auto& r : runs) {
+            put_varint(out, r.start);
+            put_varint(out, r.end - r.start);
+            put_varint(out, static_cast<uint64_t>(r.group));
+        }
+    }
+}
+
+void
+read_highlights(VarintReader& in, LineHighlights& h) {
+    h.resize(in.count());
+    for (auto& runs : h) {
+        runs.resize(in.count());
+        for (auto& r : runs) {
+            r.start = static_cast<uint32_t>(in.varint());
+            r.end = r.start + static_cast<uint32_t>(in.varint());
+            r.group = static_cast<HighlightGroup>(in.varint());
+        }
+        if (!in.ok) {
+            return;
+        }
+    }
+}
+
+}  // namespace
+
+std::string
+diff_record_key(const std::string& a_text,
+                const std::string& b_text,
+                const std::string& a_name,
+                const std::string& b_name,
+                const DiffPipelineOptions& options,
+                std::string_view version) {
+    std::string material;
+    for (const auto* text : {&a_text, &b_text}) {
+        put_varint(material, text->size());
+        put_varint(material, fnv1a(*text));
+        put_varint(material, hash::hash(text->data(), text->size()));
+    }
+    put_string(material, a_name);
+    put_string(material, b_name);
+    put_varint(material, static_cast<uint64_t>(options.algorithm));
+    put_varint(material, static_cast<uint64_t>(options.context_lines));
+    put_varint(material, options.ignore_whitespace);
+    put_varint(material, options.ignore_line_endings);
+    put_string(material, options.force_language);
+    put_varint(material, kRecordVersion);
+    put_string(material, version);
+    return fmt::format("{:016x}{:08x}", fnv1a(material), hash::hash(material.data(), material.size()));
+}
+
+// Layout: version, status, the edit script as runs of consecutive edits
+// (type, length, first a/b index), the hunk labels, then the highlight runs.
+std::string
+serialize_diff_record(const DiffRecord& record) {
+    std::string out;
+    out += static_cast<char>(kRecordVersion);
+    put_varint(out, static_cast<uint64_t>(record.status));
+
+    const auto& es = record.edit_sequence;
+    std::string runs;
+    size_t run_count = 0;
+    for (size_t i = 0; i < es.size();) {
+        size_t j = i + 1;
+        while (j < es.size() && continues_run(es[j - 1], es[j])) {
+            ++j;
+        }
+        runs += static_cast<char>(es[i].type);
+        put_varint(runs, j - i);
+        put_varint(runs, index_code(es[i].a_index));
+        put_varint(runs, index_code(es[i].b_index));
+        ++run_count;
+        i = j;
+    }
+    put_varint(out, run_count);
+    out += runs;
+
+    put_varint(out, record.hunk_contexts.size());
+    for (const auto& c : record.hunk_contexts) {
+        put_string(out, c);
+    }
+    out += static_cast<char>(record.has_highlights);
+    if (record.has_highlights) {
+        put_highlights(out, record.a_highlights);
+        put_highlights(out, record.b_highlights);
+    }
+    return out;
+}
+
+std::optional<DiffRecord>
+deserialize_diff_record(std::string_view data, size_t a_lines, size_t b_lines) {
+    if (data.empty() || static_cast<uint8_t>(data[0]) != kRecordVersion) {
+        return std::nullopt;
+    }
+    VarintReader in{data, 1};
+    DiffRecord record;
+    const uint64_t status = in.varint();
+    if (status > static_cast<uint64_t>(DiffResultStatus::NoChanges)) {
+        return std::nullopt;
+    }
+    record.status = static_cast<DiffResultStatus>(status);
+
+    const uint64_t run_count = in.count();
+    for (uint64_t r = 0; r < run_count && in.ok; r++) {
+        if (in.pos >= data.size()) {
+            return std::nullopt;
+        }
+        const auto type = static_cast<EditType>(data[in.pos++]);
+        if (type > EditType::Meta) {
+            return std::nullopt;
+        }
+        const uint64_t length = in.varint();
+        Edit e{type, index_from_code(in.varint()), index_from_code(in.varint())};
+        const uint64_t a_end = e.a_index.valid ? static_cast<uint64_t>(e.a_index.value) + length : 0;
+        const uint64_t b_end = e.b_index.valid ? static_cast<uint64_t>(e.b_index.value) + length : 0;
+        if (!in.ok || length == 0 || a_end > a_lines || b_end > b_lines) {
+            return std::nullopt;
+        }
+        for (uint64_t k = 0; k < length; k++) {
+            record.edit_sequence.push_back(e);
+            e.a_index.value += e.a_index.valid ? 1 : 0;
+            e.b_index.value += e.b_index.valid ? 1 : 0;
+        }
+    }
+
+    record.hunk_contexts.resize(in.count());
+    for (auto& c : record.hunk_contexts) {
+        c = in.string();
+    }
+    if (!in.ok || in.pos >= data.size()) {
+        return std::nullopt;
+    }
+    record.has_highlights = data[in.pos++] != 0;
+    if (record.has_highlights) {
+        read_highlights(in, record.a_highlights);
+        read_highlights(in, record.b_highlights);
+    }
+    if (!in.ok || in.pos != data.size()) {
+        return std::nullopt;
+    }
+    return record;
+}
+
+}  // namespace diffy
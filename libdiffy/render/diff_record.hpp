@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+    Compact serialized form of a diff's expensive parts — the edit script, the
+    per-hunk scope labels and the syntax highlight runs — so a repeat invocation
+    on the same pair can load them from the on-disk cache (util/disk_cache.hpp)
+    instead of re-running the diff, scope analysis and tree-sitter.
+*/
+
+#include "algorithms/algorithm.hpp"
+#include "highlight/syntax_highlighter.hpp"
+#include "render/diff_view_model.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace diffy {
+
+struct DiffRecord {
+    DiffResultStatus status = DiffResultStatus::OK;
+    std::vector<Edit> edit_sequence;
+    std::vector<std::string> hunk_contexts;  // one per hunk; empty when not computed
+    bool has_highlights = false;             // the runs below were computed (maybe empty)
+    LineHighlights a_highlights;
+    LineHighlights b_highlights;
+};
+
+// Cache key for a pair of buffers: both contents, the names (which pick the
+// grammar), the options that shape the record and the producing build's
+// `version`, as a 24-hex-digit file name. Options that only affect annotation
+// (granularity, move tolerance) are left out: the record doesn't hold annotations.
+std::string
+diff_record_key(const std::string& a_text,
+                const std::string& b_text,
+                const std::string& a_name,
+                const std::string& b_name,
+                const DiffPipelineOptions& options,
+                std::string_view version);
+
+std::string
+serialize_diff_record(const DiffRecord& record);
+
+// nullopt when `data` isn't a well-formed record for inputs of `a_lines` and
+// `b_lines` lines (an edit indexing past either side rejects it).
+std::optional<DiffRecord>
+deserialize_diff_record(std::string_view data, size_t a_lines, size_t b_lines);
+
+}  // namespace diffy
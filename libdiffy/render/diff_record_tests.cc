@@ -0,0 +1,75 @@
+#include <doctest.h>
+
+#include "render/diff_record.hpp"
+
+#include <string>
+
+using namespace diffy;
+
+namespace {
+
+DiffRecord
+sample_record() {
+    DiffRecord r;
+    r.status = DiffResultStatus::OK;
+    for (int i = 0; i < 40; i++) {
+        r.edit_sequence.push_back({EditType::Common, EditIndex(i), EditIndex(i)});
+    }
+    r.edit_sequence.push_back({EditType::Delete, EditIndex(40), EditIndexInvalid});
+    r.edit_sequence.push_back({EditType::Delete, EditIndex(41), EditIndexInvalid});
+    r.edit_sequence.push_back({EditType::Insert, EditIndexInvalid, EditIndex(40)});
+    r.edit_sequence.push_back({EditType::Common, EditIndex(42), EditIndex(41)});
+    r.hunk_contexts = {"int main()"};
+    r.has_highlights = true;
+    r.a_highlights = {{{0, 3, HighlightGroup::Comment}}, {}};
+    r.b_highlights = {{}, {{2, 7, HighlightGroup::None}, {7, 9, HighlightGroup::Comment}}};
+    return r;
+}
+
+}  // namespace
+
+TEST_CASE("diff record: round-trips and stores runs compactly") {
+    const DiffRecord r = sample_record();
+    const std::string data = serialize_diff_record(r);
+    CHECK(data.size() < 64);  // 44 edits collapse into 4 runs
+
+    const auto back = deserialize_diff_record(data, 43, 42);
+    REQUIRE(back.has_value());
+    CHECK(back->status == r.status);
+    REQUIRE(back->edit_sequence.size() == r.edit_sequence.size());
+    for (size_t i = 0; i < r.edit_sequence.size(); i++) {
+        CHECK(back->edit_sequence[i].type == r.edit_sequence[i].type);
+        CHECK(back->edit_sequence[i].a_index.valid == r.edit_sequence[i].a_index.valid);
+        CHECK(back->edit_sequence[i].a_index.value == r.edit_sequence[i].a_index.value);
+        CHECK(back->edit_sequence[i].b_index.valid == r.edit_sequence[i].b_index.valid);
+        CHECK(back->edit_sequence[i].b_index.value == r.edit_sequence[i].b_index.value);
+    }
+    CHECK(back->hunk_contexts == r.hunk_contexts);
+    CHECK(back->has_highlights);
+    REQUIRE(back->b_highlights.size() == 2);
+    REQUIRE(back->b_highlights[1].size() == 2);
+    CHECK(back->b_highlights[1][1].start == 7);
+    CHECK(back->b_highlights[1][1].end == 9);
+    CHECK(back->b_highlights[1][1].group == HighlightGroup::Comment);
+}
+
+TEST_CASE("diff record: rejects truncated data and out-of-range edits") {
+    const std::string data = serialize_diff_record(sample_record());
+    for (size_t n = 0; n < data.size(); n++) {
+        CHECK_FALSE(deserialize_diff_record(std::string_view(data).substr(0, n), 43, 42).has_value());
+    }
+    CHECK_FALSE(deserialize_diff_record(data, 42, 42).has_value());
+    CHECK_FALSE(deserialize_diff_record(data + "x", 43, 42).has_value());
+}
+
+TEST_CASE("diff record: the key depends on content, names, options and version") {
+    DiffPipelineOptions o;
+    const auto key = diff_record_key("a\n", "b\n", "x.c", "y.c", o, "1");
+    CHECK(key.size() == 24);
+    CHECK(key == diff_record_key("a\n", "b\n", "x.c", "y.c", o, "1"));
+    CHECK(key != diff_record_key("a\n", "c\n", "x.c", "y.c", o, "1"));
+    CHECK(key != diff_record_key("a\n", "b\n", "x.c", "y.py", o, "1"));
+    CHECK(key != diff_record_key("a\n", "b\n", "x.c", "y.c", o, "2"));
+    o.context_lines = 5;
+    CHECK(key != diff_record_key("a\n", "b\n", "x.c", "y.c", o, "1"));
+}
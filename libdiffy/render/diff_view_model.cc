@@ -1,10 +1,17 @@
 #include "diff_view_model.hpp"
 
+#include "util/hash.hpp"
+#include "util/parallel.hpp"
+#include "util/trace.hpp"
+
 #include <fmt/format.h>
 
 #include <algorithm>
+#include <deque>
 #include <functional>
 #include <gsl/span>
+#include <limits>
+#include <string_view>
 #include <unordered_map>
 
 namespace diffy {
@@ -34,28 +41,14 @@ strip_eol(std::string s) {
     return s;
 }
 
-// Emit spans for one diff segment [start, start+length) of `text`, split at the
-// boundaries of the line's syntax-highlight runs so each emitted span carries a
-// single (diff style, syntax group) pair. `runs` is null when the line has no
-// highlighting, in which case the whole segment becomes one span (group None).
+// Split one diff segment [start, start+length) of a line at the boundaries of the
+// line's syntax-highlight runs, calling push(a, b, group) for each piece so every
+// span carries a single (diff style, syntax group) pair. `runs` is null when the
+// line has no highlighting, in which case the whole segment is one piece (None).
+template <typename Push>
 void
-emit_segment_spans(DiffCell& cell,
-                   const std::string& text,
-                   uint32_t start,
-                   uint32_t length,
-                   SpanStyle style,
-                   const std::vector<HighlightRun>* runs) {
+split_segment(uint32_t start, uint32_t length, const std::vector<HighlightRun>* runs, Push&& push) {
     const uint32_t seg_end = start + length;
-    auto push = [&](uint32_t a, uint32_t b, HighlightGroup g) {
-        if (b <= a) {
-            return;
-        }
-        std::string piece = strip_eol(text.substr(a, b - a));
-        if (!piece.empty()) {
-            cell.spans.push_back({std::move(piece), style, g});
-        }
-    };
-
     if (!runs) {
         push(start, seg_end, HighlightGroup::None);
         return;
@@ -82,139 +75,215 @@ emit_segment_spans(DiffCell& cell,
     }
 }
 
-// Build a content cell from one annotated edit line, pulling the actual text out
-// of the source side (A or B). Newlines are dropped: each row is one visual line.
-DiffCell
-make_cell(const gsl::span<Line>& source, const EditLine& line, const LineHighlights* highlights) {
-    DiffCell cell;
-    cell.present = true;
-    cell.type = line.type;
+const std::vector<HighlightRun>*
+line_runs(const LineHighlights* highlights, const EditLine& line) {
+    if (highlights && line.line_index < highlights->size() && !(*highlights)[line.line_index].empty()) {
+        return &(*highlights)[line.line_index];
+    }
+    return nullptr;
+}
 
-    const std::string& text = source[static_cast<long>(line.line_index)].line;
-    const std::vector<HighlightRun>* runs = nullptr;
-    if (highlights && line.line_index < highlights->size() &&
-        !(*highlights)[line.line_index].empty()) {
-        runs = &(*highlights)[line.line_index];
+// The cell builders behind the two models. OwnedCells copies each span's text
+// out of the input into a DiffCell; RefCells appends (line, offset, length)
+// references to the model's span pool. Newlines are dropped either way: each
+// row is one visual line.
+struct OwnedCells {
+    using Model = DiffViewModel;
+    using Cell = DiffCell;
+
+    const DiffInput<Line>& input;
+    Model& model;
+
+    DiffCell
+    make(DiffSide side, const EditLine& line, const LineHighlights* highlights) {
+        DiffCell cell;
+        cell.present = true;
+        cell.type = line.type;
+
+        const auto& source = side == DiffSide::Old ? input.A : input.B;
+        const std::string& text = source[static_cast<long>(line.line_index)].line;
+        const std::vector<HighlightRun>* runs = line_runs(highlights, line);
+        for (const auto& seg : line.segments) {
+            const SpanStyle style = span_style_for(line.type, seg.type);
+            split_segment(seg.start, seg.length, runs, [&](uint32_t a, uint32_t b, HighlightGroup g) {
+                if (b <= a) {
+                    return;
+                }
+                std::string piece = strip_eol(text.substr(a, b - a));
+                if (!piece.empty()) {
+                    cell.spans.push_back({std::move(piece), style, g});
+                }
+            });
+        }
+        return cell;
     }
-    for (const auto& seg : line.segments) {
-        emit_segment_spans(cell, text, seg.start, seg.length, span_style_for(line.type, seg.type),
-                           runs);
+};
+
+struct RefCells {
+    using Model = DiffViewRefModel;
+    using Cell = DiffCellRef;
+
+    const DiffInput<Line>& input;
+    Model& model;
+
+    DiffCellRef
+    make(DiffSide side, const EditLine& line, const LineHighlights* highlights) {
+        DiffCellRef cell;
+        cell.present = true;
+        cell.type = line.type;
+        cell.first_span = static_cast<uint32_t>(model.spans.size());
+
+        const auto& source = side == DiffSide::Old ? input.A : input.B;
+        const std::string& text = source[static_cast<long>(line.line_index)].line;
+        const auto line_index = static_cast<uint32_t>(line.line_index);
+        const std::vector<HighlightRun>* runs = line_runs(highlights, line);
+        for (const auto& seg : line.segments) {
+            const SpanStyle style = span_style_for(line.type, seg.type);
+            split_segment(seg.start, seg.length, runs, [&](uint32_t a, uint32_t b, HighlightGroup g) {
+                // The piece minus its CR/LF bytes, as one reference per unbroken run.
+                b = std::min<uint32_t>(b, static_cast<uint32_t>(text.size()));
+                bool continued = false;
+                uint32_t run = a;
+                for (uint32_t k = a; k <= b; k++) {
+                    if (k < b && text[k] != '\n' && text[k] != '\r') {
+                        continue;
+                    }
+                    if (k > run) {
+                        model.spans.push_back({line_index, run, k - run, side, continued, style, g});
+                        continued = true;
+                    }
+                    run = k + 1;
+                }
+            });
+        }
+        cell.span_count = static_cast<uint32_t>(model.spans.size()) - cell.first_span;
+        return cell;
     }
-    return cell;
-}
+};
 
-void
-build_side_by_side(const DiffInput<Line>& input, const AnnotatedHunk& hunk, std::vector<DiffRow>& rows,
-                   const LineHighlights* a_hl, const LineHighlights* b_hl) {
+// Which lines the next row of a hunk takes: A[i] and B[j] side by side, or one
+// of them on its own.
+enum class Take { Both, Old, New };
+
+Take
+next_take(const AnnotatedHunk& hunk, std::size_t i, std::size_t j, ViewMode mode) {
     const auto& A = hunk.a_lines;
     const auto& B = hunk.b_lines;
-    std::size_t i = 0, j = 0;
-
-    while (i < A.size() || j < B.size()) {
-        const bool has_a = i < A.size();
-        const bool has_b = j < B.size();
-        const EditType at = has_a ? A[i].type : EditType::Meta;
-        const EditType bt = has_b ? B[j].type : EditType::Meta;
-
-        DiffRow row;
-        if (has_a && has_b && at == EditType::Common && bt == EditType::Common) {
-            row.left = make_cell(input.A, A[i], a_hl);
-            row.old_lineno = static_cast<int64_t>(A[i].line_index) + 1;
-            row.right = make_cell(input.B, B[j], b_hl);
-            row.new_lineno = static_cast<int64_t>(B[j].line_index) + 1;
-            ++i;
-            ++j;
-        } else if (has_a && has_b && at == EditType::Delete && bt == EditType::Insert &&
-                   A[i].move_id == 0 && B[j].move_id == 0) {
-            // A changed line: show the deletion and insertion as a pair. Only when
-            // NEITHER side is a moved line — a DiffRow carries a single move_id, so
-            // pairing a moved delete with a moved insert here would silently drop the
-            // move markers of one (or both). Moved lines instead fall through to the
-            // delete-only / insert-only branches below, which preserve move_id, so a
-            // relocated block renders whole on its own side (GAP-9).
-            row.left = make_cell(input.A, A[i], a_hl);
-            row.old_lineno = static_cast<int64_t>(A[i].line_index) + 1;
-            row.right = make_cell(input.B, B[j], b_hl);
-            row.new_lineno = static_cast<int64_t>(B[j].line_index) + 1;
-            ++i;
-            ++j;
-        } else if (has_a && at == EditType::Delete) {
-            row.left = make_cell(input.A, A[i], a_hl);
-            row.old_lineno = static_cast<int64_t>(A[i].line_index) + 1;
-            row.move_id = A[i].move_id;
-            row.move_line = A[i].move_line;
-            ++i;
-        } else if (has_b && bt == EditType::Insert) {
-            row.right = make_cell(input.B, B[j], b_hl);
-            row.new_lineno = static_cast<int64_t>(B[j].line_index) + 1;
-            row.move_id = B[j].move_id;
-            row.move_line = B[j].move_line;
-            ++j;
-        } else if (has_a) {
-            row.left = make_cell(input.A, A[i], a_hl);
-            row.old_lineno = static_cast<int64_t>(A[i].line_index) + 1;
-            ++i;
-        } else {
-            row.right = make_cell(input.B, B[j], b_hl);
-            row.new_lineno = static_cast<int64_t>(B[j].line_index) + 1;
-            ++j;
+    const bool has_a = i < A.size();
+    const bool has_b = j < B.size();
+    const EditType at = has_a ? A[i].type : EditType::Meta;
+    const EditType bt = has_b ? B[j].type : EditType::Meta;
+
+    if (has_a && has_b && at == EditType::Common && bt == EditType::Common) {
+        return Take::Both;
+    }
+    // A changed line: side by side, show the deletion and insertion as a pair. Only
+    // when NEITHER side is a moved line — a DiffRow carries a single move_id, so
+    // pairing a moved delete with a moved insert here would silently drop the move
+    // markers of one (or both). Moved lines instead take a row each, which preserves
+    // move_id, so a relocated block renders whole on its own side (GAP-9).
+    if (mode == ViewMode::SideBySide && has_a && has_b && at == EditType::Delete &&
+        bt == EditType::Insert && A[i].move_id == 0 && B[j].move_id == 0) {
+        return Take::Both;
+    }
+    if (has_a && at == EditType::Delete) {
+        return Take::Old;
+    }
+    if (has_b && bt == EditType::Insert) {
+        return Take::New;
+    }
+    return has_a ? Take::Old : Take::New;
+}
+
+// The row for one step of the pairing walk. Unified rows put everything in the
+// left cell (a common pair shows the old side, with both line numbers); right
+// stays !present.
+template <typename Cells>
+BasicDiffRow<typename Cells::Cell>
+make_hunk_row(Cells& cells, const AnnotatedHunk& hunk, std::size_t i, std::size_t j, Take take, ViewMode mode,
+              const LineHighlights* a_hl, const LineHighlights* b_hl) {
+    BasicDiffRow<typename Cells::Cell> row;
+    if (take != Take::New) {
+        const EditLine& line = hunk.a_lines[i];
+        row.left = cells.make(DiffSide::Old, line, a_hl);
+        row.old_lineno = static_cast<int64_t>(line.line_index) + 1;
+        if (take == Take::Old) {
+            row.move_id = line.move_id;
+            row.move_line = line.move_line;
+        }
+    }
+    if (take != Take::Old) {
+        const EditLine& line = hunk.b_lines[j];
+        if (mode == ViewMode::SideBySide) {
+            row.right = cells.make(DiffSide::New, line, b_hl);
+        } else if (take == Take::New) {
+            row.left = cells.make(DiffSide::New, line, b_hl);
+        }
+        row.new_lineno = static_cast<int64_t>(line.line_index) + 1;
+        if (take == Take::New) {
+            row.move_id = line.move_id;
+            row.move_line = line.move_line;
         }
-        rows.push_back(std::move(row));
     }
+    return row;
 }
 
+// Lay out `count` of a hunk's content rows, starting `skip` rows past `from` in
+// its pairing walk.
+template <typename Cells>
 void
-build_unified(const DiffInput<Line>& input, const AnnotatedHunk& hunk, std::vector<DiffRow>& rows,
-              const LineHighlights* a_hl, const LineHighlights* b_hl) {
-    const auto& A = hunk.a_lines;
-    const auto& B = hunk.b_lines;
-    std::size_t i = 0, j = 0;
-
-    while (i < A.size() || j < B.size()) {
-        const bool has_a = i < A.size();
-        const bool has_b = j < B.size();
-        const EditType at = has_a ? A[i].type : EditType::Meta;
-        const EditType bt = has_b ? B[j].type : EditType::Meta;
-
-        DiffRow row;  // right stays !present in unified mode
-        if (has_a && has_b && at == EditType::Common && bt == EditType::Common) {
-            row.left = make_cell(input.A, A[i], a_hl);
-            row.old_lineno = static_cast<int64_t>(A[i].line_index) + 1;
-            row.new_lineno = static_cast<int64_t>(B[j].line_index) + 1;
-            ++i;
-            ++j;
-        } else if (has_a && at == EditType::Delete) {
-            row.left = make_cell(input.A, A[i], a_hl);
-            row.old_lineno = static_cast<int64_t>(A[i].line_index) + 1;
-            row.move_id = A[i].move_id;
-            row.move_line = A[i].move_line;
-            ++i;
-        } else if (has_b && bt == EditType::Insert) {
-            row.left = make_cell(input.B, B[j], b_hl);
-            row.new_lineno = static_cast<int64_t>(B[j].line_index) + 1;
-            row.move_id = B[j].move_id;
-            row.move_line = B[j].move_line;
-            ++j;
-        } else if (has_a) {
-            row.left = make_cell(input.A, A[i], a_hl);
-            row.old_lineno = static_cast<int64_t>(A[i].line_index) + 1;
-            ++i;
+build_hunk_rows(Cells& cells,
+                const AnnotatedHunk& hunk,
+                ViewMode mode,
+                DiffViewIndex::Cursor from,
+                int64_t skip,
+                int64_t count,
+                const LineHighlights* a_hl,
+                const LineHighlights* b_hl) {
+    std::size_t i = from.a;
+    std::size_t j = from.b;
+    while ((i < hunk.a_lines.size() || j < hunk.b_lines.size()) && count > 0) {
+        const Take take = next_take(hunk, i, j, mode);
+        if (skip > 0) {
+            --skip;
         } else {
-            row.left = make_cell(input.B, B[j], b_hl);
-            row.new_lineno = static_cast<int64_t>(B[j].line_index) + 1;
-            ++j;
+            cells.model.rows.push_back(make_hunk_row(cells, hunk, i, j, take, mode, a_hl, b_hl));
+            --count;
+        }
+        i += take != Take::New;
+        j += take != Take::Old;
+    }
+}
+
+// Content rows between pairing checkpoints in a DiffViewIndex.
+constexpr int64_t kCursorStride = 256;
+
+// Count a hunk's content rows, appending a checkpoint every kCursorStride rows.
+int64_t
+index_hunk_rows(const AnnotatedHunk& hunk, ViewMode mode, std::vector<DiffViewIndex::Cursor>& cursors) {
+    int64_t rows = 0;
+    std::size_t i = 0;
+    std::size_t j = 0;
+    while (i < hunk.a_lines.size() || j < hunk.b_lines.size()) {
+        if (rows % kCursorStride == 0) {
+            cursors.push_back({static_cast<uint32_t>(i), static_cast<uint32_t>(j)});
         }
-        rows.push_back(std::move(row));
+        const Take take = next_take(hunk, i, j, mode);
+        i += take != Take::New;
+        j += take != Take::Old;
+        ++rows;
     }
+    return rows;
 }
 
 // Build a Content row for one common (unchanged) line revealed inside a context
-// gap. Mirrors the Common-line branch of build_side_by_side (:120) / build_unified
-// (:180): a synthesized EditLine carrying one whole-line Common segment feeds
-// make_cell, so a revealed line gets the same syntax highlighting as any other
-// row. `oi`/`ni` are 0-based A/B line indices (they advance 1:1 across a gap).
-DiffRow
-make_common_row(const DiffInput<Line>& input, int64_t oi, int64_t ni, ViewMode mode,
+// gap. Mirrors the Common-line branch of make_hunk_row: a synthesized EditLine
+// carrying one whole-line Common segment feeds the cell builder, so a revealed
+// line gets the same syntax highlighting as any other row. `oi`/`ni` are 0-based
+// A/B line indices (they advance 1:1 across a gap).
+template <typename Cells>
+BasicDiffRow<typename Cells::Cell>
+make_common_row(Cells& cells, int64_t oi, int64_t ni, ViewMode mode,
                 const LineHighlights* a_hl, const LineHighlights* b_hl) {
     auto synth = [](int64_t idx, const gsl::span<Line>& src) {
         EditLine el;
@@ -224,28 +293,107 @@ make_common_row(const DiffInput<Line>& input, int64_t oi, int64_t ni, ViewMode m
                                           EditType::Common});
         return el;
     };
-    DiffRow row;
-    row.left = make_cell(input.A, synth(oi, input.A), a_hl);
+    BasicDiffRow<typename Cells::Cell> row;
+    row.left = cells.make(DiffSide::Old, synth(oi, cells.input.A), a_hl);
     row.old_lineno = oi + 1;
     row.new_lineno = ni + 1;  // unified shows both numbers in a single cell
     if (mode == ViewMode::SideBySide) {
-        row.right = make_cell(input.B, synth(ni, input.B), b_hl);  // new side alongside the old
+        row.right = cells.make(DiffSide::New, synth(ni, cells.input.B), b_hl);  // new side alongside the old
     }
     return row;
 }
 
-}  // namespace
+// There are hunks.size()+1 runs of hidden common lines: gap g (0..N-1) precedes
+// hunks[g]; gap N is the tail after the last hunk. Only the hunks' line ranges are
+// needed, so a lazy source isn't annotated for this.
+template <typename Source>
+DiffViewIndex::Gap
+gap_layout(const Source& hunks, std::size_t g, const DiffInput<Line>& input,
+           const std::map<int, GapExpansion>* expansions) {
+    const int64_t nA = static_cast<int64_t>(input.A.size());
+    const int64_t nB = static_cast<int64_t>(input.B.size());
+    // The hidden common range for this gap, as 1-based A/B line ranges of equal
+    // length H. Between two hunks it's [prev hunk end + 1 .. next hunk start - 1];
+    // the leading gap starts at line 1; the tail runs to end-of-file. Old line k
+    // and new line k advance together (the region is entirely common).
+    DiffViewIndex::Gap gap;
+    int64_t H;
+    if (g < hunks.size()) {
+        const int64_t prev_old_end =
+            (g == 0) ? 0 : hunks.hunk(g - 1).from_start + hunks.hunk(g - 1).from_count - 1;
+        const int64_t prev_new_end =
+            (g == 0) ? 0 : hunks.hunk(g - 1).to_start + hunks.hunk(g - 1).to_count - 1;
+        gap.old_start = prev_old_end + 1;
+        gap.new_start = prev_new_end + 1;
+        H = hunks.hunk(g).from_start - gap.old_start;  // == (from_start-1) - old_start + 1
+    } else {
+        const auto& last = hunks.hunk(hunks.size() - 1);
+        gap.old_start = last.from_start + last.from_count;
+        gap.new_start = last.to_start + last.to_count;
+        H = nA - gap.old_start + 1;
+    }
+    // Defensive: old/new ranges are equal-length in a well-formed diff, but never
+    // read past either buffer if a stray count ever disagrees.
+    H = std::min(H, nB - gap.new_start + 1);
+    if (H <= 0) {
+        return gap;
+    }
 
-DiffViewModel
-build_diff_view(const DiffInput<Line>& input,
-                const std::vector<AnnotatedHunk>& hunks,
-                const DiffLayoutOptions& options,
-                const LineHighlights* a_highlights,
-                const LineHighlights* b_highlights,
-                const std::map<int, GapExpansion>* expansions) {
-    DiffViewModel model;
-    model.mode = options.mode;
+    GapExpansion exp;
+    if (expansions) {
+        auto it = expansions->find(static_cast<int>(g));
+        if (it != expansions->end()) {
+            exp = it->second;
+        }
+    }
+    gap.size = H;
+    gap.top = std::min(exp.top, H);
+    gap.bot = std::min(exp.bot, H - gap.top);
+    return gap;
+}
+
+// The tail gap has no following @@ header to host its controls, so it keeps a
+// standalone ContextGap marker row: it carries the hidden count (for "expand"
+// affordances) and, when partly revealed, doubles as the "collapse" seam between
+// the top/bot blocks. Non-tail gaps fold their controls onto the next hunk's @@
+// header instead, so they emit no marker.
+bool
+has_marker(const DiffViewIndex::Gap& gap, bool is_tail) {
+    return is_tail && gap.size > 0;
+}
 
+int64_t
+gap_rows(const DiffViewIndex::Gap& gap, bool is_tail) {
+    return gap.top + (has_marker(gap, is_tail) ? 1 : 0) + gap.bot;
+}
+
+// Row `k` of a gap: one of the `top` lines revealed at its start (adjacent to the
+// prev hunk), the tail's marker, or one of the `bot` lines revealed at its end
+// (adjacent to the next hunk).
+template <typename Cells>
+BasicDiffRow<typename Cells::Cell>
+make_gap_row(Cells& cells, const DiffViewIndex::Gap& gap, int g, bool is_tail, int64_t k, ViewMode mode,
+             const LineHighlights* a_hl, const LineHighlights* b_hl) {
+    if (k < gap.top) {
+        return make_common_row(cells, gap.old_start - 1 + k, gap.new_start - 1 + k, mode, a_hl, b_hl);
+    }
+    const int64_t marker = has_marker(gap, is_tail) ? 1 : 0;
+    if (k < gap.top + marker) {
+        BasicDiffRow<typename Cells::Cell> row;
+        row.kind = RowKind::ContextGap;
+        row.gap_id = g;
+        row.gap_hidden = gap.size - gap.top - gap.bot;
+        row.old_lineno = gap.old_start + gap.top;  // first still-hidden line (the seam)
+        row.new_lineno = gap.new_start + gap.top;
+        return row;
+    }
+    const int64_t line = gap.size - gap.bot + (k - gap.top - marker);
+    return make_common_row(cells, gap.old_start - 1 + line, gap.new_start - 1 + line, mode, a_hl, b_hl);
+}
+
+template <typename Cell>
+BasicDiffRow<Cell>
+make_header_row(const AnnotatedHunk& hunk, const DiffViewIndex::Gap& gap, int g) {
     // Git-style range, matching the unified and column-view @@ headers exactly:
     // from_start/to_start are already 1-based, and a count of 1 is shown as a
     // single number.
@@ -253,180 +401,498 @@ build_diff_view(const DiffInput<Line>& input,
         return count == 1 ? fmt::format("{}", start) : fmt::format("{},{}", start, count);
     };
 
+    BasicDiffRow<Cell> header;
+    header.kind = RowKind::HunkHeader;
+    header.header_text = fmt::format("@@ -{} +{} @@", fmt_change(hunk.from_start, hunk.from_count),
+                                     fmt_change(hunk.to_start, hunk.to_count));
+    if (!hunk.context.empty()) {
+        header.header_text += " " + hunk.context;
+    }
+    // Gap g precedes this hunk, so its @@ header is the natural home for the gap's
+    // expand/collapse controls (the frontend renders them right-aligned on this row).
+    // Stamp the header with the gap's id + still-hidden count; gap_id keeps its -1
+    // default when no run of common lines is hidden before this hunk.
+    if (gap.size > 0) {
+        header.gap_id = g;
+        header.gap_hidden = gap.size - gap.top - gap.bot;
+    }
+    return header;
+}
+
+// Hunk source over an already annotated diff (see LazyAnnotatedHunks for the other).
+struct EagerHunks {
+    const std::vector<AnnotatedHunk>& hunks;
+
+    size_t size() const {
+        return hunks.size();
+    }
+    const AnnotatedHunk& hunk(size_t i) const {
+        return hunks[i];
+    }
+    const AnnotatedHunk& get(size_t i) const {
+        return hunks[i];
+    }
+    void release(size_t) const {
+    }
+};
+
+// The gap walk only needs each hunk's line ranges (`hunk(i)`); the annotated lines
+// (`get(i)`) are pulled just for the hunk being laid out and released after, so a
+// lazy source never holds more than one annotated hunk.
+template <typename Cells, typename Source>
+void
+build_diff_view_from_source(Cells& cells,
+                            Source& hunks,
+                            const DiffLayoutOptions& options,
+                            const LineHighlights* a_highlights,
+                            const LineHighlights* b_highlights,
+                            const std::map<int, GapExpansion>* expansions) {
+    DIFFY_TRACE_SCOPE("build_diff_view");
+    auto& model = cells.model;
+    model.mode = options.mode;
+
     // No hunks => no changes => nothing to give context to (matches the pre-gap
     // behaviour: identical input yields an empty model).
-    if (hunks.empty()) {
-        return model;
+    if (hunks.size() == 0) {
+        return;
     }
 
-    const int64_t nA = static_cast<int64_t>(input.A.size());
-    const int64_t nB = static_cast<int64_t>(input.B.size());
-    // There are hunks.size()+1 runs of hidden common lines: gap g (0..N-1) precedes
-    // hunks[g]; gap N is the tail after the last hunk. Walk them in file order,
-    // emitting each gap's revealed/collapsed rows, then the hunk that follows it.
-    const int num_gaps = static_cast<int>(hunks.size()) + 1;
-    for (int g = 0; g < num_gaps; ++g) {
-        const bool is_tail = g == static_cast<int>(hunks.size());
-        // The hidden common range for this gap, as 1-based A/B line ranges of equal
-        // length H. Between two hunks it's [prev hunk end + 1 .. next hunk start - 1];
-        // the leading gap starts at line 1; the tail runs to end-of-file. Old line k
-        // and new line k advance together (the region is entirely common).
-        int64_t old_start, new_start, H;
-        if (!is_tail) {
-            const int64_t prev_old_end =
-                (g == 0) ? 0 : hunks[g - 1].from_start + hunks[g - 1].from_count - 1;
-            const int64_t prev_new_end =
-                (g == 0) ? 0 : hunks[g - 1].to_start + hunks[g - 1].to_count - 1;
-            old_start = prev_old_end + 1;
-            new_start = prev_new_end + 1;
-            H = hunks[g].from_start - old_start;  // == (from_start-1) - old_start + 1
-        } else {
-            const auto& last = hunks.back();
-            old_start = last.from_start + last.from_count;
-            new_start = last.to_start + last.to_count;
-            H = nA - old_start + 1;
+    // Walk the gaps in file order, emitting each gap's revealed/collapsed rows, then
+    // the hunk that follows it.
+    for (std::size_t g = 0; g <= hunks.size(); ++g) {
+        const bool is_tail = g == hunks.size();
+        const DiffViewIndex::Gap gap = gap_layout(hunks, g, cells.input, expansions);
+        const int64_t rows = gap_rows(gap, is_tail);
+        for (int64_t k = 0; k < rows; ++k) {
+            model.rows.push_back(make_gap_row(cells, gap, static_cast<int>(g), is_tail, k, options.mode,
+                                              a_highlights, b_highlights));
         }
-        // Defensive: old/new ranges are equal-length in a well-formed diff, but never
-        // read past either buffer if a stray count ever disagrees.
-        H = std::min(H, nB - new_start + 1);
-
-        // How many of this gap's common lines are still hidden after applying any
-        // expansion. Declared out here so the following @@ header — which now hosts
-        // gap g's expand/collapse controls — can carry the count. Stays 0 when the gap
-        // has no hidden lines (H == 0).
-        int64_t remaining = 0;
-        if (H > 0) {
-            GapExpansion exp;
-            if (expansions) {
-                auto it = expansions->find(g);
-                if (it != expansions->end()) {
-                    exp = it->second;
-                }
-            }
-            const int64_t top = std::min(exp.top, H);
-            const int64_t bot = std::min(exp.bot, H - top);
-            remaining = H - top - bot;
-            // (a) `top` lines revealed at the gap's start (adjacent to the prev hunk).
-            for (int64_t k = 0; k < top; ++k) {
-                model.rows.push_back(make_common_row(input, old_start - 1 + k, new_start - 1 + k,
-                                                     options.mode, a_highlights, b_highlights));
-            }
-            // (b) The tail gap has no following @@ header to host its controls, so it
-            // keeps a standalone ContextGap marker row: it carries the hidden count (for
-            // "expand" affordances) and, when partly revealed, doubles as the "collapse"
-            // seam between the top/bot blocks. Non-tail gaps fold their controls onto the
-            // next hunk's @@ header (below) instead, so they emit no marker.
-            if (is_tail && (remaining > 0 || top > 0 || bot > 0)) {
-                DiffRow marker;
-                marker.kind = RowKind::ContextGap;
-                marker.gap_id = g;
-                marker.gap_hidden = remaining;
-                marker.old_lineno = old_start + top;  // first still-hidden line (the seam)
-                marker.new_lineno = new_start + top;
-                model.rows.push_back(std::move(marker));
-            }
-            // (c) `bot` lines revealed at the gap's end (adjacent to the next hunk).
-            for (int64_t k = H - bot; k < H; ++k) {
-                model.rows.push_back(make_common_row(input, old_start - 1 + k, new_start - 1 + k,
-                                                     options.mode, a_highlights, b_highlights));
-            }
+        if (is_tail) {
+            break;  // no hunk follows the tail gap
         }
 
+        const auto& hunk = hunks.get(g);
+        model.rows.push_back(make_header_row<typename Cells::Cell>(hunk, gap, static_cast<int>(g)));
+        build_hunk_rows(cells, hunk, options.mode, {}, 0, std::numeric_limits<int64_t>::max(), a_highlights,
+                        b_highlights);
+        hunks.release(g);
+    }
+}
+
+template <typename Source>
+DiffViewIndex
+build_index_from_source(const DiffInput<Line>& input,
+                        Source& hunks,
+                        const DiffLayoutOptions& options,
+                        const std::map<int, GapExpansion>* expansions) {
+    DIFFY_TRACE_SCOPE("build_diff_view_index");
+    DiffViewIndex index;
+    index.mode = options.mode;
+    if (hunks.size() == 0) {
+        return index;
+    }
+
+    index.gaps.reserve(hunks.size() + 1);
+    index.block_start.reserve(2 * hunks.size() + 2);
+    index.cursor_start.reserve(hunks.size() + 1);
+    int64_t row = 0;
+    for (std::size_t g = 0; g <= hunks.size(); ++g) {
+        const bool is_tail = g == hunks.size();
+        index.gaps.push_back(gap_layout(hunks, g, input, expansions));
+        index.block_start.push_back(row);
+        row += gap_rows(index.gaps.back(), is_tail);
         if (is_tail) {
-            break;  // no hunk follows the tail gap
+            break;
+        }
+        index.block_start.push_back(row);
+        index.cursor_start.push_back(static_cast<uint32_t>(index.cursors.size()));
+        row += 1 + index_hunk_rows(hunks.get(g), options.mode, index.cursors);
+        hunks.release(g);
+    }
+    index.cursor_start.push_back(static_cast<uint32_t>(index.cursors.size()));
+    index.block_start.push_back(row);
+    return index;
+}
+
+// Rows [first_row, first_row + count) of the layout `index` describes. Finding the
+// first block is a binary search over the prefix sums; inside a hunk the pairing
+// walk resumes from the nearest checkpoint, so the cost is the visible rows plus
+// at most one stride.
+template <typename Cells, typename Source>
+void
+build_range_from_source(Cells& cells,
+                        Source& hunks,
+                        const DiffViewIndex& index,
+                        int64_t first_row,
+                        int64_t count,
+                        const LineHighlights* a_highlights,
+                        const LineHighlights* b_highlights) {
+    auto& model = cells.model;
+    model.mode = index.mode;
+    const int64_t total = index.row_count();
+    const int64_t last = std::clamp<int64_t>(first_row + std::max<int64_t>(count, 0), 0, total);
+    first_row = std::clamp<int64_t>(first_row, 0, total);
+    if (first_row >= last) {
+        return;
+    }
+    model.rows.reserve(static_cast<std::size_t>(last - first_row));
+
+    auto block = static_cast<std::size_t>(
+        std::upper_bound(index.block_start.begin(), index.block_start.end(), first_row) -
+        index.block_start.begin() - 1);
+    for (int64_t row = first_row; row < last; ++block) {
+        const int64_t begin = index.block_start[block];
+        const int64_t end = std::min(index.block_start[block + 1], last);
+        const std::size_t g = block / 2;
+        const DiffViewIndex::Gap& gap = index.gaps[g];
+        if (block % 2 == 0) {
+            const bool is_tail = g == hunks.size();
+            for (; row < end; ++row) {
+                model.rows.push_back(make_gap_row(cells, gap, static_cast<int>(g), is_tail, row - begin,
+                                                  index.mode, a_highlights, b_highlights));
+            }
+            continue;
         }
-        const auto& hunk = hunks[g];
-        DiffRow header;
-        header.kind = RowKind::HunkHeader;
-        header.header_text = fmt::format("@@ -{} +{} @@", fmt_change(hunk.from_start, hunk.from_count),
-                                         fmt_change(hunk.to_start, hunk.to_count));
-        if (!hunk.context.empty()) {
-            header.header_text += " " + hunk.context;
+
+        const auto& hunk = hunks.get(g);
+        if (row == begin) {
+            model.rows.push_back(make_header_row<typename Cells::Cell>(hunk, gap, static_cast<int>(g)));
+            ++row;
         }
-        // Gap g precedes this hunk, so its @@ header is the natural home for the gap's
-        // expand/collapse controls (the frontend renders them right-aligned on this row).
-        // Stamp the header with the gap's id + still-hidden count; gap_id keeps its -1
-        // default when H == 0, i.e. no run of common lines is hidden before this hunk.
-        if (H > 0) {
-            header.gap_id = g;
-            header.gap_hidden = remaining;
+        if (row < end) {
+            const int64_t offset = row - begin - 1;  // content row within the hunk
+            const int64_t checkpoint = offset / kCursorStride;
+            const DiffViewIndex::Cursor from =
+                index.cursors[index.cursor_start[g] + static_cast<std::size_t>(checkpoint)];
+            build_hunk_rows(cells, hunk, index.mode, from, offset - checkpoint * kCursorStride, end - row,
+                            a_highlights, b_highlights);
+            row = end;
         }
-        model.rows.push_back(std::move(header));
+        hunks.release(g);
+    }
+}
 
-        if (options.mode == ViewMode::SideBySide) {
-            build_side_by_side(input, hunk, model.rows, a_highlights, b_highlights);
+DiffCell
+materialize_cell(const DiffInput<Line>& input, const DiffViewRefModel& model, const DiffCellRef& ref) {
+    DiffCell cell;
+    cell.type = ref.type;
+    cell.present = ref.present;
+    for (uint32_t i = 0; i < ref.span_count; i++) {
+        const SpanRef& span = model.spans[ref.first_span + i];
+        if (span.continued && !cell.spans.empty()) {
+            cell.spans.back().text += span_text(input, span);
         } else {
-            build_unified(input, hunk, model.rows, a_highlights, b_highlights);
+            cell.spans.push_back({std::string(span_text(input, span)), span.style, span.syntax});
         }
     }
+    return cell;
+}
+
+}  // namespace
+
+DiffViewModel
+build_diff_view(const DiffInput<Line>& input,
+                const std::vector<AnnotatedHunk>& hunks,
+                const DiffLayoutOptions& options,
+                const LineHighlights* a_highlights,
+                const LineHighlights* b_highlights,
+                const std::map<int, GapExpansion>* expansions) {
+    DiffViewModel model;
+    OwnedCells cells{input, model};
+    EagerHunks source{hunks};
+    build_diff_view_from_source(cells, source, options, a_highlights, b_highlights, expansions);
+    return model;
+}
+
+DiffViewModel
+build_diff_view(const DiffInput<Line>& input,
+                LazyAnnotatedHunks& hunks,
+                const DiffLayoutOptions& options,
+                const LineHighlights* a_highlights,
+                const LineHighlights* b_highlights,
+                const std::map<int, GapExpansion>* expansions) {
+    DiffViewModel model;
+    OwnedCells cells{input, model};
+    build_diff_view_from_source(cells, hunks, options, a_highlights, b_highlights, expansions);
+    return model;
+}
+
+DiffViewRefModel
+build_diff_view_refs(const DiffInput<Line>& input,
+                     const std::vector<AnnotatedHunk>& hunks,
+                     const DiffLayoutOptions& options,
+                     const LineHighlights* a_highlights,
+                     const LineHighlights* b_highlights,
+                     const std::map<int, GapExpansion>* expansions) {
+    DiffViewRefModel model;
+    RefCells cells{input, model};
+    EagerHunks source{hunks};
+    build_diff_view_from_source(cells, source, options, a_highlights, b_highlights, expansions);
+    return model;
+}
+
+DiffViewRefModel
+build_diff_view_refs(const DiffInput<Line>& input,
+                     LazyAnnotatedHunks& hunks,
+                     const DiffLayoutOptions& options,
+                     const LineHighlights* a_highlights,
+                     const LineHighlights* b_highlights,
+                     const std::map<int, GapExpansion>* expansions) {
+    DiffViewRefModel model;
+    RefCells cells{input, model};
+    build_diff_view_from_source(cells, hunks, options, a_highlights, b_highlights, expansions);
+    return model;
+}
+
+DiffViewIndex
+build_diff_view_index(const DiffInput<Line>& input,
+                      const std::vector<AnnotatedHunk>& hunks,
+                      const DiffLayoutOptions& options,
+                      const std::map<int, GapExpansion>* expansions) {
+    EagerHunks source{hunks};
+    return build_index_from_source(input, source, options, expansions);
+}
+
+DiffViewIndex
+build_diff_view_index(const DiffInput<Line>& input,
+                      LazyAnnotatedHunks& hunks,
+                      const DiffLayoutOptions& options,
+                      const std::map<int, GapExpansion>* expansions) {
+    return build_index_from_source(input, hunks, options, expansions);
+}
+
+DiffViewModel
+build_diff_view_range(const DiffInput<Line>& input,
+                      const std::vector<AnnotatedHunk>& hunks,
+                      const DiffViewIndex& index,
+                      int64_t first_row,
+                      int64_t count,
+                      const LineHighlights* a_highlights,
+                      const LineHighlights* b_highlights) {
+    DiffViewModel model;
+    OwnedCells cells{input, model};
+    EagerHunks source{hunks};
+    build_range_from_source(cells, source, index, first_row, count, a_highlights, b_highlights);
+    return model;
+}
 
+DiffViewModel
+build_diff_view_range(const DiffInput<Line>& input,
+                      LazyAnnotatedHunks& hunks,
+                      const DiffViewIndex& index,
+                      int64_t first_row,
+                      int64_t count,
+                      const LineHighlights* a_highlights,
+                      const LineHighlights* b_highlights) {
+    DiffViewModel model;
+    OwnedCells cells{input, model};
+    build_range_from_source(cells, hunks, index, first_row, count, a_highlights, b_highlights);
     return model;
 }
 
+std::string_view
+span_text(const DiffInput<Line>& input, const SpanRef& span) {
+    const auto& source = span.side == DiffSide::Old ? input.A : input.B;
+    return std::string_view(source[static_cast<long>(span.line)].line).substr(span.offset, span.length);
+}
+
+DiffRow
+materialize_row(const DiffInput<Line>& input, const DiffViewRefModel& model, const DiffRowRef& row) {
+    DiffRow out;
+    out.kind = row.kind;
+    out.old_lineno = row.old_lineno;
+    out.new_lineno = row.new_lineno;
+    out.left = materialize_cell(input, model, row.left);
+    out.right = materialize_cell(input, model, row.right);
+    out.header_text = row.header_text;
+    out.move_id = row.move_id;
+    out.move_line = row.move_line;
+    out.move_file = row.move_file;
+    out.gap_id = row.gap_id;
+    out.gap_hidden = row.gap_hidden;
+    return out;
+}
+
 void
 detect_cross_file_moves(const std::vector<CrossFileDiff>& files) {
+    DIFFY_TRACE_SCOPE("detect_cross_file_moves");
+    constexpr int kMinMoveLines = 3;
+    constexpr size_t kWindow = static_cast<size_t>(kMinMoveLines);
+    constexpr size_t kMaxWindowCandidates = 64;  // see detect_moves: repeats are coincidence
+    constexpr uint64_t kWindowBase = 0x100000001b3ull;
+
     struct XRef {
         DiffRow* row;
         size_t file;
         int64_t lineno;
-        std::string text;
+        uint32_t hash;
+        std::string_view text;
     };
-    auto row_text = [](const DiffRow& r) {
-        std::string t;
-        const DiffCell& cell = r.left.present ? r.left : r.right;
-        for (const auto& s : cell.spans) {
-            t += s.text;
-        }
-        return t;
+    // Per-file gather. With the file's Lines at hand the checksum computed at read
+    // time is reused and the text is viewed in place; with only the checksums there
+    // is no text to compare; otherwise the row's span text is joined and hashed
+    // (kept in `owned`, whose deque never moves its strings).
+    struct FileRefs {
+        std::vector<XRef> dels, inss;
+        std::deque<std::string> owned;
     };
-
-    std::vector<XRef> xdels, xinss;
-    for (size_t fi = 0; fi < files.size(); ++fi) {
-        if (!files[fi].model) {
-            continue;
+    std::vector<FileRefs> per_file(files.size());
+    parallel_for(files.size(), [&](size_t fi) {
+        const CrossFileDiff& f = files[fi];
+        if (!f.model) {
+            return;
         }
-        for (auto& row : files[fi].model->rows) {
+        FileRefs& out = per_file[fi];
+        auto ref_for = [&](DiffRow& row, int64_t lineno, gsl::span<const Line> lines) {
+            if (lineno >= 1 && lineno <= static_cast<int64_t>(lines.size())) {
+                const Line& L = lines[static_cast<size_t>(lineno - 1)];
+                return XRef{&row, fi, lineno, L.checksum, L.line};
+            }
+            std::string t;
+            const DiffCell& cell = row.left.present ? row.left : row.right;
+            for (const auto& sp : cell.spans) {
+                t += sp.text;
+            }
+            const std::string& text = out.owned.emplace_back(std::move(t));
+            return XRef{&row, fi, lineno, hash::hash(text.data(), text.size()), text};
+        };
+        const bool by_checksum = !f.row_checksums.empty();
+        for (size_t ri = 0; ri < f.model->rows.size(); ri++) {
+            DiffRow& row = f.model->rows[ri];
             if (row.kind != RowKind::Content || row.move_id != 0) {
                 continue;
             }
-            if (row.old_lineno && !row.new_lineno) {
-                xdels.push_back({&row, fi, *row.old_lineno, row_text(row)});
-            } else if (row.new_lineno && !row.old_lineno) {
-                xinss.push_back({&row, fi, *row.new_lineno, row_text(row)});
+            const bool deleted = row.old_lineno && !row.new_lineno;
+            if (!deleted && !(row.new_lineno && !row.old_lineno)) {
+                continue;
             }
+            const int64_t lineno = deleted ? *row.old_lineno : *row.new_lineno;
+            XRef ref = by_checksum ? XRef{&row, fi, lineno, f.row_checksums[ri], {}}
+                                   : ref_for(row, lineno, deleted ? f.a_lines : f.b_lines);
+            (deleted ? out.dels : out.inss).push_back(ref);
         }
-    }
+    });
 
-    constexpr int kMinMoveLines = 3;
-    constexpr size_t kMoveBudget = 1u << 22;
-    if (xdels.empty() || xinss.empty() || xdels.size() * xinss.size() > kMoveBudget) {
+    std::vector<XRef> xdels, xinss;
+    for (auto& f : per_file) {
+        xdels.insert(xdels.end(), f.dels.begin(), f.dels.end());
+        xinss.insert(xinss.end(), f.inss.begin(), f.inss.end());
+    }
+    if (xdels.size() < kWindow || xinss.size() < kWindow) {
         return;
     }
 
-    std::hash<std::string> H;
-    std::unordered_multimap<size_t, size_t> ins_by_hash;
-    for (size_t k = 0; k < xinss.size(); ++k) {
-        ins_by_hash.emplace(H(xinss[k].text), k);
+    // Rabin-Karp hash of the kWindow-line window starting at each ref; a window that
+    // would straddle two files can never be a move and is marked invalid.
+    auto window_hashes = [](const std::vector<XRef>& refs) {
+        std::vector<std::pair<bool, uint64_t>> out(refs.size(), {false, 0});
+        uint64_t top = 1;
+        for (size_t k = 1; k < kWindow; ++k) {
+            top *= kWindowBase;
+        }
+        uint64_t h = 0;
+        size_t run = 0;  // refs of the current file folded into h
+        for (size_t i = 0; i < refs.size(); ++i) {
+            if (i > 0 && refs[i].file != refs[i - 1].file) {
+                h = 0;
+                run = 0;
+            }
+            if (run == kWindow) {
+                h -= refs[i - kWindow].hash * top;
+                --run;
+            }
+            h = h * kWindowBase + refs[i].hash;
+            ++run;
+            if (run == kWindow) {
+                out[i + 1 - kWindow] = {true, h};
+            }
+        }
+        return out;
+    };
+    const auto del_windows = window_hashes(xdels);
+    const auto ins_windows = window_hashes(xinss);
+    // Every occurrence of an inserted window, one group per file in file order. In
+    // a group at[0, head) are claimed; groups[0, head) are used up.
+    struct FileOccurrences {
+        size_t file;
+        std::vector<uint32_t> at;
+        size_t head = 0;
+    };
+    struct Occurrences {
+        std::vector<FileOccurrences> groups;
+        size_t head = 0;
+    };
+    std::unordered_map<uint64_t, Occurrences> ins_by_window;
+    for (size_t k = 0; k < ins_windows.size(); ++k) {
+        if (ins_windows[k].first) {
+            auto& groups = ins_by_window[ins_windows[k].second].groups;
+            if (groups.empty() || groups.back().file != xinss[k].file) {
+                groups.push_back({xinss[k].file, {}});
+            }
+            groups.back().at.push_back(static_cast<uint32_t>(k));
+        }
     }
+
     std::vector<bool> used(xinss.size(), false);
+    // The first kMaxWindowCandidates unclaimed occurrences in `o` outside `file`, as
+    // detect_moves retries past claimed ones: claimed occurrences met on the way are
+    // dropped for good, and so are groups left empty, so neither is skipped twice.
+    // The deleting file's own group is passed over without counting toward the cap.
+    std::vector<uint32_t> candidates;
+    auto unclaimed = [&used, &candidates](Occurrences& o, size_t file) {
+        candidates.clear();
+        size_t keep[kMaxWindowCandidates + 1];
+        size_t kept = 0, g = o.head;
+        for (; g < o.groups.size() && candidates.size() < kMaxWindowCandidates; ++g) {
+            FileOccurrences& f = o.groups[g];
+            if (f.file == file) {
+                keep[kept++] = g;  // cross-FILE only
+                continue;
+            }
+            const size_t first = candidates.size();
+            size_t r = f.head;
+            for (; r < f.at.size() && candidates.size() < kMaxWindowCandidates; ++r) {
+                if (!used[f.at[r]]) {
+                    candidates.push_back(f.at[r]);
+                }
+            }
+            const size_t n = candidates.size() - first;
+            f.head = r - n;
+            std::copy(candidates.begin() + static_cast<long>(first), candidates.end(),
+                      f.at.begin() + static_cast<long>(f.head));
+            if (f.head < f.at.size()) {
+                keep[kept++] = g;
+            }
+        }
+        // Slide the groups still in use up to the new head, keeping their order.
+        size_t w = g;
+        while (kept > 0) {
+            const size_t from = keep[--kept];
+            if (--w != from) {
+                o.groups[w] = std::move(o.groups[from]);
+            }
+        }
+        o.head = w;
+    };
     int mid = 1'000'000;  // cross-file move ids live in their own range
     for (size_t di = 0; di < xdels.size();) {
         size_t best_len = 0, best_ii = 0;
-        auto range = ins_by_hash.equal_range(H(xdels[di].text));
-        for (auto it = range.first; it != range.second; ++it) {
-            size_t ii = it->second;
-            if (used[ii] || xinss[ii].file == xdels[di].file) {
-                continue;  // cross-FILE only
-            }
-            size_t len = 0;
-            while (di + len < xdels.size() && ii + len < xinss.size() && !used[ii + len] &&
-                   xdels[di + len].file == xdels[di].file && xinss[ii + len].file == xinss[ii].file &&
-                   xdels[di + len].text == xinss[ii + len].text) {
-                ++len;
-            }
-            if (len > best_len) {
-                best_len = len;
-                best_ii = ii;
+        auto found = del_windows[di].first ? ins_by_window.find(del_windows[di].second)
+                                           : ins_by_window.end();
+        if (found != ins_by_window.end()) {
+            unclaimed(found->second, xdels[di].file);
+            for (size_t ii : candidates) {
+                size_t len = 0;
+                while (di + len < xdels.size() && ii + len < xinss.size() && !used[ii + len] &&
+                       xdels[di + len].file == xdels[di].file && xinss[ii + len].file == xinss[ii].file &&
+                       xdels[di + len].hash == xinss[ii + len].hash &&
+                       xdels[di + len].text == xinss[ii + len].text) {
+                    ++len;
+                }
+                if (len > best_len) {
+                    best_len = len;
+                    best_ii = ii;
+                }
             }
         }
         if (best_len >= static_cast<size_t>(kMinMoveLines)) {
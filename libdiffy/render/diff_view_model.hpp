@@ -11,17 +11,31 @@
 
     The same model expresses both unified and side-by-side layouts so a frontend
     can switch views without re-running the diff.
+
+    build_diff_view_refs() lays out the same rows without copying any text: each
+    span is a (side, line, offset, length) reference into the input, resolved
+    with span_text() when it's drawn. For very large views, where the model would
+    otherwise hold a second copy of every visible line.
+
+    build_diff_view_index() only works out where each row falls; a frontend that
+    scrolls a large diff then lays out just the rows on screen with
+    build_diff_view_range(), at a cost proportional to the rows it asks for.
 */
 
 #include "algorithms/algorithm.hpp"
 #include "highlight/highlight_group.hpp"
 #include "highlight/syntax_highlighter.hpp"
 #include "processing/diff_hunk_annotate.hpp"
+#include "util/deadline.hpp"
 #include "util/readlines.hpp"
 
+#include <gsl/span>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace diffy {
@@ -54,18 +68,46 @@ struct DiffCell {
     bool present = false;  // false => empty padding cell (alignment gap / unused side)
 };
 
+// Which input a line comes from.
+enum class DiffSide : uint8_t { Old, New };
+
+// A StyledSpan by reference: `length` bytes at `offset` of line `line` (0-based)
+// on one side of the input.
+struct SpanRef {
+    uint32_t line = 0;
+    uint32_t offset = 0;
+    uint32_t length = 0;
+    DiffSide side = DiffSide::Old;
+    // Part of the same StyledSpan as the span before it, split off where a
+    // stray '\r' inside the line was skipped.
+    bool continued = false;
+    SpanStyle style = SpanStyle::Common;
+    HighlightGroup syntax = HighlightGroup::None;
+};
+
+// A DiffCell whose spans are [first_span, first_span + span_count) of its
+// model's span pool.
+struct DiffCellRef {
+    uint32_t first_span = 0;
+    uint32_t span_count = 0;
+    EditType type = EditType::Common;
+    bool present = false;
+};
+
 enum class RowKind {
     HunkHeader,  // the "@@ ... @@" separator between hunks
     Content,     // a real line of diff
     ContextGap,  // the tail gap's expander band (non-tail gaps ride their @@ header)
 };
 
-struct DiffRow {
+// A row of either model; Cell is DiffCell (owned text) or DiffCellRef.
+template <typename Cell>
+struct BasicDiffRow {
     RowKind kind = RowKind::Content;
     std::optional<int64_t> old_lineno;  // A-side (old) line number, if any
     std::optional<int64_t> new_lineno;  // B-side (new) line number, if any
-    DiffCell left;                      // unified: the content; side-by-side: old side
-    DiffCell right;                     // side-by-side: new side; unified: unused
+    Cell left;                          // unified: the content; side-by-side: old side
+    Cell right;                         // side-by-side: new side; unified: unused
     std::string header_text;            // populated only for HunkHeader rows
     // Moved-block info for a pure delete/insert row (GAP-9): move_id pairs the two
     // ends; move_line is the 1-based counterpart line to point an arrow/reference at.
@@ -84,6 +126,22 @@ struct DiffRow {
     int64_t gap_hidden = 0;
 };
 
+using DiffRow = BasicDiffRow<DiffCell>;
+using DiffRowRef = BasicDiffRow<DiffCellRef>;
+
+// The pipeline stage a DiffProgress event reports.
+enum class DiffStage { Reading, Diffing, Annotating, Done };
+
+// A progress event from the pipeline (DiffPipelineOptions::progress). Within one
+// computation the counters only grow.
+struct DiffProgress {
+    DiffStage stage = DiffStage::Reading;
+    int64_t lines_read = 0;       // lines split off both sides so far
+    int64_t edit_distance = 0;    // edit distance the line diff has reached so far
+    int64_t hunks_annotated = 0;  // hunks tokenized and intra-line diffed so far
+    int64_t hunks_total = 0;      // known from DiffStage::Annotating on
+};
+
 // Options that change the diff itself: flipping one must re-run compute+annotate.
 struct DiffPipelineOptions {
     Algo algorithm = Algo::kPatience;
@@ -91,11 +149,24 @@ struct DiffPipelineOptions {
     EditGranularity granularity = EditGranularity::Token;
     bool ignore_whitespace = false;
     bool ignore_line_endings = false;
+    MoveOptions move_options;      // tolerance of the moved-block pass (GAP-9)
     bool syntax_highlight = true;  // run tree-sitter highlighting when available
     // Force the highlight grammar for both sides instead of inferring it from
     // the file names (the --language / -L equivalent). Accepts anything
     // language_from_name accepts; empty = auto-detect.
     std::string force_language;
+    // Defer annotation: DiffComputation::lazy_hunks is filled instead of `hunks`,
+    // and each hunk is annotated only when a renderer pulls it.
+    bool lazy_annotation = false;
+    // Keep the texts, edit sequence and outlines in the DiffComputation so
+    // apply_text_edit can patch it in place instead of recomputing.
+    bool incremental = false;
+    // Time budget and cancellation (not owned; null = unlimited). Stages that would
+    // run past it degrade instead; DiffComputation::degradations says which.
+    const Deadline* deadline = nullptr;
+    // Called on the computing thread as the stages advance, for a progress
+    // display; keep it cheap. Empty = no reporting.
+    std::function<void(const DiffProgress&)> progress;
 };
 
 // Options that only change presentation: flipping one only re-runs build_diff_view.
@@ -108,6 +179,14 @@ struct DiffViewModel {
     std::vector<DiffRow> rows;
 };
 
+// build_diff_view_refs' model: the layout alone. Its spans point into the input
+// it was built from (e.g. a retained DiffComputation), which must outlive it.
+struct DiffViewRefModel {
+    ViewMode mode = ViewMode::SideBySide;
+    std::vector<DiffRowRef> rows;
+    std::vector<SpanRef> spans;
+};
+
 // How much of one context gap the frontend has expanded (GitHub-style "expand
 // context"). `top` = common lines revealed at the gap's start, adjacent to the
 // PREVIOUS hunk; `bot` = lines revealed at the gap's end, adjacent to the NEXT
@@ -117,6 +196,40 @@ struct GapExpansion {
     int64_t bot = 0;
 };
 
+// Where each row of a layout falls, without laying any row out. Built by
+// build_diff_view_index for one set of hunks, view mode and gap expansions;
+// rebuild it when any of them changes.
+struct DiffViewIndex {
+    // A context gap resolved against its expansion (see build_diff_view).
+    struct Gap {
+        int64_t old_start = 0;  // 1-based first hidden line on each side
+        int64_t new_start = 0;
+        int64_t size = 0;  // common lines in the run (0 = none hidden)
+        int64_t top = 0;   // revealed at its start
+        int64_t bot = 0;   // revealed at its end
+    };
+    // A point in a hunk's row pairing: the next a_lines / b_lines to lay out.
+    struct Cursor {
+        uint32_t a = 0;
+        uint32_t b = 0;
+    };
+
+    ViewMode mode = ViewMode::SideBySide;
+    std::vector<Gap> gaps;  // one per gap, the tail last
+    // Prefix sums: block_start[2g] is gap g's first row, block_start[2g + 1] is
+    // hunk g's @@ row, and the last entry is the row count.
+    std::vector<int64_t> block_start;
+    // Pairing checkpoints every few hundred content rows; hunk g's are
+    // cursors[cursor_start[g] .. cursor_start[g + 1]).
+    std::vector<Cursor> cursors;
+    std::vector<uint32_t> cursor_start;
+
+    int64_t
+    row_count() const {
+        return block_start.empty() ? 0 : block_start.back();
+    }
+};
+
 // Pure: lays out already-annotated hunks into the chosen view. No I/O.
 // When per-line syntax highlights are supplied (a_highlights for the A/old
 // side, b_highlights for the B/new side), spans are additionally split at
@@ -135,17 +248,100 @@ build_diff_view(const DiffInput<Line>& input,
                 const LineHighlights* b_highlights = nullptr,
                 const std::map<int, GapExpansion>* expansions = nullptr);
 
+// Same layout from a lazy source: each hunk is annotated as it is laid out and
+// released right after, so the only annotated state alive is the current hunk.
+DiffViewModel
+build_diff_view(const DiffInput<Line>& input,
+                LazyAnnotatedHunks& hunks,
+                const DiffLayoutOptions& options,
+                const LineHighlights* a_highlights = nullptr,
+                const LineHighlights* b_highlights = nullptr,
+                const std::map<int, GapExpansion>* expansions = nullptr);
+
+// build_diff_view's layout with spans that reference the input's lines rather
+// than copying them.
+DiffViewRefModel
+build_diff_view_refs(const DiffInput<Line>& input,
+                     const std::vector<AnnotatedHunk>& hunks,
+                     const DiffLayoutOptions& options,
+                     const LineHighlights* a_highlights = nullptr,
+                     const LineHighlights* b_highlights = nullptr,
+                     const std::map<int, GapExpansion>* expansions = nullptr);
+
+DiffViewRefModel
+build_diff_view_refs(const DiffInput<Line>& input,
+                     LazyAnnotatedHunks& hunks,
+                     const DiffLayoutOptions& options,
+                     const LineHighlights* a_highlights = nullptr,
+                     const LineHighlights* b_highlights = nullptr,
+                     const std::map<int, GapExpansion>* expansions = nullptr);
+
+// The row index of build_diff_view's layout. Walks each hunk's line pairing once
+// without building any cells; a lazy source has each hunk annotated and released
+// in turn.
+DiffViewIndex
+build_diff_view_index(const DiffInput<Line>& input,
+                      const std::vector<AnnotatedHunk>& hunks,
+                      const DiffLayoutOptions& options,
+                      const std::map<int, GapExpansion>* expansions = nullptr);
+
+DiffViewIndex
+build_diff_view_index(const DiffInput<Line>& input,
+                      LazyAnnotatedHunks& hunks,
+                      const DiffLayoutOptions& options,
+                      const std::map<int, GapExpansion>* expansions = nullptr);
+
+// Rows [first_row, first_row + count) of build_diff_view's layout (the part of
+// it inside [0, index.row_count())), from the `hunks` the index was built for. Only the hunks
+// with a row in the range are pulled from a lazy source.
+DiffViewModel
+build_diff_view_range(const DiffInput<Line>& input,
+                      const std::vector<AnnotatedHunk>& hunks,
+                      const DiffViewIndex& index,
+                      int64_t first_row,
+                      int64_t count,
+                      const LineHighlights* a_highlights = nullptr,
+                      const LineHighlights* b_highlights = nullptr);
+
+DiffViewModel
+build_diff_view_range(const DiffInput<Line>& input,
+                      LazyAnnotatedHunks& hunks,
+                      const DiffViewIndex& index,
+                      int64_t first_row,
+                      int64_t count,
+                      const LineHighlights* a_highlights = nullptr,
+                      const LineHighlights* b_highlights = nullptr);
+
+// The text `span` refers to, viewed in place.
+std::string_view
+span_text(const DiffInput<Line>& input, const SpanRef& span);
+
+// `row` with its text copied out: the row build_diff_view would have made.
+DiffRow
+materialize_row(const DiffInput<Line>& input, const DiffViewRefModel& model, const DiffRowRef& row);
+
 // One file's built diff, for cross-file move detection.
 struct CrossFileDiff {
     std::string path;
     DiffViewModel* model;  // mutated in place: move_id/move_line/move_file get set
+    // The file's read lines (e.g. DiffComputation::a_lines/b_lines). When given, rows
+    // are matched on the checksums computed at read time instead of re-joining and
+    // hashing each row's span text. Supply them (or row_checksums) for every file or
+    // for none, so both ends of a move are compared the same way.
+    gsl::span<const Line> a_lines;
+    gsl::span<const Line> b_lines;
+    // Instead of the lines: each row's read-time checksum, in row order, for rows
+    // that carry no text (see cross_file_move_rows). Rows are then matched on the
+    // checksums alone.
+    gsl::span<const uint32_t> row_checksums;
 };
 
 // GAP-9 cross-file moves: across several files' diffs, a run of >= 3 pure-deleted
 // lines in one file whose content matches a run of pure-inserted lines in ANOTHER
 // file is tagged as a move (shared move_id, and each end's move_file/move_line points
 // at the counterpart). Same-file moves are handled per file by detect_moves(); this
-// only considers still-unmatched (move_id == 0) rows. Pure logic — no I/O, no threads.
+// only considers still-unmatched (move_id == 0) rows. No I/O; rows are gathered per
+// file on worker threads, then matched through one shared window-hash index.
 void
 detect_cross_file_moves(const std::vector<CrossFileDiff>& files);
 
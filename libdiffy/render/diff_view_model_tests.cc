@@ -1,9 +1,15 @@
 #include <doctest.h>
 
 #include "highlight/language.hpp"
+#include "processing/diff_hunk.hpp"
+#include "render/diff_cache.hpp"
 #include "render/diff_pipeline.hpp"
 #include "render/diff_view_model.hpp"
 
+#include <algorithm>
+#include <random>
+#include <thread>
+
 using namespace diffy;
 
 namespace {
@@ -347,3 +353,620 @@ TEST_CASE("detect_cross_file_moves: a same-file block is left for the per-file p
         CHECK(r.move_id == 0);  // never cross-file tagged within one file
     }
 }
+
+TEST_CASE("detect_cross_file_moves: a window repeated past the candidate cap still pairs") {
+    auto row = [](int64_t oldno, int64_t newno, const std::string& t) {
+        DiffRow r;
+        r.kind = RowKind::Content;
+        StyledSpan sp;
+        sp.text = t;
+        if (oldno >= 0) {
+            r.old_lineno = oldno;
+            r.left.present = true;
+            r.left.spans = {sp};
+        }
+        if (newno >= 0) {
+            r.new_lineno = newno;
+            r.right.present = true;
+            r.right.spans = {sp};
+        }
+        return r;
+    };
+    // `copies` blocks of the same three lines, each followed by a line of its own.
+    auto add_copies = [&row](DiffViewModel& m, bool deleted, int copies) {
+        int64_t lineno = 1;
+        for (int c = 0; c < copies; ++c) {
+            for (const char* t : {"shared one", "shared two", "shared three"}) {
+                m.rows.push_back(deleted ? row(lineno++, -1, t) : row(-1, lineno++, t));
+            }
+            const std::string own = (deleted ? "deleted " : "inserted ") + std::to_string(c);
+            m.rows.push_back(deleted ? row(lineno++, -1, own) : row(-1, lineno++, own));
+        }
+    };
+    auto tagged = [](const DiffViewModel& m) {
+        return std::count_if(m.rows.begin(), m.rows.end(), [](const DiffRow& r) { return r.move_id != 0; });
+    };
+
+    // The deleting file's own 70 copies come first but don't use up the probe.
+    DiffViewModel a, b;
+    add_copies(a, true, 1);
+    add_copies(a, false, 70);
+    add_copies(b, false, 1);
+    detect_cross_file_moves({{"a.txt", &a}, {"b.txt", &b}});
+    CHECK(a.rows[0].move_file == "b.txt");
+    CHECK(tagged(b) == 3);
+
+    // Copies claimed by earlier blocks make room for the rest.
+    DiffViewModel c, d;
+    add_copies(c, true, 70);
+    add_copies(d, false, 70);
+    detect_cross_file_moves({{"c.txt", &c}, {"d.txt", &d}});
+    CHECK(tagged(c) == 70 * 3);
+    CHECK(tagged(d) == 70 * 3);
+}
+
+TEST_CASE("render model: lazy annotation lays out the same rows") {
+    std::string a, b;
+    for (int i = 0; i < 40; i++) {
+        a += "line " + std::to_string(i) + "\n";
+        b += (i % 15 == 7 ? "changed " : "line ") + std::to_string(i) + "\n";
+    }
+    for (auto mode : {ViewMode::SideBySide, ViewMode::Unified}) {
+        DiffLayoutOptions layout;
+        layout.mode = mode;
+        auto lazy_opts = default_pipeline();
+        lazy_opts.lazy_annotation = true;
+
+        DiffComputation c;
+        auto eager = build_diff_view_from_text(a, b, "a", "b", default_pipeline(), layout);
+        auto lazy = build_diff_view_from_text(a, b, "a", "b", lazy_opts, layout, &c);
+        REQUIRE(c.lazy_hunks);
+        CHECK(c.hunks.empty());
+        REQUIRE(lazy.rows.size() == eager.rows.size());
+        for (size_t i = 0; i < eager.rows.size(); i++) {
+            const auto& x = eager.rows[i];
+            const auto& y = lazy.rows[i];
+            CHECK(x.kind == y.kind);
+            CHECK(x.header_text == y.header_text);
+            CHECK(x.old_lineno == y.old_lineno);
+            CHECK(x.new_lineno == y.new_lineno);
+            CHECK(x.left.type == y.left.type);
+            CHECK(x.left.spans.size() == y.left.spans.size());
+            CHECK(x.right.spans.size() == y.right.spans.size());
+        }
+    }
+}
+
+TEST_CASE("render model: span references materialise to the copied rows") {
+    std::string a, b;
+    for (int i = 0; i < 60; i++) {
+        const std::string n = std::to_string(i);
+        a += "int value_" + n + " = " + n + ";\r\n";
+        if (i == 10) {
+            b += "int value_10 =\r10; // stray CR\r\n";
+        } else if (i % 20 == 5) {
+            b += "long value_" + n + " = " + n + "0;\r\n";
+        } else {
+            b += "int value_" + n + " = " + n + ";\r\n";
+        }
+    }
+    std::map<int, GapExpansion> exp;
+    exp[1] = {2, 3};
+    exp[3] = {4, 0};
+
+    for (auto mode : {ViewMode::SideBySide, ViewMode::Unified}) {
+        DiffLayoutOptions layout;
+        layout.mode = mode;
+        DiffComputation c = compute_annotated_diff(a, b, "a.c", "b.c", default_pipeline());
+        const DiffViewModel copied = build_diff_view(c, layout, &exp);
+        const DiffViewRefModel refs = build_diff_view_refs(c, layout, &exp);
+
+        CHECK(refs.mode == copied.mode);
+        REQUIRE(refs.rows.size() == copied.rows.size());
+        const auto input = c.input();
+        for (size_t i = 0; i < copied.rows.size(); i++) {
+            const DiffRow& x = copied.rows[i];
+            const DiffRow y = materialize_row(input, refs, refs.rows[i]);
+            CHECK(x.kind == y.kind);
+            CHECK(x.header_text == y.header_text);
+            CHECK(x.old_lineno == y.old_lineno);
+            CHECK(x.new_lineno == y.new_lineno);
+            CHECK(x.gap_id == y.gap_id);
+            CHECK(x.gap_hidden == y.gap_hidden);
+            CHECK(x.move_id == y.move_id);
+            for (const auto& [cx, cy] : {std::pair{&x.left, &y.left}, std::pair{&x.right, &y.right}}) {
+                CHECK(cx->present == cy->present);
+                CHECK(cx->type == cy->type);
+                REQUIRE(cx->spans.size() == cy->spans.size());
+                for (size_t s = 0; s < cx->spans.size(); s++) {
+                    CHECK(cx->spans[s].text == cy->spans[s].text);
+                    CHECK(cx->spans[s].style == cy->spans[s].style);
+                    CHECK(cx->spans[s].syntax == cy->spans[s].syntax);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("render model: a row range lays out the same rows as the whole view") {
+    // One hunk long enough to need several pairing checkpoints (a rewritten run
+    // with a moved block inside, so side-by-side pairs only some lines), then
+    // a few small hunks and an unchanged tail.
+    std::string a, b;
+    for (int i = 0; i < 1200; i++) {
+        const std::string n = std::to_string(i);
+        a += "line " + n + "\n";
+        if (i >= 100 && i < 700) {
+            b += (i % 3 == 0 ? "" : "edited " + n + "\n");
+        } else if (i % 150 == 40) {
+            b += "changed " + n + "\n";
+        } else {
+            b += "line " + n + "\n";
+        }
+        if (i == 400) {
+            for (int k = 900; k < 910; k++) {
+                b += "line " + std::to_string(k) + "\n";
+            }
+        }
+    }
+    std::map<int, GapExpansion> exp;
+    exp[0] = {5, 5};
+    exp[2] = {3, 0};
+
+    for (auto mode : {ViewMode::SideBySide, ViewMode::Unified}) {
+        for (bool lazy : {false, true}) {
+            CAPTURE(lazy);
+            DiffLayoutOptions layout;
+            layout.mode = mode;
+            auto opts = default_pipeline();
+            opts.lazy_annotation = lazy;
+            DiffComputation c = compute_annotated_diff(a, b, "a", "b", opts);
+            const size_t hunks = lazy ? c.lazy_hunks->size() : c.hunks.size();
+            exp[static_cast<int>(hunks)] = {1, 1};  // the tail gap, with its marker
+            const DiffViewModel full = build_diff_view(c, layout, &exp);
+            const DiffViewIndex index = build_diff_view_index(c, layout, &exp);
+            REQUIRE(index.row_count() == static_cast<int64_t>(full.rows.size()));
+            REQUIRE(index.cursors.size() > hunks + 1);  // a hunk with several checkpoints
+
+            auto check_range = [&](int64_t first, int64_t count) {
+                CAPTURE(first);
+                const DiffViewModel part = build_diff_view_range(c, index, first, count);
+                CHECK(part.mode == mode);
+                const int64_t lo = std::max<int64_t>(first, 0);
+                const int64_t hi = std::min<int64_t>(first + count, static_cast<int64_t>(full.rows.size()));
+                REQUIRE(static_cast<int64_t>(part.rows.size()) == std::max<int64_t>(hi - lo, 0));
+                for (size_t i = 0; i < part.rows.size(); i++) {
+                    const DiffRow& x = full.rows[static_cast<size_t>(lo) + i];
+                    const DiffRow& y = part.rows[i];
+                    CHECK(x.kind == y.kind);
+                    CHECK(x.header_text == y.header_text);
+                    CHECK(x.old_lineno == y.old_lineno);
+                    CHECK(x.new_lineno == y.new_lineno);
+                    CHECK(x.gap_id == y.gap_id);
+                    CHECK(x.gap_hidden == y.gap_hidden);
+                    CHECK(x.move_id == y.move_id);
+                    CHECK(x.move_line == y.move_line);
+                    for (const auto& [cx, cy] : {std::pair{&x.left, &y.left}, std::pair{&x.right, &y.right}}) {
+                        CHECK(cx->present == cy->present);
+                        REQUIRE(cx->spans.size() == cy->spans.size());
+                        for (size_t s = 0; s < cx->spans.size(); s++) {
+                            CHECK(cx->spans[s].text == cy->spans[s].text);
+                            CHECK(cx->spans[s].style == cy->spans[s].style);
+                        }
+                    }
+                }
+            };
+            const auto total = static_cast<int64_t>(full.rows.size());
+            check_range(0, total);
+            for (int64_t first = 0; first < total; first += 97) {
+                check_range(first, 40);
+            }
+            check_range(255, 3);  // across the first checkpoint
+            check_range(total - 5, 50);
+            check_range(total, 10);
+            check_range(-3, 5);  // rows 0 and 1
+        }
+    }
+}
+
+TEST_CASE("detect_cross_file_moves: matches on line checksums across a large change set") {
+    // Two files rewritten wholesale (~2100 changed lines each, past the old
+    // dels*inss cut-off) with one function moved from the first into the second.
+    const std::string moved = "int moved_fn() {\n    return compute(42);\n}  // moved_fn\n";
+    std::string a_old, a_new, b_old, b_new;
+    a_old += moved;
+    for (int i = 0; i < 2100; i++) {
+        a_old += "a old " + std::to_string(i) + "\n";
+        a_new += "a new " + std::to_string(i) + "\n";
+        b_old += "b old " + std::to_string(i) + "\n";
+        b_new += "b new " + std::to_string(i) + "\n";
+    }
+    b_new += moved;
+
+    auto pipeline = default_pipeline();
+    pipeline.syntax_highlight = false;
+    DiffLayoutOptions layout;
+    layout.mode = ViewMode::Unified;  // one row per deleted/inserted line
+    DiffComputation ca, cb;
+    auto ma = build_diff_view_from_text(a_old, a_new, "a.cc", "a.cc", pipeline, layout, &ca);
+    auto mb = build_diff_view_from_text(b_old, b_new, "b.cc", "b.cc", pipeline, layout, &cb);
+    detect_cross_file_moves({{"a.cc", &ma, ca.a_lines, ca.b_lines}, {"b.cc", &mb, cb.a_lines, cb.b_lines}});
+
+    int moved_from_a = 0, moved_into_b = 0;
+    for (const auto& r : ma.rows) {
+        if (r.move_id != 0) {
+            ++moved_from_a;
+            CHECK(r.move_file == "b.cc");
+            CHECK(r.move_line == 2101);
+        }
+    }
+    for (const auto& r : mb.rows) {
+        if (r.move_id != 0) {
+            ++moved_into_b;
+            CHECK(r.move_file == "a.cc");
+            CHECK(r.move_line == 1);
+        }
+    }
+    CHECK(moved_from_a == 3);
+    CHECK(moved_into_b == 3);
+}
+
+namespace {
+
+void
+check_same_lines(const DiffComputation& got, const DiffComputation& want) {
+    REQUIRE(got.status == want.status);
+    REQUIRE(got.a_lines.size() == want.a_lines.size());
+    REQUIRE(got.b_lines.size() == want.b_lines.size());
+    for (const auto* sides : {&got.a_lines, &got.b_lines}) {
+        const auto& other = sides == &got.a_lines ? want.a_lines : want.b_lines;
+        for (size_t i = 0; i < sides->size(); i++) {
+            CHECK((*sides)[i].line == other[i].line);
+            CHECK((*sides)[i].checksum == other[i].checksum);
+            CHECK((*sides)[i].line_number == other[i].line_number);
+        }
+    }
+}
+
+bool
+same_edit_sequence(const std::vector<Edit>& got, const std::vector<Edit>& want) {
+    return std::equal(got.begin(), got.end(), want.begin(), want.end(), [](const Edit& x, const Edit& y) {
+        return x.type == y.type && x.a_index.valid == y.a_index.valid && x.b_index.valid == y.b_index.valid &&
+               (!x.a_index.valid || x.a_index.value == y.a_index.value) &&
+               (!x.b_index.valid || x.b_index.value == y.b_index.value);
+    });
+}
+
+void
+check_same_hunks(const std::vector<AnnotatedHunk>& got, const std::vector<AnnotatedHunk>& want) {
+    REQUIRE(got.size() == want.size());
+    for (size_t h = 0; h < got.size(); h++) {
+        const auto& x = got[h];
+        const auto& y = want[h];
+        CHECK(x.from_start == y.from_start);
+        CHECK(x.from_count == y.from_count);
+        CHECK(x.to_start == y.to_start);
+        CHECK(x.to_count == y.to_count);
+        CHECK(x.context == y.context);
+        for (const auto* lines : {&x.a_lines, &x.b_lines}) {
+            const auto& other = lines == &x.a_lines ? y.a_lines : y.b_lines;
+            REQUIRE(lines->size() == other.size());
+            for (size_t i = 0; i < lines->size(); i++) {
+                CHECK((*lines)[i].type == other[i].type);
+                CHECK((*lines)[i].line_index.value == other[i].line_index.value);
+                CHECK((*lines)[i].move_id == other[i].move_id);
+                CHECK((*lines)[i].move_line == other[i].move_line);
+                REQUIRE((*lines)[i].segments.size() == other[i].segments.size());
+                for (size_t s = 0; s < other[i].segments.size(); s++) {
+                    CHECK((*lines)[i].segments[s].start == other[i].segments[s].start);
+                    CHECK((*lines)[i].segments[s].length == other[i].segments[s].length);
+                    CHECK((*lines)[i].segments[s].type == other[i].segments[s].type);
+                }
+            }
+        }
+    }
+}
+
+void
+check_same_computation(const DiffComputation& got, const DiffComputation& want) {
+    check_same_lines(got, want);
+    CHECK(same_edit_sequence(got.edit_sequence, want.edit_sequence));
+    check_same_hunks(got.hunks, want.hunks);
+}
+
+// `c`'s edit sequence walks both sides in order, each line once, and pairs only
+// equal lines.
+void
+check_valid_script(const DiffComputation& c) {
+    int64_t ai = 0, bi = 0;
+    for (const auto& e : c.edit_sequence) {
+        if (e.a_index.valid) {
+            REQUIRE(e.a_index.value == ai++);
+        }
+        if (e.b_index.valid) {
+            REQUIRE(e.b_index.value == bi++);
+        }
+        if (e.type == EditType::Common) {
+            REQUIRE((e.a_index.valid && e.b_index.valid));
+            CHECK(c.a_lines[static_cast<size_t>(e.a_index.value)] == c.b_lines[static_cast<size_t>(e.b_index.value)]);
+        } else {
+            CHECK(e.a_index.valid != e.b_index.valid);
+        }
+    }
+    CHECK(ai == static_cast<int64_t>(c.a_lines.size()));
+    CHECK(bi == static_cast<int64_t>(c.b_lines.size()));
+}
+
+}  // namespace
+
+TEST_CASE("pipeline: incremental edits on distinct lines match a full recompute") {
+    std::string a, b;
+    for (int i = 0; i < 60; i++) {
+        a += "int value_" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+    }
+    b = a;
+    b.replace(b.find("value_10 = 10"), 13, "value_10 = 11");
+    b.replace(b.find("int value_40"), 3, "long");
+
+    auto p = default_pipeline();
+    p.incremental = true;
+    p.move_options.max_edited_lines = 1;
+    auto c = compute_annotated_diff(a, b, "a.cc", "b.cc", p);
+    REQUIRE(c.status == DiffResultStatus::OK);
+
+    auto step = [&](DiffSide side, size_t offset, size_t length, const std::string& replacement) {
+        std::string& text = side == DiffSide::Old ? a : b;
+        text.replace(offset, length, replacement);
+        REQUIRE(apply_text_edit(c, side, offset, length, replacement));
+        CHECK(c.a_text == a);
+        CHECK(c.b_text == b);
+        check_same_computation(c, compute_annotated_diff(a, b, "a.cc", "b.cc", p));
+    };
+
+    SUBCASE("character edits on both sides") {
+        step(DiffSide::New, b.find("value_20"), 0, "x");
+        step(DiffSide::Old, a.find("value_50"), 1, "V");
+        step(DiffSide::New, b.find("xvalue_20"), 1, "");
+    }
+    SUBCASE("joining and splitting lines shifts later hunks") {
+        step(DiffSide::New, b.find('\n'), 1, "");
+        step(DiffSide::New, b.find("value_30"), 0, "\nint extra = 1;\nint ");
+        step(DiffSide::Old, a.find("int value_5 "), 0, "// comment\n");
+    }
+    SUBCASE("appending at the end and emptying a side") {
+        step(DiffSide::New, b.size(), 0, "int tail = 0;\n");
+        step(DiffSide::Old, a.size(), 0, "no newline at end");
+        step(DiffSide::Old, 0, a.size(), "");
+        step(DiffSide::Old, 0, 0, "int value_0 = 0;\n");
+    }
+    SUBCASE("editing back to identical reports no changes") {
+        step(DiffSide::New, b.find("value_10 = 11"), 13, "value_10 = 10");
+        step(DiffSide::New, b.find("long value_40"), 4, "int");
+        CHECK(c.status == DiffResultStatus::NoChanges);
+        CHECK(c.hunks.empty());
+    }
+    SUBCASE("moving a block keeps move tags in step") {
+        const size_t from = b.find("int value_2 ");
+        const size_t to = b.find("int value_7 ");
+        const std::string block = b.substr(from, to - from);
+        step(DiffSide::New, from, block.size(), "");
+        step(DiffSide::New, b.find("int value_55"), 0, block);
+    }
+}
+
+TEST_CASE("pipeline: random incremental edits match a full recompute") {
+    // Brace/blank-heavy text, where lines from a tiny vocabulary repeat all over and
+    // many alignments cost the same, and code-like text with mostly distinct lines.
+    std::mt19937 rng(7);
+    auto pick = [&](size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); };
+    const std::vector<std::string> braces = {"{\n", "}\n", "\n", "x = 1;\n", "return x;\n", "y = 2;\n"};
+    const std::vector<std::string> code = [] {
+        std::vector<std::string> lines = {"}\n", "\n", "if (ok) {\n"};
+        for (int i = 0; i < 40; i++) {
+            lines.push_back("int value_" + std::to_string(i) + " = f(" + std::to_string(i % 7) + ");\n");
+        }
+        return lines;
+    }();
+
+    for (const auto* vocab : {&braces, &code}) {
+        std::string a;
+        for (int i = 0; i < 80; i++) {
+            a += (*vocab)[pick(vocab->size())];
+        }
+        std::string b = a;
+        for (int i = 0; i < 6; i++) {
+            b.insert(pick(b.size()), (*vocab)[pick(vocab->size())]);
+        }
+        for (Algo algorithm : {Algo::kPatience, Algo::kMyersGreedy, Algo::kMyersLinear}) {
+            CAPTURE(static_cast<int>(algorithm));
+            auto p = default_pipeline();
+            p.incremental = true;
+            p.syntax_highlight = false;
+            p.algorithm = algorithm;
+            std::string x = a, y = b;
+            auto c = compute_annotated_diff(x, y, "a.cc", "b.cc", p);
+            for (int step = 0; step < 150; step++) {
+                CAPTURE(step);
+                const DiffSide side = pick(2) == 0 ? DiffSide::Old : DiffSide::New;
+                std::string& text = side == DiffSide::Old ? x : y;
+                const size_t offset = pick(text.size() + 1);
+                const size_t length = std::min(pick(12), text.size() - offset);
+                const std::string replacement = pick(3) == 0   ? ""
+                                                : pick(2) == 0 ? (*vocab)[pick(vocab->size())]
+                                                               : "x\n";
+                text.replace(offset, length, replacement);
+                REQUIRE(apply_text_edit(c, side, offset, length, replacement));
+
+                check_valid_script(c);
+                const auto fresh = compute_annotated_diff(x, y, "a.cc", "b.cc", p);
+                CHECK(c.status == fresh.status);
+                check_same_computation(c, fresh);
+            }
+        }
+    }
+}
+
+TEST_CASE("pipeline: an edit to a deadline-degraded computation redoes it in full") {
+    auto p = default_pipeline();
+    p.incremental = true;
+    Deadline expired;
+    expired.cancel();
+    p.deadline = &expired;
+    auto c = compute_annotated_diff("a\nb\nc\n", "a\nB\nc\n", "a", "b", p);
+    REQUIRE(c.degradations != DegradedNone);
+    REQUIRE(apply_text_edit(c, DiffSide::New, 0, 1, "A"));
+    CHECK(c.degradations == DegradedNone);
+    p.deadline = nullptr;
+    check_same_computation(c, compute_annotated_diff("a\nb\nc\n", "A\nB\nc\n", "a", "b", p));
+}
+
+TEST_CASE("pipeline: apply_text_edit needs an incremental computation") {
+    auto c = compute_annotated_diff("a\n", "b\n", "a", "b", default_pipeline());
+    CHECK_FALSE(apply_text_edit(c, DiffSide::New, 0, 1, "a"));
+    CHECK(c.b_lines[0].line == "b\n");
+}
+
+TEST_CASE("diff cache: revisits and layout changes reuse the computation") {
+    const std::string a = "one\ntwo\nthree\n";
+    const std::string b = "one\n2\nthree\n";
+    DiffCache cache;
+    auto p = default_pipeline();
+
+    auto first = cache.get_or_compute(a, b, "a", "b", p);
+    auto again = cache.get_or_compute(a, b, "a", "b", p);
+    CHECK(first == again);
+    CHECK(cache.hits() == 1);
+    CHECK(cache.misses() == 1);
+    CHECK(cache.bytes() >= approximate_bytes(*first));
+
+    DiffLayoutOptions unified;
+    unified.mode = ViewMode::Unified;
+    auto model = build_diff_view_from_text(cache, a, b, "a", "b", p, unified);
+    CHECK(cache.hits() == 2);
+    CHECK(has_left_type(model, EditType::Delete));
+
+    p.ignore_whitespace = true;  // a different option is a different entry
+    CHECK(cache.get_or_compute(a, b, "a", "b", p) != first);
+    CHECK(cache.size() == 2);
+}
+
+TEST_CASE("diff cache: evicts least recently used entries past the byte cap") {
+    auto text = [](int n) {
+        std::string s;
+        for (int i = 0; i < 200; i++) {
+            s += "line " + std::to_string(n * 1000 + i) + "\n";
+        }
+        return s;
+    };
+    const auto p = default_pipeline();
+    DiffCache probe;
+    probe.get_or_compute(text(4), text(5), "a", "b", p);
+    const size_t one = probe.bytes();
+
+    DiffCache cache(one * 2 + one / 2);
+    auto kept = cache.get_or_compute(text(0), text(1), "a", "b", p);
+    cache.get_or_compute(text(2), text(3), "a", "b", p);
+    cache.get_or_compute(text(0), text(1), "a", "b", p);  // touch: now most recent
+    cache.get_or_compute(text(4), text(5), "a", "b", p);  // evicts (2, 3)
+    CHECK(cache.size() == 2);
+    CHECK(cache.bytes() <= cache.max_bytes());
+    CHECK(cache.get_or_compute(text(0), text(1), "a", "b", p) == kept);
+    CHECK(cache.misses() == 3);
+
+    cache.set_max_bytes(0);
+    CHECK(cache.size() == 0);
+    CHECK(cache.bytes() == 0);
+}
+
+TEST_CASE("diff cache: a cached lazy computation annotates each hunk once across views") {
+    std::string a, b;
+    for (int i = 0; i < 60; i++) {
+        a += "line " + std::to_string(i) + "\n";
+        b += (i % 10 == 5 ? "edited " : "line ") + std::to_string(i) + "\n";
+    }
+    DiffCache cache;
+    auto p = default_pipeline();
+    p.lazy_annotation = true;
+    auto c = cache.get_or_compute(a, b, "a", "b", p);
+    REQUIRE(c->lazy_hunks);
+    const size_t hunks = c->lazy_hunks->size();
+    REQUIRE(hunks > 1);
+
+    // The rows as one string: each cell's spans with their styles.
+    auto flatten = [](const DiffViewModel& m) {
+        std::string out;
+        for (const auto& r : m.rows) {
+            out += std::to_string(static_cast<int>(r.kind));
+            for (const auto* cell : {&r.left, &r.right}) {
+                for (const auto& span : cell->spans) {
+                    out += std::to_string(static_cast<int>(span.style)) + span.text;
+                }
+                out += '|';
+            }
+        }
+        return out;
+    };
+    const std::string first =
+        flatten(build_diff_view_from_text(cache, a, b, "a", "b", p, DiffLayoutOptions{}));
+    CHECK(c->lazy_hunks->annotated_count() == hunks);
+
+    // Concurrent views of the same entry share its annotations instead of racing on them.
+    std::vector<DiffViewModel> models(4);
+    std::vector<std::thread> threads;
+    for (auto& m : models) {
+        threads.emplace_back(
+            [&] { m = build_diff_view_from_text(cache, a, b, "a", "b", p, DiffLayoutOptions{}); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    CHECK(c->lazy_hunks->annotated_count() == hunks);
+    for (const auto& m : models) {
+        CHECK(flatten(m) == first);
+    }
+}
+
+TEST_CASE("pipeline: an expired deadline degrades instead of failing") {
+    const std::string a = "one\ntwo\nthree\nfour\n";
+    const std::string b = "one\n2\nthree\nfour 4\n";
+    auto p = default_pipeline();
+    Deadline cancelled;
+    cancelled.cancel();
+    p.deadline = &cancelled;
+
+    auto c = compute_annotated_diff(a, b, "a.txt", "b.txt", p);
+    CHECK(c.status == DiffResultStatus::OK);
+    CHECK((c.degradations & DegradedDiff) != 0);
+    CHECK((c.degradations & DegradedMoves) != 0);
+    CHECK((c.degradations & DegradedAnnotation) != 0);
+    CHECK(degradation_names(DegradedDiff | DegradedAnnotation) == "diff, annotation");
+    REQUIRE(c.hunks.size() == 1);
+    // Whole-line annotation: no intra-line diff, every segment takes its line's type.
+    for (const auto& el : c.hunks[0].b_lines) {
+        for (const auto& seg : el.segments) {
+            CHECK(seg.type == el.type);
+        }
+    }
+
+    // Degraded results aren't cached; the next caller may have the time.
+    DiffCache cache;
+    cache.get_or_compute(a, b, "a.txt", "b.txt", p);
+    CHECK(cache.size() == 0);
+
+    Deadline roomy(std::chrono::milliseconds(60000));
+    p.deadline = &roomy;
+    auto full = compute_annotated_diff(a, b, "a.txt", "b.txt", p);
+    CHECK(full.degradations == DegradedNone);
+    CHECK(degradation_names(full.degradations).empty());
+    // The coarse script deletes and re-inserts the unchanged "three" as well.
+    auto deletes = [](const DiffComputation& dc) {
+        int n = 0;
+        for (const auto& el : dc.hunks[0].a_lines) {
+            n += el.type == EditType::Delete ? 1 : 0;
+        }
+        return n;
+    };
+    REQUIRE(full.hunks.size() == 1);
+    CHECK(deletes(c) == 3);
+    CHECK(deletes(full) == 2);
+}
@@ -0,0 +1,151 @@
+#include "render/dir_diff.hpp"
+
+#include "util/trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace diffy {
+
+namespace {
+
+// Relative paths of the regular files under `root`, sorted.
+std::vector<std::string>
+list_files(const std::string& root) {
+    std::vector<std::string> out;
+    std::error_code ec;
+    fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        std::error_code type_ec;
+        if (it->is_regular_file(type_ec)) {
+            out.push_back(it->path().lexically_relative(root).generic_string());
+        }
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+constexpr size_t kCompareBlockBytes = 64 * 1024;
+
+}  // namespace
+
+std::vector<DirPair>
+pair_directory_files(const std::string& a_root, const std::string& b_root) {
+    DIFFY_TRACE_SCOPE("dir.pair");
+    const std::vector<std::string> a = list_files(a_root);
+    const std::vector<std::string> b = list_files(b_root);
+    std::vector<DirPair> pairs;
+    pairs.reserve(std::max(a.size(), b.size()));
+    size_t i = 0, j = 0;
+    while (i < a.size() || j < b.size()) {
+        if (j == b.size() || (i < a.size() && a[i] < b[j])) {
+            pairs.push_back({a[i++], DirPairKind::OnlyA});
+        } else if (i == a.size() || b[j] < a[i]) {
+            pairs.push_back({b[j++], DirPairKind::OnlyB});
+        } else {
+            pairs.push_back({a[i], DirPairKind::Both});
+            i++;
+            j++;
+        }
+    }
+    return pairs;
+}
+
+bool
+files_identical(const std::string& a_path, const std::string& b_path) {
+    std::error_code ec;
+    const uintmax_t a_size = fs::file_size(a_path, ec);
+    if (ec) {
+        return false;
+    }
+    const uintmax_t b_size = fs::file_size(b_path, ec);
+    if (ec || a_size != b_size) {
+        return false;
+    }
+    if (fs::equivalent(a_path, b_path, ec) && !ec) {
+        return true;  // hard link, or the same path twice
+    }
+
+    FILE* fa = fopen(a_path.c_str(), "rb");
+    FILE* fb = fa ? fopen(b_path.c_str(), "rb") : nullptr;
+    bool same = fa && fb;
+    std::vector<char> a_block(kCompareBlockBytes), b_block(kCompareBlockBytes);
+    while (same) {
+        const size_t na = fread(a_block.data(), 1, a_block.size(), fa);
+        const size_t nb = fread(b_block.data(), 1, b_block.size(), fb);
+        if (na != nb || std::memcmp(a_block.data(), b_block.data(), na) != 0) {
+            same = false;
+        } else if (na < a_block.size()) {
+            // Both ran out together; a read error on either still means "not known equal".
+            same = !ferror(fa) && !ferror(fb);
+            break;
+        }
+    }
+    if (fa) {
+        fclose(fa);
+    }
+    if (fb) {
+        fclose(fb);
+    }
+    return same;
+}
+
+CrossFileRows
+cross_file_move_rows(const DiffInput<Line>& input, const std::vector<Hunk>& hunks, const MoveIndex& moves) {
+    CrossFileRows out;
+    out.model.mode = ViewMode::Unified;
+    for (const auto& hunk : hunks) {
+        for (const auto& e : hunk.edit_units) {
+            if (e.type == EditType::Common) {
+                continue;
+            }
+            const bool deleted = e.type == EditType::Delete;
+            const int64_t index = deleted ? static_cast<int64_t>(e.a_index) : static_cast<int64_t>(e.b_index);
+            DiffRow row;
+            row.kind = RowKind::Content;
+            (deleted ? row.old_lineno : row.new_lineno) = index + 1;
+            row.left.present = true;
+            row.left.type = e.type;
+            const auto& tags = deleted ? moves.a_lines : moves.b_lines;
+            if (auto it = tags.find(index); it != tags.end()) {
+                row.move_id = it->second.move_id;
+                row.move_line = it->second.move_line;
+            }
+            out.model.rows.push_back(std::move(row));
+            out.checksums.push_back((deleted ? input.A : input.B)[index].checksum);
+        }
+    }
+    return out;
+}
+
+std::vector<CrossFileMove>
+collect_cross_file_moves(const std::vector<CrossFileDiff>& files) {
+    std::vector<CrossFileMove> moves;
+    for (const auto& f : files) {
+        if (!f.model) {
+            continue;
+        }
+        int last_id = 0;
+        for (const auto& row : f.model->rows) {
+            const bool deleted = row.kind == RowKind::Content && row.old_lineno && !row.new_lineno;
+            if (!deleted || row.move_file.empty()) {
+                last_id = 0;
+                continue;
+            }
+            if (row.move_id == last_id) {
+                moves.back().lines++;
+                continue;
+            }
+            last_id = row.move_id;
+            moves.push_back({f.path, *row.old_lineno, row.move_file, row.move_line, 1});
+        }
+    }
+    return moves;
+}
+
+}  // namespace diffy
@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+    Building blocks for diffing two directory trees (`diffy -r`): pair the files
+    of both trees by relative path, rule out identical pairs without reading more
+    than needed, and gather each changed file's added/removed lines for the
+    cross-file move pass (detect_cross_file_moves) that runs over the whole set.
+    The per-file diffs themselves are the ordinary pipeline; scheduling them is
+    the caller's (see parallel_for_ordered).
+*/
+
+#include "processing/diff_hunk.hpp"
+#include "processing/diff_hunk_annotate.hpp"
+#include "render/diff_view_model.hpp"
+#include "util/readlines.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace diffy {
+
+enum class DirPairKind {
+    Both,   // present in both trees
+    OnlyA,  // only in the old tree
+    OnlyB,  // only in the new tree
+};
+
+struct DirPair {
+    std::string path;  // relative to both roots, '/'-separated
+    DirPairKind kind = DirPairKind::Both;
+};
+
+// Every regular file under `a_root` and `b_root`, paired by relative path and
+// sorted by it, so the result (and anything emitted in its order) is the same
+// from run to run. Directory symlinks aren't followed; unreadable directories
+// are skipped.
+std::vector<DirPair>
+pair_directory_files(const std::string& a_root, const std::string& b_root);
+
+// True when both files hold the same bytes. Decided from the sizes, then from
+// both names resolving to the same file, and only then by comparing the
+// contents a block at a time. An unreadable file is never identical.
+bool
+files_identical(const std::string& a_path, const std::string& b_path);
+
+// One changed file's deleted and inserted lines, kept for the cross-file move
+// pass after the file itself has been dropped: a row per line with its number
+// but no text, and the checksum readlines computed for it.
+struct CrossFileRows {
+    DiffViewModel model;
+    std::vector<uint32_t> checksums;  // checksums[i] belongs to model.rows[i]
+
+    CrossFileDiff
+    diff(std::string path) {
+        return {std::move(path), &model, {}, {}, checksums};
+    }
+};
+
+// The CrossFileRows of `hunks`. Blocks `moves` (the file's own detect_moves
+// pass) pairs within the file come tagged already, so the cross-file pass leaves
+// them be.
+CrossFileRows
+cross_file_move_rows(const DiffInput<Line>& input, const std::vector<Hunk>& hunks, const MoveIndex& moves);
+
+// One block detect_cross_file_moves paired across files.
+struct CrossFileMove {
+    std::string from_path;  // where it was deleted
+    int64_t from_line = 0;  // 1-based, first line of the block
+    std::string to_path;    // where it was inserted
+    int64_t to_line = 0;
+    int64_t lines = 0;
+};
+
+// The moves tagged on `files` by detect_cross_file_moves, one per block, in
+// file then line order.
+std::vector<CrossFileMove>
+collect_cross_file_moves(const std::vector<CrossFileDiff>& files);
+
+}  // namespace diffy
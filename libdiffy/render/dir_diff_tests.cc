@@ -0,0 +1,127 @@
+#include <doctest.h>
+
+#include "algorithms/patience.hpp"
+#include "render/dir_diff.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace diffy;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A fresh, empty directory under the temp dir. Caller removes it.
+fs::path
+temp_tree(const char* tag) {
+    const fs::path p = fs::temp_directory_path() / (std::string("diffy_dir_diff_test_") + tag);
+    fs::remove_all(p);
+    fs::create_directories(p);
+    return p;
+}
+
+void
+write_file(const fs::path& path, const std::string& content) {
+    fs::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+// One file's diff, for the move helpers. Keeps the lines the input points at.
+struct FileDiff {
+    std::vector<Line> a, b;
+    std::vector<Hunk> hunks;
+
+    FileDiff(const std::string& a_text, const std::string& b_text)
+        : a(readlines_from_string(a_text, false)), b(readlines_from_string(b_text, false)) {
+        DiffInput<Line> in = input();
+        hunks = compose_hunks(Patience<Line>(in).compute().edit_sequence, 3);
+    }
+
+    DiffInput<Line>
+    input() {
+        return DiffInput<Line>{gsl::span<Line>(a), gsl::span<Line>(b), "a", "b"};
+    }
+};
+
+}  // namespace
+
+TEST_CASE("dir diff: files are paired by relative path, in path order") {
+    const fs::path root = temp_tree("pair");
+    write_file(root / "a" / "same.txt", "x\n");
+    write_file(root / "b" / "same.txt", "x\n");
+    write_file(root / "a" / "sub" / "gone.txt", "x\n");
+    write_file(root / "b" / "sub" / "new.txt", "x\n");
+    write_file(root / "a" / "sub" / "deep" / "z.c", "x\n");
+    write_file(root / "b" / "sub" / "deep" / "z.c", "y\n");
+    fs::create_directories(root / "b" / "empty");
+
+    const auto pairs = pair_directory_files((root / "a").string(), (root / "b").string());
+    REQUIRE(pairs.size() == 4);
+    CHECK(pairs[0].path == "same.txt");
+    CHECK(pairs[0].kind == DirPairKind::Both);
+    CHECK(pairs[1].path == "sub/deep/z.c");
+    CHECK(pairs[1].kind == DirPairKind::Both);
+    CHECK(pairs[2].path == "sub/gone.txt");
+    CHECK(pairs[2].kind == DirPairKind::OnlyA);
+    CHECK(pairs[3].path == "sub/new.txt");
+    CHECK(pairs[3].kind == DirPairKind::OnlyB);
+    fs::remove_all(root);
+}
+
+TEST_CASE("dir diff: files_identical compares sizes, then contents") {
+    const fs::path root = temp_tree("identical");
+    const std::string big(200 * 1024, 'q');  // spans several compare blocks
+    write_file(root / "a", big);
+    write_file(root / "b", big);
+    write_file(root / "c", big.substr(0, big.size() - 1) + "r");  // same size, last byte differs
+    write_file(root / "d", "short");
+
+    CHECK(files_identical((root / "a").string(), (root / "b").string()));
+    CHECK(files_identical((root / "a").string(), (root / "a").string()));
+    CHECK_FALSE(files_identical((root / "a").string(), (root / "c").string()));
+    CHECK_FALSE(files_identical((root / "a").string(), (root / "d").string()));
+    CHECK_FALSE(files_identical((root / "a").string(), (root / "missing").string()));
+    fs::remove_all(root);
+}
+
+TEST_CASE("dir diff: a block moved between files is collected once") {
+    FileDiff x("keep\nalpha\nbeta\ngamma\ndelta\n", "keep\n");
+    FileDiff y("one\ntwo\n", "one\nalpha\nbeta\ngamma\ndelta\ntwo\n");
+    CrossFileRows x_rows = cross_file_move_rows(x.input(), x.hunks, detect_moves(x.input(), x.hunks));
+    CrossFileRows y_rows = cross_file_move_rows(y.input(), y.hunks, detect_moves(y.input(), y.hunks));
+    REQUIRE(x_rows.model.rows.size() == 4);
+    CHECK(y_rows.model.rows.size() == 4);
+    // The rows keep the checksums readlines computed, not a copy of the text.
+    REQUIRE(x_rows.checksums.size() == 4);
+    CHECK(x_rows.checksums[0] == x.a[1].checksum);
+    for (const auto& row : x_rows.model.rows) {
+        CHECK(row.left.spans.empty());
+    }
+
+    const std::vector<CrossFileDiff> files = {x_rows.diff("x.txt"), y_rows.diff("y.txt")};
+    detect_cross_file_moves(files);
+    const auto moves = collect_cross_file_moves(files);
+    REQUIRE(moves.size() == 1);
+    CHECK(moves[0].from_path == "x.txt");
+    CHECK(moves[0].from_line == 2);
+    CHECK(moves[0].to_path == "y.txt");
+    CHECK(moves[0].to_line == 2);
+    CHECK(moves[0].lines == 4);
+}
+
+TEST_CASE("dir diff: a move within one file is not reported across files") {
+    // x moves its block below four unchanged lines; y gains a copy of it. The
+    // deleted end in x is already paired within x, so it can't pair with y.
+    FileDiff x("alpha\nbeta\ngamma\nm1\nm2\nm3\nm4\n", "m1\nm2\nm3\nm4\nalpha\nbeta\ngamma\n");
+    FileDiff y("one\n", "one\nalpha\nbeta\ngamma\n");
+    CrossFileRows x_rows = cross_file_move_rows(x.input(), x.hunks, detect_moves(x.input(), x.hunks));
+    CrossFileRows y_rows = cross_file_move_rows(y.input(), y.hunks, detect_moves(y.input(), y.hunks));
+    REQUIRE(x_rows.model.rows.size() == 6);
+    CHECK(x_rows.model.rows.front().move_id != 0);
+
+    const std::vector<CrossFileDiff> files = {x_rows.diff("x.txt"), y_rows.diff("y.txt")};
+    detect_cross_file_moves(files);
+    CHECK(collect_cross_file_moves(files).empty());
+}
@@ -5,9 +5,9 @@
 
     build_hex_view() turns a binary alignment into the same DiffViewModel the text
     diff produces, so a frontend that already renders DiffViewModel (the GUI) can
-    show hex diffs with no new rendering code. It mirrors what the CLI's
-    hex_unified_render / hex_column_render produce, but as StyledSpans instead of
-    ANSI: equal bytes are SpanStyle::Common, removed bytes DeleteToken, added
+    show hex diffs with no new rendering code. It walks the alignment with the
+    same HexRowIterator as the CLI's hex_unified_render / hex_column_render, so
+    the rows match theirs, but as StyledSpans instead of ANSI: equal bytes are SpanStyle::Common, removed bytes DeleteToken, added
     bytes InsertToken. Byte offsets are embedded as leading Common spans (the
     line-number gutters stay empty, since offsets aren't line numbers).
 */
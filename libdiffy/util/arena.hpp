@@ -0,0 +1,100 @@
+#pragma once
+
+/*
+    Bump allocator for short-lived text. Strings copied in are handed back as
+    views that stay valid until reset(); reset() rewinds without freeing, so a
+    renderer that resets once per hunk stops allocating once the arena has grown
+    to fit its largest hunk.
+*/
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace diffy {
+
+class TextArena {
+   public:
+    explicit TextArena(std::size_t block_bytes = 16 * 1024) : block_bytes_(std::max<std::size_t>(block_bytes, 64)) {
+    }
+
+    TextArena(const TextArena&) = delete;
+    TextArena& operator=(const TextArena&) = delete;
+
+    // `n` uninitialised bytes, valid until reset().
+    char*
+    allocate(std::size_t n) {
+        while (block_ < blocks_.size()) {
+            Block& b = blocks_[block_];
+            if (used_ + n <= b.size) {
+                char* p = b.data.get() + used_;
+                used_ += n;
+                return p;
+            }
+            block_++;
+            used_ = 0;
+        }
+        const std::size_t size = std::max(block_bytes_, n);
+        blocks_.push_back({std::make_unique<char[]>(size), size});
+        block_ = blocks_.size() - 1;
+        used_ = n;
+        return blocks_.back().data.get();
+    }
+
+    std::string_view
+    copy(std::string_view text) {
+        if (text.empty()) {
+            return {};
+        }
+        char* p = allocate(text.size());
+        std::memcpy(p, text.data(), text.size());
+        return {p, text.size()};
+    }
+
+    // `unit` repeated `count` times.
+    std::string_view
+    repeat(std::string_view unit, std::size_t count) {
+        const std::size_t n = unit.size() * count;
+        if (n == 0) {
+            return {};
+        }
+        char* p = allocate(n);
+        for (std::size_t i = 0; i < count; i++) {
+            std::memcpy(p + i * unit.size(), unit.data(), unit.size());
+        }
+        return {p, n};
+    }
+
+    // Invalidate every view handed out; the blocks are kept for reuse.
+    void
+    reset() {
+        block_ = 0;
+        used_ = 0;
+    }
+
+    // Bytes reserved across all blocks.
+    std::size_t
+    capacity() const {
+        std::size_t total = 0;
+        for (const auto& b : blocks_) {
+            total += b.size;
+        }
+        return total;
+    }
+
+   private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        std::size_t size;
+    };
+
+    std::size_t block_bytes_;
+    std::vector<Block> blocks_;
+    std::size_t block_ = 0;  // block being filled
+    std::size_t used_ = 0;   // bytes used in it
+};
+
+}  // namespace diffy
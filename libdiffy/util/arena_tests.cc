@@ -0,0 +1,45 @@
+#include <doctest.h>
+
+#include "util/arena.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace diffy;
+
+TEST_CASE("TextArena: copies and repeats stay valid as blocks fill up") {
+    TextArena arena(64);
+    std::vector<std::string_view> views;
+    for (int i = 0; i < 100; i++) {
+        views.push_back(arena.copy("line " + std::to_string(i)));
+    }
+    views.push_back(arena.repeat("ab", 50));  // larger than a block
+    for (int i = 0; i < 100; i++) {
+        CHECK(views[static_cast<std::size_t>(i)] == "line " + std::to_string(i));
+    }
+    std::string expected;
+    for (int i = 0; i < 50; i++) {
+        expected += "ab";
+    }
+    CHECK(views.back() == expected);
+    CHECK(arena.copy("").empty());
+    CHECK(arena.repeat("\xc2\xb7", 0).empty());
+}
+
+TEST_CASE("TextArena: reset() rewinds without giving the memory back") {
+    TextArena arena(256);
+    for (int i = 0; i < 40; i++) {
+        arena.repeat("x", 100);
+    }
+    const std::size_t grown = arena.capacity();
+    CHECK(grown >= 4000);
+
+    for (int round = 0; round < 5; round++) {
+        arena.reset();
+        for (int i = 0; i < 40; i++) {
+            CHECK(arena.repeat("y", 100) == std::string(100, 'y'));
+        }
+    }
+    CHECK(arena.capacity() == grown);
+}
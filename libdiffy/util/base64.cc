@@ -0,0 +1,31 @@
+#include "util/base64.hpp"
+
+namespace {
+
+const char kB64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+}  // namespace
+
+std::string
+diffy::base64(const uint8_t* data, size_t n) {
+    std::string out;
+    out.reserve((n + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3) {
+        const uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out.push_back(kB64[(v >> 18) & 0x3f]);
+        out.push_back(kB64[(v >> 12) & 0x3f]);
+        out.push_back(kB64[(v >> 6) & 0x3f]);
+        out.push_back(kB64[v & 0x3f]);
+    }
+    if (i < n) {
+        const uint32_t b0 = data[i];
+        const uint32_t b1 = (i + 1 < n) ? data[i + 1] : 0;
+        const uint32_t v = (b0 << 16) | (b1 << 8);
+        out.push_back(kB64[(v >> 18) & 0x3f]);
+        out.push_back(kB64[(v >> 12) & 0x3f]);
+        out.push_back((i + 1 < n) ? kB64[(v >> 6) & 0x3f] : '=');
+        out.push_back('=');
+    }
+    return out;
+}
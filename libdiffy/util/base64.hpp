@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace diffy {
+
+// Standard base64 (RFC 4648 alphabet, '=' padded) of `n` bytes.
+std::string
+base64(const uint8_t* data, std::size_t n);
+
+}  // namespace diffy
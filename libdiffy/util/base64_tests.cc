@@ -0,0 +1,19 @@
+#include "util/base64.hpp"
+
+#include <doctest.h>
+
+#include <string>
+
+using namespace diffy;
+
+TEST_CASE("base64 — RFC 4648 vectors") {
+    auto enc = [](const std::string& s) { return base64(reinterpret_cast<const uint8_t*>(s.data()), s.size()); };
+    CHECK(enc("") == "");
+    CHECK(enc("f") == "Zg==");
+    CHECK(enc("fo") == "Zm8=");
+    CHECK(enc("foo") == "Zm9v");
+    CHECK(enc("foob") == "Zm9vYg==");
+    CHECK(enc("fooba") == "Zm9vYmE=");
+    CHECK(enc("foobar") == "Zm9vYmFy");
+    CHECK(enc("caf\xE9\n") == "Y2Fm6Qo=");
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+    A time budget and cancellation token for one diff. The caller owns it and
+    hands the pipeline a pointer (DiffPipelineOptions::deadline); the stages poll
+    it and, once it has passed, degrade rather than fail — the diff falls back to
+    a coarse delete/insert script, annotation drops to whole lines, tree-sitter
+    passes are skipped or aborted. cancel() may be called from any thread and
+    expires the deadline at once.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace diffy {
+
+class Deadline {
+   public:
+    // No time limit; expires only on cancel().
+    Deadline() = default;
+
+    explicit Deadline(std::chrono::milliseconds budget)
+        : end_(std::chrono::steady_clock::now() + budget), bounded_(true) {
+    }
+
+    Deadline(const Deadline&) = delete;
+    Deadline& operator=(const Deadline&) = delete;
+
+    void
+    cancel() {
+        std::atomic_ref<size_t>(cancelled_).store(1, std::memory_order_relaxed);
+    }
+
+    bool
+    cancelled() const {
+        return std::atomic_ref<size_t>(cancelled_).load(std::memory_order_relaxed) != 0;
+    }
+
+    bool
+    expired() const {
+        return cancelled() || (bounded_ && std::chrono::steady_clock::now() >= end_);
+    }
+
+    // Microseconds left: 0 once expired, the uint64_t maximum when unbounded.
+    uint64_t
+    remaining_micros() const {
+        if (cancelled()) {
+            return 0;
+        }
+        if (!bounded_) {
+            return std::numeric_limits<uint64_t>::max();
+        }
+        const auto left = std::chrono::duration_cast<std::chrono::microseconds>(end_ - std::chrono::steady_clock::now());
+        return left.count() > 0 ? static_cast<uint64_t>(left.count()) : 0;
+    }
+
+    // Non-zero once cancelled; laid out for ts_parser_set_cancellation_flag.
+    const size_t*
+    cancel_flag() const {
+        return &cancelled_;
+    }
+
+   private:
+    std::chrono::steady_clock::time_point end_{};
+    bool bounded_ = false;
+    alignas(std::atomic_ref<size_t>::required_alignment) mutable size_t cancelled_ = 0;
+};
+
+// Polled from tight loops: a null deadline never expires.
+inline bool
+deadline_expired(const Deadline* deadline) {
+    return deadline && deadline->expired();
+}
+
+}  // namespace diffy
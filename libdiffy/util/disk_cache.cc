@@ -0,0 +1,211 @@
+#include "util/disk_cache.hpp"
+
+#include "util/hash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef DIFFY_PLATFORM_POSIX
+#include <unistd.h>
+#endif
+
+namespace diffy {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// "DFYC" + crc32c of the payload. Bump the magic if the framing ever changes.
+constexpr char kMagic[4] = {'D', 'F', 'Y', 'C'};
+constexpr size_t kHeaderSize = sizeof(kMagic) + sizeof(uint32_t);
+constexpr const char* kExtension = ".dfc";
+constexpr const char* kTempMarker = ".dfc.tmp.";
+// A temp file this old belongs to a writer that died before its rename.
+constexpr auto kStaleTempAge = std::chrono::hours(1);
+// Stores between full scans while the running total stays under the cap.
+constexpr int kRescanStores = 64;
+
+bool
+read_file(const std::string& path, std::string* out) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    out->clear();
+    char buf[1 << 16];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out->append(buf, n);
+    }
+    const bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Distinct per writer, so concurrent stores of the same key don't share a temp file.
+std::string
+temp_suffix() {
+#ifdef DIFFY_PLATFORM_POSIX
+    const long pid = static_cast<long>(getpid());
+#else
+    const long pid = 0;
+#endif
+    static std::atomic<int> counter{0};
+    return ".tmp." + std::to_string(pid) + "." + std::to_string(++counter);
+}
+
+}  // namespace
+
+DiskCache::DiskCache(std::string directory, uint64_t max_bytes)
+    : directory_(std::move(directory)), max_bytes_(max_bytes) {
+}
+
+std::string
+DiskCache::path_for(const std::string& key) const {
+    return (fs::path(directory_) / (key + kExtension)).string();
+}
+
+std::optional<std::string>
+DiskCache::load(const std::string& key) {
+    const std::string path = path_for(key);
+    std::string data;
+    if (!read_file(path, &data)) {
+        return std::nullopt;
+    }
+    uint32_t crc = 0;
+    if (data.size() < kHeaderSize || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        std::error_code ec;
+        if (fs::remove(path, ec)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (bytes_) {
+                *bytes_ -= std::min<uint64_t>(*bytes_, data.size());
+            }
+        }
+        return std::nullopt;
+    }
+    std::memcpy(&crc, data.data() + sizeof(kMagic), sizeof(crc));
+    if (hash::hash(data.data() + kHeaderSize, data.size() - kHeaderSize) != crc) {
+        std::error_code ec;
+        if (fs::remove(path, ec)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (bytes_) {
+                *bytes_ -= std::min<uint64_t>(*bytes_, data.size());
+            }
+        }
+        return std::nullopt;
+    }
+    // Recency for eviction. Best-effort: a read-only cache still serves hits.
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+    return data.substr(kHeaderSize);
+}
+
+bool
+DiskCache::store(const std::string& key, std::string_view value) {
+    std::error_code ec;
+    fs::create_directories(directory_, ec);
+
+    const std::string path = path_for(key);
+    const std::string tmp = path + temp_suffix();
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    const uint32_t crc = hash::hash(value.data(), value.size());
+    bool ok = fwrite(kMagic, 1, sizeof(kMagic), f) == sizeof(kMagic) &&
+              fwrite(&crc, 1, sizeof(crc), f) == sizeof(crc) &&
+              (value.empty() || fwrite(value.data(), 1, value.size(), f) == value.size());
+    if (fflush(f) != 0)
+        ok = false;
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    uint64_t replaced = fs::file_size(path, ec);
+    if (ec) {
+        replaced = 0;
+    }
+    fs::rename(tmp, path, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+        return false;
+    }
+    bool scan;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (bytes_) {
+            *bytes_ = *bytes_ - std::min(*bytes_, replaced) + kHeaderSize + value.size();
+        }
+        scan = !bytes_ || *bytes_ > max_bytes_ || ++stores_since_scan_ >= kRescanStores;
+    }
+    if (scan) {
+        evict();
+    }
+    return true;
+}
+
+void
+DiskCache::evict() {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type time;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    const auto now = fs::file_time_type::clock::now();
+    std::error_code ec;
+    for (fs::directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec)) {
+        const bool temp = it->path().filename().string().find(kTempMarker) != std::string::npos;
+        if (!temp && it->path().extension() != kExtension) {
+            continue;
+        }
+        std::error_code entry_ec;
+        const uint64_t size = it->file_size(entry_ec);
+        const auto time = it->last_write_time(entry_ec);
+        if (entry_ec) {
+            continue;
+        }
+        if (temp) {
+            // A live writer's temp file is renamed away shortly; only old ones are litter.
+            if (now - time > kStaleTempAge) {
+                fs::remove(it->path(), entry_ec);
+            }
+            continue;
+        }
+        entries.push_back({it->path(), time, size});
+        total += size;
+    }
+    if (total > max_bytes_) {
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.time < b.time; });
+        for (const auto& e : entries) {
+            if (total <= max_bytes_) {
+                break;
+            }
+            // Another process may have removed it already; either way it's gone.
+            fs::remove(e.path, ec);
+            total -= e.size;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytes_ = total;
+    stores_since_scan_ = 0;
+}
+
+uint64_t
+DiskCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_.value_or(0);
+}
+
+}  // namespace diffy
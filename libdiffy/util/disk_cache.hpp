@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+    Size-bounded key/value store in a directory, one file per key. Values are
+    written to a temp file and renamed into place (like the config save), so a
+    reader never sees a half-written entry even with several diffy processes
+    sharing the directory. Each entry carries a checksum; a damaged one reads as a
+    miss and is removed. Reads bump the file's mtime, and stores trim the oldest
+    entries once the directory grows past its byte cap. Stores keep a running
+    total rather than listing the directory each time; the full scan runs when
+    that total passes the cap (and every kRescanStores stores, to pick up other
+    processes' writes), and it also removes temp files a crashed writer left.
+*/
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace diffy {
+
+class DiskCache {
+   public:
+    DiskCache(std::string directory, uint64_t max_bytes);
+
+    // The stored value, or nullopt on a miss (absent, unreadable or damaged).
+    std::optional<std::string>
+    load(const std::string& key);
+
+    // Store `value` under `key`, replacing any previous value, then evict. Returns
+    // false if it could not be written; the cache is best-effort, so callers
+    // normally carry on either way.
+    bool
+    store(const std::string& key, std::string_view value);
+
+    // List the directory, delete least recently used entries until the total is
+    // within the cap, and remove temp files older than kStaleTempAge.
+    void
+    evict();
+
+    // The entries' total size as of the last scan, plus this object's stores since.
+    uint64_t
+    bytes() const;
+
+    const std::string&
+    directory() const {
+        return directory_;
+    }
+
+   private:
+    std::string
+    path_for(const std::string& key) const;
+
+    std::string directory_;
+    uint64_t max_bytes_;
+    mutable std::mutex mutex_;
+    std::optional<uint64_t> bytes_;  // unknown until the first scan
+    int stores_since_scan_ = 0;
+};
+
+}  // namespace diffy
@@ -0,0 +1,106 @@
+#include <doctest.h>
+
+#include "util/disk_cache.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+using namespace diffy;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A fresh, empty directory under the temp dir. Caller removes it.
+std::string
+temp_cache_dir(const char* tag) {
+    const fs::path p = fs::temp_directory_path() / (std::string("diffy_disk_cache_test_") + tag);
+    fs::remove_all(p);
+    return p.string();
+}
+
+}  // namespace
+
+TEST_CASE("disk cache: stores, replaces and loads values") {
+    const std::string dir = temp_cache_dir("roundtrip");
+    DiskCache cache(dir, 1 << 20);
+    CHECK_FALSE(cache.load("k").has_value());
+
+    REQUIRE(cache.store("k", std::string("first\0value", 11)));
+    REQUIRE(cache.load("k").has_value());
+    CHECK(*cache.load("k") == std::string("first\0value", 11));
+
+    REQUIRE(cache.store("k", ""));
+    CHECK(cache.load("k") == std::string());
+
+    // No temp files are left behind.
+    int files = 0;
+    for (const auto& e : fs::directory_iterator(dir)) {
+        CHECK(e.path().extension() == ".dfc");
+        ++files;
+    }
+    CHECK(files == 1);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("disk cache: a damaged entry is a miss and is removed") {
+    const std::string dir = temp_cache_dir("damaged");
+    DiskCache cache(dir, 1 << 20);
+    REQUIRE(cache.store("k", "some value"));
+    const fs::path entry = fs::path(dir) / "k.dfc";
+    {
+        std::fstream f(entry, std::ios::in | std::ios::out | std::ios::binary);
+        f.seekp(-1, std::ios::end);
+        f.put('X');
+    }
+    CHECK_FALSE(cache.load("k").has_value());
+    CHECK_FALSE(fs::exists(entry));
+    fs::remove_all(dir);
+}
+
+TEST_CASE("disk cache: evicts the least recently used entries past the cap") {
+    const std::string dir = temp_cache_dir("evict");
+    const std::string value(1000, 'v');
+    DiskCache cache(dir, 2500);  // room for two entries
+    REQUIRE(cache.store("a", value));
+    REQUIRE(cache.store("b", value));
+    // Make "a" the most recently used, as a load does.
+    fs::last_write_time(fs::path(dir) / "b.dfc", fs::last_write_time(fs::path(dir) / "a.dfc") - std::chrono::hours(1));
+    REQUIRE(cache.store("c", value));
+    CHECK(cache.load("a").has_value());
+    CHECK_FALSE(cache.load("b").has_value());
+    CHECK(cache.load("c").has_value());
+    fs::remove_all(dir);
+}
+
+TEST_CASE("disk cache: eviction removes stale temp files and keeps a writer's fresh one") {
+    const std::string dir = temp_cache_dir("temps");
+    DiskCache cache(dir, 1 << 20);
+    REQUIRE(cache.store("k", "value"));
+    const fs::path stale = fs::path(dir) / "a.dfc.tmp.123.1";
+    const fs::path fresh = fs::path(dir) / "b.dfc.tmp.456.1";
+    std::ofstream(stale) << "partial";
+    std::ofstream(fresh) << "partial";
+    fs::last_write_time(stale, fs::last_write_time(stale) - std::chrono::hours(2));
+
+    cache.evict();
+    CHECK_FALSE(fs::exists(stale));
+    CHECK(fs::exists(fresh));
+    CHECK(cache.load("k").has_value());
+    fs::remove_all(dir);
+}
+
+TEST_CASE("disk cache: stores keep a running total of the entries") {
+    const std::string dir = temp_cache_dir("total");
+    DiskCache cache(dir, 1 << 20);
+    const std::string value(1000, 'v');
+    REQUIRE(cache.store("a", value));
+    const uint64_t one = cache.bytes();
+    CHECK(one == fs::file_size(fs::path(dir) / "a.dfc"));
+    REQUIRE(cache.store("b", value));
+    CHECK(cache.bytes() == 2 * one);
+    REQUIRE(cache.store("b", value));  // a replacement doesn't grow the total
+    CHECK(cache.bytes() == 2 * one);
+    fs::remove_all(dir);
+}
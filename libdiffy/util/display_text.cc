@@ -16,34 +16,15 @@ cp_len(const std::string& s, size_t i) {
     return n;
 }
 
-// One display column: its bytes, resolved style, and whether it's a break space.
-struct Cell {
-    std::string bytes;
-    uint32_t argb;
-    uint32_t bg_argb;
-    bool bold;
-    bool space;
-};
-
-// Coalesce consecutive same-style cells into runs.
-std::vector<DisplayRun>
-emit_line(const std::vector<Cell>& cells) {
-    std::vector<DisplayRun> line;
-    for (const auto& c : cells) {
-        if (!line.empty() && line.back().argb == c.argb && line.back().bg_argb == c.bg_argb &&
-            line.back().bold == c.bold) {
-            line.back().text += c.bytes;
-        } else {
-            line.push_back(DisplayRun{c.bytes, c.argb, c.bold, c.bg_argb});
-        }
-    }
-    return line;
+bool
+same_style(const DisplayRun& a, const DisplayRun& b) {
+    return a.argb == b.argb && a.bg_argb == b.bg_argb && a.bold == b.bold;
 }
 
 }  // namespace
 
 int
-display_width(const std::string& s, int tab_width, int start_col) {
+display_width(std::string_view s, int tab_width, int start_col) {
     if (tab_width < 1) {
         tab_width = 1;
     }
@@ -53,86 +34,120 @@ display_width(const std::string& s, int tab_width, int start_col) {
     // display_cols did; a tab then snaps to the next multiple of tab_width.
     int64_t cols = start_col;
     std::size_t seg = 0;
-    for (std::size_t i = 0; i <= s.size(); i++) {
-        if (i == s.size() || s[i] == '\t') {
-            cols += utf8_len(s, seg, i);
-            if (i < s.size()) {  // the tab itself
-                cols += tab_width - (cols % tab_width);
-            }
-            seg = i + 1;
+    for (;;) {
+        const std::size_t tab = s.find('\t', seg);
+        cols += utf8_len(s, seg, tab == std::string_view::npos ? s.size() : tab);
+        if (tab == std::string_view::npos) {
+            break;
         }
+        cols += tab_width - (cols % tab_width);  // the tab itself
+        seg = tab + 1;
     }
     return static_cast<int>(cols - start_col);
 }
 
 std::vector<std::vector<DisplayRun>>
 wrap_display_runs(const std::vector<DisplayRun>& runs, int wrap_cols) {
+    return wrap_prepared_runs(prepare_display_runs(runs), wrap_cols);
+}
+
+PreparedDisplayRuns
+prepare_display_runs(const std::vector<DisplayRun>& runs) {
+    PreparedDisplayRuns out;
+    out.runs.reserve(runs.size());
+    for (const auto& r : runs) {
+        out.run_start.push_back(static_cast<uint32_t>(out.text.size()));
+        out.runs.push_back(DisplayRun{{}, r.argb, r.bold, r.bg_argb});
+        for (size_t i = 0; i < r.text.size();) {
+            out.cp_start.push_back(static_cast<uint32_t>(out.text.size() + i));
+            out.cp_run.push_back(static_cast<uint32_t>(out.runs.size() - 1));
+            i += cp_len(r.text, i);
+        }
+        out.text += r.text;
+    }
+    out.run_start.push_back(static_cast<uint32_t>(out.text.size()));
+    out.cp_start.push_back(static_cast<uint32_t>(out.text.size()));
+    return out;
+}
+
+std::vector<std::vector<DisplayRun>>
+wrap_prepared_runs(const PreparedDisplayRuns& line, int wrap_cols) {
+    auto run_text = [&line](size_t from_cp, size_t to_cp) {
+        return line.text.substr(line.cp_start[from_cp], line.cp_start[to_cp] - line.cp_start[from_cp]);
+    };
+
     if (wrap_cols < 1) {
         std::vector<DisplayRun> single;
-        for (const auto& r : runs) {
-            if (!r.text.empty()) {
-                single.push_back(r);
+        for (size_t r = 0; r < line.runs.size(); r++) {
+            const uint32_t begin = line.run_start[r];
+            const uint32_t end = line.run_start[r + 1];
+            if (end > begin) {
+                const DisplayRun& style = line.runs[r];
+                single.push_back(
+                    DisplayRun{line.text.substr(begin, end - begin), style.argb, style.bold, style.bg_argb});
             }
         }
         return {std::move(single)};
     }
 
-    // Flatten to display columns (code points).
-    std::vector<Cell> cells;
-    for (const auto& r : runs) {
-        for (size_t i = 0; i < r.text.size();) {
-            const size_t n = cp_len(r.text, i);
-            std::string b = r.text.substr(i, n);
-            const bool sp = (n == 1 && b[0] == ' ');
-            cells.push_back(Cell{std::move(b), r.argb, r.bg_argb, r.bold, sp});
-            i += n;
-        }
-    }
-
+    // Code points [a, b) as one visual line, coalescing same-style neighbours.
     std::vector<std::vector<DisplayRun>> lines;
-    std::vector<Cell> cur;
-    int last_space = -1;  // index in `cur` of the last space (soft-break point)
-
-    auto reset_last_space = [&]() {
-        last_space = -1;
-        for (int j = 0; j < static_cast<int>(cur.size()); ++j) {
-            if (cur[j].space) {
-                last_space = j;
+    auto emit_line = [&](size_t a, size_t b) {
+        std::vector<DisplayRun> out;
+        for (size_t k = a; k < b;) {
+            size_t e = k + 1;
+            while (e < b && line.cp_run[e] == line.cp_run[k]) {
+                ++e;
+            }
+            const DisplayRun& style = line.runs[line.cp_run[k]];
+            if (!out.empty() && same_style(out.back(), style)) {
+                out.back().text += run_text(k, e);
+            } else {
+                out.push_back(DisplayRun{run_text(k, e), style.argb, style.bold, style.bg_argb});
             }
+            k = e;
         }
+        lines.push_back(std::move(out));
+    };
+    auto is_space = [&line](size_t k) {
+        return line.cp_start[k + 1] - line.cp_start[k] == 1 && line.text[line.cp_start[k]] == ' ';
     };
 
-    for (const auto& cell : cells) {
-        cur.push_back(cell);
-        if (cell.space) {
-            last_space = static_cast<int>(cur.size()) - 1;
+    // The current visual line is code points [start, i]; last_space is the last
+    // space in it (the soft-break point), or -1.
+    const size_t n = line.cp_run.size();
+    const auto cols = static_cast<size_t>(wrap_cols);
+    size_t start = 0;
+    int64_t last_space = -1;
+    for (size_t i = 0; i < n; i++) {
+        if (is_space(i)) {
+            last_space = static_cast<int64_t>(i);
         }
-        if (static_cast<int>(cur.size()) <= wrap_cols) {
+        if (i - start + 1 <= cols) {
             continue;
         }
         // Overflowed by one column; break.
-        if (last_space >= 0 && last_space + 1 < static_cast<int>(cur.size())) {
+        if (last_space >= 0 && static_cast<size_t>(last_space) < i) {
             // Soft break: emit up to the space (dropped), carry the rest.
-            std::vector<Cell> head(cur.begin(), cur.begin() + last_space);
-            std::vector<Cell> tail(cur.begin() + last_space + 1, cur.end());
-            lines.push_back(emit_line(head));
-            cur = std::move(tail);
-        } else if (cur.back().space) {
+            emit_line(start, static_cast<size_t>(last_space));
+            start = static_cast<size_t>(last_space) + 1;
+        } else if (is_space(i)) {
             // The overflowing column is itself a space: drop it, keep the line.
-            cur.pop_back();
-            lines.push_back(emit_line(cur));
-            cur.clear();
+            emit_line(start, i);
+            start = i + 1;
         } else {
             // Hard break: emit the full-width head, carry the overflow column.
-            Cell carry = cur.back();
-            cur.pop_back();
-            lines.push_back(emit_line(cur));
-            cur.clear();
-            cur.push_back(std::move(carry));
+            emit_line(start, i);
+            start = i;
+        }
+        last_space = -1;
+        for (size_t k = start; k <= i; k++) {
+            if (is_space(k)) {
+                last_space = static_cast<int64_t>(k);
+            }
         }
-        reset_last_space();
     }
-    lines.push_back(emit_line(cur));
+    emit_line(start, n);
     return lines;
 }
 
@@ -9,6 +9,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace diffy {
@@ -24,7 +25,7 @@ namespace diffy {
 // column), which matters for Latin-1 / mixed-encoding lines. `tab_width` < 1 is
 // treated as 1.
 int
-display_width(const std::string& s, int tab_width, int start_col = 0);
+display_width(std::string_view s, int tab_width, int start_col = 0);
 
 // A run of display text sharing one resolved style. `argb` is a packed colour
 // (0xAARRGGBB) so this stays UI-toolkit-agnostic; the bridge converts to/from
@@ -45,6 +46,25 @@ struct DisplayRun {
 std::vector<std::vector<DisplayRun>>
 wrap_display_runs(const std::vector<DisplayRun>& runs, int wrap_cols);
 
+// The part of wrap_display_runs that doesn't depend on the width: the runs' text
+// laid end to end and split into code points, each one display column, with the
+// run it came from. Keep one per displayed line and only wrap_prepared_runs again
+// when the pane is resized.
+struct PreparedDisplayRuns {
+    std::vector<DisplayRun> runs;     // the runs' styles; their text lives in `text`
+    std::string text;
+    std::vector<uint32_t> run_start;  // byte offset of each run in `text`, then the end
+    std::vector<uint32_t> cp_start;   // byte offset of each code point, then the end
+    std::vector<uint32_t> cp_run;     // the run each code point belongs to
+};
+
+PreparedDisplayRuns
+prepare_display_runs(const std::vector<DisplayRun>& runs);
+
+// wrap_display_runs of the runs `line` was prepared from.
+std::vector<std::vector<DisplayRun>>
+wrap_prepared_runs(const PreparedDisplayRuns& line, int wrap_cols);
+
 // Expand tabs to the next tab stop and replace control characters with spaces,
 // producing text that renders with stable columns (a renderer may have no glyph
 // for tabs / control chars). `col` is the running display column; it is advanced
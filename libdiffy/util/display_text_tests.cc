@@ -195,6 +195,24 @@ TEST_CASE("wrap_display_runs: empty input yields one empty line") {
     CHECK(lines[0].empty());
 }
 
+TEST_CASE("wrap_prepared_runs: one prepared line rewraps at every width") {
+    std::vector<DisplayRun> runs{{"alpha be", 0x1, false}, {"ta g\xC3\xA4mma", 0x2, true}};
+    const PreparedDisplayRuns prepared = prepare_display_runs(runs);
+    CHECK(prepared.cp_run.size() == 16);  // 'ä' is one column
+
+    auto lines = wrap_prepared_runs(prepared, 10);
+    REQUIRE(lines.size() == 2);
+    REQUIRE(lines[0].size() == 2);
+    CHECK(lines[0][0].text == "alpha be");
+    CHECK(lines[0][1].text == "ta");
+    CHECK(lines[0][1].bold);
+    CHECK(line_text(lines[1]) == "g\xC3\xA4mma");
+
+    CHECK(wrap_prepared_runs(prepared, 6).size() == 3);
+    CHECK(wrap_prepared_runs(prepared, 0).size() == 1);
+    CHECK(line_text(wrap_prepared_runs(prepared, 40)[0]) == "alpha beta g\xC3\xA4mma");
+}
+
 TEST_CASE("ws_glyph_at: spaces and the ·/→ display glyphs count as whitespace") {
     CHECK(ws_glyph_at(" ", 0));             // plain space
     CHECK(ws_glyph_at("\xc2\xb7", 0));      // · middot (U+00B7)
@@ -0,0 +1,304 @@
+#pragma once
+
+/*
+    Minimal fork-join helpers.
+
+    parallel_for runs fn(i) for every i in [0, count) on a few worker threads and
+    waits for all of them. Work is handed out one index at a time, so uneven
+    items (one huge file among many small ones) still balance. Each index runs
+    exactly once; fn must only touch state owned by its index. The first
+    exception fn throws stops the handing out and is rethrown to the caller.
+
+    Parallel work started on a thread that is already running parallel_for
+    items runs inline (a directory diff's per-file renders and tree-sitter
+    passes), so nesting never takes more threads than the outer loop has.
+
+    parallel_for_ordered is parallel_for with a result per index that is handed
+    on strictly in index order, for output that must not depend on scheduling;
+    it runs only a few indices ahead of the one being handed on.
+    parallel_batches groups many cheap items (hunks) into runs worth a thread.
+
+    TaskGroup runs a handful of unrelated jobs (the tree-sitter passes) alongside
+    the calling thread, which keeps working until it needs their results.
+
+    WorkerPool keeps a few long-lived threads for jobs that outlive the caller's
+    stack frame (the async diff API).
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace diffy {
+
+// Worker count for `count` items: the hardware concurrency, capped by the item
+// count and by `max_threads` when non-zero. Always >= 1.
+inline std::size_t
+parallel_worker_count(std::size_t count, std::size_t max_threads = 0) {
+    std::size_t n = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    if (max_threads > 0) {
+        n = std::min(n, max_threads);
+    }
+    return std::max<std::size_t>(1, std::min(n, count));
+}
+
+// True while this thread runs parallel_for items (the calling thread included).
+inline thread_local bool on_parallel_worker = false;
+
+template <typename Fn>
+void
+parallel_for(std::size_t count, Fn&& fn, std::size_t max_threads = 0) {
+    const std::size_t workers = on_parallel_worker ? 1 : parallel_worker_count(count, max_threads);
+    if (workers <= 1) {
+        for (std::size_t i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+    std::atomic<std::size_t> next{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto work = [&] {
+        on_parallel_worker = true;
+        try {
+            for (std::size_t i = next++; i < count; i = next++) {
+                fn(i);
+            }
+        } catch (...) {
+            next = count;  // hand out nothing more
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        on_parallel_worker = false;
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (std::size_t t = 1; t < workers; t++) {
+        threads.emplace_back(work);
+    }
+    work();  // the calling thread is a worker too
+    for (auto& th : threads) {
+        th.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// produce(i) runs for every i on the workers as in parallel_for; consume(i,
+// result) then sees the results one at a time in increasing i, on whichever
+// worker completed the next index due. A result finished ahead of its turn is
+// held until then, and a worker doesn't start an index more than two per worker
+// ahead of the next one due, so a slow index or a slow consumer (a full pipe)
+// holds up production instead of letting finished results pile up.
+// An exception from either stops the loop and is rethrown to the caller.
+template <typename Produce, typename Consume>
+void
+parallel_for_ordered(std::size_t count, Produce&& produce, Consume&& consume, std::size_t max_threads = 0) {
+    using Result = std::invoke_result_t<Produce&, std::size_t>;
+    const std::size_t window = 2 * (on_parallel_worker ? 1 : parallel_worker_count(count, max_threads));
+    std::vector<std::optional<Result>> done(count);
+    std::mutex mutex;
+    std::condition_variable advanced;  // `next` moved on, or `failed` was set
+    std::size_t next = 0;
+    bool draining = false;
+    bool failed = false;
+    parallel_for(
+        count,
+        [&](std::size_t i) {
+            std::unique_lock<std::mutex> lock(mutex);
+            // Index `next` went to a worker that isn't waiting here, so this ends.
+            advanced.wait(lock, [&] { return failed || i < next + window; });
+            if (failed) {
+                return;  // parallel_for rethrows the error that set it
+            }
+            lock.unlock();
+            try {
+                Result result = produce(i);
+                lock.lock();
+                done[i].emplace(std::move(result));
+                if (draining) {
+                    return;  // the draining worker picks it up when its turn comes
+                }
+                draining = true;
+                while (next < count && done[next]) {
+                    Result ready = std::move(*done[next]);
+                    done[next].reset();
+                    const std::size_t k = next++;
+                    advanced.notify_all();
+                    lock.unlock();
+                    consume(k, std::move(ready));
+                    lock.lock();
+                }
+                draining = false;
+            } catch (...) {
+                if (!lock.owns_lock()) {
+                    lock.lock();
+                }
+                failed = true;
+                advanced.notify_all();
+                throw;
+            }
+        },
+        max_threads);
+}
+
+// Cut [0, count) into consecutive batches whose weight(i) adds up to about
+// `target` (at least one item each). Returns each batch's first index and then
+// `count`, so batch b is [bounds[b], bounds[b + 1]); a single batch means the
+// work isn't worth splitting.
+template <typename Weight>
+std::vector<std::size_t>
+parallel_batches(std::size_t count, Weight&& weight, std::size_t target) {
+    std::vector<std::size_t> bounds{0};
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i + 1 < count; i++) {
+        sum += weight(i);
+        if (sum >= target) {
+            bounds.push_back(i + 1);
+            sum = 0;
+        }
+    }
+    bounds.push_back(count);
+    return bounds;
+}
+
+// Each run() job gets its own thread (or runs inline on a single-core machine or
+// a parallel_for worker); wait() joins them all and rethrows the first exception
+// a job threw. The destructor waits too, so results a job writes must outlive
+// the group.
+class TaskGroup {
+   public:
+    TaskGroup() = default;
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    ~TaskGroup() {
+        join();
+    }
+
+    void
+    run(std::function<void()> job) {
+        if (std::thread::hardware_concurrency() <= 1 || on_parallel_worker) {
+            guarded(job);
+            return;
+        }
+        threads_.emplace_back([this, job = std::move(job)] { guarded(job); });
+    }
+
+    void
+    wait() {
+        join();
+        if (error_) {
+            std::rethrow_exception(std::exchange(error_, nullptr));
+        }
+    }
+
+   private:
+    void
+    guarded(const std::function<void()>& job) {
+        try {
+            job();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+    }
+
+    void
+    join() {
+        for (auto& t : threads_) {
+            t.join();
+        }
+        threads_.clear();
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::exception_ptr error_;
+};
+
+// Fixed-size pool fed from a FIFO queue. Jobs report their own results and
+// errors (through a promise, say); an exception escaping one is dropped. The
+// destructor lets the queued jobs finish, then joins.
+class WorkerPool {
+   public:
+    explicit WorkerPool(std::size_t threads) {
+        threads = std::max<std::size_t>(1, threads);
+        threads_.reserve(threads);
+        for (std::size_t i = 0; i < threads; i++) {
+            threads_.emplace_back([this] { work(); });
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    void
+    submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(job));
+        }
+        ready_.notify_one();
+    }
+
+    std::size_t
+    size() const {
+        return threads_.size();
+    }
+
+   private:
+    void
+    work() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    return;  // stopping, and nothing left to run
+                }
+                job = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            try {
+                job();
+            } catch (...) {
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace diffy
@@ -0,0 +1,180 @@
+#include <doctest.h>
+
+#include "util/parallel.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace diffy;
+
+TEST_CASE("parallel_for: runs every index exactly once") {
+    std::vector<std::atomic<int>> hits(1000);
+    parallel_for(hits.size(), [&](std::size_t i) { hits[i]++; });
+    for (const auto& h : hits) {
+        CHECK(h.load() == 1);
+    }
+}
+
+TEST_CASE("TaskGroup: jobs run alongside the caller and wait() joins them") {
+    std::vector<int> results(4, 0);
+    TaskGroup group;
+    for (int i = 0; i < 4; i++) {
+        group.run([&results, i] { results[static_cast<std::size_t>(i)] = i * i; });
+    }
+    group.wait();
+    CHECK(results == std::vector<int>{0, 1, 4, 9});
+
+    // A job's exception surfaces from wait(), after every job has finished.
+    std::atomic<int> finished{0};
+    group.run([] { throw std::runtime_error("job failed"); });
+    group.run([&] { finished++; });
+    bool threw = false;
+    try {
+        group.wait();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(finished.load() == 1);
+    group.wait();  // the error is reported once
+}
+
+TEST_CASE("WorkerPool: runs submitted jobs and drains the queue on destruction") {
+    std::atomic<int> done{0};
+    {
+        WorkerPool pool(2);
+        CHECK(pool.size() == 2);
+        pool.submit([] { throw std::runtime_error("dropped"); });  // doesn't take a worker down
+        for (int i = 0; i < 100; i++) {
+            pool.submit([&done] { done++; });
+        }
+    }
+    CHECK(done.load() == 100);
+}
+
+TEST_CASE("parallel_for_ordered: results are consumed once each, in index order") {
+    std::vector<size_t> order;
+    std::vector<size_t> values;
+    parallel_for_ordered(
+        500,
+        [](size_t i) {
+            if (i % 7 == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));  // finish out of order
+            }
+            return i * i;
+        },
+        [&](size_t i, size_t v) {
+            order.push_back(i);
+            values.push_back(v);
+        },
+        4);
+    REQUIRE(order.size() == 500);
+    for (size_t i = 0; i < order.size(); i++) {
+        CHECK(order[i] == i);
+        CHECK(values[i] == i * i);
+    }
+}
+
+TEST_CASE("parallel_for_ordered: a blocked consumer holds up production") {
+    // The first consume stalls (as a full pipe would); meanwhile the workers may
+    // only get two indices per worker ahead of the one due.
+    const size_t window = 2 * parallel_worker_count(200, 4);
+    std::atomic<size_t> consumed{0};
+    std::atomic<size_t> ahead{0};  // the most indices started past the consumed ones
+    parallel_for_ordered(
+        200,
+        [&](size_t i) {
+            const size_t lead = i - consumed.load();
+            size_t seen = ahead.load();
+            while (lead > seen && !ahead.compare_exchange_weak(seen, lead)) {
+            }
+            return i;
+        },
+        [&](size_t i, size_t) {
+            if (i == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            consumed++;
+        },
+        4);
+    CHECK(consumed.load() == 200);
+    CHECK(ahead.load() <= window);
+}
+
+TEST_CASE("parallel_batches: consecutive runs of about the target weight") {
+    const std::vector<size_t> weights = {5, 5, 1, 1, 1, 20, 2, 2};
+    const auto bounds = parallel_batches(weights.size(), [&](size_t i) { return weights[i]; }, 10);
+    CHECK(bounds == std::vector<size_t>{0, 2, 6, 8});
+
+    CHECK(parallel_batches(3, [](size_t) { return 1; }, 100) == std::vector<size_t>{0, 3});
+    CHECK(parallel_batches(0, [](size_t) { return 1; }, 100) == std::vector<size_t>{0, 0});
+    // One heavy item still makes a batch of its own.
+    CHECK(parallel_batches(3, [](size_t) { return 50; }, 10) == std::vector<size_t>{0, 1, 2, 3});
+}
+
+TEST_CASE("parallel_for: a worker's exception reaches the caller") {
+    std::atomic<int> ran{0};
+    bool threw = false;
+    try {
+        parallel_for(
+            1000,
+            [&](size_t i) {
+                ran++;
+                if (i == 3) {
+                    throw std::runtime_error("item failed");
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            },
+            4);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(ran.load() < 1000);  // nothing new was handed out after the throw
+
+    threw = false;
+    std::vector<size_t> consumed;
+    try {
+        parallel_for_ordered(
+            100,
+            [](size_t i) {
+                if (i == 50) {
+                    throw std::runtime_error("produce failed");
+                }
+                return i;
+            },
+            [&](size_t, size_t v) { consumed.push_back(v); }, 4);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(consumed.size() <= 50);
+}
+
+TEST_CASE("parallel_for: nested parallel work runs inline on the worker") {
+    std::vector<std::atomic<int>> foreign(8);
+    parallel_for(
+        foreign.size(),
+        [&](size_t i) {
+            const auto outer = std::this_thread::get_id();
+            parallel_for(16, [&](size_t) {
+                if (std::this_thread::get_id() != outer) {
+                    foreign[i]++;
+                }
+            });
+            TaskGroup group;
+            group.run([&] {
+                if (std::this_thread::get_id() != outer) {
+                    foreign[i]++;
+                }
+            });
+            group.wait();
+        },
+        4);
+    for (const auto& f : foreign) {
+        CHECK(f.load() == 0);
+    }
+}
@@ -1,7 +1,9 @@
 #include "readlines.hpp"
 
 #include "util/hash.hpp"
+#include "util/trace.hpp"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -119,6 +121,7 @@ diffy::Line
 make_line(uint32_t number, std::string display, bool ignore_whitespace) {
     diffy::Line ln;
     ln.line_number = number;
+    ln.meta = diffy::compute_line_info(display);
     if (ignore_whitespace) {
         ln.cmp_key = strip_whitespace(display);
         ln.has_cmp_key = true;
@@ -131,8 +134,43 @@ make_line(uint32_t number, std::string display, bool ignore_whitespace) {
 }
 };  // namespace
 
+diffy::LineInfo
+diffy::compute_line_info(const std::string& s) {
+    LineInfo info;
+    info.valid = true;
+    info.blank = true;
+    int indent = 0;
+    uint32_t nonws = 0;
+    for (char ch : s) {
+        const auto c = static_cast<unsigned char>(ch);
+        if (is_ws(ch)) {
+            if (info.blank && indent < LineInfo::kMaxIndent) {
+                // Leading whitespace: tab to the next multiple of 8, anything else one column.
+                indent += (ch == '\t') ? 8 - indent % 8 : 1;
+            }
+            continue;
+        }
+        // A control character ends the indent and makes the line non-blank (as the
+        // indent heuristic always had it) but, as in the move pass, isn't counted as
+        // visible text.
+        info.blank = false;
+        if (c > ' ') {
+            ++nonws;
+            info.content = info.content || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+                           (c >= 'a' && c <= 'z') || c == '_' || c > 0x7F;
+        }
+    }
+    // git's get_indent gives up at MAX_INDENT before it can tell that a line is
+    // blank, so whitespace that reaches the cap still counts as that indent.
+    const bool capped = indent >= LineInfo::kMaxIndent;
+    info.indent = static_cast<uint8_t>(capped ? LineInfo::kMaxIndent : info.blank ? 0 : indent);
+    info.nonws = static_cast<uint16_t>(std::min<uint32_t>(nonws, 0xFFFF));
+    return info;
+}
+
 std::vector<diffy::Line>
 diffy::readlines(const std::string& path, bool ignore_line_endings, bool ignore_whitespace) {
+    DIFFY_TRACE_SCOPE("readlines");
     std::vector<diffy::Line> lines;
 
     char* line = nullptr;
@@ -165,6 +203,7 @@ diffy::readlines(const std::string& path, bool ignore_line_endings, bool ignore_
 std::vector<diffy::Line>
 diffy::readlines_from_string(const std::string& content, bool ignore_line_endings,
                              bool ignore_whitespace) {
+    DIFFY_TRACE_SCOPE("readlines");
     std::vector<diffy::Line> lines;
 
     uint32_t i = 1;
@@ -9,6 +9,24 @@
 
 namespace diffy {
 
+// Per-line facts that several stages need — the indent heuristic's indent/blank
+// scan, blank-line merging after the diff, the move-detection content gate — taken
+// in one pass when the line is read so no stage rescans its bytes.
+struct LineInfo {
+    static constexpr int kMaxIndent = 200;  // git's MAX_INDENT; wider indents clamp
+
+    // Visual indent (spaces=1, tab to next multiple of 8), clamped. 0 on a blank
+    // line, unless its whitespace alone reaches kMaxIndent.
+    uint8_t indent = 0;
+    bool valid = false;    // set by compute_line_info(); false on a hand-built Line
+    bool blank = false;    // only whitespace (or nothing): " \t\r\n\f\v"
+    bool content = false;  // has an identifier/literal byte: alnum, '_' or non-ASCII
+    uint16_t nonws = 0;    // bytes above ' ' (not controls), saturating at 65535
+};
+
+LineInfo
+compute_line_info(const std::string& s);
+
 struct Line {
     uint32_t line_number;
     uint32_t checksum;
@@ -21,6 +39,15 @@ struct Line {
     std::string cmp_key;
     bool has_cmp_key = false;
 
+    // Filled by readlines; sits in the padding after has_cmp_key, so it is free.
+    LineInfo meta;
+
+    // The line's metadata, computed on the spot for Lines not built by readlines.
+    LineInfo
+    info() const {
+        return meta.valid ? meta : compute_line_info(line);
+    }
+
     uint32_t
     hash() const {
         return checksum;
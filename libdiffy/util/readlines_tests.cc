@@ -148,3 +148,49 @@ TEST_CASE("readlines ignore_whitespace") {
         CHECK_FALSE(a[0] == c[0]);  // real content difference -> not equal
     }
 }
+
+TEST_CASE("readlines fills per-line metadata") {
+    auto lines = readlines_from_string("    int x;\n\t\ty = 1;\n   \t\n});\n", false);
+    REQUIRE(lines.size() == 4);
+    for (const auto& l : lines) {
+        CHECK(l.meta.valid);
+    }
+    CHECK(lines[0].meta.indent == 4);
+    CHECK(lines[0].meta.content);
+    CHECK(lines[0].meta.nonws == 5);
+    CHECK(lines[1].meta.indent == 16);  // two tabs
+    CHECK_FALSE(lines[1].meta.blank);
+    CHECK(lines[2].meta.blank);
+    CHECK_FALSE(lines[2].meta.content);
+    CHECK_FALSE(lines[3].meta.content);  // brackets only
+    CHECK(lines[3].meta.nonws == 3);
+
+    // A hand-built Line has no metadata; info() computes the same answer.
+    Line bare{1, 0, "    int x;\n"};
+    CHECK_FALSE(bare.meta.valid);
+    CHECK(bare.info().indent == lines[0].meta.indent);
+    CHECK(bare.info().nonws == lines[0].meta.nonws);
+
+    // Deep indents clamp like the indent heuristic's MAX_INDENT.
+    CHECK(compute_line_info(std::string(300, ' ') + "x").indent == LineInfo::kMaxIndent);
+    // A blank line is indent 0, unless its whitespace alone reaches the cap: git's
+    // get_indent stops there and reports MAX_INDENT, not blank, and so do we.
+    CHECK(compute_line_info("   \n").indent == 0);
+    const LineInfo wide = compute_line_info(std::string(300, ' ') + "\n");
+    CHECK(wide.blank);
+    CHECK(wide.indent == LineInfo::kMaxIndent);
+    CHECK(compute_line_info(std::string(25, '\t') + "\n").indent == LineInfo::kMaxIndent);
+    CHECK(compute_line_info(std::string(150, ' ') + "\n").indent == 0);
+
+    // Control characters: they end the indent and the line isn't blank (the indent
+    // heuristic's rule), but they aren't counted as visible text (the move pass's).
+    const LineInfo esc = compute_line_info("  \x1b[0m\n");
+    CHECK(esc.indent == 2);
+    CHECK_FALSE(esc.blank);
+    CHECK(esc.nonws == 3);
+    const LineInfo ctl = compute_line_info(std::string("\x01\x00 \x7f\n", 5));
+    CHECK(ctl.indent == 0);
+    CHECK_FALSE(ctl.blank);
+    CHECK_FALSE(ctl.content);
+    CHECK(ctl.nonws == 1);  // only DEL (0x7f) is above ' '
+}
@@ -0,0 +1,318 @@
+#include "sgr.hpp"
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <vector>
+
+namespace diffy {
+
+namespace {
+
+constexpr uint16_t
+attr_bit(int code) {
+    return static_cast<uint16_t>(1u << code);
+}
+
+// Attribute codes in the order they're written, and the code that clears each
+// group (22 clears both bold and dim).
+constexpr std::array<int, 8> kAttrCodes = {1, 2, 3, 4, 5, 7, 8, 9};
+
+struct AttrOff {
+    int code;
+    uint16_t bits;
+};
+
+constexpr std::array<AttrOff, 7> kAttrOff = {{
+    {22, attr_bit(1) | attr_bit(2)},
+    {23, attr_bit(3)},
+    {24, attr_bit(4)},
+    {25, attr_bit(5)},
+    {27, attr_bit(7)},
+    {28, attr_bit(8)},
+    {29, attr_bit(9)},
+}};
+
+// SGR parameters under construction; big enough for any transition.
+struct Params {
+    std::array<char, 128> data;
+    std::size_t size = 0;
+
+    void
+    add(int code) {
+        if (size > 0) {
+            data[size++] = ';';
+        }
+        const auto r = std::to_chars(data.data() + size, data.data() + data.size(), code);
+        size = static_cast<std::size_t>(r.ptr - data.data());
+    }
+
+    void
+    add_color(const SgrColor& color, bool fg) {
+        switch (color.kind) {
+            case SgrColor::Kind::Default:
+                add(fg ? 39 : 49);
+                break;
+            case SgrColor::Kind::Basic:
+                add(color.a);
+                break;
+            case SgrColor::Kind::Palette:
+                add(fg ? 38 : 48);
+                add(5);
+                add(color.a);
+                break;
+            case SgrColor::Kind::Rgb:
+                add(fg ? 38 : 48);
+                add(2);
+                add(color.a);
+                add(color.g);
+                add(color.b);
+                break;
+        }
+    }
+
+    void
+    write(std::string& out) const {
+        out += "\033[";
+        out.append(data.data(), size);
+        out += 'm';
+    }
+};
+
+// "0" followed by everything that differs from the default in `to`.
+Params
+reset_params(const SgrState& to) {
+    Params p;
+    p.add(0);
+    for (const int code : kAttrCodes) {
+        if (to.attrs & attr_bit(code)) {
+            p.add(code);
+        }
+    }
+    if (to.fg.kind != SgrColor::Kind::Default) {
+        p.add_color(to.fg, true);
+    }
+    if (to.bg.kind != SgrColor::Kind::Default) {
+        p.add_color(to.bg, false);
+    }
+    return p;
+}
+
+// The extended-colour tail after a 38/48: "5;n" or "2;r;g;b".
+bool
+parse_extended_color(const std::vector<int>& codes, std::size_t& k, SgrColor& color) {
+    if (k + 2 < codes.size() && codes[k + 1] == 5 && codes[k + 2] <= 255) {
+        color = {SgrColor::Kind::Palette, static_cast<uint8_t>(codes[k + 2]), 0, 0};
+        k += 2;
+        return true;
+    }
+    if (k + 4 < codes.size() && codes[k + 1] == 2 && codes[k + 2] <= 255 && codes[k + 3] <= 255 &&
+        codes[k + 4] <= 255) {
+        color = {SgrColor::Kind::Rgb, static_cast<uint8_t>(codes[k + 2]), static_cast<uint8_t>(codes[k + 3]),
+                 static_cast<uint8_t>(codes[k + 4])};
+        k += 4;
+        return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+std::optional<SgrDelta>
+SgrDelta::parse(std::string_view escapes) {
+    SgrDelta delta;
+    std::vector<int> codes;
+    std::size_t i = 0;
+    while (i < escapes.size()) {
+        if (escapes.size() - i < 3 || escapes[i] != '\033' || escapes[i + 1] != '[') {
+            return std::nullopt;
+        }
+        i += 2;
+        codes.clear();
+        int code = 0;
+        for (;; i++) {
+            if (i == escapes.size()) {
+                return std::nullopt;
+            }
+            const char c = escapes[i];
+            if (c >= '0' && c <= '9') {
+                code = code * 10 + (c - '0');
+                if (code > 9999) {
+                    return std::nullopt;
+                }
+            } else if (c == ';' || c == 'm') {
+                codes.push_back(code);  // an empty parameter means 0
+                code = 0;
+                if (c == 'm') {
+                    i++;
+                    break;
+                }
+            } else {
+                return std::nullopt;
+            }
+        }
+
+        for (std::size_t k = 0; k < codes.size(); k++) {
+            const int c = codes[k];
+            if (c == 0) {
+                delta = SgrDelta{};
+                delta.reset = true;
+            } else if (c >= 1 && c <= 9 && c != 6) {
+                delta.attrs_on |= attr_bit(c);
+                delta.attrs_off &= static_cast<uint16_t>(~attr_bit(c));
+            } else if ((c >= 30 && c <= 37) || (c >= 90 && c <= 97)) {
+                delta.sets_fg = true;
+                delta.fg = {SgrColor::Kind::Basic, static_cast<uint8_t>(c), 0, 0};
+            } else if (c == 39) {
+                delta.sets_fg = true;
+                delta.fg = {};
+            } else if ((c >= 40 && c <= 47) || (c >= 100 && c <= 107)) {
+                delta.sets_bg = true;
+                delta.bg = {SgrColor::Kind::Basic, static_cast<uint8_t>(c), 0, 0};
+            } else if (c == 49) {
+                delta.sets_bg = true;
+                delta.bg = {};
+            } else if (c == 38 || c == 48) {
+                SgrColor color;
+                if (!parse_extended_color(codes, k, color)) {
+                    return std::nullopt;
+                }
+                (c == 38 ? delta.sets_fg : delta.sets_bg) = true;
+                (c == 38 ? delta.fg : delta.bg) = color;
+            } else {
+                bool known = false;
+                for (const auto& off : kAttrOff) {
+                    if (off.code == c) {
+                        delta.attrs_off |= off.bits;
+                        delta.attrs_on &= static_cast<uint16_t>(~off.bits);
+                        known = true;
+                    }
+                }
+                if (!known) {
+                    return std::nullopt;
+                }
+            }
+        }
+    }
+    return delta;
+}
+
+SgrDelta
+SgrDelta::then(const SgrDelta& next) const {
+    if (next.reset) {
+        return next;
+    }
+    SgrDelta out = *this;
+    if (next.sets_fg) {
+        out.sets_fg = true;
+        out.fg = next.fg;
+    }
+    if (next.sets_bg) {
+        out.sets_bg = true;
+        out.bg = next.bg;
+    }
+    out.attrs_on = static_cast<uint16_t>((attrs_on & ~next.attrs_off) | next.attrs_on);
+    out.attrs_off = static_cast<uint16_t>((attrs_off & ~next.attrs_on) | next.attrs_off);
+    return out;
+}
+
+SgrState
+SgrDelta::apply(SgrState state) const {
+    if (reset) {
+        state = SgrState{};
+    }
+    if (sets_fg) {
+        state.fg = fg;
+    }
+    if (sets_bg) {
+        state.bg = bg;
+    }
+    state.attrs = static_cast<uint16_t>((state.attrs & ~attrs_off) | attrs_on);
+    return state;
+}
+
+void
+sgr_transition(std::string& out, const SgrState& from, const SgrState& to) {
+    if (from == to) {
+        return;
+    }
+
+    Params step;
+    uint16_t attrs = from.attrs;
+    const uint16_t cleared = static_cast<uint16_t>(from.attrs & ~to.attrs);
+    for (const auto& off : kAttrOff) {
+        if (cleared & off.bits) {
+            step.add(off.code);
+            attrs = static_cast<uint16_t>(attrs & ~off.bits);
+        }
+    }
+    for (const int code : kAttrCodes) {
+        if ((to.attrs & attr_bit(code)) && !(attrs & attr_bit(code))) {
+            step.add(code);
+        }
+    }
+    if (!(from.fg == to.fg)) {
+        step.add_color(to.fg, true);
+    }
+    if (!(from.bg == to.bg)) {
+        step.add_color(to.bg, false);
+    }
+
+    const Params reset = reset_params(to);
+    (reset.size < step.size ? reset : step).write(out);
+}
+
+void
+SgrWriter::set(std::string& out, std::initializer_list<std::string_view> layers) {
+    SgrDelta delta;
+    for (const auto layer : layers) {
+        if (layer.empty()) {
+            continue;
+        }
+        const auto& parsed = lookup(layer);
+        if (!parsed) {
+            // Not something we can track: reset, then replay the layers as-is.
+            reset(out);
+            for (const auto l : layers) {
+                out += l;
+            }
+            known_ = false;
+            return;
+        }
+        delta = delta.then(*parsed);
+    }
+
+    const SgrState target = delta.apply(SgrState{});
+    if (!known_) {
+        reset_params(target).write(out);
+        known_ = true;
+    } else {
+        sgr_transition(out, state_, target);
+    }
+    state_ = target;
+}
+
+void
+SgrWriter::reset(std::string& out) {
+    if (!known_ || !(state_ == SgrState{})) {
+        out += "\033[0m";
+    }
+    state_ = SgrState{};
+    known_ = true;
+}
+
+const std::optional<SgrDelta>&
+SgrWriter::lookup(std::string_view layer) {
+    for (const auto& [key, parsed] : cache_) {
+        if (key.data() == layer.data() && key.size() == layer.size()) {
+            return parsed;
+        }
+    }
+    if (cache_.size() >= 64) {
+        cache_.clear();  // only reached by callers passing transient layers
+    }
+    cache_.emplace_back(layer, SgrDelta::parse(layer));
+    return cache_.back().second;
+}
+
+}  // namespace diffy
@@ -0,0 +1,123 @@
+#pragma once
+
+/*
+    Terminal style (SGR) state tracking for the ANSI renderers.
+
+    Theme styles are opaque escape strings layered on top of each other
+    (background, then line tint, then token, then syntax foreground). Writing
+    every layer plus a reset for every cell is correct but mostly redundant:
+    neighbouring cells usually share all but one attribute, or all of them.
+    SgrWriter folds each cell's layers into the state the terminal would end up
+    in, and emits only the codes that move the terminal from where it is to
+    there — nothing at all when the state doesn't change.
+*/
+
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace diffy {
+
+// One colour slot (foreground or background).
+struct SgrColor {
+    enum class Kind : uint8_t {
+        Default,  // 39 / 49
+        Basic,    // a single code: 30-37, 90-97 (fg) or 40-47, 100-107 (bg)
+        Palette,  // 38;5;n / 48;5;n
+        Rgb,      // 38;2;r;g;b / 48;2;r;g;b
+    };
+
+    Kind kind = Kind::Default;
+    uint8_t a = 0;  // Basic: the code; Palette: the index; Rgb: red
+    uint8_t g = 0;
+    uint8_t b = 0;
+
+    bool
+    operator==(const SgrColor& other) const {
+        return kind == other.kind && a == other.a && g == other.g && b == other.b;
+    }
+};
+
+// What a terminal's current text attributes are. Attribute bit n is SGR code
+// n (1 bold, 2 dim, 3 italic, 4 underline, 5 blink, 7 inverse, 8 hidden,
+// 9 strikethrough).
+struct SgrState {
+    SgrColor fg;
+    SgrColor bg;
+    uint16_t attrs = 0;
+
+    bool
+    operator==(const SgrState& other) const {
+        return fg == other.fg && bg == other.bg && attrs == other.attrs;
+    }
+};
+
+// The net effect of a run of SGR escapes: an optional full reset, followed by
+// the colours and attributes it sets or clears.
+struct SgrDelta {
+    bool reset = false;
+    bool sets_fg = false;
+    bool sets_bg = false;
+    SgrColor fg;
+    SgrColor bg;
+    uint16_t attrs_on = 0;
+    uint16_t attrs_off = 0;
+
+    // Parse a string of CSI ... m sequences. Returns nullopt for anything else
+    // (other escapes, text, or SGR codes the state machine doesn't model).
+    static std::optional<SgrDelta>
+    parse(std::string_view escapes);
+
+    // `this`, followed by `next`.
+    SgrDelta
+    then(const SgrDelta& next) const;
+
+    SgrState
+    apply(SgrState state) const;
+};
+
+// Write the SGR sequence that moves a terminal from `from` to `to` (nothing if
+// they're equal): either the individual changes, or a reset followed by `to`,
+// whichever is shorter.
+void
+sgr_transition(std::string& out, const SgrState& from, const SgrState& to);
+
+// Tracks the style a stream of cells has left the terminal in.
+//
+// Layers are parsed on first sight and cached by address, so they must stay
+// put for the writer's lifetime (theme strings, the syntax escape table). A
+// layer the state machine can't parse is written verbatim after a reset, and
+// the state is then treated as unknown until the next reset.
+class SgrWriter {
+   public:
+    // Put the terminal in the state of `layers` applied, in order, to the
+    // default style. Empty layers are skipped; no layers means the default.
+    void
+    set(std::string& out, std::initializer_list<std::string_view> layers);
+
+    // Back to the default style; call at the end of each row so rows stand on
+    // their own.
+    void
+    reset(std::string& out);
+
+    // `out` just received text carrying escapes of its own (e.g. a pre-styled
+    // header). Forget what the terminal's style is.
+    void
+    invalidate() {
+        known_ = false;
+    }
+
+   private:
+    const std::optional<SgrDelta>&
+    lookup(std::string_view layer);
+
+    SgrState state_;
+    bool known_ = true;
+    std::vector<std::pair<std::string_view, std::optional<SgrDelta>>> cache_;
+};
+
+}  // namespace diffy
@@ -0,0 +1,122 @@
+#include <doctest.h>
+
+#include "highlight/highlight_palette.hpp"
+#include "util/sgr.hpp"
+
+#include <string>
+
+using namespace diffy;
+
+namespace {
+
+SgrState
+state_of(const std::string& escapes) {
+    auto delta = SgrDelta::parse(escapes);
+    REQUIRE(delta.has_value());
+    return delta->apply(SgrState{});
+}
+
+}  // namespace
+
+TEST_CASE("SgrDelta::parse folds a run of escapes into one state") {
+    const SgrState s = state_of("\033[97;4m\033[48;5;52m\033[1m\033[38;2;1;2;3m");
+    CHECK(s.fg == SgrColor{SgrColor::Kind::Rgb, 1, 2, 3});
+    CHECK(s.bg == SgrColor{SgrColor::Kind::Palette, 52, 0, 0});
+    CHECK(s.attrs == ((1 << 1) | (1 << 4)));
+
+    // A reset part-way drops everything before it; 22 clears bold and dim.
+    CHECK(state_of("\033[1;2;31m\033[0;44m") == state_of("\033[44m"));
+    CHECK(state_of("\033[1;2m\033[22m") == SgrState{});
+    CHECK(state_of("\033[m") == SgrState{});
+    CHECK(state_of("") == SgrState{});
+
+    CHECK_FALSE(SgrDelta::parse("plain").has_value());
+    CHECK_FALSE(SgrDelta::parse("\033[2J").has_value());      // not SGR
+    CHECK_FALSE(SgrDelta::parse("\033[53m").has_value());     // overline: not modelled
+    CHECK_FALSE(SgrDelta::parse("\033[38;5m").has_value());   // truncated colour
+    CHECK_FALSE(SgrDelta::parse("\033[38;2;300;0;0m").has_value());
+}
+
+TEST_CASE("SgrDelta::then layers like the terminal does") {
+    const auto base = *SgrDelta::parse("\033[97;48;5;22m");
+    const auto token = *SgrDelta::parse("\033[1;38;5;28m");
+    const auto plain = *SgrDelta::parse("\033[22;39m");
+    CHECK(base.then(token).apply({}) == state_of("\033[97;48;5;22m\033[1;38;5;28m"));
+    CHECK(base.then(token).then(plain).apply({}) == state_of("\033[48;5;22m"));
+}
+
+TEST_CASE("sgr_transition writes only what changed, or a shorter reset") {
+    std::string out;
+    sgr_transition(out, state_of("\033[1;31m"), state_of("\033[1;31m"));
+    CHECK(out.empty());
+
+    sgr_transition(out, state_of("\033[1;31;44m"), state_of("\033[1;32;44m"));
+    CHECK(out == "\033[32m");
+
+    out.clear();
+    sgr_transition(out, state_of("\033[1;2;31m"), state_of("\033[2;31m"));
+    CHECK(out == "\033[22;2m");  // 22 clears dim too, so it's put back
+
+    out.clear();
+    sgr_transition(out, state_of("\033[1;4;38;2;10;20;30;48;5;1m"), SgrState{});
+    CHECK(out == "\033[0m");
+}
+
+TEST_CASE("SgrWriter: cells sharing a style emit it once") {
+    const std::string line = "\033[48;5;22m";
+    const std::string token = "\033[1m";
+    std::string out;
+    SgrWriter sgr;
+    sgr.set(out, {line});
+    out += "a";
+    sgr.set(out, {line});
+    out += "b";
+    sgr.set(out, {line, token});
+    out += "c";
+    sgr.set(out, {"", line});
+    out += "d";
+    sgr.reset(out);
+    CHECK(out == "\033[48;5;22mab\033[1mc\033[22md\033[0m");
+
+    // Nothing styled, nothing written.
+    out.clear();
+    sgr.set(out, {"", ""});
+    out += "x";
+    sgr.reset(out);
+    CHECK(out == "x");
+}
+
+TEST_CASE("SgrWriter: untracked escapes are replayed verbatim") {
+    const std::string odd = "\033[53m";  // overline
+    const std::string bg = "\033[44m";
+    std::string out;
+    SgrWriter sgr;
+    sgr.set(out, {bg});
+    sgr.set(out, {odd});
+    out += "x";
+    sgr.set(out, {bg});
+    out += "y";
+    sgr.reset(out);
+    CHECK(out == "\033[44m\033[0m\033[53mx\033[0;44my\033[0m");
+
+    // Text that carried its own escapes leaves the state unknown.
+    out.clear();
+    sgr.set(out, {bg});
+    out += "\033[31mhdr\033[0m";
+    sgr.invalidate();
+    sgr.set(out, {bg});
+    CHECK(out == "\033[44m\033[31mhdr\033[0m\033[0;44m");
+}
+
+TEST_CASE("syntax_fg_escape matches syntax_color and follows overrides") {
+    const HlRgb c = syntax_color(HighlightGroup::String, false);
+    CHECK(syntax_fg_escape(HighlightGroup::String, false) ==
+          "\033[38;2;" + std::to_string(c.r) + ";" + std::to_string(c.g) + ";" + std::to_string(c.b) + "m");
+    CHECK(syntax_fg_escape(HighlightGroup::None, true).empty());
+
+    set_syntax_color_override(HighlightGroup::String, HlRgb{1, 2, 3});
+    CHECK(syntax_fg_escape(HighlightGroup::String, true) == "\033[38;2;1;2;3m");
+    clear_syntax_overrides();
+    CHECK(syntax_fg_escape(HighlightGroup::String, false) ==
+          "\033[38;2;" + std::to_string(c.r) + ";" + std::to_string(c.g) + ";" + std::to_string(c.b) + "m");
+}
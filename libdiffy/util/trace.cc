@@ -0,0 +1,220 @@
+#include "util/trace.hpp"
+
+#ifdef DIFFY_ENABLE_TRACE
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace diffy {
+
+namespace {
+
+constexpr std::array<const char*, static_cast<size_t>(TraceCounter::kCount)> kCounterNames = {
+    "diff.edit_distance", "diff.snakes", "diff.greedy_to_linear", "diff.patience_to_myers", "annotate.hunks",
+};
+
+struct TraceEvent {
+    const char* name;
+    int64_t start_ns;
+    int64_t duration_ns;
+    int tid;
+};
+
+// Each thread records into its own buffer, so scopes on different workers never
+// contend; the lock is only shared with a reader merging the buffers.
+struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    int tid = 0;  // small, stable id for the trace viewer
+};
+
+struct TraceState {
+    std::mutex mutex;                                   // guards `buffers`
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;  // outlive their threads
+    std::array<std::atomic<int64_t>, static_cast<size_t>(TraceCounter::kCount)> counters{};
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+TraceState&
+state() {
+    static TraceState s;
+    return s;
+}
+
+ThreadBuffer&
+thread_buffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        auto& s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = s.buffers.back().get();
+        buffer->tid = static_cast<int>(s.buffers.size());
+    }
+    return *buffer;
+}
+
+// Every thread's events so far, merged in start order.
+std::vector<TraceEvent>
+collect_events() {
+    auto& s = state();
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (const auto& buffer : s.buffers) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            events.insert(events.end(), buffer->events.begin(), buffer->events.end());
+        }
+    }
+    std::sort(events.begin(), events.end(),
+              [](const TraceEvent& a, const TraceEvent& b) { return a.start_ns < b.start_ns; });
+    return events;
+}
+
+int64_t
+now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - state().epoch)
+        .count();
+}
+
+}  // namespace
+
+bool detail::trace_on = false;
+
+void
+detail::trace_add(TraceCounter counter, int64_t n) {
+    state().counters[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+}
+
+void
+trace_enable() {
+    state();  // fix the epoch
+    detail::trace_on = true;
+}
+
+bool
+trace_enabled() {
+    return detail::trace_on;
+}
+
+TraceScope::TraceScope(const char* name) : name_(name) {
+    if (detail::trace_on) {
+        start_ns_ = now_ns();
+    }
+}
+
+TraceScope::~TraceScope() {
+    // A scope opened before trace_enable() has no start; timing it from 0 would
+    // charge it the whole run.
+    if (!detail::trace_on || start_ns_ < 0) {
+        return;
+    }
+    const int64_t end_ns = now_ns();
+    ThreadBuffer& buffer = thread_buffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.events.push_back({name_, start_ns_, end_ns - start_ns_, buffer.tid});
+}
+
+std::string
+trace_stats_table() {
+    struct Row {
+        int64_t calls = 0;
+        int64_t total_ns = 0;
+        int64_t max_ns = 0;
+        int64_t first_ns = 0;
+    };
+    auto& s = state();
+    std::map<std::string, Row> by_name;
+    for (const auto& e : collect_events()) {
+        auto [it, inserted] = by_name.try_emplace(e.name);
+        Row& r = it->second;
+        if (inserted || e.start_ns < r.first_ns) {
+            r.first_ns = e.start_ns;
+        }
+        r.calls++;
+        r.total_ns += e.duration_ns;
+        r.max_ns = std::max(r.max_ns, e.duration_ns);
+    }
+    std::vector<std::pair<std::string, Row>> rows(by_name.begin(), by_name.end());
+    // Pipeline order reads better than alphabetical.
+    std::sort(rows.begin(), rows.end(),
+              [](const auto& a, const auto& b) { return a.second.first_ns < b.second.first_ns; });
+
+    std::string out = fmt::format("{:<28} {:>8} {:>12} {:>12}\n", "stage", "calls", "total ms", "max ms");
+    for (const auto& [name, r] : rows) {
+        out += fmt::format("{:<28} {:>8} {:>12.3f} {:>12.3f}\n", name, r.calls, r.total_ns / 1e6, r.max_ns / 1e6);
+    }
+    for (size_t i = 0; i < kCounterNames.size(); i++) {
+        const int64_t v = s.counters[i].load(std::memory_order_relaxed);
+        if (v != 0) {
+            out += fmt::format("{:<28} {:>8}\n", kCounterNames[i], v);
+        }
+    }
+    return out;
+}
+
+bool
+trace_write_chrome(const std::string& path) {
+    auto& s = state();
+    nlohmann::json events = nlohmann::json::array();
+    int64_t end_ns = 0;
+    for (const auto& e : collect_events()) {
+        events.push_back({{"name", e.name},
+                          {"cat", "diffy"},
+                          {"ph", "X"},
+                          {"ts", e.start_ns / 1000.0},
+                          {"dur", e.duration_ns / 1000.0},
+                          {"pid", 1},
+                          {"tid", e.tid}});
+        end_ns = std::max(end_ns, e.start_ns + e.duration_ns);
+    }
+    for (size_t i = 0; i < kCounterNames.size(); i++) {
+        events.push_back({{"name", kCounterNames[i]},
+                          {"ph", "C"},
+                          {"ts", end_ns / 1000.0},
+                          {"pid", 1},
+                          {"args", {{"value", s.counters[i].load(std::memory_order_relaxed)}}}});
+    }
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f << nlohmann::json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}}.dump();
+    return static_cast<bool>(f);
+}
+
+}  // namespace diffy
+
+#else
+
+namespace diffy {
+
+void
+trace_enable() {
+}
+
+bool
+trace_enabled() {
+    return false;
+}
+
+std::string
+trace_stats_table() {
+    return "diffy was built without DIFFY_ENABLE_TRACE; no stats recorded\n";
+}
+
+bool
+trace_write_chrome(const std::string&) {
+    return false;
+}
+
+}  // namespace diffy
+
+#endif
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+    Hot-path instrumentation: named, timed scopes around the pipeline stages and
+    a few algorithm counters. Both are recorded only after trace_enable() — the
+    CLI's --stats prints the per-stage table, DIFFY_TRACE=<file> writes Chrome
+    trace-event JSON (chrome://tracing, Perfetto).
+
+    Built without DIFFY_ENABLE_TRACE, the DIFFY_TRACE_* macros expand to nothing
+    and the functions below are inert stubs, so instrumented code costs nothing.
+*/
+
+#include <cstdint>
+#include <string>
+
+namespace diffy {
+
+// Algorithm counters summed over a run, from the line-level diff only (see
+// Algorithm::trace_counters). Keep trace.cc's names in step.
+enum class TraceCounter {
+    DiffEditDistance,   // edits in the line diff's script, any algorithm
+    DiffSnakes,         // middle snakes found by linear-space Myers
+    GreedyToLinear,     // greedy Myers traces over budget, redone linear-space
+    PatienceToMyers,    // patience slices without a unique anchor, sent to Myers
+    AnnotatedHunks,     // hunks tokenized and intra-line diffed
+    kCount,
+};
+
+// Start recording (process-wide). Scopes opened before this aren't recorded.
+void
+trace_enable();
+
+bool
+trace_enabled();
+
+// Per-stage calls, total and max wall time, then the counters; for stderr.
+std::string
+trace_stats_table();
+
+// Every recorded scope as a Chrome "complete" event plus the counters. Returns
+// false if the file couldn't be written.
+bool
+trace_write_chrome(const std::string& path);
+
+#ifdef DIFFY_ENABLE_TRACE
+
+namespace detail {
+
+extern bool trace_on;  // written once by trace_enable(), before any worker starts
+
+void
+trace_add(TraceCounter counter, int64_t n);
+
+}  // namespace detail
+
+// Times its lifetime as one event named `name` (a string literal).
+class TraceScope {
+   public:
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+   private:
+    const char* name_;
+    int64_t start_ns_ = -1;  // -1: opened before trace_enable(), not recorded
+};
+
+#define DIFFY_TRACE_CAT2(a, b) a##b
+#define DIFFY_TRACE_CAT(a, b) DIFFY_TRACE_CAT2(a, b)
+#define DIFFY_TRACE_SCOPE(name) ::diffy::TraceScope DIFFY_TRACE_CAT(diffy_trace_scope_, __LINE__)(name)
+#define DIFFY_TRACE_COUNT(counter, n)                                                 \
+    do {                                                                              \
+        if (::diffy::detail::trace_on) {                                              \
+            ::diffy::detail::trace_add(::diffy::TraceCounter::counter, (n));          \
+        }                                                                             \
+    } while (0)
+
+#else
+
+#define DIFFY_TRACE_SCOPE(name) \
+    do {                        \
+    } while (0)
+#define DIFFY_TRACE_COUNT(counter, n) \
+    do {                              \
+    } while (0)
+
+#endif
+
+}  // namespace diffy
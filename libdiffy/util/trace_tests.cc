@@ -0,0 +1,104 @@
+#include <doctest.h>
+
+#include "render/diff_pipeline.hpp"
+#include "util/trace.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace diffy;
+
+#ifdef DIFFY_ENABLE_TRACE
+
+namespace {
+
+// A counter's row in trace_stats_table(); 0 while it has none.
+int64_t
+counter_value(const std::string& name) {
+    const std::string table = trace_stats_table();
+    const size_t row = table.find(name + " ");
+    if (row == std::string::npos) {
+        return 0;
+    }
+    std::istringstream fields(table.substr(row + name.size()));
+    int64_t v = 0;
+    fields >> v;
+    return v;
+}
+
+}  // namespace
+
+TEST_CASE("trace: scopes and counters show up in the table and the Chrome trace") {
+    trace_enable();
+    REQUIRE(trace_enabled());
+    {
+        DIFFY_TRACE_SCOPE("trace_test.stage");
+        DIFFY_TRACE_COUNT(PatienceToMyers, 2);
+    }
+    const std::string table = trace_stats_table();
+    CHECK(table.find("trace_test.stage") != std::string::npos);
+    CHECK(table.find("diff.patience_to_myers") != std::string::npos);
+
+    const auto path = std::filesystem::temp_directory_path() / "diffy_trace_test.json";
+    REQUIRE(trace_write_chrome(path.string()));
+    std::ifstream f(path);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    CHECK(ss.str().rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+    CHECK(ss.str().find("\"name\":\"trace_test.stage\"") != std::string::npos);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("trace: a scope opened before trace_enable() is not recorded") {
+    detail::trace_on = false;  // as if tracing hadn't started yet
+    {
+        DIFFY_TRACE_SCOPE("trace_test.opened_early");
+        trace_enable();
+    }
+    CHECK(trace_stats_table().find("trace_test.opened_early") == std::string::npos);
+}
+
+TEST_CASE("trace: scopes from several threads are merged") {
+    trace_enable();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([] {
+            for (int i = 0; i < 25; i++) {
+                DIFFY_TRACE_SCOPE("trace_test.worker");
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    const std::string table = trace_stats_table();
+    const size_t row = table.find("trace_test.worker");
+    REQUIRE(row != std::string::npos);
+    std::istringstream fields(table.substr(row));
+    std::string name;
+    int64_t calls = 0;
+    fields >> name >> calls;
+    CHECK(calls == 100);
+}
+
+TEST_CASE("trace: diff counters count the line diff only, for every algorithm") {
+    trace_enable();
+    // Each changed line also gets an intra-line pass; none of that may reach diff.*.
+    const std::string a = "alpha one\nbeta two\ngamma three\ndelta four\n";
+    const std::string b = "alpha 1\nbeta two\ngamma 3\ndelta four\nepsilon\n";
+    for (Algo algorithm : {Algo::kPatience, Algo::kMyersGreedy, Algo::kMyersLinear}) {
+        CAPTURE(static_cast<int>(algorithm));
+        DiffPipelineOptions p;
+        p.algorithm = algorithm;
+        p.granularity = EditGranularity::Token;
+        const int64_t before = counter_value("diff.edit_distance");
+        compute_annotated_diff(a, b, "a", "b", p);
+        CHECK(counter_value("diff.edit_distance") - before == 5);  // 2 deletes + 3 inserts
+    }
+}
+
+#endif
@@ -23,6 +23,13 @@ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
 SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <bit>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 using namespace diffy;
 
 #define UTF8_ACCEPT 0
@@ -65,15 +72,54 @@ uint32_t inline diffy::utf8_decode(uint32_t* state, uint32_t* codep, uint32_t by
     return *state;
 }
 
+// Number of ASCII bytes (< 0x80) at the start of [p, p + n). Sixteen bytes at a
+// time on SSE2, then eight at a time as one word, then byte by byte. Nearly all
+// source text is ASCII, so this usually covers a whole segment without the DFA.
+static std::size_t
+ascii_run(const char* p, std::size_t n) {
+    std::size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const auto high = static_cast<unsigned>(_mm_movemask_epi8(v));
+        if (high != 0) {
+            return i + static_cast<std::size_t>(std::countr_zero(high));
+        }
+    }
+#endif
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, sizeof w);
+        if (w & 0x8080808080808080ull) {
+            break;
+        }
+    }
+    while (i < n && static_cast<unsigned char>(p[i]) < 0x80) {
+        i++;
+    }
+    return i;
+}
+
 int64_t
-diffy::utf8_len(const std::string& s, std::string::size_type start, std::string::size_type end) {
+diffy::utf8_len(std::string_view s, std::size_t start, std::size_t end) {
     uint32_t codepoint;
     uint32_t state = 0;
     std::size_t count = 0;
 
     // TODO: Handle out of bounds start/end.
 
-    for (std::string::size_type i = start; i < end; i++) {
+    for (std::size_t i = start; i < end; i++) {
+        // Between code points an ASCII byte is always one column; only hand the
+        // DFA what follows the run. (Mid-sequence, an ASCII byte is a malformed
+        // continuation, so it must go through the DFA.)
+        if (state == UTF8_ACCEPT) {
+            const std::size_t run = ascii_run(s.data() + i, end - i);
+            count += run;
+            i += run;
+            if (i == end) {
+                break;
+            }
+        }
         const uint32_t st = utf8_decode(&state, &codepoint, static_cast<uint8_t>(s[i]));
         if (st == UTF8_ACCEPT) {
             count += 1;
@@ -91,12 +137,30 @@ diffy::utf8_len(const std::string& s, std::string::size_type start, std::string:
 }
 
 int64_t
-diffy::utf8_len(const std::string& s) {
+diffy::utf8_len(std::string_view s) {
     return utf8_len(s, 0, s.size());
 }
 
-std::string::size_type
-diffy::utf8_advance_by(const std::string& s, std::string::size_type start, std::size_t index) {
+bool
+diffy::utf8_valid(std::string_view s) {
+    uint32_t codepoint;
+    uint32_t state = 0;
+    for (std::size_t i = 0; i < s.size(); i++) {
+        if (state == UTF8_ACCEPT) {  // see utf8_len
+            i += ascii_run(s.data() + i, s.size() - i);
+            if (i == s.size()) {
+                break;
+            }
+        }
+        if (utf8_decode(&state, &codepoint, static_cast<uint8_t>(s[i])) == UTF8_REJECT) {
+            return false;
+        }
+    }
+    return state == UTF8_ACCEPT;
+}
+
+std::size_t
+diffy::utf8_advance_by(std::string_view s, std::size_t start, std::size_t index) {
     uint32_t codepoint;
     uint32_t state = 0;
     std::size_t count = 0;
@@ -108,7 +172,18 @@ diffy::utf8_advance_by(const std::string& s, std::string::size_type start, std::
         return s.size() - 1;
     }
 
-    for (std::string::size_type i = start; i < s.size(); i++) {
+    for (std::size_t i = start; i < s.size(); i++) {
+        if (state == UTF8_ACCEPT) {  // see utf8_len
+            const std::size_t run = ascii_run(s.data() + i, s.size() - i);
+            if (index > count && index - count <= run) {
+                return i + (index - count);
+            }
+            count += run;
+            i += run;
+            if (i == s.size()) {
+                break;
+            }
+        }
         const uint32_t st = utf8_decode(&state, &codepoint, static_cast<uint8_t>(s[i]));
         if (st == UTF8_ACCEPT) {
             if (++count == index) {
@@ -123,4 +198,4 @@ diffy::utf8_advance_by(const std::string& s, std::string::size_type start, std::
     }
 
     return s.size() - 1;
-}
\ No newline at end of file
+}
@@ -25,6 +25,7 @@ SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace diffy {
 
@@ -32,13 +33,17 @@ uint32_t inline utf8_decode(uint32_t* state, uint32_t* codep, uint32_t byte);
 
 // Count code points inside given range.
 int64_t
-utf8_len(const std::string& s, std::string::size_type start, std::string::size_type end);
+utf8_len(std::string_view s, std::size_t start, std::size_t end);
 
-// Count code points contained in a std::string
+// Count code points contained in a string
 int64_t
-utf8_len(const std::string& s);
+utf8_len(std::string_view s);
 
-std::string::size_type
-utf8_advance_by(const std::string& s, std::string::size_type start, std::size_t index);
+std::size_t
+utf8_advance_by(std::string_view s, std::size_t start, std::size_t index);
+
+// Whether `s` is well-formed UTF-8 (no invalid or truncated sequences).
+bool
+utf8_valid(std::string_view s);
 
 }  // namespace diffy
\ No newline at end of file
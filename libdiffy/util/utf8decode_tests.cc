@@ -71,4 +71,40 @@ TEST_CASE("unicode") {
         }
         CHECK(boundaries == std::vector<std::string::size_type>{1, 3, 7, 8});
     }
-}
\ No newline at end of file
+
+    SUBCASE("ASCII runs of any length around multi-byte and malformed bytes") {
+        // The ASCII fast path works in 16- and 8-byte blocks; put the non-ASCII
+        // byte at every offset across those boundaries.
+        for (std::size_t k = 0; k < 40; k++) {
+            CAPTURE(k);
+            const std::string head(k, 'x');
+            const std::string tail = "yz0123456789abcdefghij";
+
+            const std::string s = head + "\xC3\xB6" + tail;  // ö
+            CHECK(utf8_len(s) == static_cast<int64_t>(k + 1 + tail.size()));
+            if (k > 0) {
+                CHECK(utf8_len(s, 1, s.size()) == static_cast<int64_t>(k + tail.size()));
+                CHECK(utf8_advance_by(s, 0, k) == k);
+            }
+            CHECK(utf8_advance_by(s, 0, k + 1) == k + 2);
+            CHECK(utf8_advance_by(s, 0, k + 3) == k + 4);
+            CHECK(utf8_advance_by(s, 0, 0) == s.size() - 1);
+
+            // A malformed byte counts as one column.
+            CHECK(utf8_len(head + "\xFF" + tail) == static_cast<int64_t>(k + 1 + tail.size()));
+            // A truncated sequence swallows the ASCII byte that breaks it: the pair
+            // is one column.
+            CHECK(utf8_len(head + "\xC3" + tail) == static_cast<int64_t>(k + tail.size()));
+            CHECK(utf8_advance_by(head + "\xC3" + tail, 0, k + 1) == k + 2);
+        }
+    }
+
+    SUBCASE("validity") {
+        CHECK(utf8_valid(""));
+        CHECK(utf8_valid("plain ascii\n"));
+        CHECK(utf8_valid("öl och bål"));
+        CHECK_FALSE(utf8_valid("caf\xE9\n"));  // Latin-1 é
+        CHECK_FALSE(utf8_valid("abc\xC3"));  // truncated at the end
+        CHECK_FALSE(utf8_valid(std::string(20, 'x') + "\xFF"));  // past the ASCII fast path
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+/*
+    LEB128 varints and length-prefixed strings, for the compact serialized
+    forms (the cache record, the binary diff output).
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace diffy {
+
+inline void
+put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+inline void
+put_string(std::string& out, std::string_view s) {
+    put_varint(out, s.size());
+    out += s;
+}
+
+// Reads what put_varint/put_string wrote. A read past the end or an overlong
+// varint clears `ok` and yields zero / empty from then on.
+struct VarintReader {
+    std::string_view data;
+    size_t pos = 0;
+    bool ok = true;
+
+    uint64_t
+    varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= data.size()) {
+                break;
+            }
+            const auto byte = static_cast<unsigned char>(data[pos++]);
+            v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return v;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    // A count of items still to read; each takes at least one byte, which bounds
+    // allocations made from damaged input.
+    uint64_t
+    count() {
+        const uint64_t n = varint();
+        if (n > data.size() - pos) {
+            ok = false;
+            return 0;
+        }
+        return n;
+    }
+
+    std::string
+    string() {
+        const uint64_t n = count();
+        std::string s(data.substr(pos, ok ? n : 0));
+        pos += s.size();
+        return s;
+    }
+
+    // One byte, or 0 (and !ok) at the end.
+    uint8_t
+    byte() {
+        if (pos >= data.size()) {
+            ok = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(data[pos++]);
+    }
+};
+
+}  // namespace diffy
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""Drive `diffy --pager` under a pseudo-terminal.
+
+Runs the pager on a diff of a few thousand hunks with the child's stdin and
+stdout on a pty, and checks, by what reaches the terminal:
+
+  1. the first screen shows the top of the diff and its status line,
+  2. `n` moves to the next hunk and `G` to the last screen,
+  3. resizing the pty (the kernel sends SIGWINCH) re-lays the screen out at
+     the new width,
+  4. `q` restores the terminal and exits with diff's status (1: differences).
+
+The time to the first screen is printed; it is set by the diff itself, not by
+rendering, which only covers the rows on screen.
+
+Usage: python3 pager_pty_test.py <path-to-diffy>
+Skips (exit 0) where there are no ptys.
+"""
+import fcntl
+import os
+import re
+import select
+import struct
+import sys
+import tempfile
+import termios
+import time
+
+HUNKS = 5000
+TIMEOUT = 60.0
+CSI = re.compile(rb"\x1b\[[0-9;?]*[@-~]")
+
+
+def set_size(fd, rows, cols):
+    fcntl.ioctl(fd, termios.TIOCSWINSZ, struct.pack("HHHH", rows, cols, 0, 0))
+
+
+class Terminal:
+    def __init__(self, fd):
+        self.fd = fd
+        self.data = b""
+        self.seen = 0  # output up to here was returned already
+
+    # Everything written since the last call, up to and including `needle`,
+    # with the escapes stripped unless `needle` is one.
+    def read_until(self, needle, what):
+        deadline = time.monotonic() + TIMEOUT
+        while True:
+            text = self.data[self.seen:]
+            if needle.startswith(b"\x1b"):
+                found = text.find(needle)
+            else:
+                text = CSI.sub(b"", text)
+                found = text.find(needle)
+            if found >= 0:
+                self.seen = len(self.data)
+                return text
+            left = deadline - time.monotonic()
+            if left <= 0:
+                fail(f"timed out waiting for {what} ({needle!r})")
+            ready, _, _ = select.select([self.fd], [], [], left)
+            if ready:
+                try:
+                    chunk = os.read(self.fd, 65536)
+                except OSError:
+                    chunk = b""
+                if not chunk:
+                    fail(f"diffy exited while waiting for {what}")
+                self.data += chunk
+
+    def send(self, keys):
+        os.write(self.fd, keys)
+
+
+def fail(message):
+    print(f"FAIL: {message}")
+    sys.exit(1)
+
+
+def main(argv):
+    if len(argv) != 2:
+        print(__doc__)
+        return 2
+    diffy = os.path.abspath(argv[1])
+    try:
+        import pty
+    except ImportError:
+        print("skipped: no pty module")
+        return 0
+
+    with tempfile.TemporaryDirectory() as tmp:
+        old_path = os.path.join(tmp, "old.txt")
+        new_path = os.path.join(tmp, "new.txt")
+        with open(old_path, "w") as old, open(new_path, "w") as new:
+            for i in range(HUNKS * 40):
+                line = f"line {i} of a file long enough to page through\n"
+                old.write(line)
+                new.write(line.replace("long", "LONG") if i % 40 == 20 else line)
+
+        started = time.monotonic()
+        pid, fd = pty.fork()
+        if pid == 0:
+            set_size(sys.stdin.fileno(), 24, 120)
+            env = dict(os.environ, HOME=tmp, TERM="xterm-256color")
+            os.execve(diffy, [diffy, "--pager", old_path, new_path], env)
+        term = Terminal(fd)
+
+        first = term.read_until(f"hunk 1/{HUNKS}".encode(), "the first screen")
+        print(f"first screen after {time.monotonic() - started:.3f}s")
+        if b"old.txt" not in first or b"@@ -18,7 +18,7 @@" not in first:
+            fail("the first screen doesn't start at the top of the diff")
+
+        term.send(b"nn")  # the file header, then hunk 1, are on top before this
+        term.read_until(f"hunk 2/{HUNKS}".encode(), "the next hunk")
+        term.send(b"G")
+        last = term.read_until(b"(END)", "the last screen")
+        if f"line {HUNKS * 40 - 17} ".encode() not in last:
+            fail("G didn't show the end of the diff")
+
+        set_size(fd, 20, 60)
+        narrow = term.read_until(b" hunk ", "the resized screen")
+        widest = max(len(row.decode("utf-8", "replace")) for row in narrow.split(b"\r\n"))
+        if widest > 60:
+            fail(f"rows are {widest} columns wide after resizing to 60")
+
+        term.send(b"q")
+        term.read_until(b"\x1b[?1049l", "the terminal to be restored")
+        _, status = os.waitpid(pid, 0)
+        if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 1:
+            fail(f"diffy exited with status {status}, expected 1")
+        os.close(fd)
+
+    print("pager ok")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))